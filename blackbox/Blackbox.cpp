@@ -0,0 +1,471 @@
+// implementation for the Blackbox header
+//
+// each ring is only ever written by the thread that claimed it and emptied by the writer
+//   thread, so the two only share the head and the tail counts, which sit on their own
+//   cache lines, and the recording thread only reads the tail when the ring looks full
+//
+// by Mark Hill
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdint.h>
+#include<string.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<pthread.h>
+
+#include<atomic>
+
+#include<Blackbox.h>
+#include<BlackboxEncoding.h>
+#include<Clock.h>
+#include<RealTime.h>
+
+static_assert(sizeof(struct BlackboxRecord) == 64, "a record should fill a cache line");
+static_assert(sizeof(struct BlackboxBlockHeader) == sizeof(struct BlackboxRecord), \
+		"the block header should take the place of one record");
+
+// the alignment O_DIRECT wants of the buffer, the file offsets and the write sizes
+#define BLACKBOX_ALIGNMENT 4096
+
+enum RingState {
+	RING_FREE,
+	// claimed by a running thread
+	RING_OWNED,
+	// its thread has exited, and the writer frees it once it is empty
+	RING_RELEASED,
+};
+
+struct BlackboxRing {
+	struct BlackboxRecord records[BLACKBOX_RING_SIZE];
+	// the number of records ever added, written by the owning thread
+	alignas(64) std::atomic<uint64_t> head;
+	// the owning thread's own copy of tail
+	uint64_t tailCache;
+	uint32_t sequence;
+	std::atomic<uint64_t> dropped;
+	// the number of records ever taken out, written by the writer thread
+	alignas(64) std::atomic<uint64_t> tail;
+	std::atomic<int> state;
+};
+
+static struct BlackboxRing _rings[BLACKBOX_MAX_THREADS];
+// the calling thread's ring, or NULL if it has not recorded yet
+static thread_local struct BlackboxRing *_threadRing = NULL;
+// frees a thread's ring when it exits
+static pthread_key_t _ringKey;
+static pthread_once_t _ringKeyOnce = PTHREAD_ONCE_INIT;
+
+static std::atomic<int> _recording(0);
+static std::atomic<int> _writerRunning(0);
+// set by the writer thread once it has written everything
+static std::atomic<int> _writerFinished(0);
+static pthread_t _writerThread;
+
+// the file, only touched by the writer thread while it runs
+static int _file = -1;
+static int _direct = 0;
+// BLACKBOX_WRITE_BLOCKS blocks, the first of which is block _firstBlock of the file
+static char *_buffer = NULL;
+static uint32_t _firstBlock = 0;
+// the block in the buffer being filled, the number of records in it and the streams
+//   the frames in it are predicted from
+static int _block = 0;
+static uint32_t _blockRecords = 0;
+static struct BlackboxPredictor _predictor;
+// the byte of the buffer up to which the frames are on disk, and the number of blocks
+//   the file has been sized to
+// the header of the block this ends in changes after it is written, the rest does not
+static size_t _writtenEnd = 0;
+static uint64_t _fileBlocks = 0;
+
+// the statistics for the report
+static std::atomic<uint64_t> _typeRecords[BLACKBOX_RECORD_TYPES];
+// the bytes the records took as frames, and would have taken as a time and their values
+//   in doubles
+static std::atomic<uint64_t> _encodedBytes(0);
+static std::atomic<uint64_t> _plainBytes(0);
+static std::atomic<uint64_t> _bytesWritten(0);
+static std::atomic<uint64_t> _writes(0);
+static std::atomic<uint64_t> _writeFailures(0);
+// the records dropped by the rings freed so far and by threads that found no free ring
+static std::atomic<uint64_t> _freedDrops(0);
+static std::atomic<uint64_t> _ringlessDrops(0);
+// what the rings in use had dropped before this recording started
+static uint64_t _dropBaseline = 0;
+
+
+// the destructor of _ringKey
+static void releaseRing(void *value) {
+	struct BlackboxRing *ring = (struct BlackboxRing *)(value);
+	ring->state.store(RING_RELEASED, std::memory_order_release);
+}
+
+static void createRingKey() {
+	pthread_key_create(&_ringKey, &releaseRing);
+}
+
+// gives the calling thread a free ring, or returns NULL if they are all taken
+static struct BlackboxRing *claimRing() {
+	pthread_once(&_ringKeyOnce, &createRingKey);
+	for (int i = 0; i < BLACKBOX_MAX_THREADS; i++) {
+		int expected = RING_FREE;
+		if (_rings[i].state.compare_exchange_strong(expected, RING_OWNED, \
+				std::memory_order_acquire)) {
+			pthread_setspecific(_ringKey, &_rings[i]);
+			return &_rings[i];
+		}
+	}
+	return NULL;
+}
+
+void blackboxRecord(enum BlackboxRecordType type, double time, const double *values, \
+		int count) {
+	if (!_recording.load(std::memory_order_relaxed))
+		return;
+
+	struct BlackboxRing *ring = _threadRing;
+	if (ring == NULL) {
+		ring = claimRing();
+		if (ring == NULL) {
+			_ringlessDrops.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		_threadRing = ring;
+	}
+
+	uint32_t sequence = ring->sequence++;
+	uint64_t head = ring->head.load(std::memory_order_relaxed);
+	if (head - ring->tailCache >= BLACKBOX_RING_SIZE) {
+		ring->tailCache = ring->tail.load(std::memory_order_acquire);
+		if (head - ring->tailCache >= BLACKBOX_RING_SIZE) {
+			ring->dropped.store(ring->dropped.load(std::memory_order_relaxed) + 1, \
+					std::memory_order_relaxed);
+			return;
+		}
+	}
+
+	if (count > BLACKBOX_RECORD_VALUES)
+		count = BLACKBOX_RECORD_VALUES;
+	struct BlackboxRecord *record = &ring->records[head & (BLACKBOX_RING_SIZE - 1)];
+	record->type = type;
+	record->source = ring - _rings;
+	record->count = count;
+	record->sequence = sequence;
+	record->time = time;
+	for (int i = 0; i < BLACKBOX_RECORD_VALUES; i++) {
+		record->values[i] = i < count ? values[i] : 0;
+	}
+
+	ring->head.store(head + 1, std::memory_order_release);
+}
+
+int blackboxRecording() {
+	return _recording.load(std::memory_order_acquire);
+}
+
+
+// writer functions
+
+// returns the block of the buffer at index
+static char *bufferBlock(int index) {
+	return _buffer + (size_t)(index) * BLACKBOX_BLOCK_SIZE;
+}
+
+// clears the block being filled, gives it its header and starts every stream over
+static void startBlock() {
+	char *block = bufferBlock(_block);
+	memset(block, 0, BLACKBOX_BLOCK_SIZE);
+
+	struct BlackboxBlockHeader *header = (struct BlackboxBlockHeader *)(block);
+	memcpy(header->magic, BLACKBOX_MAGIC, sizeof(header->magic));
+	header->version = BLACKBOX_VERSION;
+	header->index = _firstBlock + _block;
+	_blockRecords = 0;
+	resetBlackboxPredictor(&_predictor);
+}
+
+// writes the BLACKBOX_ALIGNMENT pages of the buffer from first up to but not including
+//   end in one go
+static void writePages(size_t first, size_t end) {
+	if (end <= first)
+		return;
+
+	size_t size = (end - first) * BLACKBOX_ALIGNMENT;
+	off_t offset = (off_t)(_firstBlock) * BLACKBOX_BLOCK_SIZE + \
+			(off_t)(first) * BLACKBOX_ALIGNMENT;
+	ssize_t written = pwrite(_file, _buffer + first * BLACKBOX_ALIGNMENT, size, offset);
+	// some file systems accept O_DIRECT when opening but not when writing
+	if (written < 0 && errno == EINVAL && _direct) {
+		fcntl(_file, F_SETFL, fcntl(_file, F_GETFL) & ~O_DIRECT);
+		_direct = 0;
+		written = pwrite(_file, _buffer + first * BLACKBOX_ALIGNMENT, size, offset);
+	}
+
+	if (written != (ssize_t)(size)) {
+		if (_writeFailures.fetch_add(1, std::memory_order_relaxed) == 0)
+			printf("failed to write blackbox (%s)\n", written < 0 ? strerror(errno) : "short write");
+		return;
+	}
+	_bytesWritten.fetch_add(size, std::memory_order_relaxed);
+	_writes.fetch_add(1, std::memory_order_relaxed);
+}
+
+// writes the pages of the buffer that changed since the last write, up to byte end
+// the file is first grown to whole blocks, so a reader always finds a whole last block
+//   with zeros after its frames, without the zeros having to be written
+static void writeChanges(size_t end) {
+	if (end <= _writtenEnd)
+		return;
+
+	uint64_t blocks = _firstBlock + (end + BLACKBOX_BLOCK_SIZE - 1) / BLACKBOX_BLOCK_SIZE;
+	if (blocks > _fileBlocks) {
+		if (ftruncate(_file, (off_t)(blocks) * BLACKBOX_BLOCK_SIZE) == 0)
+			_fileBlocks = blocks;
+	}
+
+	size_t first = _writtenEnd / BLACKBOX_ALIGNMENT;
+	size_t header = _writtenEnd / BLACKBOX_BLOCK_SIZE * (BLACKBOX_BLOCK_SIZE / BLACKBOX_ALIGNMENT);
+	if (header < first)
+		writePages(header, header + 1);
+	writePages(first, (end + BLACKBOX_ALIGNMENT - 1) / BLACKBOX_ALIGNMENT);
+	_writtenEnd = end;
+}
+
+// encodes a record into the block being filled, moving on to the next block when it
+//   does not fit and writing the buffer out once it is full
+static void appendRecord(const struct BlackboxRecord *record) {
+	if (record->type == BLACKBOX_PADDING || record->type >= BLACKBOX_RECORD_TYPES)
+		return;
+
+	const uint32_t space = BLACKBOX_BLOCK_SIZE - sizeof(struct BlackboxBlockHeader);
+	struct BlackboxBlockHeader *header = (struct BlackboxBlockHeader *)(bufferBlock(_block));
+	uint8_t *frames = (uint8_t *)(header + 1);
+	int size = encodeBlackboxFrame(&_predictor, record, frames + header->bytes, \
+			space - header->bytes);
+	if (size == 0) {
+		_block++;
+		if (_block == BLACKBOX_WRITE_BLOCKS) {
+			writeChanges((size_t)(BLACKBOX_WRITE_BLOCKS) * BLACKBOX_BLOCK_SIZE);
+			_firstBlock += BLACKBOX_WRITE_BLOCKS;
+			_block = 0;
+			_writtenEnd = 0;
+		}
+		startBlock();
+		header = (struct BlackboxBlockHeader *)(bufferBlock(_block));
+		frames = (uint8_t *)(header + 1);
+		size = encodeBlackboxFrame(&_predictor, record, frames, space);
+	}
+
+	if (_blockRecords == 0 || record->time < header->firstTime)
+		header->firstTime = record->time;
+	if (_blockRecords == 0 || record->time > header->lastTime)
+		header->lastTime = record->time;
+	header->bytes += size;
+	header->records = ++_blockRecords;
+	header->typeRecords[record->type]++;
+
+	_typeRecords[record->type].fetch_add(1, std::memory_order_relaxed);
+	_encodedBytes.fetch_add(size, std::memory_order_relaxed);
+	_plainBytes.fetch_add(sizeof(double) * (1 + record->count), std::memory_order_relaxed);
+}
+
+// writes what has been added to the buffer since the last write, which for the block
+//   being filled is its header and the pages its new frames are in
+static void flushBlocks() {
+	size_t end = (size_t)(_block) * BLACKBOX_BLOCK_SIZE;
+	if (_blockRecords > 0) {
+		struct BlackboxBlockHeader *header = (struct BlackboxBlockHeader *)(bufferBlock(_block));
+		end += sizeof(struct BlackboxBlockHeader) + header->bytes;
+	}
+	writeChanges(end);
+}
+
+// moves everything in the rings into the buffer, and frees the rings of threads that
+//   have exited once they are empty
+static void drainRings() {
+	for (int i = 0; i < BLACKBOX_MAX_THREADS; i++) {
+		struct BlackboxRing *ring = &_rings[i];
+		int state = ring->state.load(std::memory_order_acquire);
+		if (state == RING_FREE)
+			continue;
+
+		uint64_t head = ring->head.load(std::memory_order_acquire);
+		uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+		for (; tail < head; tail++) {
+			appendRecord(&ring->records[tail & (BLACKBOX_RING_SIZE - 1)]);
+		}
+		ring->tail.store(tail, std::memory_order_release);
+
+		// nothing else touches a released ring
+		if (state == RING_RELEASED) {
+			_freedDrops.fetch_add(ring->dropped.load(std::memory_order_relaxed), \
+					std::memory_order_relaxed);
+			ring->head.store(0, std::memory_order_relaxed);
+			ring->tail.store(0, std::memory_order_relaxed);
+			ring->tailCache = 0;
+			ring->sequence = 0;
+			ring->dropped.store(0, std::memory_order_relaxed);
+			ring->state.store(RING_FREE, std::memory_order_release);
+		}
+	}
+}
+
+// empties the rings every BLACKBOX_DRAIN_INTERVAL seconds and writes the block being
+//   filled every BLACKBOX_FLUSH_INTERVAL seconds until stopped
+static void *blackboxWriter(void *input) {
+	makeBackgroundThread();
+
+	double lastFlush = monotonicTime();
+	while (_writerRunning.load(std::memory_order_acquire)) {
+		sleepFor(BLACKBOX_DRAIN_INTERVAL);
+		drainRings();
+
+		double now = monotonicTime();
+		if (now - lastFlush >= BLACKBOX_FLUSH_INTERVAL) {
+			flushBlocks();
+			lastFlush = now;
+		}
+	}
+
+	drainRings();
+	flushBlocks();
+	_writerFinished.store(1, std::memory_order_release);
+	return NULL;
+}
+
+int startBlackbox(const char *path) {
+	if (_writerRunning.load(std::memory_order_acquire))
+		return 0;
+
+	int flags = O_WRONLY | O_CREAT | O_TRUNC;
+	_direct = 1;
+	_file = open(path, flags | O_DIRECT, 0644);
+	if (_file < 0 && errno == EINVAL) {
+		_direct = 0;
+		_file = open(path, flags, 0644);
+	}
+	if (_file < 0) {
+		printf("failed to open blackbox %s (%s)\n", path, strerror(errno));
+		return -1;
+	}
+
+	void *buffer = NULL;
+	if (posix_memalign(&buffer, BLACKBOX_ALIGNMENT, \
+			(size_t)(BLACKBOX_WRITE_BLOCKS) * BLACKBOX_BLOCK_SIZE)) {
+		printf("failed to allocate blackbox buffer\n");
+		close(_file);
+		_file = -1;
+		return -1;
+	}
+	_buffer = (char *)(buffer);
+	_firstBlock = 0;
+	_block = 0;
+	_writtenEnd = 0;
+	_fileBlocks = 0;
+	startBlock();
+
+	for (int type = 0; type < BLACKBOX_RECORD_TYPES; type++) {
+		_typeRecords[type].store(0, std::memory_order_relaxed);
+	}
+	_bytesWritten.store(0, std::memory_order_relaxed);
+	_encodedBytes.store(0, std::memory_order_relaxed);
+	_plainBytes.store(0, std::memory_order_relaxed);
+	_writes.store(0, std::memory_order_relaxed);
+	_writeFailures.store(0, std::memory_order_relaxed);
+	_freedDrops.store(0, std::memory_order_relaxed);
+	_ringlessDrops.store(0, std::memory_order_relaxed);
+	_dropBaseline = 0;
+	for (int i = 0; i < BLACKBOX_MAX_THREADS; i++) {
+		_dropBaseline += _rings[i].dropped.load(std::memory_order_relaxed);
+	}
+	// anything left from an earlier recording is skipped
+	for (int i = 0; i < BLACKBOX_MAX_THREADS; i++) {
+		_rings[i].tail.store(_rings[i].head.load(std::memory_order_acquire), \
+				std::memory_order_release);
+	}
+
+	_writerFinished.store(0, std::memory_order_relaxed);
+	_writerRunning.store(1, std::memory_order_release);
+	if (createClockThread(&_writerThread, NULL, &blackboxWriter, NULL)) {
+		printf("failed to create blackbox writer thread\n");
+		_writerRunning.store(0, std::memory_order_release);
+		free(_buffer);
+		_buffer = NULL;
+		close(_file);
+		_file = -1;
+		return -1;
+	}
+	_recording.store(1, std::memory_order_release);
+
+	return 0;
+}
+
+void stopBlackbox() {
+	if (!_writerRunning.load(std::memory_order_acquire))
+		return;
+
+	_recording.store(0, std::memory_order_release);
+	_writerRunning.store(0, std::memory_order_release);
+	// on the virtual clock the writer only wakes up while this thread sleeps, see
+	//   stopSimulator()
+	while (!_writerFinished.load(std::memory_order_acquire)) {
+		sleepFor(BLACKBOX_DRAIN_INTERVAL);
+	}
+	pthread_join(_writerThread, NULL);
+
+	fdatasync(_file);
+	close(_file);
+	_file = -1;
+	free(_buffer);
+	_buffer = NULL;
+}
+
+// the names of the record types in the report
+static const char *_typeNames[BLACKBOX_RECORD_TYPES] = {
+	"padding",
+	"acceleration",
+	"rotation",
+	"magnetic field",
+	"altitude",
+	"orientation",
+	"setpoint",
+	"control",
+	"motor output",
+};
+
+void printBlackboxReport() {
+	uint64_t records = 0;
+	for (int type = 1; type < BLACKBOX_RECORD_TYPES; type++) {
+		records += _typeRecords[type].load(std::memory_order_relaxed);
+	}
+	uint64_t dropped = _freedDrops.load(std::memory_order_relaxed) + \
+			_ringlessDrops.load(std::memory_order_relaxed);
+	for (int i = 0; i < BLACKBOX_MAX_THREADS; i++) {
+		dropped += _rings[i].dropped.load(std::memory_order_relaxed);
+	}
+	dropped -= dropped > _dropBaseline ? _dropBaseline : dropped;
+
+	printf("blackbox %s, %s\n", blackboxRecording() ? "recording" : "stopped", \
+			_direct ? "O_DIRECT" : "through the page cache");
+	printf("  %llu records, %llu dropped, %llu bytes in %llu writes", \
+			(unsigned long long)(records), (unsigned long long)(dropped), \
+			(unsigned long long)(_bytesWritten.load(std::memory_order_relaxed)), \
+			(unsigned long long)(_writes.load(std::memory_order_relaxed)));
+	uint64_t failures = _writeFailures.load(std::memory_order_relaxed);
+	if (failures > 0)
+		printf(", %llu failed", (unsigned long long)(failures));
+	printf("\n");
+	uint64_t encoded = _encodedBytes.load(std::memory_order_relaxed);
+	uint64_t plain = _plainBytes.load(std::memory_order_relaxed);
+	if (records > 0) {
+		printf("  %.1f bytes per record, %.1f times smaller than doubles\n", \
+				(double)(encoded) / records, encoded > 0 ? (double)(plain) / encoded : 0);
+	}
+	for (int type = 1; type < BLACKBOX_RECORD_TYPES; type++) {
+		uint64_t count = _typeRecords[type].load(std::memory_order_relaxed);
+		if (count > 0)
+			printf("  %-16s%llu\n", _typeNames[type], (unsigned long long)(count));
+	}
+}
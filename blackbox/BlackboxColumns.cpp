@@ -0,0 +1,381 @@
+// implementation for the BlackboxColumns header
+//
+// by Mark Hill
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdint.h>
+#include<string.h>
+#include<errno.h>
+#include<math.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<pthread.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+
+#include<atomic>
+
+#include<BlackboxColumns.h>
+#include<BlackboxEncoding.h>
+
+static const char *_typeNames[BLACKBOX_RECORD_TYPES] = {
+	"padding",
+	"acceleration",
+	"rotation",
+	"magnetic_field",
+	"altitude",
+	"orientation",
+	"setpoint",
+	"control",
+	"motor_output",
+};
+
+// the names of the values of every type, see BlackboxRecordType
+static const char *_fieldNames[BLACKBOX_RECORD_TYPES][BLACKBOX_RECORD_VALUES] = {
+	{NULL},
+	{"x", "y", "z"},
+	{"x", "y", "z"},
+	{"x", "y", "z"},
+	{"altitude"},
+	{"gravity_x", "gravity_y", "gravity_z", "heading", "altitude", "climb_rate"},
+	{"velocity_x", "velocity_y", "velocity_z", "rate_x", "rate_y", "rate_z"},
+	{"angular_x", "angular_y", "angular_z", "thrust"},
+	{"motor_0", "motor_1", "motor_2", "motor_3", "motor_4", "motor_5"},
+};
+
+const char *blackboxTypeName(int type) {
+	if (type < 0 || type >= BLACKBOX_RECORD_TYPES)
+		return "unknown";
+	return _typeNames[type];
+}
+
+const char *blackboxFieldName(int type, int field) {
+	if (type < 0 || type >= BLACKBOX_RECORD_TYPES || field < 0 || \
+			field >= BLACKBOX_RECORD_VALUES || _fieldNames[type][field] == NULL)
+		return "unknown";
+	return _fieldNames[type][field];
+}
+
+
+// decoding functions
+
+// shared by the decoding threads
+struct DecodeJob {
+	const uint8_t *file;
+	uint64_t blocks;
+	// the row in each table of the first record of each type in every block
+	uint64_t *rows;
+	struct BlackboxColumns *columns;
+	// the next block to hand out
+	std::atomic<uint64_t> next;
+	std::atomic<uint64_t> badBlocks;
+	std::atomic<int> widths[BLACKBOX_RECORD_TYPES];
+};
+
+// decodes block index into its rows of the tables
+// reader is the worker's own, which is large enough to be worth allocating only once
+static void decodeBlock(struct DecodeJob *job, uint64_t index, \
+		struct BlackboxBlockReader *reader, int *widths) {
+	const uint8_t *block = job->file + index * BLACKBOX_BLOCK_SIZE;
+	const struct BlackboxBlockHeader *header = (const struct BlackboxBlockHeader *)(block);
+	// blocks with a bad header were counted and given no rows when the rows were laid out
+	if (openBlackboxBlock(reader, block))
+		return;
+
+	const uint64_t *rows = &job->rows[index * BLACKBOX_RECORD_TYPES];
+	uint32_t filled[BLACKBOX_RECORD_TYPES] = {};
+	struct BlackboxRecord record;
+	int result;
+	while ((result = nextBlackboxRecord(reader, &record)) > 0) {
+		int type = record.type;
+		// the header has to agree with the frames, or the rows would run into the next block's
+		if (filled[type] >= header->typeRecords[type]) {
+			result = -1;
+			break;
+		}
+
+		struct BlackboxTable *table = &job->columns->tables[type];
+		uint64_t row = rows[type] + filled[type]++;
+		table->time[row] = record.time;
+		table->source[row] = record.source;
+		table->sequence[row] = record.sequence;
+		for (int i = 0; i < record.count; i++) {
+			table->values[i][row] = record.values[i];
+		}
+		if (record.count > widths[type])
+			widths[type] = record.count;
+	}
+
+	int complete = result == 0;
+	for (int type = 0; type < BLACKBOX_RECORD_TYPES; type++) {
+		struct BlackboxTable *table = &job->columns->tables[type];
+		for (uint32_t i = filled[type]; i < header->typeRecords[type]; i++) {
+			table->time[rows[type] + i] = NAN;
+			table->source[rows[type] + i] = BLACKBOX_UNKNOWN_SOURCE;
+			table->sequence[rows[type] + i] = 0;
+			complete = 0;
+		}
+	}
+	if (!complete)
+		job->badBlocks.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void *decodeWorker(void *input) {
+	struct DecodeJob *job = (struct DecodeJob *)(input);
+	struct BlackboxBlockReader *reader = \
+			(struct BlackboxBlockReader *)(malloc(sizeof(struct BlackboxBlockReader)));
+	if (reader == NULL)
+		return NULL;
+	int widths[BLACKBOX_RECORD_TYPES] = {};
+
+	uint64_t first;
+	while ((first = job->next.fetch_add(BLACKBOX_DECODE_CHUNK)) < job->blocks) {
+		uint64_t end = first + BLACKBOX_DECODE_CHUNK;
+		for (uint64_t index = first; index < end && index < job->blocks; index++) {
+			decodeBlock(job, index, reader, widths);
+		}
+	}
+
+	for (int type = 0; type < BLACKBOX_RECORD_TYPES; type++) {
+		int width = job->widths[type].load(std::memory_order_relaxed);
+		while (widths[type] > width && !job->widths[type].compare_exchange_weak(width, \
+				widths[type], std::memory_order_relaxed));
+	}
+	free(reader);
+	return NULL;
+}
+
+// allocates the arrays of a table of rows records
+// the value arrays come zeroed, and those never written are never faulted in
+// returns 0 on success and -1 on failure
+static int allocateTable(struct BlackboxTable *table, uint64_t rows) {
+	table->rows = rows;
+	if (rows == 0)
+		return 0;
+
+	table->time = (double *)(malloc(rows * sizeof(double)));
+	table->source = (uint8_t *)(malloc(rows * sizeof(uint8_t)));
+	table->sequence = (uint32_t *)(malloc(rows * sizeof(uint32_t)));
+	int failure = table->time == NULL || table->source == NULL || table->sequence == NULL;
+	for (int i = 0; i < BLACKBOX_RECORD_VALUES; i++) {
+		table->values[i] = (double *)(calloc(rows, sizeof(double)));
+		failure |= table->values[i] == NULL;
+	}
+	return failure ? -1 : 0;
+}
+
+int decodeBlackboxColumns(const char *path, int threads, struct BlackboxColumns *columns) {
+	memset(columns, 0, sizeof(*columns));
+
+	int file = open(path, O_RDONLY);
+	if (file < 0) {
+		printf("failed to open %s (%s)\n", path, strerror(errno));
+		return -1;
+	}
+	struct stat status;
+	if (fstat(file, &status)) {
+		printf("failed to read %s (%s)\n", path, strerror(errno));
+		close(file);
+		return -1;
+	}
+	uint64_t blocks = status.st_size / BLACKBOX_BLOCK_SIZE;
+	columns->blocks = blocks;
+	if (blocks == 0) {
+		close(file);
+		return 0;
+	}
+
+	size_t size = blocks * BLACKBOX_BLOCK_SIZE;
+	void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+	if (mapping == MAP_FAILED) {
+		printf("failed to map %s (%s)\n", path, strerror(errno));
+		return -1;
+	}
+	madvise(mapping, size, MADV_SEQUENTIAL);
+
+	struct DecodeJob job;
+	job.file = (const uint8_t *)(mapping);
+	job.blocks = blocks;
+	job.columns = columns;
+	job.next = 0;
+	job.badBlocks = 0;
+	for (int type = 0; type < BLACKBOX_RECORD_TYPES; type++) {
+		job.widths[type] = 0;
+	}
+
+	// lays out the rows of every block from the headers alone
+	job.rows = (uint64_t *)(malloc(blocks * BLACKBOX_RECORD_TYPES * sizeof(uint64_t)));
+	if (job.rows == NULL) {
+		printf("failed to allocate the row table\n");
+		munmap(mapping, size);
+		return -1;
+	}
+	uint64_t totals[BLACKBOX_RECORD_TYPES] = {};
+	for (uint64_t index = 0; index < blocks; index++) {
+		const uint8_t *block = job.file + index * BLACKBOX_BLOCK_SIZE;
+		const struct BlackboxBlockHeader *header = (const struct BlackboxBlockHeader *)(block);
+		int valid = checkBlackboxBlock(block) == 0;
+		if (!valid)
+			job.badBlocks++;
+		for (int type = 0; type < BLACKBOX_RECORD_TYPES; type++) {
+			job.rows[index * BLACKBOX_RECORD_TYPES + type] = totals[type];
+			if (valid)
+				totals[type] += header->typeRecords[type];
+		}
+	}
+
+	int failure = 0;
+	for (int type = 0; type < BLACKBOX_RECORD_TYPES; type++) {
+		failure |= allocateTable(&columns->tables[type], totals[type]);
+	}
+	if (failure) {
+		printf("failed to allocate the columns\n");
+		free(job.rows);
+		munmap(mapping, size);
+		freeBlackboxColumns(columns);
+		return -1;
+	}
+
+	if (threads <= 0)
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+	uint64_t chunks = (blocks + BLACKBOX_DECODE_CHUNK - 1) / BLACKBOX_DECODE_CHUNK;
+	if ((uint64_t)(threads) > chunks)
+		threads = chunks;
+	if (threads < 1)
+		threads = 1;
+
+	// the calling thread does its share of the work too
+	pthread_t workers[threads - 1];
+	int started = 0;
+	for (; started < threads - 1; started++) {
+		if (pthread_create(&workers[started], NULL, &decodeWorker, &job)) {
+			printf("failed to create decoding thread, continuing with %d\n", started + 1);
+			break;
+		}
+	}
+	decodeWorker(&job);
+	for (int i = 0; i < started; i++) {
+		pthread_join(workers[i], NULL);
+	}
+
+	// the value arrays no record reached are given back
+	for (int type = 0; type < BLACKBOX_RECORD_TYPES; type++) {
+		struct BlackboxTable *table = &columns->tables[type];
+		table->width = job.widths[type].load(std::memory_order_relaxed);
+		for (int i = table->width; i < BLACKBOX_RECORD_VALUES; i++) {
+			free(table->values[i]);
+			table->values[i] = NULL;
+		}
+	}
+	columns->badBlocks = job.badBlocks.load(std::memory_order_relaxed);
+
+	free(job.rows);
+	munmap(mapping, size);
+	return 0;
+}
+
+void freeBlackboxColumns(struct BlackboxColumns *columns) {
+	for (int type = 0; type < BLACKBOX_RECORD_TYPES; type++) {
+		struct BlackboxTable *table = &columns->tables[type];
+		free(table->time);
+		free(table->source);
+		free(table->sequence);
+		for (int i = 0; i < BLACKBOX_RECORD_VALUES; i++) {
+			free(table->values[i]);
+		}
+		memset(table, 0, sizeof(*table));
+	}
+}
+
+
+// output functions
+
+// writes count items of size bytes from data to directory/name
+// returns 0 on success and -1 on failure
+static int writeArray(const char *directory, const char *name, const void *data, \
+		size_t size, uint64_t count) {
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/%s", directory, name);
+	FILE *file = fopen(path, "wb");
+	if (file == NULL) {
+		printf("failed to create %s\n", path);
+		return -1;
+	}
+
+	int failure = fwrite(data, size, count, file) != count;
+	failure |= fclose(file) != 0;
+	if (failure)
+		printf("failed to write %s\n", path);
+	return failure ? -1 : 0;
+}
+
+// writes a summary line for a field to summary and its array to directory
+// returns 0 on success and -1 on failure
+static int writeField(const char *directory, FILE *summary, int type, const char *field, \
+		const double *data, uint64_t rows) {
+	char name[256];
+	snprintf(name, sizeof(name), "%s_%s.f64", _typeNames[type], field);
+
+	double minimum = INFINITY, maximum = -INFINITY, total = 0;
+	uint64_t counted = 0;
+	for (uint64_t i = 0; i < rows; i++) {
+		if (isnan(data[i]))
+			continue;
+		if (data[i] < minimum)
+			minimum = data[i];
+		if (data[i] > maximum)
+			maximum = data[i];
+		total += data[i];
+		counted++;
+	}
+	fprintf(summary, "%s,%s,%s,%llu,%.9g,%.9g,%.9g\n", _typeNames[type], field, name, \
+			(unsigned long long)(rows), counted ? minimum : NAN, counted ? maximum : NAN, \
+			counted ? total / counted : NAN);
+
+	return writeArray(directory, name, data, sizeof(double), rows);
+}
+
+int writeBlackboxColumns(const struct BlackboxColumns *columns, const char *directory) {
+	if (mkdir(directory, 0755) && errno != EEXIST) {
+		printf("failed to create %s (%s)\n", directory, strerror(errno));
+		return -1;
+	}
+
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/summary.csv", directory);
+	FILE *summary = fopen(path, "w");
+	if (summary == NULL) {
+		printf("failed to create %s\n", path);
+		return -1;
+	}
+	fprintf(summary, "type,field,file,rows,minimum,maximum,mean\n");
+
+	int failure = 0;
+	for (int type = 0; type < BLACKBOX_RECORD_TYPES; type++) {
+		const struct BlackboxTable *table = &columns->tables[type];
+		if (table->rows == 0)
+			continue;
+
+		failure |= writeField(directory, summary, type, "time", table->time, table->rows);
+		char name[256];
+		for (int i = 0; i < table->width; i++) {
+			// a record with more values than its type should have still gets them all out
+			if (_fieldNames[type][i] != NULL)
+				snprintf(name, sizeof(name), "%s", _fieldNames[type][i]);
+			else
+				snprintf(name, sizeof(name), "value_%d", i);
+			failure |= writeField(directory, summary, type, name, table->values[i], \
+					table->rows);
+		}
+
+		snprintf(name, sizeof(name), "%s_sequence.u32", _typeNames[type]);
+		failure |= writeArray(directory, name, table->sequence, sizeof(uint32_t), table->rows);
+		snprintf(name, sizeof(name), "%s_source.u8", _typeNames[type]);
+		failure |= writeArray(directory, name, table->source, sizeof(uint8_t), table->rows);
+	}
+
+	failure |= fclose(summary) != 0;
+	return failure ? -1 : 0;
+}
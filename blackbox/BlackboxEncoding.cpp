@@ -0,0 +1,230 @@
+// implementation for the BlackboxEncoding header
+//
+// by Mark Hill
+
+#include<stdint.h>
+#include<string.h>
+#include<math.h>
+
+#include<BlackboxEncoding.h>
+
+// the counts per g of the accelerometer, per rad/s of the gyroscope and per microtesla of
+//   the magnetometer, see SensorManager.cpp
+#define ACCELERATION_COUNTS 8192
+#define ROTATION_COUNTS 3274.04
+#define MAGNETIC_FIELD_COUNTS 10
+// the steps of the commands and thrusts, which go from -1 or 0 to 1
+#define COMMAND_COUNTS 10000
+
+const double blackboxResolutions[BLACKBOX_RECORD_TYPES][BLACKBOX_RECORD_VALUES] = {
+	// padding
+	{0},
+	{ACCELERATION_COUNTS, ACCELERATION_COUNTS, ACCELERATION_COUNTS},
+	{ROTATION_COUNTS, ROTATION_COUNTS, ROTATION_COUNTS},
+	{MAGNETIC_FIELD_COUNTS, MAGNETIC_FIELD_COUNTS, MAGNETIC_FIELD_COUNTS},
+	// centimeters
+	{100},
+	// gravity like the accelerometer, hundredths of a degree, millimeters and mm/s
+	{ACCELERATION_COUNTS, ACCELERATION_COUNTS, ACCELERATION_COUNTS, 100, 1000, 1000},
+	{COMMAND_COUNTS, COMMAND_COUNTS, COMMAND_COUNTS, \
+		ROTATION_COUNTS, ROTATION_COUNTS, ROTATION_COUNTS},
+	{COMMAND_COUNTS, COMMAND_COUNTS, COMMAND_COUNTS, COMMAND_COUNTS},
+	{COMMAND_COUNTS, COMMAND_COUNTS, COMMAND_COUNTS, \
+		COMMAND_COUNTS, COMMAND_COUNTS, COMMAND_COUNTS},
+};
+
+// the largest value stored, well inside what the shift in zigzag() can take
+static const double _largestValue = 4.0e18;
+
+static uint64_t zigzag(int64_t value) {
+	return ((uint64_t)(value) << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+	return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+// writes value as a varint at output and returns the bytes taken
+static int putVarint(uint8_t *output, uint64_t value) {
+	int size = 0;
+	while (value >= 0x80) {
+		output[size++] = (uint8_t)(value) | 0x80;
+		value >>= 7;
+	}
+	output[size++] = (uint8_t)(value);
+	return size;
+}
+
+// reads a varint from input, which has size bytes, into value
+// returns the bytes taken, or -1 if it runs past the end or is too long
+static int getVarint(const uint8_t *input, uint32_t size, uint64_t *value) {
+	uint64_t result = 0;
+	for (uint32_t i = 0; i < size && i < 10; i++) {
+		result |= (uint64_t)(input[i] & 0x7f) << (7 * i);
+		if (!(input[i] & 0x80)) {
+			*value = result;
+			return i + 1;
+		}
+	}
+	return -1;
+}
+
+// turns value into an integer number of steps of resolution
+static int64_t quantize(double value, double resolution) {
+	double steps = round(value * resolution);
+	if (!(steps == steps))
+		return 0;
+	if (steps > _largestValue)
+		return (int64_t)(_largestValue);
+	if (steps < -_largestValue)
+		return -(int64_t)(_largestValue);
+	return (int64_t)(steps);
+}
+
+// returns the time the stream expects its next frame at, in microseconds
+static int64_t predictTime(const struct BlackboxStream *stream) {
+	if (stream->frames == 0)
+		return 0;
+	return stream->time + stream->timeStep;
+}
+
+void resetBlackboxPredictor(struct BlackboxPredictor *predictor) {
+	memset(predictor, 0, sizeof(*predictor));
+}
+
+int encodeBlackboxFrame(struct BlackboxPredictor *predictor, \
+		const struct BlackboxRecord *record, uint8_t *output, uint32_t space) {
+	if (space < BLACKBOX_MAX_FRAME_SIZE)
+		return 0;
+
+	int type = record->type % BLACKBOX_RECORD_TYPES;
+	int source = record->source % BLACKBOX_SOURCES;
+	int count = record->count > BLACKBOX_RECORD_VALUES ? BLACKBOX_RECORD_VALUES : record->count;
+	struct BlackboxStream *stream = &predictor->streams[source][type];
+	int size = 0;
+
+	output[size++] = (uint8_t)(type | source << 4);
+
+	uint32_t expected = stream->frames > 0 ? stream->sequence + 1 : 0;
+	int newCount = stream->frames == 0 || count != stream->count;
+	int64_t sequenceChange = (int64_t)(record->sequence) - (int64_t)(expected);
+	size += putVarint(output + size, zigzag(sequenceChange) << 1 | newCount);
+	if (newCount)
+		size += putVarint(output + size, count);
+
+	int64_t time = quantize(record->time, 1e6);
+	size += putVarint(output + size, zigzag(time - predictTime(stream)));
+
+	for (int i = 0; i < count; i++) {
+		int64_t value = quantize(record->values[i], blackboxResolutions[type][i]);
+		// a new count means the values may not line up with the last ones
+		int64_t predicted = newCount ? 0 : stream->values[i];
+		size += putVarint(output + size, zigzag(value - predicted));
+		stream->values[i] = value;
+	}
+
+	stream->timeStep = stream->frames > 0 ? time - stream->time : 0;
+	stream->time = time;
+	stream->sequence = record->sequence;
+	stream->count = count;
+	stream->frames++;
+
+	return size;
+}
+
+int decodeBlackboxFrame(struct BlackboxPredictor *predictor, const uint8_t *input, \
+		uint32_t size, struct BlackboxRecord *record) {
+	if (size == 0 || input[0] == 0)
+		return 0;
+
+	int type = input[0] & 0x0f;
+	int source = input[0] >> 4;
+	if (type >= BLACKBOX_RECORD_TYPES)
+		return -1;
+	struct BlackboxStream *stream = &predictor->streams[source][type];
+	uint32_t position = 1;
+	uint64_t field;
+	int taken;
+
+	if ((taken = getVarint(input + position, size - position, &field)) < 0)
+		return -1;
+	position += taken;
+	int newCount = field & 1;
+	uint32_t expected = stream->frames > 0 ? stream->sequence + 1 : 0;
+	uint32_t sequence = (uint32_t)((int64_t)(expected) + unzigzag(field >> 1));
+
+	int count = stream->count;
+	if (newCount) {
+		if ((taken = getVarint(input + position, size - position, &field)) < 0)
+			return -1;
+		position += taken;
+		if (field > BLACKBOX_RECORD_VALUES)
+			return -1;
+		count = (int)(field);
+	}
+	else if (stream->frames == 0) {
+		return -1;
+	}
+
+	if ((taken = getVarint(input + position, size - position, &field)) < 0)
+		return -1;
+	position += taken;
+	int64_t time = predictTime(stream) + unzigzag(field);
+
+	record->type = type;
+	record->source = source;
+	record->count = count;
+	record->sequence = sequence;
+	record->time = time / 1e6;
+	for (int i = 0; i < BLACKBOX_RECORD_VALUES; i++) {
+		if (i >= count) {
+			record->values[i] = 0;
+			continue;
+		}
+		if ((taken = getVarint(input + position, size - position, &field)) < 0)
+			return -1;
+		position += taken;
+		int64_t value = (newCount ? 0 : stream->values[i]) + unzigzag(field);
+		stream->values[i] = value;
+		record->values[i] = value / blackboxResolutions[type][i];
+	}
+
+	stream->timeStep = stream->frames > 0 ? time - stream->time : 0;
+	stream->time = time;
+	stream->sequence = sequence;
+	stream->count = count;
+	stream->frames++;
+
+	return position;
+}
+
+int checkBlackboxBlock(const void *block) {
+	const struct BlackboxBlockHeader *header = (const struct BlackboxBlockHeader *)(block);
+	if (memcmp(header->magic, BLACKBOX_MAGIC, sizeof(header->magic)) || \
+			header->version != BLACKBOX_VERSION || \
+			header->bytes > BLACKBOX_BLOCK_SIZE - sizeof(struct BlackboxBlockHeader))
+		return -1;
+	return 0;
+}
+
+int openBlackboxBlock(struct BlackboxBlockReader *reader, const void *block) {
+	const struct BlackboxBlockHeader *header = (const struct BlackboxBlockHeader *)(block);
+	if (checkBlackboxBlock(block))
+		return -1;
+
+	reader->frames = (const uint8_t *)(block) + sizeof(struct BlackboxBlockHeader);
+	reader->size = header->bytes;
+	reader->position = 0;
+	resetBlackboxPredictor(&reader->predictor);
+	return 0;
+}
+
+int nextBlackboxRecord(struct BlackboxBlockReader *reader, struct BlackboxRecord *record) {
+	int size = decodeBlackboxFrame(&reader->predictor, reader->frames + reader->position, \
+			reader->size - reader->position, record);
+	if (size <= 0)
+		return size;
+
+	reader->position += size;
+	return 1;
+}
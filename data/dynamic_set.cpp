@@ -0,0 +1,102 @@
+// dynamic set implementation
+// keeps the C interface working on top of a DynamicSet of pointers
+// by Mark Hill
+
+#include<stdint.h>
+#include<pthread.h>
+
+#include<new>
+
+#include<DynamicSet.h>
+extern "C" {
+	#include<dynamic_set.h>
+}
+
+
+/*
+ * internal representation of a dynamic set
+ * @lock		recursive mutex held by every operation and by callers looping through the set
+ * @items		the void * pointers, the first 8 inside the set itself
+ */
+struct dyn_set {
+	pthread_mutex_t lock;
+	DynamicSet<void *, 8> items;
+};
+
+
+
+struct dyn_set *dyn_set_init(uint64_t start_size) {
+	if (start_size == 0 || start_size > UINT32_MAX)
+		return NULL;
+
+	struct dyn_set *set = new (std::nothrow) dyn_set;
+	if (set == NULL)
+		return NULL;
+
+	pthread_mutexattr_t attr;
+	if (pthread_mutexattr_init(&attr) ||
+			pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE) ||
+			pthread_mutex_init(&set->lock, &attr) ||
+			reserveDynamicSet(&set->items, (uint32_t)(start_size))) {
+		delete set;
+		return NULL;
+	}
+	pthread_mutexattr_destroy(&attr);
+
+	return set;
+}
+
+void dyn_set_deinit(struct dyn_set *set) {
+	dyn_set_lock(set);
+	dyn_set_unlock(set);
+	pthread_mutex_destroy(&set->lock);
+	delete set;
+}
+
+uint8_t dyn_set_lock(struct dyn_set *set) {
+	return pthread_mutex_lock(&set->lock) ? 1 : 0;
+}
+
+uint8_t dyn_set_unlock(struct dyn_set *set) {
+	return pthread_mutex_unlock(&set->lock) ? 1 : 0;
+}
+
+uint64_t dyn_set_count(struct dyn_set *set) {
+	if (set == NULL || dyn_set_lock(set))
+		return 0;
+	uint64_t count = set->items.count;
+	dyn_set_unlock(set);
+	return count;
+}
+
+void *dyn_set_get_item(struct dyn_set *set, uint64_t index) {
+	if (set == NULL || dyn_set_lock(set))
+		return NULL;
+	// read before unlocking, since a remove can move another item into the slot
+	void *item = index < set->items.count ? set->items[(uint32_t)(index)] : NULL;
+	dyn_set_unlock(set);
+	return item;
+}
+
+
+int8_t dyn_set_add(struct dyn_set *set, void *item) {
+	if (set == NULL || item == NULL)
+		return 2;
+	if (dyn_set_lock(set))
+		return 1;
+
+	int8_t failure = addToDynamicSet(&set->items, item) < 0 ? 1 : 0;
+	dyn_set_unlock(set);
+	return failure;
+}
+
+int8_t dyn_set_remove(struct dyn_set *set, void *item) {
+	if (set == NULL || item == NULL)
+		return 2;
+	if (dyn_set_lock(set))
+		return 1;
+
+	int8_t missing = removeFromDynamicSet(&set->items, item) ? 1 : 0;
+	dyn_set_unlock(set);
+	return missing;
+}
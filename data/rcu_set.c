@@ -0,0 +1,219 @@
+// read-mostly set implementation
+// by Mark Hill
+
+#include<stdint.h>
+#include<stdlib.h>
+#include<string.h>
+#include<sched.h>
+#include<pthread.h>
+#include<stdatomic.h>
+
+#include<rcu_set.h>
+
+
+/*
+ * internal representation of a snapshot of the items
+ * never changed once published, writers replace it as a whole
+ * @count		number of stored items
+ * @items		array of void * pointers
+ */
+struct rcu_set_items {
+	uint64_t count;
+	void *items[];
+};
+
+/*
+ * internal representation of a read-mostly set
+ * @current		the snapshot new read sections pick up
+ * @epoch		which of the reader counts new read sections go to, by its lowest bit
+ * @readers		the number of read sections in each epoch, on their own cache lines
+ * 					so the readers of one epoch do not slow down the other
+ * @write_lock	serializes the writers
+ */
+struct rcu_set {
+	_Atomic(struct rcu_set_items *) current;
+	atomic_uint epoch;
+	struct {
+		_Alignas(64) atomic_uint_fast64_t count;
+	} readers[2];
+	pthread_mutex_t write_lock;
+};
+
+static const struct rcu_set_items __empty_items = {0};
+
+
+/*
+ * internal function to allocate a snapshot of count items
+ * @return		the snapshot
+ * 				NULL on memory allocation error
+ */
+static struct rcu_set_items *__rcu_set_alloc(uint64_t count) {
+	struct rcu_set_items *items = malloc(sizeof(struct rcu_set_items) + sizeof(void *) * count);
+	if (items)
+		items->count = count;
+	return items;
+}
+
+/*
+ * internal function to free a snapshot, leaving the shared empty one alone
+ */
+static void __rcu_set_free(struct rcu_set_items *items) {
+	if (items != &__empty_items)
+		free(items);
+}
+
+/*
+ * internal function to find the index of an item in a snapshot
+ * @return		the index of the item in items->items
+ * 				items->count if the item was not found
+ */
+static uint64_t __rcu_set_find(const struct rcu_set_items *items, void *item) {
+	for (uint64_t i = 0; i < items->count; i++) {
+		if (items->items[i] == item)
+			return i;
+	}
+	return items->count;
+}
+
+/*
+ * internal function to publish a new snapshot and free the old one once no read
+ * 	section holds it any more
+ * must be called with the write lock held
+ * every read section that picked up the old snapshot counted itself in one of the
+ * 	epochs before doing so, so it is enough to wait out each epoch once after the
+ * 	new snapshot is published; flipping to the other epoch first sends the new read
+ * 	sections there, so the count being waited on only goes down
+ */
+static void __rcu_set_replace(struct rcu_set *set, struct rcu_set_items *items) {
+	struct rcu_set_items *old = atomic_exchange(&set->current, items);
+
+	for (int i = 0; i < 2; i++) {
+		unsigned epoch = atomic_fetch_add(&set->epoch, 1);
+		while (atomic_load(&set->readers[epoch & 1].count) != 0)
+			sched_yield();
+	}
+
+	__rcu_set_free(old);
+}
+
+
+
+struct rcu_set *rcu_set_init(void) {
+	// the reader counts are aligned to cache lines, which malloc does not guarantee
+	struct rcu_set *set;
+	size_t size = (sizeof(struct rcu_set) + _Alignof(struct rcu_set) - 1) & \
+			~(_Alignof(struct rcu_set) - 1);
+	if (!(set = aligned_alloc(_Alignof(struct rcu_set), size)))
+		return NULL;
+	if (pthread_mutex_init(&set->write_lock, NULL)) {
+		free(set);
+		return NULL;
+	}
+
+	atomic_init(&set->current, (struct rcu_set_items *)&__empty_items);
+	atomic_init(&set->epoch, 0);
+	atomic_init(&set->readers[0].count, 0);
+	atomic_init(&set->readers[1].count, 0);
+	return set;
+}
+
+void rcu_set_deinit(struct rcu_set *set) {
+	if (set == NULL)
+		return;
+	pthread_mutex_destroy(&set->write_lock);
+	__rcu_set_free(atomic_load(&set->current));
+	free(set);
+}
+
+uint64_t rcu_set_read_begin(struct rcu_set *set, struct rcu_set_reader *reader) {
+	if (set == NULL) {
+		reader->snapshot = &__empty_items;
+		reader->items = __empty_items.items;
+		reader->count = 0;
+		return 0;
+	}
+
+	reader->epoch = atomic_load(&set->epoch) & 1;
+	atomic_fetch_add(&set->readers[reader->epoch].count, 1);
+	reader->snapshot = atomic_load(&set->current);
+	reader->items = reader->snapshot->items;
+	reader->count = reader->snapshot->count;
+	return reader->count;
+}
+
+void rcu_set_read_end(struct rcu_set *set, struct rcu_set_reader *reader) {
+	if (set != NULL)
+		atomic_fetch_sub_explicit(&set->readers[reader->epoch].count, 1, memory_order_release);
+	reader->snapshot = NULL;
+	reader->items = NULL;
+	reader->count = 0;
+}
+
+uint64_t rcu_set_count(struct rcu_set *set) {
+	struct rcu_set_reader reader;
+	uint64_t count = rcu_set_read_begin(set, &reader);
+	rcu_set_read_end(set, &reader);
+	return count;
+}
+
+uint8_t rcu_set_contains(struct rcu_set *set, void *item) {
+	struct rcu_set_reader reader;
+	rcu_set_read_begin(set, &reader);
+	uint8_t found = item != NULL && __rcu_set_find(reader.snapshot, item) < reader.count;
+	rcu_set_read_end(set, &reader);
+	return found;
+}
+
+
+int8_t rcu_set_add(struct rcu_set *set, void *item) {
+	if (set == NULL || item == NULL)
+		return 2;
+
+	pthread_mutex_lock(&set->write_lock);
+	// only writers replace the snapshot, so it can be used without a read section here
+	struct rcu_set_items *old = atomic_load(&set->current);
+	if (__rcu_set_find(old, item) < old->count) {
+		pthread_mutex_unlock(&set->write_lock);
+		return 3;
+	}
+
+	struct rcu_set_items *items = __rcu_set_alloc(old->count + 1);
+	if (items == NULL) {
+		pthread_mutex_unlock(&set->write_lock);
+		return 1;
+	}
+	memcpy(items->items, old->items, sizeof(void *) * old->count);
+	items->items[old->count] = item;
+
+	__rcu_set_replace(set, items);
+	pthread_mutex_unlock(&set->write_lock);
+	return 0;
+}
+
+int8_t rcu_set_remove(struct rcu_set *set, void *item) {
+	if (set == NULL || item == NULL)
+		return 2;
+
+	pthread_mutex_lock(&set->write_lock);
+	struct rcu_set_items *old = atomic_load(&set->current);
+	uint64_t index = __rcu_set_find(old, item);
+	if (index >= old->count) {
+		pthread_mutex_unlock(&set->write_lock);
+		return 1;
+	}
+
+	struct rcu_set_items *items = (struct rcu_set_items *)&__empty_items;
+	if (old->count > 1) {
+		if (!(items = __rcu_set_alloc(old->count - 1))) {
+			pthread_mutex_unlock(&set->write_lock);
+			return 3;
+		}
+		memcpy(items->items, old->items, sizeof(void *) * (old->count - 1));
+		if (index < old->count - 1)
+			items->items[index] = old->items[old->count - 1];
+	}
+
+	__rcu_set_replace(set, items);
+	pthread_mutex_unlock(&set->write_lock);
+	return 0;
+}
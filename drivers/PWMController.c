@@ -8,6 +8,9 @@
 #include<stdio.h>
 #include<stdlib.h>
 #include<unistd.h>
+#include<math.h>
+#include<string.h>
+#include<pthread.h>
 
 #include <PWMController.h>
 #include <i2cctl.h>
@@ -15,85 +18,95 @@
 // i2c address of the PWM chip
 static const uint16_t pwmDeviceAddress = 0x40;
 
+// the frequency of the chip's internal oscillator in Hz
+static const double pwmOscillatorFrequency = 25000000;
+// divides the oscillator down to the PWM frequency, see pwmFrequency()
+// the chip only takes prescales from 3 up
+static uint8_t pwmPrescale = 0x16;
+static const uint8_t pwmMinimumPrescale = 3;
+
 // flag indicating whether the PWM chip has been initialized
 // this should only be set by the initializePWMController function
 // 0 = uninitialized = not ready for use
 // 1 = initialized = ready for use
 static uint8_t initialized = 0;
 
+// the number of PWM channels on the chip
+#define PWM_CHANNEL_COUNT 16
+
+// the last on low, on high, off low and off high register values written to or read from
+//   each channel, so reads and unchanged writes don't need the bus
+// a channel's registers are only trusted once _shadowValid is set for it
+static uint8_t _shadow[PWM_CHANNEL_COUNT][4];
+static uint8_t _shadowValid[PWM_CHANNEL_COUNT] = {0};
+// keeps the shadow registers in step with the chip when several threads use it
+static pthread_mutex_t _shadowLock = PTHREAD_MUTEX_INITIALIZER;
+
 // on boot, the PWM device must have its configuration registers set
 //   to the values specific for this application
-static void initializePWMController() {
-    // if the chip has already been initialized, return
-    if (initialized) {
-        return;
-    }
+// there are three registers that must be set:
+//   Mode 1 (first configuration register)
+//   Mode 2 (second configuration register)
+//   Prescale (sets the clock speed for PWM)
+// the registers can be set in any order, as long
+//   as the device is first put to sleep by setting the
+//   sleep bit on Mode 1, and ending with a write to wake
+//   the device with a final write to Mode 1
+// in order to set the registers, the chip must be put into sleep
+//   mode by turning off the internal oscilator
+// this is done by setting bit 4 on the mode 1 register to 1
+static const uint8_t pwmConfigurationRegisters[] = {0x00, 0xfe, 0x01, 0x00};
+static const char *pwmConfigurationNames[] = {"mode 1 sleep", "prescale", "mode 2", \
+        "mode 1 wake"};
+#define PWM_CONFIGURATION_STEPS 4
 
-    // there are three registers that must be set:
-    //   Mode 1 (first configuration register)
-    //   Mode 2 (second configuration register)
-    //   Prescale (sets the clock speed for PWM)
-    // the registers can be set in any order, as long
-    //   as the device is first put to sleep by setting the
-    //   sleep bit on Mode 1, and ending with a write to wake
-    //   the device with a final write to Mode 1
-    
-    // in order to set the registers, the chip must be put into sleep
-    //   mode by turning off the internal oscilator
-    // this is done by setting bit 4 on the mode 1 register to 1
-    
-    // Mode 1 (set to sleep)
-    uint8_t data[] = {0x00, 0x30};
-    
-    int success = i2c_write(pwmDeviceAddress, data, 2);
+int pwmConfigurationSteps() {
+    return initialized ? 0 : PWM_CONFIGURATION_STEPS;
+}
 
-    for (int i = 0; i < 3 && success != 0; i++) {
-        printf("retrying mode 1 sleep register write in PWMController\n");
-        success |= i2c_write(pwmDeviceAddress, data, 2);
-    }
-    
+const char *pwmConfigurationStepName(int step) {
+    return step >= 0 && step < PWM_CONFIGURATION_STEPS ? pwmConfigurationNames[step] : "";
+}
 
-    // Prescale
-    data[0] = 0xfe;
-    data[1] = 0x16;
-    
-    success |= i2c_write(pwmDeviceAddress, data, 2);
-    
-    for (int i = 0; i < 3 && success != 0; i++) {
-        printf("retrying prescale register write in PWMController\n");
-        success |= i2c_write(pwmDeviceAddress, data, 2);
-    }
-    
-    // Mode 2
-    data[0] = 0x01;
-    data[1] = 0x04;
-    
-    success |= i2c_write(pwmDeviceAddress, data, 2);
+int writePWMConfiguration(int step) {
+    if (step < 0 || step >= PWM_CONFIGURATION_STEPS)
+        return -1;
 
-    for (int i = 0; i < 3 && success != 0; i++) {
-        printf("retrying mode 2 register write in PWMController\n");
-        success |= i2c_write(pwmDeviceAddress, data, 2);
-    }
+    // the prescale is the only value that can change, see setPWMFrequency()
+    const uint8_t values[] = {0x30, pwmPrescale, 0x04, 0xa0};
+    uint8_t data[] = {pwmConfigurationRegisters[step], values[step]};
+    return i2c_write(pwmDeviceAddress, data, 2);
+}
 
-    // Mode 1 (wake from sleep)
-    data[0] = 0x00;
-    data[1] = 0xa0;
-    
-    success |= i2c_write(pwmDeviceAddress, data, 2);
+void finishPWMConfiguration(int success) {
+    if (success == 0)
+        initialized = 1;
+    else
+        printf("failed to initialize PWM device\n");
+}
 
-    for (int i = 0; i < 3 && success != 0; i++) {
-        printf("retrying mode 1 wake register write in PWMController\n");
-        success |= i2c_write(pwmDeviceAddress, data, 2);
+static void initializePWMController() {
+    // if the chip has already been initialized, return
+    if (initialized) {
+        return;
+    }
+
+    int success = 0;
+    for (int step = 0; step < PWM_CONFIGURATION_STEPS; step++) {
+        int failure = writePWMConfiguration(step);
+        for (int i = 0; i < PWM_CONFIGURATION_RETRIES && failure != 0; i++) {
+            printf("retrying %s register write in PWMController\n", \
+                    pwmConfigurationStepName(step));
+            failure = writePWMConfiguration(step);
+        }
+        success |= failure;
     }
 
     // must wait 500us for the internal oscillator on the PWM chip to stabilize as
     //   per the datasheet recommendation   
-    usleep(500);
+    usleep((useconds_t)(PWM_OSCILLATOR_SETTLE_TIME * 1000000));
     
-    if (success == 0)
-        initialized = 1;
-    else
-        printf("failed to initialize PWM device\n");
+    finishPWMConfiguration(success);
 }
 
 // sets the PWM device to sleep by turning off the internal oscillator
@@ -109,56 +122,204 @@ void deinitializePWMController() {
     }
 }
 
+// the chip counts to 4096 every cycle, one count per prescale + 1 oscillator ticks
+double pwmFrequency() {
+    return pwmOscillatorFrequency / (4096 * (pwmPrescale + 1));
+}
+
+// picks the prescale giving the frequency closest to the requested one, then runs the
+//   configuration again if the chip was already running, since the prescale can only
+//   be written while it sleeps
+int setPWMFrequency(double frequency) {
+    double prescale = round(pwmOscillatorFrequency / (4096 * frequency)) - 1;
+    if (frequency <= 0 || prescale < pwmMinimumPrescale || prescale > 255) {
+        printf("PWM frequency %.1fHz is out of range\n", frequency);
+        return -1;
+    }
+
+    pwmPrescale = (uint8_t)prescale;
+    if (initialized) {
+        initialized = 0;
+        initializePWMController();
+        if (!initialized)
+            return -1;
+    }
+
+    return 0;
+}
+
+// returns the number of counts out of 4096 the registers keep the output on for
+static uint16_t registerCounts(const uint8_t registers[4]) {
+    // full off wins over full on
+    if (registers[3] & 0x10)
+        return 0;
+    if (registers[1] & 0x10)
+        return 4096;
+
+    uint16_t on = registers[0] + ((registers[1] & 0x0f) << 8);
+    uint16_t off = registers[2] + ((registers[3] & 0x0f) << 8);
+    return (off - on) & 0x0fff;
+}
+
 // returns the duty cycle of the addressed PWM device as a value from 0 - 1
+// only goes to the chip the first time a channel is read before it has been written
 double getDutyPercent(uint8_t address) {
-    // read the on and off values to the corresponding registers
-    // the 4 * address sum is used to offset the register to read from
-    //   based on which PWM pin is being addressed
-    uint8_t onLowRegister = (uint8_t)(0x06 + (4 * address));
-    uint8_t data[4];
-    i2c_read(pwmDeviceAddress, onLowRegister, data, 4);
-    
-    uint32_t on = data[0] + (data[1] << 8);
-    uint32_t off = data[2] + (data[3] << 8);
-    // get it?
-    double duty = abs((int)off - (int)on) / (double) 4096;
+    if (address >= PWM_CHANNEL_COUNT)
+        return 0;
 
-    return duty;
-}
+    pthread_mutex_lock(&_shadowLock);
+    if (!_shadowValid[address]) {
+        // read the on and off values to the corresponding registers
+        // the 4 * address sum is used to offset the register to read from
+        //   based on which PWM pin is being addressed
+        uint8_t onLowRegister = (uint8_t)(0x06 + (4 * address));
+        if (i2c_read(pwmDeviceAddress, onLowRegister, _shadow[address], 4) == 0)
+            _shadowValid[address] = 1;
+    }
+    uint16_t counts = registerCounts(_shadow[address]);
+    pthread_mutex_unlock(&_shadowLock);
 
-// sets the duty cycle of the addressed PWM device to the specified value between 0 - 1
-void setDutyPercent(uint8_t address, double percent) {
-    // the PWM chip obviously needs to be configured before values can be written
-    initializePWMController();
-    
-    // check the inputs and make sure they don't exceed passed in values
-    if (percent > 1)
-        percent = 1;
-    if (percent < 0)
-        percent = 0;
+    return counts / (double) 4096;
+}
 
+// fills registers with the on low, on high, off low and off high register values that
+//   keep the addressed PWM device on for counts out of 4096
+static void countRegisters(uint8_t address, uint16_t counts, uint8_t registers[4]) {
     // the time the chip should wait each cycle before turning the pulse on
     // this is used to prevent power surging
     uint16_t onDelay = 225 * address;
     // the time the chip should wait each cycle before turning the pulse off
-    uint16_t offDelay = onDelay + (uint16_t)(percent * 4096) - 1;
-    // because the data sheet says to subtract 1 for proper function of the device,
-    //   I have to check that the offDelay did not underflow from 0 -1 and become 65535
-    if (offDelay > 4096)
+    // the output is on from the count in the on registers up to the count in the off
+    //   registers, wrapping around at the end of the cycle, so the later channels can
+    //   turn off early in the next one
+    uint16_t offDelay = (onDelay + counts) & 0x0fff;
+    // a pulse of no counts or of the whole cycle would have the same on and off counts,
+    //   so those use the full off and full on bits in the high registers instead
+    if (counts == 0) {
+        onDelay = 0;
+        offDelay = 0x1000;
+    }
+    else if (counts >= 4096) {
+        onDelay = 0x1000;
         offDelay = 0;
-    uint8_t onL = onDelay & 0xff;
-    uint8_t onH = (onDelay & 0xff00) >> 8;
-    uint8_t offL = offDelay & 0xff;
-    uint8_t offH = (offDelay & 0xff00) >> 8;
-    
-    //printf("Setting motor to on for %d counts out of 4095\n", offDelay - onDelay);
+    }
+    registers[0] = onDelay & 0xff;
+    registers[1] = (onDelay & 0xff00) >> 8;
+    registers[2] = offDelay & 0xff;
+    registers[3] = (offDelay & 0xff00) >> 8;
+}
+
+// sets the duty cycle of the addressed PWM device to the specified value between 0 - 1
+void setDutyPercent(uint8_t address, double percent) {
+    setDutyPercents(address, 1, &percent);
+}
+
+int setDutyPercents(uint8_t first, uint8_t count, const double *percents) {
+    uint16_t counts[PWM_CHANNEL_COUNT];
+    for (int i = 0; i < count && i < PWM_CHANNEL_COUNT; i++) {
+        // check the inputs and make sure they don't exceed passed in values
+        double percent = percents[i];
+        if (percent > 1)
+            percent = 1;
+        if (percent < 0)
+            percent = 0;
+        // rounded so the pulse is as close to the requested one as the chip can make it
+        counts[i] = (uint16_t)(percent * 4096 + 0.5);
+    }
+
+    return setDutyCounts(first, count, counts);
+}
+
+int setDutyCounts(uint8_t first, uint8_t count, const uint16_t *counts) {
+    // the PWM chip obviously needs to be configured before values can be written
+    initializePWMController();
+
+    if (count == 0 || first + count > PWM_CHANNEL_COUNT) {
+        printf("PWM channels %d - %d do not exist\n", first, first + count - 1);
+        return -1;
+    }
+
+    uint8_t registers[PWM_CHANNEL_COUNT][4];
+    for (int i = 0; i < count; i++) {
+        countRegisters(first + i, counts[i], registers[i]);
+    }
+
+    // only the span from the first to the last channel that changed is written, so
+    //   repeating a value costs nothing
+    pthread_mutex_lock(&_shadowLock);
+    int low = count, high = -1;
+    for (int i = 0; i < count; i++) {
+        uint8_t channel = first + i;
+        if (!_shadowValid[channel] || memcmp(_shadow[channel], registers[i], 4)) {
+            low = i < low ? i : low;
+            high = i;
+        }
+    }
+    if (high < 0) {
+        pthread_mutex_unlock(&_shadowLock);
+        return 0;
+    }
+
     // write the on and off values to the corresponding registers
     // the 4 * address sum is used to offset the register to write to
     //   based on which PWM pin should be configured
-    uint8_t onLowRegister = (uint8_t)(0x06 + (4 * address));
-    
-    uint8_t data[] = {onLowRegister, onL, onH, offL, offH};
-    i2c_write(pwmDeviceAddress, data, 5);
+    // the auto increment bit set in mode 1 moves the register pointer along after every
+    //   byte, so the registers of all the channels follow each other in one write
+    int span = high - low + 1;
+    uint8_t data[1 + 4 * PWM_CHANNEL_COUNT];
+    data[0] = (uint8_t)(0x06 + (4 * (first + low)));
+    memcpy(&data[1], registers[low], 4 * span);
+
+    int failure = i2c_write(pwmDeviceAddress, data, 1 + 4 * span);
+    // after a failed write the chip could hold anything, so the next write goes out
+    //   no matter what
+    for (int i = low; i <= high; i++) {
+        memcpy(_shadow[first + i], registers[i], 4);
+        _shadowValid[first + i] = !failure;
+    }
+    pthread_mutex_unlock(&_shadowLock);
+
+    return failure;
+}
+
+int verifyPWMController() {
+    uint8_t data[4 * PWM_CHANNEL_COUNT];
+    int repaired = 0;
+
+    pthread_mutex_lock(&_shadowLock);
+    // reads the channels a quarter at a time to keep each read short
+    for (int i = 0; i < PWM_CHANNEL_COUNT; i += 4) {
+        if (i2c_read(pwmDeviceAddress, (uint8_t)(0x06 + 4 * i), &data[4 * i], 16)) {
+            pthread_mutex_unlock(&_shadowLock);
+            printf("failed to read PWM registers for verification\n");
+            return -1;
+        }
+    }
+
+    for (int channel = 0; channel < PWM_CHANNEL_COUNT; channel++) {
+        uint8_t *chip = &data[4 * channel];
+        // channels that were never written take whatever the chip has
+        if (!_shadowValid[channel]) {
+            memcpy(_shadow[channel], chip, 4);
+            _shadowValid[channel] = 1;
+            continue;
+        }
+        if (!memcmp(_shadow[channel], chip, 4))
+            continue;
+
+        printf("PWM channel %d does not hold the expected value, rewriting it\n", channel);
+        uint8_t write[] = {(uint8_t)(0x06 + 4 * channel), _shadow[channel][0], \
+                _shadow[channel][1], _shadow[channel][2], _shadow[channel][3]};
+        if (i2c_write(pwmDeviceAddress, write, 5)) {
+            _shadowValid[channel] = 0;
+            pthread_mutex_unlock(&_shadowLock);
+            return -1;
+        }
+        repaired++;
+    }
+    pthread_mutex_unlock(&_shadowLock);
+
+    return repaired;
 }
 
 
@@ -19,6 +19,7 @@
 #include <pthread.h>
 
 #include <i2cctl.h>
+#include <i2csim.h>
 
 
 #ifdef RELEASE
@@ -32,6 +33,8 @@ static const int debug = 1;
 // defaults to 1 because lets face it, thats normal
 static uint8_t _bus = 1;
 static int _i2cFile = -1000;
+// 1 when transactions go to the simulated bus in i2csim.c instead
+static int _simulated = 0;
 
 // this mutex is used to protect the i2c device from being used to do a read or write operations
 //   simulateously on another thread
@@ -130,10 +133,30 @@ void i2cSetBus(uint8_t bus) {
     releaseLock();
 }
 
+void i2cUseSimulation(int simulated) {
+    getLock();
+    _simulated = simulated;
+    releaseLock();
+}
+
+void i2cLockBus() {
+    getLock();
+}
+
+void i2cUnlockBus() {
+    releaseLock();
+}
+
 // performs a read operation
 int i2c_read(uint16_t address, uint8_t reg, uint8_t *data, uint8_t count) {
     getLock();
 
+    if (_simulated) {
+        if (i2cSimRead(address, reg, data, count))
+            goto read_error;
+        releaseLock();
+        return 0;
+    }
     if (i2cSetAddress(address))
         goto read_error;
     if (write(_i2cFile, &reg, 1) < 1)
@@ -153,6 +176,12 @@ read_error:
 int i2c_write(uint16_t address, const uint8_t *data, uint8_t count) {
     getLock();
 
+    if (_simulated) {
+        if (i2cSimWrite(address, data, count))
+            goto write_error;
+        releaseLock();
+        return 0;
+    }
     if (i2cSetAddress(address))
         goto write_error;
     if (write(_i2cFile, data, count) < count)
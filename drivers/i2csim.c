@@ -0,0 +1,433 @@
+// implementation for the simulated i2c bus
+//
+// by Mark Hill
+
+#include<stdint.h>
+#include<string.h>
+#include<math.h>
+
+#include<i2csim.h>
+
+// the devices on the bus, protected by the i2cctl lock like the real bus
+static struct I2CSimDevice *_devices[I2C_SIM_MAX_DEVICES];
+static int _deviceCount = 0;
+
+// returns the device at address, or NULL if there is none
+static struct I2CSimDevice *findDevice(uint16_t address) {
+    for (int i = 0; i < _deviceCount; i++) {
+        if (_devices[i]->address == address)
+            return _devices[i];
+    }
+    return NULL;
+}
+
+int i2cSimAttach(struct I2CSimDevice *device) {
+    for (int i = 0; i < _deviceCount; i++) {
+        if (_devices[i]->address == device->address) {
+            _devices[i] = device;
+            return 0;
+        }
+    }
+    if (_deviceCount == I2C_SIM_MAX_DEVICES)
+        return -1;
+
+    _devices[_deviceCount++] = device;
+    return 0;
+}
+
+void i2cSimDetachAll() {
+    _deviceCount = 0;
+}
+
+int i2cSimRead(uint16_t address, uint8_t reg, uint8_t *data, uint8_t count) {
+    struct I2CSimDevice *device = findDevice(address);
+    if (device == NULL || device->read == NULL)
+        return -1;
+    return device->read(device, reg, data, count);
+}
+
+int i2cSimWrite(uint16_t address, const uint8_t *data, uint8_t count) {
+    struct I2CSimDevice *device = findDevice(address);
+    if (device == NULL || device->write == NULL)
+        return -1;
+    return device->write(device, data, count);
+}
+
+
+// PCA9685 model
+// register addresses and bits from the datasheet
+
+#define PCA9685_MODE1 0x00
+#define PCA9685_MODE2 0x01
+#define PCA9685_LED0 0x06
+#define PCA9685_PRESCALE 0xfe
+#define PCA9685_SLEEP 0x10
+#define PCA9685_AUTO_INCREMENT 0x20
+#define PCA9685_FULL 0x10
+
+static const double _pca9685Oscillator = 25000000;
+
+static int pca9685Write(struct I2CSimDevice *device, const uint8_t *data, uint8_t count) {
+    struct PCA9685Model *model = (struct PCA9685Model *)(device->state);
+    model->writes++;
+    if (count == 0)
+        return 0;
+
+    uint8_t reg = data[0];
+    for (int i = 1; i < count; i++) {
+        // the prescale can only change while the oscillator is off
+        if (reg == PCA9685_PRESCALE && !(model->registers[PCA9685_MODE1] & PCA9685_SLEEP))
+            model->blockedPrescaleWrites++;
+        else
+            model->registers[reg] = data[i];
+
+        if (model->registers[PCA9685_MODE1] & PCA9685_AUTO_INCREMENT)
+            reg++;
+    }
+
+    return 0;
+}
+
+static int pca9685Read(struct I2CSimDevice *device, uint8_t reg, uint8_t *data, uint8_t count) {
+    struct PCA9685Model *model = (struct PCA9685Model *)(device->state);
+    for (int i = 0; i < count; i++) {
+        data[i] = model->registers[reg];
+        if (model->registers[PCA9685_MODE1] & PCA9685_AUTO_INCREMENT)
+            reg++;
+    }
+    return 0;
+}
+
+void initPCA9685Model(struct PCA9685Model *model, struct I2CSimDevice *device, uint16_t address) {
+    memset(model, 0, sizeof(struct PCA9685Model));
+    // power on values, asleep with every output fully off
+    model->registers[PCA9685_MODE1] = 0x11;
+    model->registers[PCA9685_MODE2] = 0x04;
+    model->registers[PCA9685_PRESCALE] = 0x1e;
+    for (int channel = 0; channel < 16; channel++) {
+        model->registers[PCA9685_LED0 + 4 * channel + 3] = PCA9685_FULL;
+    }
+
+    device->address = address;
+    device->write = &pca9685Write;
+    device->read = &pca9685Read;
+    device->state = model;
+}
+
+double pca9685Frequency(const struct PCA9685Model *model) {
+    return _pca9685Oscillator / (4096 * (model->registers[PCA9685_PRESCALE] + 1));
+}
+
+double pca9685PulseWidth(const struct PCA9685Model *model, uint8_t channel) {
+    const uint8_t *led = &model->registers[PCA9685_LED0 + 4 * channel];
+    double period = 1000000 / pca9685Frequency(model);
+
+    // a sleeping chip puts out nothing, full off wins over full on
+    if (model->registers[PCA9685_MODE1] & PCA9685_SLEEP)
+        return 0;
+    if (led[3] & PCA9685_FULL)
+        return 0;
+    if (led[1] & PCA9685_FULL)
+        return period;
+
+    int on = led[0] | ((led[1] & 0x0f) << 8);
+    int off = led[2] | ((led[3] & 0x0f) << 8);
+    // the output goes high when the counter reaches on and low when it reaches off,
+    //   wrapping around the end of the cycle
+    int counts = (off - on + 4096) % 4096;
+    return period * counts / 4096;
+}
+
+
+// LSM6DS33 model
+// register addresses and bits from the datasheet
+
+#define LSM6DS33_WHO_AM_I 0x0f
+#define LSM6DS33_CTRL1_XL 0x10
+#define LSM6DS33_CTRL2_G 0x11
+#define LSM6DS33_CTRL3_C 0x12
+#define LSM6DS33_OUTX_L_G 0x22
+#define LSM6DS33_OUTX_L_XL 0x28
+#define LSM6DS33_BIG_ENDIAN 0x02
+#define LSM6DS33_AUTO_INCREMENT 0x04
+#define LSM6DS33_GYRO_125 0x02
+
+// the full scales in g and the sensitivities in millidegrees per second per count,
+//   indexed by the full scale bits of the control registers
+static const double _lsm6ds33AccelerationScales[] = {2, 16, 4, 8};
+static const double _lsm6ds33RotationSensitivities[] = {8.75, 17.5, 35, 70};
+
+// moves to the register after reg, which the chip only does with auto increment on
+static uint8_t lsm6ds33NextRegister(const struct LSM6DS33Model *model, uint8_t reg) {
+    if (model->registers[LSM6DS33_CTRL3_C] & LSM6DS33_AUTO_INCREMENT)
+        return (reg + 1) & 0x7f;
+    return reg;
+}
+
+static int lsm6ds33Write(struct I2CSimDevice *device, const uint8_t *data, uint8_t count) {
+    struct LSM6DS33Model *model = (struct LSM6DS33Model *)(device->state);
+    if (count == 0)
+        return 0;
+
+    uint8_t reg = data[0] & 0x7f;
+    for (int i = 1; i < count; i++) {
+        // the identity and the outputs are read only
+        if (reg != LSM6DS33_WHO_AM_I && reg < LSM6DS33_OUTX_L_G)
+            model->registers[reg] = data[i];
+        reg = lsm6ds33NextRegister(model, reg);
+    }
+
+    return 0;
+}
+
+// stores value as a 16 bit count at reg in the byte order the chip is set to, saturating
+//   at the ends of the range like the chip does
+static void lsm6ds33SetOutput(struct LSM6DS33Model *model, uint8_t reg, double value) {
+    long rounded = lround(value);
+    rounded = rounded > 32767 ? 32767 : (rounded < -32768 ? -32768 : rounded);
+    uint16_t counts = (uint16_t)(rounded);
+
+    if (model->registers[LSM6DS33_CTRL3_C] & LSM6DS33_BIG_ENDIAN) {
+        model->registers[reg] = counts >> 8;
+        model->registers[reg + 1] = counts & 0xff;
+    }
+    else {
+        model->registers[reg] = counts & 0xff;
+        model->registers[reg + 1] = counts >> 8;
+    }
+}
+
+// measures the motion into the outputs with the full scales set
+// a sensor with its output data rate at 0 is powered down and keeps its last output
+static void lsm6ds33Measure(struct LSM6DS33Model *model) {
+    uint8_t accelerationControl = model->registers[LSM6DS33_CTRL1_XL];
+    uint8_t rotationControl = model->registers[LSM6DS33_CTRL2_G];
+    double countsPerG = 32768 / _lsm6ds33AccelerationScales[(accelerationControl >> 2) & 0x03];
+    double sensitivity = (rotationControl & LSM6DS33_GYRO_125) ? 4.375 : \
+            _lsm6ds33RotationSensitivities[(rotationControl >> 2) & 0x03];
+
+    for (int axis = 0; axis < 3; axis++) {
+        if (accelerationControl >> 4) {
+            lsm6ds33SetOutput(model, LSM6DS33_OUTX_L_XL + 2 * axis, \
+                    model->acceleration[axis] * countsPerG);
+        }
+        if (rotationControl >> 4) {
+            lsm6ds33SetOutput(model, LSM6DS33_OUTX_L_G + 2 * axis, \
+                    model->rotation[axis] * 1000 / sensitivity);
+        }
+    }
+}
+
+static int lsm6ds33Read(struct I2CSimDevice *device, uint8_t reg, uint8_t *data, uint8_t count) {
+    struct LSM6DS33Model *model = (struct LSM6DS33Model *)(device->state);
+    lsm6ds33Measure(model);
+
+    reg &= 0x7f;
+    for (int i = 0; i < count; i++) {
+        data[i] = model->registers[reg];
+        reg = lsm6ds33NextRegister(model, reg);
+    }
+    return 0;
+}
+
+void initLSM6DS33Model(struct LSM6DS33Model *model, struct I2CSimDevice *device, uint16_t address) {
+    memset(model, 0, sizeof(struct LSM6DS33Model));
+    model->registers[LSM6DS33_WHO_AM_I] = 0x69;
+    model->registers[LSM6DS33_CTRL3_C] = LSM6DS33_AUTO_INCREMENT;
+
+    device->address = address;
+    device->write = &lsm6ds33Write;
+    device->read = &lsm6ds33Read;
+    device->state = model;
+}
+
+void lsm6ds33SetMotion(struct LSM6DS33Model *model, const double *acceleration, \
+        const double *rotation) {
+    for (int axis = 0; axis < 3; axis++) {
+        model->acceleration[axis] = acceleration[axis];
+        model->rotation[axis] = rotation[axis];
+    }
+}
+
+
+// MAG3110 model
+// register addresses and bits from the datasheet
+
+#define MAG3110_OUT_X_MSB 0x01
+#define MAG3110_WHO_AM_I 0x07
+#define MAG3110_CTRL_REG1 0x10
+#define MAG3110_CTRL_REG2 0x11
+#define MAG3110_ACTIVE 0x01
+
+// the outputs are in tenths of a microtesla
+static const double _mag3110CountsPerMicrotesla = 10;
+
+static int mag3110Write(struct I2CSimDevice *device, const uint8_t *data, uint8_t count) {
+    struct MAG3110Model *model = (struct MAG3110Model *)(device->state);
+    if (count == 0)
+        return 0;
+
+    uint8_t reg = data[0];
+    for (int i = 1; i < count && reg <= MAG3110_CTRL_REG2; i++, reg++) {
+        // only the offsets and the control registers can be written
+        if (reg > MAG3110_WHO_AM_I)
+            model->registers[reg] = data[i];
+    }
+
+    return 0;
+}
+
+// measures the field into the outputs, which a chip in standby does not do
+static void mag3110Measure(struct MAG3110Model *model) {
+    if (!(model->registers[MAG3110_CTRL_REG1] & MAG3110_ACTIVE))
+        return;
+
+    for (int axis = 0; axis < 3; axis++) {
+        long rounded = lround(model->field[axis] * _mag3110CountsPerMicrotesla);
+        rounded = rounded > 32767 ? 32767 : (rounded < -32768 ? -32768 : rounded);
+        uint16_t counts = (uint16_t)(rounded);
+        model->registers[MAG3110_OUT_X_MSB + 2 * axis] = counts >> 8;
+        model->registers[MAG3110_OUT_X_MSB + 2 * axis + 1] = counts & 0xff;
+    }
+}
+
+static int mag3110Read(struct I2CSimDevice *device, uint8_t reg, uint8_t *data, uint8_t count) {
+    struct MAG3110Model *model = (struct MAG3110Model *)(device->state);
+    mag3110Measure(model);
+
+    for (int i = 0; i < count; i++, reg++) {
+        data[i] = reg <= MAG3110_CTRL_REG2 ? model->registers[reg] : 0;
+    }
+    return 0;
+}
+
+void initMAG3110Model(struct MAG3110Model *model, struct I2CSimDevice *device, uint16_t address) {
+    memset(model, 0, sizeof(struct MAG3110Model));
+    model->registers[MAG3110_WHO_AM_I] = 0xc4;
+
+    device->address = address;
+    device->write = &mag3110Write;
+    device->read = &mag3110Read;
+    device->state = model;
+}
+
+void mag3110SetField(struct MAG3110Model *model, const double *field) {
+    for (int axis = 0; axis < 3; axis++) {
+        model->field[axis] = field[axis];
+    }
+}
+
+
+// BMP180 model
+// register addresses, values and the compensation from the datasheet
+
+#define BMP180_CALIBRATION 0xaa
+#define BMP180_CHIP_ID 0xd0
+#define BMP180_CONTROL 0xf4
+#define BMP180_OUT_MSB 0xf6
+#define BMP180_TEMPERATURE 0x2e
+#define BMP180_PRESSURE 0x34
+
+// the example calibration from the datasheet, AC1 - AC6, B1, B2, MB, MC and MD
+static const int32_t _bmp180Calibration[11] = {
+    408, -72, -14383, 32741, 32757, 23153, 6190, 4, -32768, -8711, 2868,
+};
+// the raw temperature of the datasheet example, which is 15 degrees
+static const int32_t _bmp180ExampleTemperature = 27898;
+
+// returns the pressure in pascals the datasheet compensation gets from the raw pressure
+//   up at oversampling setting oss and the raw temperature ut
+static int32_t bmp180CompensatedPressure(int32_t up, int32_t ut, int oss) {
+    const int32_t *c = _bmp180Calibration;
+    int32_t x1 = (ut - c[5]) * c[4] / 32768;
+    int32_t x2 = c[9] * 2048 / (x1 + c[10]);
+    int32_t b5 = x1 + x2;
+
+    int32_t b6 = b5 - 4000;
+    x1 = (c[7] * (b6 * b6 / 4096)) / 2048;
+    x2 = c[1] * b6 / 2048;
+    int32_t x3 = x1 + x2;
+    int32_t b3 = (((c[0] * 4 + x3) << oss) + 2) / 4;
+    x1 = c[2] * b6 / 8192;
+    x2 = (c[6] * (b6 * b6 / 4096)) / 65536;
+    x3 = (x1 + x2 + 2) / 4;
+    uint32_t b4 = (uint32_t)(c[3]) * (uint32_t)(x3 + 32768) / 32768;
+    uint32_t b7 = ((uint32_t)(up) - b3) * (50000 >> oss);
+    int32_t p = b7 < 0x80000000 ? (b7 * 2) / b4 : (b7 / b4) * 2;
+
+    x1 = (p / 256) * (p / 256);
+    x1 = (x1 * 3038) / 65536;
+    x2 = (-7357 * p) / 65536;
+    return p + (x1 + x2 + 3791) / 16;
+}
+
+// returns the raw pressure at oversampling setting oss that compensates closest to the
+//   model's pressure
+// the compensation only ever grows with the raw pressure, so it can be searched
+static int32_t bmp180UncompensatedPressure(const struct BMP180Model *model, int oss) {
+    int32_t low = 0;
+    int32_t high = (1 << (16 + oss)) - 1;
+    while (low < high) {
+        int32_t middle = (low + high) / 2;
+        if (bmp180CompensatedPressure(middle, model->uncompensatedTemperature, oss) < \
+                model->pressure)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+static int bmp180Write(struct I2CSimDevice *device, const uint8_t *data, uint8_t count) {
+    struct BMP180Model *model = (struct BMP180Model *)(device->state);
+    if (count < 2 || data[0] != BMP180_CONTROL)
+        return 0;
+
+    // conversions finish the moment they start, the reader waits the conversion time
+    //   anyway
+    uint8_t control = data[1];
+    model->registers[BMP180_CONTROL] = control;
+    if (control == BMP180_TEMPERATURE) {
+        model->registers[BMP180_OUT_MSB] = (model->uncompensatedTemperature >> 8) & 0xff;
+        model->registers[BMP180_OUT_MSB + 1] = model->uncompensatedTemperature & 0xff;
+        model->registers[BMP180_OUT_MSB + 2] = 0;
+    }
+    else if ((control & 0x3f) == BMP180_PRESSURE) {
+        int oss = control >> 6;
+        uint32_t output = (uint32_t)(bmp180UncompensatedPressure(model, oss)) << (8 - oss);
+        model->registers[BMP180_OUT_MSB] = (output >> 16) & 0xff;
+        model->registers[BMP180_OUT_MSB + 1] = (output >> 8) & 0xff;
+        model->registers[BMP180_OUT_MSB + 2] = output & 0xff;
+    }
+
+    return 0;
+}
+
+static int bmp180Read(struct I2CSimDevice *device, uint8_t reg, uint8_t *data, uint8_t count) {
+    struct BMP180Model *model = (struct BMP180Model *)(device->state);
+    for (int i = 0; i < count; i++) {
+        data[i] = model->registers[reg++];
+    }
+    return 0;
+}
+
+void initBMP180Model(struct BMP180Model *model, struct I2CSimDevice *device, uint16_t address) {
+    memset(model, 0, sizeof(struct BMP180Model));
+    model->registers[BMP180_CHIP_ID] = 0x55;
+    for (int i = 0; i < 11; i++) {
+        uint16_t value = (uint16_t)(_bmp180Calibration[i]);
+        model->registers[BMP180_CALIBRATION + 2 * i] = value >> 8;
+        model->registers[BMP180_CALIBRATION + 2 * i + 1] = value & 0xff;
+    }
+    model->pressure = 101325;
+    model->uncompensatedTemperature = _bmp180ExampleTemperature;
+
+    device->address = address;
+    device->write = &bmp180Write;
+    device->read = &bmp180Read;
+    device->state = model;
+}
+
+void bmp180SetPressure(struct BMP180Model *model, double pressure) {
+    model->pressure = pressure;
+}
@@ -0,0 +1,150 @@
+// implementation for the GyroFilterBank header
+//
+// by Mark Hill
+
+#include<stdint.h>
+#include<math.h>
+#include<pthread.h>
+
+#include<atomic>
+
+#include<GyroFilterBank.h>
+#include<StreamFilters.h>
+#include<Eigen/Dense>
+
+using namespace Eigen;
+
+// the lowest notch centre in Hz, below which a notch would start eating into the motion
+//   of the vehicle itself
+static const double _minimumNotchFrequency = 20;
+// the highest notch centre as a fraction of the sample rate
+static const double _maximumNotchFraction = 0.45;
+
+// from the audio EQ cookbook by Robert Bristow-Johnson
+struct BiquadCoefficients notchBiquad(double sampleRate, double center, double q) {
+	double omega = 2 * M_PI * center / sampleRate;
+	double alpha = sin(omega) / (2 * q);
+	double cosOmega = cos(omega);
+	double a0 = 1 + alpha;
+
+	struct BiquadCoefficients c;
+	c.b0 = 1 / a0;
+	c.b1 = -2 * cosOmega / a0;
+	c.b2 = c.b0;
+	c.a1 = c.b1;
+	c.a2 = (1 - alpha) / a0;
+	return c;
+}
+
+int initGyroFilterBank(struct GyroFilterBank *bank, double sampleRate, double lowPassCutoff, \
+		int notchCount, double notchQ) {
+	if (notchCount < 0 || notchCount > GYRO_FILTER_MAX_NOTCHES)
+		return -1;
+
+	bank->sampleRate = sampleRate;
+	bank->notchQ = notchQ;
+	pthread_mutex_init(&bank->updateLock, NULL);
+
+	struct GyroFilterCoefficients *c = &bank->shared;
+	c->notchCount = notchCount;
+	c->lowPass = lowPassBiquad(sampleRate, lowPassCutoff, 0.7071);
+	for (int i = 0; i < GYRO_FILTER_MAX_NOTCHES; i++) {
+		c->notches[i] = notchBiquad(sampleRate, sampleRate / 4, notchQ);
+	}
+	bank->sequence.store(0, std::memory_order_relaxed);
+
+	bank->coefficients = bank->shared;
+	bank->coefficientSequence = 0;
+	for (int i = 0; i <= GYRO_FILTER_MAX_NOTCHES; i++) {
+		bank->z1[i] = FilterSample::Zero();
+		bank->z2[i] = FilterSample::Zero();
+	}
+
+	return 0;
+}
+
+void setGyroNotchFrequencies(struct GyroFilterBank *bank, const double *centers, int count) {
+	double maximum = _maximumNotchFraction * bank->sampleRate;
+
+	// the coefficients are computed before taking the lock so that the filtering
+	//   thread spends as little time as possible waiting on a rewrite
+	struct BiquadCoefficients notches[GYRO_FILTER_MAX_NOTCHES];
+	if (count > GYRO_FILTER_MAX_NOTCHES)
+		count = GYRO_FILTER_MAX_NOTCHES;
+	for (int i = 0; i < count; i++) {
+		double center = centers[i];
+		center = center < _minimumNotchFrequency ? _minimumNotchFrequency : center;
+		center = center > maximum ? maximum : center;
+		notches[i] = notchBiquad(bank->sampleRate, center, bank->notchQ);
+	}
+
+	pthread_mutex_lock(&bank->updateLock);
+	uint32_t sequence = bank->sequence.load(std::memory_order_relaxed);
+	bank->sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	for (int i = 0; i < count; i++) {
+		bank->shared.notches[i] = notches[i];
+	}
+
+	bank->sequence.store(sequence + 2, std::memory_order_release);
+	pthread_mutex_unlock(&bank->updateLock);
+}
+
+// copies the shared coefficients if they changed since the last copy
+// keeps the old coefficients if a rewrite is in progress, they will be picked up
+//   on the next call
+static void refreshCoefficients(struct GyroFilterBank *bank) {
+	uint32_t sequence = bank->sequence.load(std::memory_order_acquire);
+	if (sequence == bank->coefficientSequence || (sequence & 1))
+		return;
+
+	struct GyroFilterCoefficients copy = bank->shared;
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (bank->sequence.load(std::memory_order_relaxed) != sequence)
+		return;
+
+	bank->coefficients = copy;
+	bank->coefficientSequence = sequence;
+}
+
+// sets the state of a section with unity gain at DC as if value had been filtered forever
+static void settleSection(const struct BiquadCoefficients *c, FilterSample value, \
+		FilterSample *z1, FilterSample *z2) {
+	*z1 = (1 - c->b0) * value;
+	*z2 = (c->b2 - c->a2) * value;
+}
+
+void settleGyroFilterBank(struct GyroFilterBank *bank, FilterSample value) {
+	refreshCoefficients(bank);
+
+	const struct GyroFilterCoefficients *c = &bank->coefficients;
+	settleSection(&c->lowPass, value, &bank->z1[0], &bank->z2[0]);
+	for (int i = 0; i < c->notchCount; i++) {
+		settleSection(&c->notches[i], value, &bank->z1[i + 1], &bank->z2[i + 1]);
+	}
+}
+
+void gyroFilterBankProcess(struct GyroFilterBank *bank, FilterSample *samples, int count) {
+	refreshCoefficients(bank);
+
+	const struct GyroFilterCoefficients *c = &bank->coefficients;
+	int sections = c->notchCount + 1;
+	const struct BiquadCoefficients *section[GYRO_FILTER_MAX_NOTCHES + 1];
+	section[0] = &c->lowPass;
+	for (int i = 1; i < sections; i++) {
+		section[i] = &c->notches[i - 1];
+	}
+
+	for (int i = 0; i < count; i++) {
+		FilterSample x = samples[i];
+		for (int j = 0; j < sections; j++) {
+			const struct BiquadCoefficients *s = section[j];
+			FilterSample y = s->b0 * x + bank->z1[j];
+			bank->z1[j] = s->b1 * x - s->a1 * y + bank->z2[j];
+			bank->z2[j] = s->b2 * x - s->a2 * y;
+			x = y;
+		}
+		samples[i] = x;
+	}
+}
@@ -0,0 +1,76 @@
+// implementation for the RealFFT header
+//
+// a real transform of size N is done as a complex transform of size N / 2 on the even
+//   values as the real parts and the odd values as the imaginary parts, after which the
+//   two interleaved spectra are separated and combined into the real spectrum
+//
+// by Mark Hill
+
+#include<stdint.h>
+#include<math.h>
+
+#include<complex>
+
+#include<RealFFT.h>
+
+using namespace std;
+
+int initRealFFT(struct RealFFT *fft, int size) {
+	if (size < 4 || size > REAL_FFT_MAX_SIZE || (size & (size - 1)))
+		return -1;
+
+	fft->size = size;
+	int half = size / 2;
+
+	for (int k = 0; k < half; k++) {
+		fft->twiddles[k] = polar(1.0, -2 * M_PI * k / size);
+	}
+
+	int bits = 0;
+	while ((1 << bits) < half)
+		bits++;
+	for (int i = 0; i < half; i++) {
+		int reversed = 0;
+		for (int b = 0; b < bits; b++) {
+			reversed |= ((i >> b) & 1) << (bits - 1 - b);
+		}
+		fft->reversed[i] = reversed;
+	}
+
+	return 0;
+}
+
+void realFFT(struct RealFFT *fft, const double *input, complex<double> *spectrum) {
+	int size = fft->size;
+	int half = size / 2;
+	complex<double> *z = fft->work;
+
+	// pack pairs of real values into complex values in bit reversed order
+	for (int i = 0; i < half; i++) {
+		z[fft->reversed[i]] = complex<double>(input[2 * i], input[2 * i + 1]);
+	}
+
+	// iterative radix-2 decimation in time butterflies
+	// the half size transform uses every other twiddle of the full size table
+	for (int length = 2; length <= half; length *= 2) {
+		int stride = size / length;
+		for (int start = 0; start < half; start += length) {
+			for (int k = 0; k < length / 2; k++) {
+				complex<double> even = z[start + k];
+				complex<double> odd = fft->twiddles[k * stride] * z[start + k + length / 2];
+				z[start + k] = even + odd;
+				z[start + k + length / 2] = even - odd;
+			}
+		}
+	}
+
+	// separate the spectra of the even and odd values and combine them
+	for (int k = 0; k <= half; k++) {
+		complex<double> a = z[k % half];
+		complex<double> b = conj(z[(half - k) % half]);
+		complex<double> evens = (a + b) * 0.5;
+		complex<double> odds = (a - b) * complex<double>(0, -0.5);
+		complex<double> twiddle = k < half ? fft->twiddles[k] : complex<double>(-1, 0);
+		spectrum[k] = evens + twiddle * odds;
+	}
+}
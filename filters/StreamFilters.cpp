@@ -0,0 +1,119 @@
+// implementation for the StreamFilters header
+//
+// by Mark Hill
+
+#include<stdint.h>
+#include<math.h>
+
+#include<StreamFilters.h>
+#include<Eigen/Dense>
+
+using namespace Eigen;
+
+
+// running mean
+
+void resetRunningMean(struct RunningMean *mean) {
+	mean->sum = FilterSample::Zero();
+	mean->count = 0;
+}
+
+void addToRunningMean(struct RunningMean *mean, const FilterSample *samples, int count) {
+	FilterSample sum = FilterSample::Zero();
+	for (int i = 0; i < count; i++) {
+		sum += samples[i];
+	}
+	mean->sum += sum;
+	mean->count += count;
+}
+
+FilterSample runningMean(const struct RunningMean *mean) {
+	if (mean->count == 0)
+		return FilterSample::Zero();
+	return mean->sum / (double)(mean->count);
+}
+
+
+// biquad
+
+// from the audio EQ cookbook by Robert Bristow-Johnson
+struct BiquadCoefficients lowPassBiquad(double sampleRate, double cutoff, double q) {
+	double omega = 2 * M_PI * cutoff / sampleRate;
+	double alpha = sin(omega) / (2 * q);
+	double cosOmega = cos(omega);
+	double a0 = 1 + alpha;
+
+	struct BiquadCoefficients c;
+	c.b0 = (1 - cosOmega) / 2 / a0;
+	c.b1 = (1 - cosOmega) / a0;
+	c.b2 = c.b0;
+	c.a1 = -2 * cosOmega / a0;
+	c.a2 = (1 - alpha) / a0;
+	return c;
+}
+
+
+// CIC decimator
+
+// the fewest fraction bits the decimator accepts, about 15 microunits of resolution
+static const int _cicMinimumFraction = 16;
+
+int initCICDecimator(struct CICDecimator *cic, int order, int rate) {
+	if (order < 1 || order > CIC_MAX_ORDER || rate < 1)
+		return -1;
+
+	// the output of the combs grows by rate^order over the input, and has to fit in a
+	//   signed 64 bit value with a bit to spare, along with the integer part of the input
+	int growth = (int)ceil(order * log2((double)rate));
+	int fraction = 62 - (int)log2(CIC_INPUT_LIMIT) - growth;
+	if (fraction < _cicMinimumFraction)
+		return -1;
+
+	cic->order = order;
+	cic->rate = rate;
+	cic->phase = 0;
+	cic->scale = ldexp(1, fraction);
+	cic->gain = 1 / (pow(rate, order) * cic->scale);
+	for (int i = 0; i < CIC_MAX_ORDER; i++) {
+		cic->integrators[i] = CICRegister::Zero();
+		cic->combs[i] = CICRegister::Zero();
+	}
+	return 0;
+}
+
+int cicDecimate(struct CICDecimator *cic, FilterSample *samples, int count) {
+	int outputs = 0;
+
+	for (int i = 0; i < count; i++) {
+		// integrators run at the input rate, in unsigned arithmetic so they wrap
+		CICRegister value = (samples[i].max(-CIC_INPUT_LIMIT).min(CIC_INPUT_LIMIT) * \
+				cic->scale).round().cast<int64_t>().cast<uint64_t>();
+		for (int j = 0; j < cic->order; j++) {
+			cic->integrators[j] += value;
+			value = cic->integrators[j];
+		}
+
+		if (++cic->phase < cic->rate)
+			continue;
+		cic->phase = 0;
+
+		// combs run at the output rate
+		for (int j = 0; j < cic->order; j++) {
+			CICRegister previous = cic->combs[j];
+			cic->combs[j] = value;
+			value -= previous;
+		}
+
+		// outputs never get ahead of inputs, so writing in place is safe
+		samples[outputs++] = value.cast<int64_t>().cast<double>() * cic->gain;
+	}
+
+	return outputs;
+}
+
+void settleCICDecimator(struct CICDecimator *cic, FilterSample value) {
+	for (int i = 0; i < cic->order * cic->rate; i++) {
+		FilterSample sample = value;
+		cicDecimate(cic, &sample, 1);
+	}
+}
@@ -0,0 +1,228 @@
+// implementation for the VibrationAnalyzer header
+//
+// by Mark Hill
+
+#include<stdint.h>
+#include<stdio.h>
+#include<math.h>
+#include<unistd.h>
+#include<sched.h>
+#include<pthread.h>
+#include<sys/resource.h>
+#include<sys/syscall.h>
+
+#include<atomic>
+#include<complex>
+
+#include<VibrationAnalyzer.h>
+#include<RealFFT.h>
+#include<SampleRing.h>
+#include<LoopTiming.h>
+#include<Clock.h>
+
+using namespace std;
+
+// defaults for the peak search
+static const double _defaultMinimumFrequency = 20;
+static const double _defaultRelativeThreshold = 0.2;
+
+// how well the analyzer threads keep their interval
+static struct LoopTiming _analyzerTiming;
+
+int initVibrationAnalyzer(struct VibrationAnalyzer *analyzer, struct SampleRing *ring, \
+		uint32_t interval) {
+	if (initRealFFT(&analyzer->fft, VIBRATION_WINDOW_SIZE))
+		return -1;
+
+	analyzer->ring = ring;
+	analyzer->interval = interval;
+	analyzer->minimumFrequency = _defaultMinimumFrequency;
+	analyzer->relativeThreshold = _defaultRelativeThreshold;
+	analyzer->shared.count = 0;
+	analyzer->shared.time = 0;
+	analyzer->sequence.store(0, std::memory_order_relaxed);
+	analyzer->running = 0;
+	analyzer->finished = 1;
+
+	// hann window, which keeps the leakage from the strong low frequency motion of the
+	//   vehicle from hiding the vibration peaks
+	for (int i = 0; i < VIBRATION_WINDOW_SIZE; i++) {
+		analyzer->window[i] = 0.5 - 0.5 * cos(2 * M_PI * i / (VIBRATION_WINDOW_SIZE - 1));
+	}
+
+	return 0;
+}
+
+// publishes peaks so that newVibrationPeaks() can pick them up
+static void publishPeaks(struct VibrationAnalyzer *analyzer, const struct VibrationPeaks *peaks) {
+	uint32_t sequence = analyzer->sequence.load(std::memory_order_relaxed);
+	analyzer->sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	analyzer->shared = *peaks;
+
+	analyzer->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+int analyzeVibration(struct VibrationAnalyzer *analyzer) {
+	const int size = VIBRATION_WINDOW_SIZE;
+	const int bins = size / 2 + 1;
+
+	uint64_t count = sampleCount(analyzer->ring);
+	if (count < (uint64_t)size)
+		return -1;
+	if (readSamples(analyzer->ring, count - size, analyzer->samples, size) < size)
+		return -1;
+
+	double span = analyzer->samples[size - 1].time - analyzer->samples[0].time;
+	if (span <= 0)
+		return -1;
+	double sampleRate = (size - 1) / span;
+
+	// scales the bins to the amplitude of a sine wave at that frequency
+	double windowSum = 0;
+	for (int i = 0; i < size; i++) {
+		windowSum += analyzer->window[i];
+	}
+	double scale = 2 / windowSum;
+
+	// sum the amplitude spectra of the three axes
+	double *amplitude = analyzer->amplitudes;
+	for (int k = 0; k < bins; k++) {
+		amplitude[k] = 0;
+	}
+	for (int axis = 0; axis < 3; axis++) {
+		double mean = 0;
+		for (int i = 0; i < size; i++) {
+			mean += analyzer->samples[i].value(axis);
+		}
+		mean /= size;
+
+		for (int i = 0; i < size; i++) {
+			analyzer->input[i] = (analyzer->samples[i].value(axis) - mean) * analyzer->window[i];
+		}
+		realFFT(&analyzer->fft, analyzer->input, analyzer->spectrum);
+
+		for (int k = 0; k < bins; k++) {
+			amplitude[k] += abs(analyzer->spectrum[k]) * scale;
+		}
+	}
+
+	// find the strongest local maxima, kept sorted strongest first
+	struct VibrationPeaks peaks;
+	peaks.time = analyzer->samples[size - 1].time;
+	peaks.count = 0;
+	int firstBin = (int)(ceil(analyzer->minimumFrequency * size / sampleRate));
+	firstBin = firstBin < 1 ? 1 : firstBin;
+
+	for (int k = firstBin; k < bins - 1; k++) {
+		if (amplitude[k] <= amplitude[k - 1] || amplitude[k] < amplitude[k + 1])
+			continue;
+
+		// fits a parabola through the peak and its neighbours for a frequency that is
+		//   not limited to the bin spacing
+		double below = amplitude[k - 1], peak = amplitude[k], above = amplitude[k + 1];
+		double curvature = below - 2 * peak + above;
+		double offset = curvature != 0 ? 0.5 * (below - above) / curvature : 0;
+		double frequency = (k + offset) * sampleRate / size;
+
+		int position = peaks.count < VIBRATION_MAX_PEAKS ? peaks.count : VIBRATION_MAX_PEAKS;
+		while (position > 0 && peaks.magnitudes[position - 1] < peak) {
+			if (position < VIBRATION_MAX_PEAKS) {
+				peaks.frequencies[position] = peaks.frequencies[position - 1];
+				peaks.magnitudes[position] = peaks.magnitudes[position - 1];
+			}
+			position--;
+		}
+		if (position < VIBRATION_MAX_PEAKS) {
+			peaks.frequencies[position] = frequency;
+			peaks.magnitudes[position] = peak;
+			if (peaks.count < VIBRATION_MAX_PEAKS)
+				peaks.count++;
+		}
+	}
+
+	// drop the peaks that are small compared to the strongest one
+	for (int i = 1; i < peaks.count; i++) {
+		if (peaks.magnitudes[i] < analyzer->relativeThreshold * peaks.magnitudes[0]) {
+			peaks.count = i;
+			break;
+		}
+	}
+
+	publishPeaks(analyzer, &peaks);
+	return 0;
+}
+
+int newVibrationPeaks(struct VibrationAnalyzer *analyzer, struct VibrationPeaks *peaks, \
+		uint32_t *sequence) {
+	uint32_t current = analyzer->sequence.load(std::memory_order_acquire);
+	if (current == *sequence || (current & 1))
+		return -1;
+
+	struct VibrationPeaks copy = analyzer->shared;
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (analyzer->sequence.load(std::memory_order_relaxed) != current)
+		return -1;
+
+	*peaks = copy;
+	*sequence = current;
+	return 0;
+}
+
+// runs a frame every interval until stopped
+// the thread asks for the idle scheduling class so it only gets the processor time the
+//   sensor and control threads leave over, falling back to the lowest nice value
+static void *analyzerThread(void *input) {
+	struct VibrationAnalyzer *analyzer = (struct VibrationAnalyzer *)(input);
+
+	struct sched_param parameters = {};
+	if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &parameters)) {
+		setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+	}
+
+	struct LoopClock clock;
+	initLoopClock(&clock, &_analyzerTiming, "vibration analyzer", \
+			analyzer->interval / 1000000.0);
+	double wakeTime = monotonicTime();
+
+	while (analyzer->running) {
+		loopStart(&_analyzerTiming, &clock, wakeTime);
+		analyzeVibration(analyzer);
+		loopEnd(&_analyzerTiming, &clock);
+
+		wakeTime = monotonicTime() + analyzer->interval / 1000000.0;
+		sleepFor(analyzer->interval / 1000000.0);
+	}
+
+	analyzer->finished = 1;
+	return NULL;
+}
+
+int startVibrationAnalyzer(struct VibrationAnalyzer *analyzer) {
+	if (analyzer->running)
+		return 0;
+
+	analyzer->running = 1;
+	analyzer->finished = 0;
+	if (createClockThread(&analyzer->thread, NULL, &analyzerThread, analyzer)) {
+		printf("failed to create vibration analyzer thread\n");
+		analyzer->running = 0;
+		return -1;
+	}
+
+	return 0;
+}
+
+void stopVibrationAnalyzer(struct VibrationAnalyzer *analyzer) {
+	if (!analyzer->running)
+		return;
+
+	analyzer->running = 0;
+	// on the virtual clock the thread only wakes up to see it should stop while this one
+	//   sleeps on the clock, so joining right away would never return (see Clock.h)
+	while (!analyzer->finished) {
+		sleepFor(analyzer->interval / 1000000.0);
+	}
+	pthread_join(analyzer->thread, NULL);
+}
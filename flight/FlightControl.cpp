@@ -0,0 +1,219 @@
+// implementation for the FlightControl header
+//
+// by Mark Hill
+
+#include<stdio.h>
+#include<stdint.h>
+#include<math.h>
+
+#include<Eigen/Dense>
+
+#include<FlightControl.h>
+#include<SampleRing.h>
+
+using namespace Eigen;
+
+// starting gains, tuned on the simulated vehicle (see QuadDynamics.h), which will need
+//   tuning on the real one
+// the velocity loop takes m/s and gives a tilt in radians, the attitude gain turns radians
+//   of attitude error into rad/s, the rate loop takes rad/s and gives the angular motion
+//   vector from -1 to 1 (see MotorController.h), and the climb loop takes m/s and gives
+//   thrust from 0 to 1
+static const double _velocityKp = 0.2;
+static const double _velocityKi = 0.02;
+static const double _velocityKd = 0.06;
+static const double _velocityIntegralLimit = 0.1;
+static const double _maximumSpeed = 2;
+static const double _maximumTilt = 0.35;
+
+static const double _rateKp = 0.1;
+static const double _rateKi = 0.2;
+static const double _rateKd = 0.002;
+static const double _rateIntegralLimit = 0.2;
+static const double _rateOutputLimit = 0.5;
+static const double _attitudeGain = 4;
+static const double _maximumRate = 3;
+static const double _maximumYawRate = 2;
+
+static const double _climbKp = 0.25;
+static const double _climbKi = 0.1;
+static const double _climbIntegralLimit = 0.3;
+static const double _climbOutputLimit = 0.4;
+static const double _maximumClimbRate = 1.5;
+static const double _hoverThrust = 0.5;
+
+// the thrust is raised to make up for the lift lost by tilting, but never by more than
+//   dividing by this
+static const double _minimumTiltCosine = 0.7;
+// keeps the angular command strictly inside the unit sphere
+static const double _maximumAngularCommand = 0.999;
+
+static void initPID(struct PIDController *pid, double kp, double ki, double kd, \
+		double integralLimit, double outputLimit) {
+	*pid = PIDController();
+	pid->kp = kp;
+	pid->ki = ki;
+	pid->kd = kd;
+	pid->integralLimit = integralLimit;
+	pid->outputLimit = outputLimit;
+}
+
+static void resetPID(struct PIDController *pid) {
+	pid->integral = 0;
+	pid->previousMeasurement = 0;
+	pid->primed = 0;
+}
+
+static double clamp(double value, double limit) {
+	return value > limit ? limit : (value < -limit ? -limit : value);
+}
+
+void initFlightControl(struct FlightControl *control, double rate) {
+	control->rate = rate;
+
+	for (int axis = 0; axis < 3; axis++) {
+		initPID(&control->ratePID[axis], _rateKp, _rateKi, _rateKd, \
+				_rateIntegralLimit, _rateOutputLimit);
+	}
+	control->attitudeGain = _attitudeGain;
+	control->maximumRate = _maximumRate;
+	control->maximumYawRate = _maximumYawRate;
+
+	for (int axis = 0; axis < 2; axis++) {
+		initPID(&control->velocityPID[axis], _velocityKp, _velocityKi, _velocityKd, \
+				_velocityIntegralLimit, _maximumTilt);
+	}
+	control->maximumSpeed = _maximumSpeed;
+	control->maximumTilt = _maximumTilt;
+	control->velocityHold = 0;
+
+	initPID(&control->climbPID, _climbKp, _climbKi, 0, _climbIntegralLimit, _climbOutputLimit);
+	control->maximumClimbRate = _maximumClimbRate;
+	control->hoverThrust = _hoverThrust;
+
+	resetFlightControl(control, Vector3d(0, 0, 1), Vector3d(0, 0, 0));
+}
+
+void resetFlightControl(struct FlightControl *control, const Vector3d &levelGravity, \
+		const Vector3d &drift) {
+	for (int axis = 0; axis < 3; axis++) {
+		resetPID(&control->ratePID[axis]);
+	}
+	for (int axis = 0; axis < 2; axis++) {
+		resetPID(&control->velocityPID[axis]);
+	}
+	resetPID(&control->climbPID);
+
+	double length = levelGravity.norm();
+	control->levelGravity = length > 0 ? Vector3d(levelGravity / length) : Vector3d(0, 0, 1);
+	control->drift = drift;
+
+	// the first read skips ahead to the newest samples
+	control->gyroIndex = 0;
+	control->rotation = Vector3d(0, 0, 0);
+	control->velocityTarget = Vector3d(0, 0, 0);
+	control->tiltTarget = Vector3d(0, 0, 0);
+	control->rateTarget = Vector3d(0, 0, 0);
+	control->angularCommand = Vector3d(0, 0, 0);
+	control->thrust = 0;
+}
+
+void clearIntegrators(struct FlightControl *control) {
+	for (int axis = 0; axis < 3; axis++) {
+		control->ratePID[axis].integral = 0;
+	}
+	for (int axis = 0; axis < 2; axis++) {
+		control->velocityPID[axis].integral = 0;
+	}
+	control->climbPID.integral = 0;
+}
+
+// the derivative is taken on the measurement rather than the error, so a step in the
+//   setpoint does not kick the output
+double pidUpdate(struct PIDController *pid, double setpoint, double measurement, double dt) {
+	double error = setpoint - measurement;
+
+	double derivative = 0;
+	if (pid->primed && dt > 0)
+		derivative = (measurement - pid->previousMeasurement) / dt;
+	pid->previousMeasurement = measurement;
+	pid->primed = 1;
+
+	// clamping the integral keeps it from winding up while the output is saturated
+	pid->integral = clamp(pid->integral + pid->ki * error * dt, pid->integralLimit);
+
+	return clamp(pid->kp * error + pid->integral - pid->kd * derivative, pid->outputLimit);
+}
+
+int readRotation(struct FlightControl *control, struct SampleRing *ring) {
+	uint64_t count = sampleCount(ring);
+	if (count <= control->gyroIndex)
+		return 0;
+
+	uint64_t first = control->gyroIndex;
+	if (count - first > FLIGHT_GYRO_BATCH)
+		first = count - FLIGHT_GYRO_BATCH;
+	int read = readSamples(ring, first, control->gyroBatch, (int)(count - first));
+	control->gyroIndex = count;
+	if (read <= 0)
+		return 0;
+
+	Vector3d sum(0, 0, 0);
+	for (int i = 0; i < read; i++) {
+		sum += control->gyroBatch[i].value;
+	}
+	control->rotation = sum / read - control->drift;
+
+	return read;
+}
+
+// seen from the body, gravity turns by itself crossed with the rotation, so rotating at
+//   the wanted gravity crossed with gravity moves gravity straight towards the wanted
+//   one, at a rate proportional to the angle between them while it is small
+void flightControlStep(struct FlightControl *control, const Vector3d &gravity, \
+		const Vector3d &horizontalVelocity, double climbRate, const Vector3d &velocity, \
+		double yaw, double dt) {
+	double length = gravity.norm();
+	Vector3d measured = length > 0 ? Vector3d(gravity / length) : control->levelGravity;
+
+	// tilting towards a direction accelerates the vehicle that way, so the velocity loop
+	//   asks for a tilt, and the integral makes up for the drag at a steady velocity
+	for (int axis = 0; axis < 2; axis++) {
+		if (control->velocityHold) {
+			control->velocityTarget(axis) = control->maximumSpeed * clamp(velocity(axis), 1);
+			control->tiltTarget(axis) = pidUpdate(&control->velocityPID[axis], \
+					control->velocityTarget(axis), horizontalVelocity(axis), dt);
+		}
+		else {
+			control->velocityTarget(axis) = 0;
+			control->tiltTarget(axis) = control->maximumTilt * clamp(velocity(axis), 1);
+		}
+	}
+
+	// moving forward pitches the vehicle forward and moving left rolls it left, as
+	//   updateMotion() in the MotorController does, and gravity seen from the body tilts
+	//   the opposite way
+	Vector3d wanted = AngleAxisd(-control->tiltTarget(0), Vector3d::UnitY()) * \
+			AngleAxisd(control->tiltTarget(1), Vector3d::UnitX()) * \
+			control->levelGravity;
+
+	Vector3d error = wanted.cross(measured);
+	control->rateTarget(0) = clamp(control->attitudeGain * error(0), control->maximumRate);
+	control->rateTarget(1) = clamp(control->attitudeGain * error(1), control->maximumRate);
+	control->rateTarget(2) = control->maximumYawRate * clamp(yaw, 1);
+
+	for (int axis = 0; axis < 3; axis++) {
+		control->angularCommand(axis) = pidUpdate(&control->ratePID[axis], \
+				control->rateTarget(axis), control->rotation(axis), dt);
+	}
+	double magnitude = control->angularCommand.norm();
+	if (magnitude > _maximumAngularCommand)
+		control->angularCommand *= _maximumAngularCommand / magnitude;
+
+	double climbTarget = control->maximumClimbRate * clamp(velocity(2), 1);
+	double thrust = control->hoverThrust + \
+			pidUpdate(&control->climbPID, climbTarget, climbRate, dt);
+	double cosine = measured.dot(control->levelGravity);
+	thrust /= cosine > _minimumTiltCosine ? cosine : _minimumTiltCosine;
+	control->thrust = thrust < 0 ? 0 : (thrust > 1 ? 1 : thrust);
+}
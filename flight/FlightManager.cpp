@@ -1,40 +1,385 @@
 // controls the flight operations at a high level
 // takes input vectors and attempts to set the device's velocity to math the input vectors
 // uses data from the avionics library (Orientation) to calculate and improve results
+//
+// a fixed rate control thread runs the loops in FlightControl.h, reading the gyroscope
+//   straight from its sample ring and the fused orientation from mailboxes, and posts the
+//   results to the MotorController's output stage
+// nothing on that thread allocates, locks or prints, so the completion handlers are
+//   called from the orientation listener thread instead
 
+#include<stdio.h>
 #include<stdint.h>
+#include<math.h>
+#include<float.h>
 #include<unistd.h>
+#include<pthread.h>
 
-#include <FlightManager.h>
-#include <Orientation.h>
-#include <MotorController.h>
+#include<atomic>
 
+#include<FlightManager.h>
+#include<FlightControl.h>
+#include<Orientation.h>
+#include<SampleRing.h>
+#include<MotorController.h>
+#include<VectorMailbox.h>
+#include<RealTime.h>
+#include<Blackbox.h>
+#include<LoopTiming.h>
+#include<Clock.h>
 
-struct Orientation desiredOrientation = {};
-struct Orientation currentOrientation = {};
+// the rate of the control loop in Hz
+static const double _controlRate = 500;
+// the rate the orientation listener passes on the fused orientation in Hz
+static const uint16_t _orientationRate = 400;
 
-// flag that indicates whether drone is in flight
-static int inFlight = 0;
+// how far a takeoff climbs in meters
+static const double _takeOffHeight = 1;
+// the takeoff slows down over this many meters below the height, so the vehicle stops
+//   there instead of climbing past it, and finishes once this close to the height
+static const double _takeOffSlowingHeight = 0.4;
+static const double _takeOffTolerance = 0.05;
+// the slowest takeoff climb and the landing descent, as fractions of the maximum climb rate
+static const double _minimumTakeOffRate = 0.1;
+static const double _landingRate = 0.3;
+// the vehicle has touched down once, after descending faster than _descendingClimbRate
+//   in m/s, it has been moving slower than _landedClimbRate for _touchdownTime seconds
+//   while still asked to descend
+static const double _descendingClimbRate = 0.2;
+static const double _landedClimbRate = 0.1;
+static const double _touchdownTime = 0.2;
+// after touching down the thrust is brought to idle over this many seconds, and the
+//   vehicle has landed once it is there
+static const double _idleRampTime = 0.5;
+// a velocity update completes once the horizontal speed and climb rate are within this
+//   fraction of their maximum of the target
+static const double _velocityTolerance = 0.1;
 
+enum FlightPhase {
+	FLIGHT_LANDED,
+	FLIGHT_TAKING_OFF,
+	FLIGHT_FLYING,
+	FLIGHT_LANDING,
+};
 
-// completion handler for orientation updates
+// a completion handler waiting on the control thread
+// the control thread only sets finishTime, and the orientation listener calls the handler
+struct Completion {
+	std::atomic<void (*)(double)> handler;
+	double startTime;
+	// the time the wait finished, 0 while it has not
+	std::atomic<double> finishTime;
+};
+
+// the progress of a landing, only touched by the control thread
+struct Landing {
+	// set once the vehicle has started descending, since it is still before that too
+	int descending;
+	// how long the vehicle has been still while descending, in seconds
+	double stillTime;
+	// the thrust when the vehicle touched down and the time since, thrust 0 before
+	double touchdownThrust;
+	double rampTime;
+};
+
+// the state of the control loops, only touched by the control thread while in flight
+static struct FlightControl _control;
+static std::atomic<int> _phase(FLIGHT_LANDED);
+// the altitude the takeoff started from and its climb command, set before leaving
+//   FLIGHT_LANDED
+static double _takeOffAltitude = 0;
+static double _takeOffRate = 0;
+
+// the newest fused gravity vector, horizontal velocity, and altitude, climb rate and
+//   heading
+static struct VectorMailbox _gravity;
+static struct VectorMailbox _horizontal;
+static struct VectorMailbox _vertical;
+// the velocity command and the angular velocity command
+static struct VectorMailbox _velocityTarget;
+static struct VectorMailbox _angularTarget;
+
+static struct Completion _takeOffCompletion;
+static struct Completion _landCompletion;
+static struct Completion _velocityCompletion;
+static struct Completion _angularCompletion;
+
+// the lateness, compute time and period of the control loop
+static struct LoopTiming _controlTiming;
+
+static pthread_t _controlThread;
+static std::atomic<int> _controlRunning(0);
+
+
+// starts waiting for handler, replacing any handler still waiting
+static void beginCompletion(struct Completion *completion, void (*handler)(double)) {
+	completion->handler.store(NULL, std::memory_order_relaxed);
+	completion->finishTime.store(0, std::memory_order_relaxed);
+	completion->startTime = monotonicTime();
+	completion->handler.store(handler, std::memory_order_release);
+}
+
+// marks the wait as finished, if it has not already
+static void finishCompletion(struct Completion *completion, double time) {
+	if (completion->finishTime.load(std::memory_order_relaxed) == 0)
+		completion->finishTime.store(time, std::memory_order_release);
+}
+
+// returns whether a handler is waiting on completion
+static int awaitingCompletion(struct Completion *completion) {
+	return completion->handler.load(std::memory_order_acquire) != NULL && \
+		completion->finishTime.load(std::memory_order_relaxed) == 0;
+}
+
+// calls the handler if the wait has finished
+static void runCompletion(struct Completion *completion) {
+	double finishTime = completion->finishTime.load(std::memory_order_acquire);
+	if (finishTime <= 0)
+		return;
+
+	void (*handler)(double) = completion->handler.exchange(NULL, std::memory_order_acquire);
+	if (handler != NULL)
+		handler(finishTime - completion->startTime);
+}
+
+// runs one cycle of the control loops at time now, dt seconds after the last
+// phase is what the loop ran in the last cycle, so entering a new phase can be noticed
+static void controlCycle(double now, double dt, int *phase, struct Landing *landing) {
+	int current = _phase.load(std::memory_order_acquire);
+	int previous = *phase;
+	*phase = current;
+	if (current == FLIGHT_LANDED) {
+		// stops the motors once on landing
+		if (previous != FLIGHT_LANDED) {
+			setAngularMotionVector(Vector3d(0, 0, 0));
+			setLinearMotionVector(Vector3d(0, 0, 0));
+		}
+		return;
+	}
+
+	Vector3d gravity(0, 0, 0), horizontal(0, 0, 0), vertical(0, 0, 0), velocity(0, 0, 0), \
+			angular(0, 0, 0);
+	uint64_t sequence;
+	latestVector(&_gravity, &gravity, &sequence);
+	latestVector(&_horizontal, &horizontal, &sequence);
+	latestVector(&_vertical, &vertical, &sequence);
+	latestVector(&_angularTarget, &angular, &sequence);
+	double altitude = vertical(0);
+	double climbRate = vertical(1);
+
+	readRotation(&_control, filteredGyroSamples());
+
+	if (current == FLIGHT_TAKING_OFF) {
+		double remaining = _takeOffHeight - (altitude - _takeOffAltitude);
+		velocity(2) = remaining < _takeOffSlowingHeight ? \
+				_takeOffRate * (remaining > 0 ? remaining : 0) / _takeOffSlowingHeight : _takeOffRate;
+		// land() may have been called meanwhile, which wins
+		int expected = FLIGHT_TAKING_OFF;
+		if (remaining <= _takeOffTolerance && \
+				_phase.compare_exchange_strong(expected, FLIGHT_FLYING)) {
+			finishCompletion(&_takeOffCompletion, now);
+		}
+	}
+	else if (current == FLIGHT_FLYING) {
+		latestVector(&_velocityTarget, &velocity, &sequence);
+	}
+	else if (current == FLIGHT_LANDING) {
+		if (previous != FLIGHT_LANDING)
+			*landing = Landing();
+		velocity(2) = -_landingRate;
+	}
+
+	if (landing->touchdownThrust > 0) {
+		// on the ground the loops are only fighting it, so they are held while the thrust
+		//   winds down
+		clearIntegrators(&_control);
+		landing->rampTime += dt;
+		double left = 1 - landing->rampTime / _idleRampTime;
+		_control.angularCommand = Vector3d(0, 0, 0);
+		_control.thrust = left > 0 ? landing->touchdownThrust * left : 0;
+	}
+	else {
+		flightControlStep(&_control, gravity, horizontal, climbRate, velocity, angular(2), dt);
+	}
+	setAngularMotionVector(_control.angularCommand);
+	setLinearMotionVector(Vector3d(0, 0, _control.thrust));
+
+	double setpoint[6] = {velocity(0), velocity(1), velocity(2), \
+			_control.rateTarget(0), _control.rateTarget(1), _control.rateTarget(2)};
+	blackboxRecord(BLACKBOX_SETPOINT, now, setpoint, 6);
+	double output[4] = {_control.angularCommand(0), _control.angularCommand(1), \
+			_control.angularCommand(2), _control.thrust};
+	blackboxRecord(BLACKBOX_CONTROL, now, output, 4);
+
+	if (current == FLIGHT_FLYING) {
+		double climbError = climbRate - _control.maximumClimbRate * velocity(2);
+		double speedError = _control.velocityHold ? \
+				(horizontal - _control.velocityTarget).head<2>().norm() : 0;
+		if (awaitingCompletion(&_velocityCompletion) && \
+				speedError < _velocityTolerance * _control.maximumSpeed && \
+				fabs(climbError) < _velocityTolerance * _control.maximumClimbRate) {
+			finishCompletion(&_velocityCompletion, now);
+		}
+		double yawError = _control.rotation(2) - _control.rateTarget(2);
+		if (awaitingCompletion(&_angularCompletion) && \
+				fabs(yawError) < _velocityTolerance * _control.maximumYawRate) {
+			finishCompletion(&_angularCompletion, now);
+		}
+	}
+	else if (current == FLIGHT_LANDING) {
+		// stopping while asked to descend means the ground is in the way
+		if (climbRate < -_descendingClimbRate)
+			landing->descending = 1;
+		if (landing->descending && fabs(climbRate) < _landedClimbRate)
+			landing->stillTime += dt;
+		else
+			landing->stillTime = 0;
+
+		if (landing->touchdownThrust == 0 && landing->stillTime >= _touchdownTime) {
+			landing->touchdownThrust = _control.thrust > 0 ? _control.thrust : DBL_MIN;
+			landing->rampTime = 0;
+		}
+		// falling means it was not the ground after all, so the descent carries on
+		else if (landing->touchdownThrust > 0 && climbRate < -_descendingClimbRate) {
+			landing->touchdownThrust = 0;
+			landing->stillTime = 0;
+		}
+
+		int expected = FLIGHT_LANDING;
+		if (landing->touchdownThrust > 0 && landing->rampTime >= _idleRampTime && \
+				_phase.compare_exchange_strong(expected, FLIGHT_LANDED)) {
+			finishCompletion(&_landCompletion, now);
+		}
+	}
+}
+
+// runs controlCycle() at _controlRate until stopped, measuring the time between cycles
+//   and the time each takes
+// sleeps until an absolute deadline so the period does not drift with the compute time
+static void *controlLoop(void *input) {
+	makeRealTimeThread(REAL_TIME_CONTROL);
+
+	double target = 1 / _controlRate;
+	int phase = FLIGHT_LANDED;
+	struct Landing landing = Landing();
+
+	struct LoopClock clock;
+	initLoopClock(&clock, &_controlTiming, "flight control", target);
+
+	double deadline = monotonicTime();
+
+	while (_controlRunning.load(std::memory_order_acquire)) {
+		loopStart(&_controlTiming, &clock, deadline);
+		double elapsed = clock.previous > 0 ? clock.start - clock.previous : target;
+		// a late cycle should not make the integrators jump
+		double dt = elapsed > 2 * target ? 2 * target : elapsed;
+
+		controlCycle(clock.start, dt, &phase, &landing);
+		loopEnd(&_controlTiming, &clock);
+
+		// skips the cycles that were missed instead of rushing to catch up
+		deadline += target;
+		double now = monotonicTime();
+		if (deadline < now)
+			deadline = now;
+		sleepUntil(deadline);
+	}
+
+	return NULL;
+}
+
+
+// passes the orientation on to the control thread and runs the completion handlers
 int orientationUpdate(struct Orientation orientation) {
-	printOrientation(orientation);
+	postVector(&_gravity, orientation.gravity);
+	postVector(&_horizontal, orientation.horizontalVelocity);
+	postVector(&_vertical, Vector3d(orientation.altitude, orientation.verticalVelocity, \
+			orientation.heading));
+
+	runCompletion(&_takeOffCompletion);
+	runCompletion(&_landCompletion);
+	runCompletion(&_velocityCompletion);
+	runCompletion(&_angularCompletion);
 
-	return (inFlight ? 500 : 1);
+	return 0;
 }
 
 
 // starts the flight manager thread
 int startFlightManager() {
-	getOrientation(&orientationUpdate, 1);
+	if (_controlRunning.load(std::memory_order_acquire))
+		return 0;
+
+	initFlightControl(&_control, _controlRate);
+	if (getOrientation(&orientationUpdate, _orientationRate))
+		return 1;
+
+	_controlRunning.store(1, std::memory_order_release);
+	if (createClockThread(&_controlThread, NULL, &controlLoop, NULL)) {
+		printf("failed to create flight control thread\n");
+		_controlRunning.store(0, std::memory_order_release);
+		return 1;
+	}
 
 	return 0;
 }
 
+void takeOff(double takeOffTime, void (*takeOffCompletionHandler)(double)) {
+	if (_phase.load(std::memory_order_acquire) != FLIGHT_LANDED) {
+		printf("cannot take off while not landed\n");
+		return;
+	}
+
+	Vector3d gravity, vertical;
+	uint64_t sequence;
+	if (latestVector(&_gravity, &gravity, &sequence) || \
+			latestVector(&_vertical, &vertical, &sequence)) {
+		printf("cannot take off before the orientation is known\n");
+		return;
+	}
 
+	// the vehicle is sitting level on the ground, so this is what level looks like
+	resetFlightControl(&_control, gravity, gyroscopeDrift());
+	// the velocity can only be held once the drag it is measured from is known
+	_control.velocityHold = horizontalDragRate() > 0;
+	_takeOffAltitude = vertical(0);
+	_takeOffRate = takeOffTime < _minimumTakeOffRate ? _minimumTakeOffRate : \
+			(takeOffTime > 1 ? 1 : takeOffTime);
+	postVector(&_velocityTarget, Vector3d(0, 0, 0));
+	postVector(&_angularTarget, Vector3d(0, 0, 0));
 
+	beginCompletion(&_takeOffCompletion, takeOffCompletionHandler);
+	_phase.store(FLIGHT_TAKING_OFF, std::memory_order_release);
+}
+
+void land(void (*landedCompletionHandler)(double)) {
+	int phase = _phase.load(std::memory_order_acquire);
+	if (phase != FLIGHT_TAKING_OFF && phase != FLIGHT_FLYING) {
+		printf("cannot land while not flying\n");
+		return;
+	}
+
+	beginCompletion(&_landCompletion, landedCompletionHandler);
+	_phase.store(FLIGHT_LANDING, std::memory_order_release);
+}
 
+void setVelocityVector(Vector3d velocityVector, void (*velocityUpdateCompletionHandler)(double)) {
+	if (velocityVector.cwiseAbs().maxCoeff() > 1) {
+		printf("velocity vector components must be between -1 and 1\n");
+		return;
+	}
 
+	beginCompletion(&_velocityCompletion, velocityUpdateCompletionHandler);
+	postVector(&_velocityTarget, velocityVector);
+}
 
+void setAngularVelocityVector(Vector3d angularVelocityVector, \
+		void (*angularVelocityUpdateCompletionHandler)(double)) {
+	if (angularVelocityVector.cwiseAbs().maxCoeff() > 1) {
+		printf("angular velocity vector components must be between -1 and 1\n");
+		return;
+	}
 
+	beginCompletion(&_angularCompletion, angularVelocityUpdateCompletionHandler);
+	postVector(&_angularTarget, angularVelocityVector);
+}
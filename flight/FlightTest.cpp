@@ -11,18 +11,33 @@
 #include<pthread.h>
 #include<math.h>
 
+#include<atomic>
+
 #include<Eigen/Dense>
 #include<geometry.h>
 #include<SensorManager.h>
 #include<MotorController.h>
+#include<Mixer.h>
 #include<Orientation.h>
 #include<FlightManager.h>
+#include<RealTime.h>
+#include<LoopTiming.h>
+#include<Clock.h>
+#include<EventLoop.h>
+#include<Simulator.h>
+#include<Blackbox.h>
+#include<BlackboxEncoding.h>
+#include<Telemetry.h>
 extern "C" {
 	#include<i2cctl.h>
+	#include<i2csim.h>
 	#include<PWMController.h>
 	#include<dynamic_set.h>
+	#include<rcu_set.h>
 	#include<string_additions.h>
 }
+#include<GyroFilterBank.h>
+#include<DynamicSet.h>
 
 #define HEADING_COLOR "\x1B[1m" // bold
 #define NORMAL_COLOR "\x1B[0m" // normal text
@@ -30,13 +45,365 @@ extern "C" {
 using namespace Eigen;
 
 
+// the file to record the blackbox to during the flight modes, or NULL
+static const char *_blackboxPath = NULL;
+
+// the ground station to send telemetry to during the flight modes, or NULL
+static const char *_telemetryHost = NULL;
+static int _telemetryPort = TELEMETRY_DEFAULT_PORT;
+
+// starts the blackbox and the telemetry if they were asked for
+static void startRequestedRecorders() {
+	if (_blackboxPath != NULL && startBlackbox(_blackboxPath))
+		printf("flying without a blackbox\n");
+	if (_telemetryHost != NULL && startTelemetry(_telemetryHost, _telemetryPort))
+		printf("flying without telemetry\n");
+}
+
+// prints the scheduling the threads got, once, after they have all started
+static int printRealTimeOnce(void *input, double time) {
+	printRealTimeReport();
+	return -1;
+}
+
+static int printTimings(void *input, double time) {
+	printLoopTimings();
+	return 0;
+}
+
+// starts the flight manager and prints the timing of the periodic tasks every 5 seconds
 void testFlightManager() {
+	startRequestedRecorders();
 	if (startFlightManager()) {
 		printf("failed to start flight manager\n");
+		return;
 	}
-	while (1) {
-		usleep(50000);
+	struct EventLoop loop;
+	if (initEventLoop(&loop) || \
+			addLoopTimer(&loop, 1, &printRealTimeOnce, NULL, NULL, NULL) < 0 || \
+			addLoopTimer(&loop, 5, &printTimings, NULL, NULL, NULL) < 0)
+		return;
+	runEventLoop(&loop);
+	closeEventLoop(&loop);
+}
+
+// runs the flight manager, and with it the sensor, listener and control threads, for
+//   the given number of seconds and prints how well each kept its rate
+void dumpLoopTimings(int seconds) {
+	startRequestedRecorders();
+	if (startFlightManager()) {
+		printf("failed to start flight manager\n");
+		return;
+	}
+	sleep(seconds);
+	printLoopTimings();
+	printRealTimeReport();
+}
+
+// reports a flight manager request finishing during a simulated flight
+static void simulatedCompletion(double seconds) {
+	printf("  done after %.2f seconds\n", seconds);
+}
+
+// set by the orientation listener thread once the simulated takeoff has finished
+static std::atomic<int> _simulatedTakeOff(0);
+
+static void simulatedTakeOffCompletion(double seconds) {
+	simulatedCompletion(seconds);
+	_simulatedTakeOff.store(1, std::memory_order_release);
+}
+
+// what a coast down of the simulated vehicle measured its drag rate as in m/s^2 per m/s
+// the vehicle really has 0.25 (see defaultQuadParameters), so this is 20% off, as a
+//   real measurement could be, rather than the simulator flying its own assumption
+static const double _simulatedDragRate = 0.3;
+
+// the bounds a simulated flight has to stay within, for a takeoff to 1 m and a forward
+//   command asking for 0.4 m/s
+// the lowest altitude only holds between finishing the takeoff and starting to land
+static const double _simulatedLowest = 0.5;
+static const double _simulatedHighest = 1.5;
+// the fastest horizontal and vertical speeds in m/s
+static const double _simulatedFastest = 0.8;
+static const double _simulatedFastestClimb = 1;
+
+// prints where the simulated vehicle is, how far it leans and the thrust of its motors
+static void printSimulatorState(double time) {
+	struct QuadState state = simulatorState();
+	Vector3d up = state.attitude * Vector3d::UnitZ();
+	printf("%6.2fs position %6.2f %6.2f %6.2f m, velocity %6.2f %6.2f %6.2f m/s, tilt %5.1f deg," \
+			" thrust", time, state.position(0), state.position(1), state.position(2), \
+			state.velocity(0), state.velocity(1), state.velocity(2), \
+			acos(up(2) < 1 ? up(2) : 1) * 180 / M_PI);
+	for (int i = 0; i < motorCount; i++) {
+		printf(" %.2f", state.motorThrusts[i]);
 	}
+	printf(" N\n");
+}
+
+// checks the simulated vehicle against the flight bounds, airborne being whether it
+//   should be well clear of the ground by now
+// returns 0 if it is within them, and -1 after printing the bound it crossed
+static int checkSimulatorBounds(double time, int airborne) {
+	struct QuadState state = simulatorState();
+	double altitude = state.position(2);
+	double speed = state.velocity.head<2>().norm();
+	if (altitude > _simulatedHighest || (airborne && altitude < _simulatedLowest)) {
+		printf("%6.2fs altitude %.2f m is outside %.2f - %.2f m\n", time, altitude, \
+				airborne ? _simulatedLowest : 0, _simulatedHighest);
+		return -1;
+	}
+	if (speed > _simulatedFastest) {
+		printf("%6.2fs horizontal speed %.2f m/s is over %.2f m/s\n", time, speed, \
+				_simulatedFastest);
+		return -1;
+	}
+	if (fabs(state.velocity(2)) > _simulatedFastestClimb) {
+		printf("%6.2fs vertical speed %.2f m/s is over %.2f m/s\n", time, state.velocity(2), \
+				_simulatedFastestClimb);
+		return -1;
+	}
+	return 0;
+}
+
+// flies a simulated vehicle (see Simulator.h) for the given number of simulated seconds,
+//   taking off, moving forward for a while, stopping and landing, and printing where it
+//   is twice a second, then how well each task kept its rate and how much faster than
+//   real time it all ran
+// everything after the takeoff is timed from when it finished, so even a short flight
+//   gets to move forward
+// returns 0 if the vehicle finished taking off and stayed within the flight bounds the
+//   whole time, and -1 otherwise
+int simulateFlight(int seconds) {
+	if (startSimulator(NULL)) {
+		printf("failed to start simulator\n");
+		return -1;
+	}
+	struct timeval startTime, endTime;
+	gettimeofday(&startTime, NULL);
+	double start = monotonicTime();
+
+	startRequestedRecorders();
+	if (startFlightManager()) {
+		printf("failed to start flight manager\n");
+		return -1;
+	}
+	// the flight manager can only take off once the sensors are calibrated
+	struct Orientation orientation;
+	while (getOrientationAt(monotonicTime(), &orientation) < 0) {
+		sleepFor(0.05);
+	}
+	setHorizontalDragRate(_simulatedDragRate);
+
+	// the bounds are checked every step, and the state printed every few
+	int step = 0, phase = 0, failed = 0;
+	const double interval = 0.1;
+	const int printSteps = 5;
+	double flying = 0;
+	_simulatedTakeOff.store(0, std::memory_order_relaxed);
+	for (double time = 0; time < seconds; time = ++step * interval) {
+		sleepUntil(start + time);
+		if (phase == 0 && time >= 1) {
+			printf("taking off\n");
+			takeOff(0.5, &simulatedTakeOffCompletion);
+			phase++;
+		}
+		else if (phase == 1 && _simulatedTakeOff.load(std::memory_order_acquire)) {
+			printf("moving forward\n");
+			setVelocityVector(Vector3d(0.2, 0, 0), &simulatedCompletion);
+			flying = time;
+			phase++;
+		}
+		else if (phase == 2 && time >= flying + 0.25 * (seconds - flying)) {
+			printf("stopping\n");
+			setVelocityVector(Vector3d(0, 0, 0), &simulatedCompletion);
+			phase++;
+		}
+		else if (phase == 3 && time >= flying + 0.5 * (seconds - flying)) {
+			printf("landing\n");
+			land(&simulatedCompletion);
+			phase++;
+		}
+
+		if (!failed && checkSimulatorBounds(time, phase == 2 || phase == 3))
+			failed = 1;
+		if (step % printSteps == 0)
+			printSimulatorState(time);
+	}
+	if (phase < 2) {
+		printf("the takeoff did not finish within %d seconds\n", seconds);
+		failed = 1;
+	}
+
+	gettimeofday(&endTime, NULL);
+	double diffTime = (double)((endTime.tv_sec * 1000000 + endTime.tv_usec) - \
+			(startTime.tv_sec * 1000000 + startTime.tv_usec)) / 1000000;
+	printLoopTimings();
+	printf("simulated %d seconds in %.2f seconds, %.1f times real time\n", seconds, diffTime, \
+			seconds / diffTime);
+	printf("the simulated flight %s its bounds\n", failed ? "left" : "stayed within");
+	return failed ? -1 : 0;
+}
+
+// what the device sequence check has seen so far
+struct SequenceCheck {
+	struct EventLoop loop;
+	double start;
+	// the ticks of a 1kHz timer, which keeps its rate only while no sequence blocks
+	int ticks;
+	// the sequences still running
+	int running;
+	// the sequences that failed
+	int failures;
+};
+
+// counts a tick of the check's timer
+static int countSequenceTick(void *input, double time) {
+	((struct SequenceCheck *)(input))->ticks++;
+	return 0;
+}
+
+// reports a sequence finishing, and stops the loop after the last one
+static void sequenceFinished(struct SequenceCheck *check, const char *result) {
+	printf("  %s after %.1f ms, %d timer ticks so far\n", result, \
+			1000 * (monotonicTime() - check->start), check->ticks);
+	if (--check->running == 0)
+		stopEventLoop(&check->loop);
+}
+
+static void motorOutputsConfigured(int failure, void *context) {
+	if (failure)
+		((struct SequenceCheck *)(context))->failures++;
+	sequenceFinished((struct SequenceCheck *)(context), \
+			failure ? "PWM configuration failed" : "PWM configured");
+}
+
+static void sequenceAltitudeRead(double altitude, void *context) {
+	if (isnan(altitude))
+		((struct SequenceCheck *)(context))->failures++;
+	char result[64];
+	snprintf(result, sizeof(result), "altitude %.2f m read", altitude);
+	sequenceFinished((struct SequenceCheck *)(context), result);
+}
+
+// runs the PWM configuration and a barometer read as tasks (see Task.h) on one event
+//   loop with the simulated devices, next to a 1kHz timer, showing that the sequences
+//   interleave and the timer keeps ticking while they wait on the hardware
+// returns the number of failures, a sequence failing or not starting, or the timer
+//   falling behind
+int checkDeviceSequences() {
+	if (startSimulator(NULL)) {
+		printf("failed to start simulator\n");
+		return 1;
+	}
+
+	struct SequenceCheck check;
+	check.ticks = 0;
+	check.running = 2;
+	check.failures = 0;
+	if (initEventLoop(&check.loop) || \
+			addLoopTimer(&check.loop, 0.001, &countSequenceTick, &check, NULL, NULL) < 0) {
+		printf("failed to create the sequence loop\n");
+		closeEventLoop(&check.loop);
+		return 1;
+	}
+
+	printf("running the PWM configuration and a barometer read on one loop\n");
+	check.start = monotonicTime();
+	if (!configureMotorOutputs(&check.loop, &motorOutputsConfigured, &check).started) {
+		printf("  the PWM configuration did not start\n");
+		check.running--;
+		check.failures++;
+	}
+	if (!readBarometerAltitude(&check.loop, &sequenceAltitudeRead, &check).started) {
+		printf("  the barometer read did not start\n");
+		check.running--;
+		check.failures++;
+	}
+	if (check.running > 0)
+		runEventLoop(&check.loop);
+	closeEventLoop(&check.loop);
+
+	double elapsed = monotonicTime() - check.start;
+	printf("both done after %.1f ms with %d timer ticks\n", 1000 * elapsed, check.ticks);
+	// a tick of slack for where the timer was when the sequences started and finished
+	if (check.ticks < (int)(1000 * elapsed) - 1) {
+		printf("the timer fell behind while the sequences ran\n");
+		check.failures++;
+	}
+	printf("device sequence check %s\n", check.failures ? "FAILED" : "passed");
+	return check.failures;
+}
+
+// reads a blackbox file back, decoding every block and counting the records and the
+//   gaps in each thread's sequence numbers
+// returns the number of bad blocks and gaps, or 1 if the file cannot be read
+static int checkBlackboxFile(const char *path) {
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) {
+		printf("failed to open %s\n", path);
+		return 1;
+	}
+
+	static char block[BLACKBOX_BLOCK_SIZE];
+	static struct BlackboxBlockReader reader;
+	uint32_t nextSequence[BLACKBOX_SOURCES] = {};
+	int seen[BLACKBOX_SOURCES] = {};
+	unsigned long blocks = 0, records = 0, gaps = 0, bad = 0;
+	while (fread(block, BLACKBOX_BLOCK_SIZE, 1, file) == 1) {
+		blocks++;
+		if (openBlackboxBlock(&reader, block)) {
+			bad++;
+			continue;
+		}
+		struct BlackboxRecord record;
+		int result;
+		while ((result = nextBlackboxRecord(&reader, &record)) > 0) {
+			if (seen[record.source] && record.sequence != nextSequence[record.source])
+				gaps++;
+			seen[record.source] = 1;
+			nextSequence[record.source] = record.sequence + 1;
+			records++;
+		}
+		if (result < 0)
+			bad++;
+	}
+	fclose(file);
+
+	printf("read back %lu records in %lu blocks, %lu bad blocks, %lu sequence gaps\n", \
+			records, blocks, bad, gaps);
+	return (int)(bad + gaps);
+}
+
+// times blackboxRecord() from this thread in bursts the writer keeps up with, then reads
+//   the file back
+// returns the number of problems reading it back (see checkBlackboxFile)
+int benchmarkBlackbox(const char *path) {
+	if (startBlackbox(path))
+		return 1;
+
+	const int bursts = 40, burst = BLACKBOX_RING_SIZE / 2;
+	double values[BLACKBOX_RECORD_VALUES] = {0.01, -0.02, 1.0, 0.5, 12.25, 0.125};
+	double total = 0, slowest = 0;
+	for (int i = 0; i < bursts; i++) {
+		double start = monotonicTime();
+		for (int j = 0; j < burst; j++) {
+			values[0] = j;
+			blackboxRecord(BLACKBOX_ORIENTATION, start, values, BLACKBOX_RECORD_VALUES);
+		}
+		double elapsed = monotonicTime() - start;
+		total += elapsed;
+		if (elapsed > slowest)
+			slowest = elapsed;
+		// lets the writer empty the ring
+		sleepFor(2 * BLACKBOX_DRAIN_INTERVAL);
+	}
+	stopBlackbox();
+
+	printf("%.1f ns per record on average, %.1f ns in the slowest burst\n", \
+			total / (bursts * burst) * 1e9, slowest / burst * 1e9);
+	printBlackboxReport();
+	return checkBlackboxFile(path);
 }
 
 int orientationCompletionHandler(struct Orientation orientation) {
@@ -45,6 +412,9 @@ int orientationCompletionHandler(struct Orientation orientation) {
 }
 
 static int canReturn = 0;
+// the main thread sleeps on this while an orientation test runs, and the test's handler
+//   stops it once the test is done
+static struct EventLoop _testLoop;
 static int N = 100;
 static int hz = 8;
 static struct Orientation totals = {};
@@ -93,6 +463,7 @@ int orientationStatisticsCompletionHandler(struct Orientation orientation) {
 		orientationCompletionHandler(variance);
 
 		canReturn = -1;
+		stopEventLoop(&_testLoop);
 	}
 	return canReturn;
 }
@@ -100,15 +471,16 @@ int orientationStatisticsCompletionHandler(struct Orientation orientation) {
 void testOrientationStatistics() {
 	printf("testing orientation - stats mode\n");
 	printf("begining orientation statistics printout of %i samples at %iHz\n", N, hz);
+	if (initEventLoop(&_testLoop))
+		return;
 	getOrientation(&orientationStatisticsCompletionHandler, hz);
-	while (!canReturn) {
-		sleep(1);
-	}
+	runEventLoop(&_testLoop);
+	closeEventLoop(&_testLoop);
 }
 
 void testEmergencyStop() {
 	printf("performing emergen(1)stop on motors\n");
-	for (int i = 0; i < 4; i++) {
+	for (int i = 0; i < motorCount; i++) {
 		setMotorThrustPercentage(i, 0);
 	}
 }
@@ -117,10 +489,30 @@ void testOrientation() {
 	printf("testing orientation\n");
 	printf("begin printing orientation @ 1Hz\n");
 	sleep(1);
+	if (initEventLoop(&_testLoop))
+		return;
+	// prints until the program is stopped
 	getOrientation(&orientationCompletionHandler, 1);
-	while (!canReturn) {
-		sleep(1);
+	runEventLoop(&_testLoop);
+	closeEventLoop(&_testLoop);
+}
+
+// records the samples fed to the orientation filter for the given number of seconds
+//   so they can be replayed with the replay tool
+static int recordingHandler(struct Orientation orientation) {
+	return canReturn;
+}
+
+void recordSensorLog(const char *path, int seconds) {
+	printf("recording sensor log to %s for %d seconds\n", path, seconds);
+	if (startSensorLog(path)) {
+		return;
 	}
+	getOrientation(&recordingHandler, 1);
+	sleep(seconds);
+	stopSensorLog();
+	canReturn = -1;
+	printf("done\n");
 }
 
 void testOrientationCalibration() {
@@ -229,6 +621,225 @@ void readsPerSecond() {
 	printf("%.2f reads per second\n", (double)(count) / diffTime);
 }
 
+// times the gyroscope filter bank with every supported number of notches
+// prints the cost per sample and how much of the time between samples that is at 1kHz
+void benchmarkGyroFilterBank() {
+	const int samples = 1000000;
+	const int batch = 2;
+	const int inputCount = 1024;
+	double rate = 1000;
+	FilterSample data[batch];
+
+	// the input is generated up front so only the filtering is timed
+	FilterSample *input = new FilterSample[inputCount];
+	for (int i = 0; i < inputCount; i++) {
+		input[i] = FilterSample(sin(i * 0.1), cos(i * 0.1), sin(i * 0.3), 0);
+	}
+
+	for (int notches = 0; notches <= GYRO_FILTER_MAX_NOTCHES; notches++) {
+		struct GyroFilterBank *bank = new GyroFilterBank();
+		initGyroFilterBank(bank, rate, 100, notches, 3);
+		double centers[GYRO_FILTER_MAX_NOTCHES] = {90, 180, 270, 360};
+		setGyroNotchFrequencies(bank, centers, notches);
+
+		struct timeval startTime, endTime;
+		gettimeofday(&startTime, NULL);
+		for (int i = 0; i < samples; i += batch) {
+			for (int j = 0; j < batch; j++) {
+				data[j] = input[(i + j) % inputCount];
+			}
+			gyroFilterBankProcess(bank, data, batch);
+		}
+		gettimeofday(&endTime, NULL);
+
+		double diffTime = (double)((endTime.tv_sec * 1000000 + endTime.tv_usec) - \
+				(startTime.tv_sec * 1000000 + startTime.tv_usec)) / 1000000;
+		double perSample = diffTime / samples;
+		printf("low pass + %d notches: %.1f ns per sample, %.3f%% of a %.0fHz period (%.3f)\n", \
+				notches, perSample * 1e9, 100 * perSample * rate, rate, data[0](0));
+		delete bank;
+	}
+	delete[] input;
+}
+
+// checks whether the pulse every motor gets on the simulated PWM chip is as close to the
+//   expected one as the chip's counter allows
+// returns the number of motors that are off
+static int checkPulses(const struct PCA9685Model *model, const double *expected) {
+	double tolerance = 0.51 * 1000000 / pca9685Frequency(model) / 4096;
+	int failures = 0;
+	for (int i = 0; i < motorCount; i++) {
+		double pulse = pca9685PulseWidth(model, i);
+		if (fabs(pulse - expected[i]) > tolerance) {
+			printf("  motor %d pulse is %.1fus instead of %.1fus\n", i, pulse, expected[i]);
+			failures++;
+		}
+	}
+	return failures;
+}
+
+// counts the calls armMotors() makes once the motors are armed
+static std::atomic<int> _escArmedCalls(0);
+
+static void escArmed(void *context) {
+	_escArmedCalls.fetch_add(1);
+}
+
+// runs the motor layer against a simulated PWM chip with every ESC protocol and checks
+//   the frame rate, the arming sequence and the pulse widths the motors get, along with
+//   the number of bus writes each motor update takes
+// returns the number of failures
+int checkEscProtocols() {
+	struct PCA9685Model model;
+	struct I2CSimDevice device;
+	initPCA9685Model(&model, &device, 0x40);
+	i2cSimAttach(&device);
+	i2cUseSimulation(1);
+
+	struct {
+		enum EscProtocolType type;
+		const char *name;
+		double frameRate;
+	} cases[] = {
+		{ESC_PWM, "PWM", 265},
+		{ESC_PWM, "PWM", 400},
+		{ESC_ONESHOT125, "OneShot125", 1000},
+		{ESC_ONESHOT125, "OneShot125", 1500},
+	};
+	int totalFailures = 0;
+
+	for (unsigned int c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+		int failures = 0;
+		if (setEscProtocol(cases[c].type, cases[c].frameRate)) {
+			printf("%s at %.0fHz could not be set\n", cases[c].name, cases[c].frameRate);
+			totalFailures++;
+			continue;
+		}
+		double frequency = pca9685Frequency(&model);
+		if (fabs(frequency - pwmFrequency()) > 0.01) {
+			printf("  the chip runs at %.2fHz instead of %.2fHz\n", frequency, pwmFrequency());
+			failures++;
+		}
+
+		struct EscProtocol protocol;
+		escProtocol(cases[c].type, frequency, &protocol);
+		double expected[motorCount];
+		double thrusts[motorCount];
+
+		// every motor gets the arming pulse at once, and is armed after the settle time,
+		//   when the callback comes
+		_escArmedCalls.store(0);
+		armMotors(&escArmed, NULL);
+		for (int i = 0; i < motorCount; i++) {
+			expected[i] = protocol.stopPulse;
+		}
+		failures += checkPulses(&model, expected);
+		if (_escArmedCalls.load() != 0) {
+			printf("  the arming callback came before the motors armed\n");
+			failures++;
+		}
+		usleep(60000);
+		if (motorArmingState() != MOTORS_ARMED) {
+			printf("  the motors did not arm\n");
+			failures++;
+		}
+		usleep(10000);
+		if (_escArmedCalls.load() != 1) {
+			printf("  the arming callback came %d times\n", _escArmedCalls.load());
+			failures++;
+		}
+
+		// the ends of the thrust curve are the stop and full pulses, and in between the
+		//   pulse has to grow with the thrust and read back as the same thrust
+		for (int i = 0; i < motorCount; i++) {
+			thrusts[i] = i / (double)(motorCount - 1);
+		}
+		uint32_t writes = model.writes;
+		setMotorThrustPercentages(0, motorCount, thrusts);
+		expected[0] = protocol.stopPulse;
+		expected[motorCount - 1] = protocol.fullPulse;
+		for (int i = 1; i < motorCount - 1; i++) {
+			double pulse = pca9685PulseWidth(&model, i);
+			expected[i] = pulse;
+			if (pulse <= protocol.idlePulse || pulse >= protocol.fullPulse || \
+					pulse <= pca9685PulseWidth(&model, i - 1)) {
+				printf("  motor %d pulse of %.1fus is off the thrust curve\n", i, pulse);
+				failures++;
+			}
+			if (fabs(getMotorThrustPercentage(i) - thrusts[i]) > 0.01) {
+				printf("  motor %d reads back %.3f thrust instead of %.3f\n", i, \
+						getMotorThrustPercentage(i), thrusts[i]);
+				failures++;
+			}
+		}
+		failures += checkPulses(&model, expected);
+		if (model.writes - writes != 1) {
+			printf("  setting the motors took %u writes\n", model.writes - writes);
+			failures++;
+		}
+		writes = model.writes;
+		setMotorThrustPercentages(0, motorCount, thrusts);
+		if (model.writes != writes) {
+			printf("  repeating the thrusts was not skipped\n");
+			failures++;
+		}
+
+		printf("%s at %.1fHz (%.0fus frame): %s\n", cases[c].name, frequency, \
+				1000000 / frequency, failures ? "FAILED" : "ok");
+		totalFailures += failures;
+	}
+	// a callback waiting on the arming has to wait through the motors being disarmed and
+	//   armed again
+	disarmMotors();
+	_escArmedCalls.store(0);
+	armMotors(&escArmed, NULL);
+	usleep(10000);
+	disarmMotors();
+	armMotors(NULL, NULL);
+	usleep(70000);
+	if (_escArmedCalls.load() != 1) {
+		printf("arming again during the wait made the callback come %d times\n", \
+				_escArmedCalls.load());
+		totalFailures++;
+	}
+
+	// a channel the chip lost, as in a brownout, has to be found and written back with
+	//   the pulse it had, while the channels that still hold theirs are left alone
+	double expected[motorCount];
+	for (int i = 0; i < motorCount; i++) {
+		expected[i] = pca9685PulseWidth(&model, i);
+	}
+	int repaired = verifyPWMController();
+	if (repaired != 0) {
+		printf("verifying the intact chip rewrote %d channels\n", repaired);
+		totalFailures++;
+	}
+	// clears the on and off counts of the second motor's channel, which start at 0x06
+	i2cLockBus();
+	memset(&model.registers[0x06 + 4 * 1], 0, 4);
+	i2cUnlockBus();
+	uint32_t writes = model.writes;
+	repaired = verifyPWMController();
+	if (repaired != 1 || model.writes - writes != 1) {
+		printf("verifying the corrupted chip rewrote %d channels in %u writes\n", \
+				repaired, model.writes - writes);
+		totalFailures++;
+	}
+	totalFailures += checkPulses(&model, expected);
+
+	if (model.blockedPrescaleWrites) {
+		printf("%u prescale writes were ignored by the chip\n", model.blockedPrescaleWrites);
+		totalFailures++;
+	}
+
+	disarmMotors();
+	setEscProtocol(ESC_PWM, pwmEscProtocol.frameRate);
+	i2cUseSimulation(0);
+	i2cSimDetachAll();
+	printf("ESC protocol check %s\n", totalFailures ? "FAILED" : "passed");
+	return totalFailures;
+}
+
 void testMotor(uint8_t address) {
 	printf("beginning test on motor %d\n", address);
 	printf("increasing motor speed\n");
@@ -370,7 +981,8 @@ void testBarometer() {
 	printf("altitude %.3f meters\n", altitude);
 }
 
-void test_dynamic_set() {
+// returns the number of failures in the typed set
+int test_dynamic_set() {
 	const char s[60] = "";
 	char d[20] = "morestriny";
 	printf("%i, %s\n", (int)strlcpy(d, s, 10), d);
@@ -395,11 +1007,170 @@ void test_dynamic_set() {
 	i = 2;
 	j = 1;
 	k = 3;
+	dyn_set_deinit(set);
+
+	// the typed set, past its inline storage, with handles that keep naming their values
+	//   while others are swapped into the gaps
+	DynamicSet<int, 2, true> typed;
+	int64_t handles[5];
+	for (int v = 0; v < 5; v++) {
+		handles[v] = addToDynamicSet(&typed, 10 * v);
+	}
+	removeFromDynamicSetByHandle(&typed, handles[1]);
+	removeFromDynamicSetByHandle(&typed, handles[3]);
+	printf("typed count: %u, values", typed.count);
+	// each removal moves the last value into the gap, so 40 fills the place of 10 and
+	//   30 was last when it went
+	const int expected[] = {0, 40, 20};
+	unsigned int seen = 0;
+	int failures = 0;
+	for (int value : typed) {
+		printf(" %d", value);
+		if (seen >= 3 || value != expected[seen])
+			failures++;
+		seen++;
+	}
+	int *value = dynamicSetHandleValue(&typed, handles[4]);
+	int *removed = dynamicSetHandleValue(&typed, handles[1]);
+	printf(", handle %lld names %d, removed handle %lld names %s\n", (long long)handles[4], \
+			value ? *value : -1, (long long)handles[1], removed ? "a value" : "nothing");
+	if (typed.count != 3 || seen != 3 || value == NULL || *value != 40 || removed != NULL)
+		failures++;
+
+	printf("dynamic set check %s\n", failures ? "FAILED" : "passed");
+	return failures;
+}
+
+// what the threads of the registry set benchmark share
+struct RegistryBenchmark {
+	struct dyn_set *dynamicSet;
+	struct rcu_set *rcuSet;
+	void *items[8];
+	// set to end the run
+	std::atomic<int> done;
+	// the tables the readers looked through, and the writes the writer made
+	std::atomic<long> reads;
+	std::atomic<long> writes;
+};
+
+// looks through the whole dyn_set table the way its users do, until the run ends
+static void *readDynamicSet(void *input) {
+	struct RegistryBenchmark *benchmark = (struct RegistryBenchmark *)(input);
+	long reads = 0;
+	uintptr_t sum = 0;
+	while (!benchmark->done.load(std::memory_order_relaxed)) {
+		dyn_set_lock(benchmark->dynamicSet);
+		uint64_t count = dyn_set_count(benchmark->dynamicSet);
+		for (uint64_t i = 0; i < count; i++) {
+			sum += (uintptr_t)dyn_set_get_item(benchmark->dynamicSet, i);
+		}
+		dyn_set_unlock(benchmark->dynamicSet);
+		reads++;
+	}
+	benchmark->reads += reads + (sum == 1);
+	return NULL;
+}
+
+// looks through the whole rcu_set table in a read section, until the run ends
+static void *readRcuSet(void *input) {
+	struct RegistryBenchmark *benchmark = (struct RegistryBenchmark *)(input);
+	long reads = 0;
+	uintptr_t sum = 0;
+	while (!benchmark->done.load(std::memory_order_relaxed)) {
+		struct rcu_set_reader reader;
+		rcu_set_read_begin(benchmark->rcuSet, &reader);
+		for (uint64_t i = 0; i < reader.count; i++) {
+			sum += (uintptr_t)reader.items[i];
+		}
+		rcu_set_read_end(benchmark->rcuSet, &reader);
+		reads++;
+	}
+	benchmark->reads += reads + (sum == 1);
+	return NULL;
+}
+
+// removes and adds back the last item of a table every interval until the run ends,
+//   like a device dropping off the bus and coming back
+static void churnRegistry(struct RegistryBenchmark *benchmark, double seconds, \
+		double interval, int (*write)(struct RegistryBenchmark *, void *, int)) {
+	double start = monotonicTime();
+	double slowest = 0;
+	void *item = benchmark->items[7];
+	while (monotonicTime() - start < seconds) {
+		usleep((useconds_t)(interval * 1000000));
+		double writeStart = monotonicTime();
+		write(benchmark, item, 0);
+		write(benchmark, item, 1);
+		double elapsed = (monotonicTime() - writeStart) / 2;
+		slowest = elapsed > slowest ? elapsed : slowest;
+		benchmark->writes += 2;
+	}
+	benchmark->done = 1;
+	printf("  slowest write %.1f us\n", slowest * 1e6);
+}
+
+static int writeDynamicSet(struct RegistryBenchmark *benchmark, void *item, int add) {
+	return add ? dyn_set_add(benchmark->dynamicSet, item) : \
+			dyn_set_remove(benchmark->dynamicSet, item);
+}
+
+static int writeRcuSet(struct RegistryBenchmark *benchmark, void *item, int add) {
+	return add ? rcu_set_add(benchmark->rcuSet, item) : rcu_set_remove(benchmark->rcuSet, item);
+}
+
+// runs readers looking through a table of 8 items on every core next to a writer
+//   changing it every 100ms, once with dyn_set and once with rcu_set, and prints how
+//   long a look through the table takes and how long the writes take
+void benchmarkRegistrySets() {
+	const double seconds = 1, interval = 0.1;
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	int readers = cores > 1 ? cores : 1;
+	static int values[8];
+
+	for (int pass = 0; pass < 2; pass++) {
+		struct RegistryBenchmark benchmark;
+		benchmark.dynamicSet = pass == 0 ? dyn_set_init(8) : NULL;
+		benchmark.rcuSet = pass == 1 ? rcu_set_init() : NULL;
+		benchmark.done = 0;
+		benchmark.reads = 0;
+		benchmark.writes = 0;
+		for (int i = 0; i < 8; i++) {
+			benchmark.items[i] = &values[i];
+			pass == 0 ? dyn_set_add(benchmark.dynamicSet, &values[i]) : \
+					rcu_set_add(benchmark.rcuSet, &values[i]);
+		}
+
+		printf("%s with %d readers:\n", pass == 0 ? "dyn_set" : "rcu_set", readers);
+		pthread_t threads[readers];
+		for (int i = 0; i < readers; i++) {
+			pthread_create(&threads[i], NULL, pass == 0 ? &readDynamicSet : &readRcuSet, \
+					&benchmark);
+		}
+		churnRegistry(&benchmark, seconds, interval, \
+				pass == 0 ? &writeDynamicSet : &writeRcuSet);
+		for (int i = 0; i < readers; i++) {
+			pthread_join(threads[i], NULL);
+		}
+
+		printf("  %.1f ns per look through the table, %ld writes\n", \
+				seconds * readers / benchmark.reads * 1e9, benchmark.writes.load());
+		if (pass == 0)
+			dyn_set_deinit(benchmark.dynamicSet);
+		else
+			rcu_set_deinit(benchmark.rcuSet);
+	}
 }
 
 int main(int argc, char * argv[]) {
+	// the checking modes set this when they fail, so scripts can tell from the exit status
+	int failures = 0;
 	for (int i = 1; i < argc; i++) {
-		if (strcmp(argv[i], "a") == 0) {
+		// runs the modes after it with the real time profile, which has to come before
+		//   any thread is started
+		if (strcmp(argv[i], "rt") == 0) {
+			enableRealTime(16 * 1024 * 1024);
+		}
+		else if (strcmp(argv[i], "a") == 0) {
 			testAccel();
 		}
 		else if (strcmp(argv[i], "g") == 0) {
@@ -465,12 +1236,60 @@ int main(int argc, char * argv[]) {
 			testFlightManager();
 		}
 		else if (strcmp(argv[i], "ds") == 0) {
-			test_dynamic_set();
+			if (test_dynamic_set())
+				failures = 1;
+		}
+		else if (strcmp(argv[i], "rcu") == 0) {
+			benchmarkRegistrySets();
+		}
+		else if (strcmp(argv[i], "fb") == 0) {
+			benchmarkGyroFilterBank();
+		}
+		else if (strcmp(argv[i], "esc") == 0) {
+			if (checkEscProtocols())
+				failures = 1;
+		}
+		else if (strcmp(argv[i], "lt") == 0) {
+			dumpLoopTimings(atoi(argv[i+1]));
+		}
+		else if (strcmp(argv[i], "rec") == 0) {
+			recordSensorLog(argv[i+1], atoi(argv[i+2]));
+		}
+		else if (strcmp(argv[i], "seq") == 0) {
+			if (checkDeviceSequences())
+				failures = 1;
+		}
+		else if (strcmp(argv[i], "sim") == 0) {
+			if (simulateFlight(atoi(argv[i+1])))
+				failures = 1;
+		}
+		// records the blackbox to a file during the flight modes after it
+		else if (strcmp(argv[i], "bl") == 0) {
+			_blackboxPath = argv[i+1];
+		}
+		// sends telemetry to a port on a host during the flight modes after it
+		else if (strcmp(argv[i], "tl") == 0) {
+			_telemetryHost = argv[i+1];
+			_telemetryPort = atoi(argv[i+2]);
+		}
+		else if (strcmp(argv[i], "bb") == 0) {
+			if (benchmarkBlackbox(argv[i+1]))
+				failures = 1;
 		}
 
 	}
+	if (blackboxRecording()) {
+		stopBlackbox();
+		printBlackboxReport();
+		if (checkBlackboxFile(_blackboxPath))
+			failures = 1;
+	}
+	if (telemetrySending()) {
+		stopTelemetry();
+		printTelemetryReport();
+	}
 	if (argc == 1) {
-		printf("enter arguments fm, os, x, aa, oo, am, sav, slv, r, m, a, s, g, c, p, t <num>, o <num>, i <num>\n");
+		printf("enter arguments [rt] [bl <file>] [tl <host> <port>] lt <seconds>, sim <seconds>, bb <file>, seq, rcu, esc, fb, rec <file> <seconds>, fm, os, x, aa, oo, am, sav, slv, r, m, a, s, g, c, p, t <num>, o <num>, i <num>\n");
 	}
 
 
@@ -487,7 +1306,7 @@ int main(int argc, char * argv[]) {
 	//pthread_create(&accelThread, NULL, func, &argument);
 
 	//manualMotorTest(0);
-	return 0;
+	return failures;
 }
 
 
@@ -0,0 +1,123 @@
+// a flight recorder that logs what the sensors, the fusion, the control loop and the
+//   motors saw and did, in binary, for looking at after the flight
+// the time critical threads add fixed size records without ever locking, allocating or
+//   making a system call: each thread gets its own single producer ring the first time
+//   it records, and a background writer thread empties all the rings every
+//   BLACKBOX_DRAIN_INTERVAL seconds and writes the records to disk in large aligned
+//   blocks, bypassing the page cache with O_DIRECT where the file system allows it
+// when a ring is full the record is dropped and counted rather than making the
+//   recording thread wait, and the per thread sequence numbers show where
+// the records of one thread are in the order they were added, but the records of
+//   different threads are not in time order with each other
+//
+// the file is a series of BLACKBOX_BLOCK_SIZE blocks, each a BlackboxBlockHeader
+//   followed by the records packed into frames (see BlackboxEncoding.h) and zeros after
+//   the last frame
+// what was added to the block being filled is written every BLACKBOX_FLUSH_INTERVAL
+//   seconds, along with its header, so a crash loses at most about that much of the
+//   flight
+//
+// by Mark Hill
+
+#ifndef _Blackbox
+#define _Blackbox
+
+#include<stdint.h>
+
+// the size of a block of the file in bytes, a multiple of any disk's block size
+#define BLACKBOX_BLOCK_SIZE (64 * 1024)
+// the number of blocks the writer collects before writing them in one go
+#define BLACKBOX_WRITE_BLOCKS 8
+// the number of records each thread's ring holds, must be a power of two
+#define BLACKBOX_RING_SIZE 1024
+// the most threads that can record
+#define BLACKBOX_MAX_THREADS 16
+// the most values in one record
+#define BLACKBOX_RECORD_VALUES 6
+// how often in seconds the writer empties the rings and writes the unfinished block
+#define BLACKBOX_DRAIN_INTERVAL 0.05
+#define BLACKBOX_FLUSH_INTERVAL 1.0
+
+// what a record holds, and the values in it
+enum BlackboxRecordType {
+	// fills the end of a block, never recorded
+	BLACKBOX_PADDING,
+	// the accelerometer in g's, x y z
+	BLACKBOX_ACCELERATION,
+	// the filtered gyroscope in rad/s, x y z
+	BLACKBOX_ROTATION,
+	// the magnetometer, x y z
+	BLACKBOX_MAGNETIC_FIELD,
+	// the barometer altitude in meters
+	BLACKBOX_ALTITUDE,
+	// the fused gravity x y z, heading in degrees, altitude in meters and climb rate in m/s
+	BLACKBOX_ORIENTATION,
+	// the velocity command x y z and the rotation rate target in rad/s x y z
+	BLACKBOX_SETPOINT,
+	// the angular motion vector x y z and the thrust from the control loop
+	BLACKBOX_CONTROL,
+	// the thrust of every motor from 0 to 1
+	BLACKBOX_MOTOR_OUTPUT,
+	BLACKBOX_RECORD_TYPES,
+};
+
+// one record, the size of a cache line
+struct BlackboxRecord {
+	// a BlackboxRecordType
+	uint8_t type;
+	// the ring, and so the thread, it came from
+	uint8_t source;
+	// the number of values used
+	uint16_t count;
+	// counts every record the thread tried to add, so a gap means records were dropped
+	uint32_t sequence;
+	// in seconds (see Clock.h)
+	double time;
+	double values[BLACKBOX_RECORD_VALUES];
+};
+
+// starts every block of the file
+struct BlackboxBlockHeader {
+	// BLACKBOX_MAGIC
+	char magic[8];
+	uint32_t version;
+	// the position of the block in the file, from 0
+	uint32_t index;
+	// the number of records in the block and the bytes of frames they take
+	uint32_t records;
+	uint32_t bytes;
+	// the earliest and the latest time of the records in the block, so a time can be
+	//   found without decoding the blocks before it
+	double firstTime;
+	double lastTime;
+	// the number of records of each type, so a decoder knows where every block's records
+	//   go before decoding any of them
+	uint16_t typeRecords[BLACKBOX_RECORD_TYPES];
+	uint16_t reserved[3];
+};
+
+#define BLACKBOX_MAGIC "BLACKBOX"
+#define BLACKBOX_VERSION 3
+
+// creates the file at path and starts the writer thread
+// on the virtual clock (see Clock.h) this must be called after switching to it
+// returns 0 on success and -1 on failure
+int startBlackbox(const char *path);
+
+// writes out everything recorded so far, stops the writer thread and closes the file
+void stopBlackbox();
+
+// returns 1 while the blackbox is recording and 0 otherwise
+int blackboxRecording();
+
+// adds a record of type with count values at time in seconds, keeping only the first
+//   BLACKBOX_RECORD_VALUES values
+// does nothing unless the blackbox is recording
+void blackboxRecord(enum BlackboxRecordType type, double time, const double *values, \
+		int count);
+
+// prints the records and bytes written, how much smaller the records are than as plain
+//   doubles, the records dropped and the way the file is being written
+void printBlackboxReport();
+
+#endif
@@ -0,0 +1,66 @@
+// decodes a whole blackbox file (see Blackbox.h) into one contiguous array per field,
+//   ready for numerical analysis, using every core
+// every block is a keyframe and its header counts its records of each type, so the
+//   place of every record in the arrays is known from the headers alone, and the blocks
+//   are then decoded in parallel straight into the arrays with nothing to merge after
+//
+// the records of each type are in file order, which is time order for the records of
+//   one thread
+//
+// by Mark Hill
+
+#ifndef _BlackboxColumns
+#define _BlackboxColumns
+
+#include<stdint.h>
+
+#include<Blackbox.h>
+
+// the number of blocks a worker thread takes at a time
+#define BLACKBOX_DECODE_CHUNK 16
+
+// the source of the rows of blocks that could not be decoded
+#define BLACKBOX_UNKNOWN_SOURCE 0xff
+
+// the records of one type, one array per field
+struct BlackboxTable {
+	uint64_t rows;
+	// the most values any of the records had
+	int width;
+	// in seconds, NAN for the rows of blocks that could not be decoded
+	double *time;
+	// BLACKBOX_UNKNOWN_SOURCE and 0 for the rows of blocks that could not be decoded
+	uint8_t *source;
+	uint32_t *sequence;
+	// the first width are used, and the values a record did not have are 0
+	double *values[BLACKBOX_RECORD_VALUES];
+};
+
+struct BlackboxColumns {
+	struct BlackboxTable tables[BLACKBOX_RECORD_TYPES];
+	uint64_t blocks;
+	// blocks that were not blackbox blocks or were broken partway
+	uint64_t badBlocks;
+};
+
+// decodes the file at path into columns, spreading the blocks over threads worker
+//   threads, where a threads value of 0 uses one thread per online processor
+// the arrays are allocated here and freed with freeBlackboxColumns()
+// returns 0 on success and -1 if the file could not be read
+int decodeBlackboxColumns(const char *path, int threads, struct BlackboxColumns *columns);
+
+// frees the arrays of columns
+void freeBlackboxColumns(struct BlackboxColumns *columns);
+
+// return the names of type and of its field, counting the values from 0, as used for
+//   the files written by writeBlackboxColumns()
+const char *blackboxTypeName(int type);
+const char *blackboxFieldName(int type, int field);
+
+// writes every array of columns into directory as a raw little endian file named
+//   <type>_<field>.f64, or .u32 and .u8 for the sequence numbers and sources, and
+//   summary.csv with the rows, the minimum, the maximum and the mean of every field
+// returns 0 on success and -1 on failure
+int writeBlackboxColumns(const struct BlackboxColumns *columns, const char *directory);
+
+#endif
@@ -0,0 +1,99 @@
+// the compact encoding of the blackbox file (see Blackbox.h)
+// every record is stored as a frame of varints, with each field turned into an integer
+//   at a fixed resolution and encoded as the zigzagged difference from what the earlier
+//   frames of the same kind predict, so the small changes from one sample to the next
+//   take a byte or two instead of the eight of a double
+// the sensor fields are kept at the resolution of the sensors' raw int16 counts, so
+//   nothing the sensors measured is lost, and the time at a microsecond
+//
+// frames of the same type from the same thread form a stream, which predicts
+//   - the sequence number to be one more than the last
+//   - the time to be as far from the last as the last was from the one before
+//   - every value to be the same as the last
+// every block of the file starts every stream over, so each block is a keyframe that can
+//   be decoded without reading anything before it
+//
+// a frame is
+//   a byte with the type in the low and the source in the high four bits, 0 after the
+//     last frame
+//   the zigzagged sequence difference shifted up a bit, with the bit set when the value
+//     count follows, which it does in the first frame of a stream and when it changes
+//   the value count if it follows
+//   the zigzagged time difference in microseconds
+//   the zigzagged difference of every value
+//
+// by Mark Hill
+
+#ifndef _BlackboxEncoding
+#define _BlackboxEncoding
+
+#include<stdint.h>
+
+#include<Blackbox.h>
+
+// the most bytes one frame can take
+#define BLACKBOX_MAX_FRAME_SIZE 80
+// the number of sources the frame header has room for
+#define BLACKBOX_SOURCES 16
+
+static_assert(BLACKBOX_MAX_THREADS <= BLACKBOX_SOURCES, "every ring needs a source");
+static_assert(BLACKBOX_RECORD_TYPES <= 16, "every type needs to fit in the frame header");
+
+// how many integer steps each value of each type is stored in per unit
+extern const double blackboxResolutions[BLACKBOX_RECORD_TYPES][BLACKBOX_RECORD_VALUES];
+
+// what the frames before predict of the next frame of a stream
+struct BlackboxStream {
+	// the number of frames in the block so far
+	uint32_t frames;
+	uint32_t sequence;
+	uint16_t count;
+	// in microseconds
+	int64_t time;
+	int64_t timeStep;
+	int64_t values[BLACKBOX_RECORD_VALUES];
+};
+
+// the state the encoder and the decoder both keep, which has to match frame for frame
+// needs no allocation, so it can live anywhere
+struct BlackboxPredictor {
+	struct BlackboxStream streams[BLACKBOX_SOURCES][BLACKBOX_RECORD_TYPES];
+};
+
+// walks through the records of one block of the file
+struct BlackboxBlockReader {
+	const uint8_t *frames;
+	uint32_t size;
+	uint32_t position;
+	struct BlackboxPredictor predictor;
+};
+
+// forgets every stream, which is done at the start of every block
+void resetBlackboxPredictor(struct BlackboxPredictor *predictor);
+
+// encodes record as a frame into output, which has space bytes
+// returns the size of the frame, or 0 without encoding anything if space is less than
+//   BLACKBOX_MAX_FRAME_SIZE
+int encodeBlackboxFrame(struct BlackboxPredictor *predictor, \
+		const struct BlackboxRecord *record, uint8_t *output, uint32_t space);
+
+// decodes the frame at the start of input, which has size bytes, into record
+// returns the size of the frame, 0 if there are no more frames, or -1 if the frame is
+//   broken
+int decodeBlackboxFrame(struct BlackboxPredictor *predictor, const uint8_t *input, \
+		uint32_t size, struct BlackboxRecord *record);
+
+// checks that block, BLACKBOX_BLOCK_SIZE bytes read from the file, has the header of a
+//   blackbox block of this version
+// returns 0 if it does and -1 otherwise
+int checkBlackboxBlock(const void *block);
+
+// checks block as checkBlackboxBlock() does and sets reader up to read its records
+// returns 0 on success and -1 if the block is not valid
+int openBlackboxBlock(struct BlackboxBlockReader *reader, const void *block);
+
+// decodes the next record of the block into record
+// returns 1 if there was one, 0 at the end of the block and -1 if the block is broken
+int nextBlackboxRecord(struct BlackboxBlockReader *reader, struct BlackboxRecord *record);
+
+#endif
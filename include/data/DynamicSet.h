@@ -0,0 +1,223 @@
+// a typed set of values kept next to each other in memory, the first N of them inside
+//   the set itself, so a small set never allocates and looking through any set is a
+//   walk over one array instead of a pointer chase per item
+// removing moves the last value into the gap, so it takes constant time but changes
+//   the order of the values
+// with Handles, every value added gets a handle that keeps naming it however the values
+//   move around, and removing by handle takes constant time as well
+// the storage only ever grows, so once a set has reached its largest size, adding and
+//   removing never allocate or free, and a set can be used from the control loops
+// the values are moved with memcpy, so T must be trivially copyable, like the pointers
+//   and small structs the registries hold
+// nothing here locks, sets shared between threads need a lock of their own
+//
+// by Mark Hill
+
+#ifndef _DynamicSet
+#define _DynamicSet
+
+#include<stdint.h>
+#include<stdlib.h>
+#include<string.h>
+
+#include<type_traits>
+
+// marks a handle slot that names no value, and ends the list of free handle slots
+#define DYNAMIC_SET_NO_HANDLE UINT32_MAX
+
+// the handle tables of a set with handles, which grow along with its values
+// handleOf holds the handle of the value at each index, and indexOf the index of the
+//   value of each handle in use, or the next free handle for the ones that are not
+template<bool Handles, uint32_t N>
+struct DynamicSetHandles {
+	uint32_t *handleOf = localHandleOf;
+	uint32_t *indexOf = localIndexOf;
+	// the first free handle, handles beyond used never having been given out
+	uint32_t freeHandle = DYNAMIC_SET_NO_HANDLE;
+	uint32_t used = 0;
+	uint32_t localHandleOf[N];
+	uint32_t localIndexOf[N];
+};
+
+// a set without handles keeps no tables
+template<uint32_t N>
+struct DynamicSetHandles<false, N> {
+};
+
+template<typename T, uint32_t N = 8, bool Handles = false>
+struct DynamicSet {
+	static_assert(std::is_trivially_copyable<T>::value, "DynamicSet moves values with memcpy");
+	static_assert(N > 0, "DynamicSet needs room for at least one value inside it");
+
+	// points at local until the values outgrow it, then at memory from malloc
+	T *values = local;
+	uint32_t count = 0;
+	uint32_t capacity = N;
+	T local[N];
+	DynamicSetHandles<Handles, N> handles;
+
+	DynamicSet() = default;
+	// values may point into the set itself, so a set cannot be copied or moved
+	DynamicSet(const DynamicSet &) = delete;
+	DynamicSet &operator=(const DynamicSet &) = delete;
+	~DynamicSet() {
+		if (values != local)
+			free(values);
+		if constexpr (Handles) {
+			if (handles.handleOf != handles.localHandleOf) {
+				free(handles.handleOf);
+				free(handles.indexOf);
+			}
+		}
+	}
+
+	// lets a set be looked through with a range for loop
+	T *begin() {
+		return values;
+	}
+	T *end() {
+		return values + count;
+	}
+	T &operator[](uint32_t index) {
+		return values[index];
+	}
+};
+
+// moves the count elements of size bytes at *memory into memory from malloc of capacity
+//   elements, freeing *memory unless it is local
+// returns 0 on success and -1 on failure, leaving *memory as it was
+template<typename E>
+inline int growDynamicSetArray(E **memory, E *local, uint32_t count, uint32_t capacity) {
+	E *grown;
+	if (*memory == local) {
+		if (!(grown = (E *)(malloc(sizeof(E) * capacity))))
+			return -1;
+		memcpy(grown, local, sizeof(E) * count);
+	}
+	else if (!(grown = (E *)(realloc(*memory, sizeof(E) * capacity)))) {
+		return -1;
+	}
+	*memory = grown;
+	return 0;
+}
+
+// makes room in set for at least capacity values
+// returns 0 on success and -1 on failure
+template<typename T, uint32_t N, bool Handles>
+int reserveDynamicSet(struct DynamicSet<T, N, Handles> *set, uint32_t capacity) {
+	if (capacity <= set->capacity)
+		return 0;
+
+	if (growDynamicSetArray(&set->values, set->local, set->count, capacity))
+		return -1;
+	if constexpr (Handles) {
+		// the handles in use can be anywhere below used, not just below count
+		if (growDynamicSetArray(&set->handles.indexOf, set->handles.localIndexOf, \
+					set->handles.used, capacity) || \
+				growDynamicSetArray(&set->handles.handleOf, set->handles.localHandleOf, \
+					set->count, capacity)) {
+			// the values have already grown, which is fine, but the tables must stay
+			//   as large as the capacity, so capacity does not change
+			return -1;
+		}
+	}
+	set->capacity = capacity;
+	return 0;
+}
+
+// adds value to the end of set, doubling the storage when it is full
+// returns the handle of value with Handles, its index without, or -1 on failure
+template<typename T, uint32_t N, bool Handles>
+int64_t addToDynamicSet(struct DynamicSet<T, N, Handles> *set, const T &value) {
+	if (set->count == set->capacity) {
+		// the largest capacity is one short of DYNAMIC_SET_NO_HANDLE
+		uint32_t grown = set->capacity < UINT32_MAX / 2 ? 2 * set->capacity : UINT32_MAX - 1;
+		if (grown == set->capacity || reserveDynamicSet(set, grown))
+			return -1;
+	}
+
+	uint32_t index = set->count++;
+	set->values[index] = value;
+	if constexpr (Handles) {
+		uint32_t handle = set->handles.freeHandle;
+		if (handle != DYNAMIC_SET_NO_HANDLE)
+			set->handles.freeHandle = set->handles.indexOf[handle];
+		else
+			handle = set->handles.used++;
+		set->handles.indexOf[handle] = index;
+		set->handles.handleOf[index] = handle;
+		return handle;
+	}
+	return index;
+}
+
+// returns the index of the first value in set equal to value, or -1 if there is none
+template<typename T, uint32_t N, bool Handles>
+int64_t findInDynamicSet(struct DynamicSet<T, N, Handles> *set, const T &value) {
+	for (uint32_t i = 0; i < set->count; i++) {
+		if (set->values[i] == value)
+			return i;
+	}
+	return -1;
+}
+
+// removes the value at index from set, moving the last value into its place
+// returns 0 on success and -1 if index is out of range
+template<typename T, uint32_t N, bool Handles>
+int removeFromDynamicSetAt(struct DynamicSet<T, N, Handles> *set, uint32_t index) {
+	if (index >= set->count)
+		return -1;
+
+	uint32_t last = --set->count;
+	if constexpr (Handles) {
+		uint32_t handle = set->handles.handleOf[index];
+		set->handles.indexOf[handle] = set->handles.freeHandle;
+		set->handles.freeHandle = handle;
+		if (index != last) {
+			uint32_t moved = set->handles.handleOf[last];
+			set->handles.handleOf[index] = moved;
+			set->handles.indexOf[moved] = index;
+		}
+	}
+	if (index != last)
+		set->values[index] = set->values[last];
+	return 0;
+}
+
+// removes the first value in set equal to value
+// returns 0 on success and -1 if value is not in set
+template<typename T, uint32_t N, bool Handles>
+int removeFromDynamicSet(struct DynamicSet<T, N, Handles> *set, const T &value) {
+	int64_t index = findInDynamicSet(set, value);
+	return index < 0 ? -1 : removeFromDynamicSetAt(set, (uint32_t)(index));
+}
+
+// returns the index of the value handle names in set, or -1 if it names none
+// a handle is only checked against the handles in use, so the handle of a removed value
+//   names whatever value gets it next
+template<typename T, uint32_t N>
+int64_t dynamicSetHandleIndex(struct DynamicSet<T, N, true> *set, uint32_t handle) {
+	if (handle >= set->handles.used)
+		return -1;
+	uint32_t index = set->handles.indexOf[handle];
+	if (index >= set->count || set->handles.handleOf[index] != handle)
+		return -1;
+	return index;
+}
+
+// returns the value handle names in set, or NULL if it names none
+template<typename T, uint32_t N>
+T *dynamicSetHandleValue(struct DynamicSet<T, N, true> *set, uint32_t handle) {
+	int64_t index = dynamicSetHandleIndex(set, handle);
+	return index < 0 ? NULL : &set->values[index];
+}
+
+// removes the value handle names from set in constant time
+// returns 0 on success and -1 if handle names no value
+template<typename T, uint32_t N>
+int removeFromDynamicSetByHandle(struct DynamicSet<T, N, true> *set, uint32_t handle) {
+	int64_t index = dynamicSetHandleIndex(set, handle);
+	return index < 0 ? -1 : removeFromDynamicSetAt(set, (uint32_t)(index));
+}
+
+#endif
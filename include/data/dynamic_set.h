@@ -1,8 +1,12 @@
 // dynamically sized set holding any data type
+// the C interface to a DynamicSet of pointers (see DynamicSet.h), so C++ code should use
+// 	that directly with the type it holds
 // by Mark Hill
 #ifndef __dynamic_set_h
 #define __dynamic_set_h
 
+#include<stdint.h>
+
 // placeholder; defined in implementation
 struct dyn_set;
 
@@ -10,6 +14,8 @@ struct dyn_set;
  * initializes a dynamic set with a start size of start_size
  * must be freed with dyn_set_deinit()
  *
+ * the first 8 items are kept inside the set, so small sets allocate only the set itself
+ *
  * @return		a pointer to the set
  * 				NULL if an error occured creating the set or start_size is 0
  */
@@ -29,12 +35,12 @@ void dyn_set_deinit(struct dyn_set *set);
  * @return		0 on success
  * 				1 on failure
  */
-inline uint8_t dyn_set_lock(struct dyn_set *set);
+uint8_t dyn_set_lock(struct dyn_set *set);
 
 /*
  * unlocks the recursive set mutex
  */
-inline uint8_t dyn_set_unlock(struct dyn_set *set);
+uint8_t dyn_set_unlock(struct dyn_set *set);
 
 /*
  * @return		the number of items in the underlying set
@@ -0,0 +1,101 @@
+// read-mostly set of pointers for registries, like the device and listener tables,
+//   which are looked through all the time and change rarely
+// readers never lock, wait or retry: a read section picks up the current snapshot of
+//   the items with one atomic increment and sees it unchanged until it ends, so
+//   iterating is wait-free however busy the writers are
+// writers are serialized by a mutex of their own, change a copy of the snapshot and
+//   publish it, then wait for the readers still in the old snapshot before freeing it,
+//   using two reader epochs like sleepable RCU so new readers never hold them up
+// nothing in the set prints or does any other I/O, every failure is a return value
+// by Mark Hill
+#ifndef __rcu_set_h
+#define __rcu_set_h
+
+#include<stdint.h>
+
+// placeholders; defined in implementation
+struct rcu_set;
+struct rcu_set_items;
+
+/*
+ * a read section of a set, filled in by rcu_set_read_begin()
+ * @count		the number of items in the snapshot
+ * @items		the items of the snapshot, which stay valid until rcu_set_read_end()
+ * @epoch		the reader epoch the section counts against, internal
+ * @snapshot	the snapshot the section holds, internal
+ */
+struct rcu_set_reader {
+	uint64_t count;
+	void *const *items;
+	unsigned epoch;
+	const struct rcu_set_items *snapshot;
+};
+
+/*
+ * initializes an empty set
+ * must be freed with rcu_set_deinit()
+ *
+ * @return		a pointer to the set
+ * 				NULL if the memory for it could not be allocated
+ */
+struct rcu_set *rcu_set_init(void);
+
+/*
+ * frees the set and its snapshot
+ * no read section or writer may be using the set any more
+ * does not free the data pointed to by set members themselves
+ */
+void rcu_set_deinit(struct rcu_set *set);
+
+/*
+ * starts a read section, filling in reader with the current items of set
+ * wait-free; the section must be short and must not sleep or block, since writers
+ * 	wait for it to end before freeing the snapshot it holds
+ * a section on a NULL set holds no items
+ *
+ * @return		the number of items in the snapshot
+ */
+uint64_t rcu_set_read_begin(struct rcu_set *set, struct rcu_set_reader *reader);
+
+/*
+ * ends a read section started by rcu_set_read_begin()
+ * wait-free; reader->items must not be used after this
+ */
+void rcu_set_read_end(struct rcu_set *set, struct rcu_set_reader *reader);
+
+/*
+ * @return		the number of items in set
+ * 				0 if set is NULL
+ */
+uint64_t rcu_set_count(struct rcu_set *set);
+
+/*
+ * @return		1 if item is in set
+ * 				0 if not, or if set or item is NULL
+ */
+uint8_t rcu_set_contains(struct rcu_set *set, void *item);
+
+/*
+ * adds the specified item to the end of the set pointed to by set
+ * waits for the read sections on the old snapshot to end
+ *
+ * @return		0 on success
+ * 				1 on memory allocation error
+ * 				2 if set or item is NULL
+ * 				3 if item is already in set
+ */
+int8_t rcu_set_add(struct rcu_set *set, void *item);
+
+/*
+ * removes the specified item, if it exists, from set, moving the last item into
+ * 	its place
+ * once this returns no read section can still see item, so it can be freed
+ *
+ * @return		0 on success
+ * 				1 on item not in set
+ * 				2 if set or item is NULL
+ * 				3 on memory allocation error
+ */
+int8_t rcu_set_remove(struct rcu_set *set, void *item);
+
+#endif
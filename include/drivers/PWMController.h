@@ -8,6 +8,43 @@
 
 #include<stdint.h>
 
+// the driver keeps a copy of every channel's registers, so reading a duty cycle does not
+//   touch the bus, and writing the duty cycle a channel already has is skipped
+
+// the chip is configured by a few register writes the first time a duty cycle is set
+// the writes are also exposed one step at a time, so a caller that must not block, like
+//   a task on an event loop, can run the configuration itself and wait between the steps
+//   on its own terms:
+//     for every step below pwmConfigurationSteps(), writePWMConfiguration(step), retried
+//       up to PWM_CONFIGURATION_RETRIES times while it fails
+//     wait PWM_OSCILLATOR_SETTLE_TIME seconds for the oscillator
+//     finishPWMConfiguration() with 0 if every step succeeded, or -1
+#define PWM_CONFIGURATION_RETRIES 3
+#define PWM_OSCILLATOR_SETTLE_TIME 0.0005
+
+// returns the number of configuration steps, or 0 if the chip is already configured
+int pwmConfigurationSteps();
+
+// returns the name of the configuration step, like "prescale", for messages
+const char *pwmConfigurationStepName(int step);
+
+// writes the register of the configuration step
+// returns 0 on success and -1 on failure
+int writePWMConfiguration(int step);
+
+// marks the chip as configured if success is 0
+void finishPWMConfiguration(int success);
+
+// returns the frequency in Hz of the PWM cycle, which is also the rate at which the
+//   devices pick up new percentages
+double pwmFrequency();
+
+// sets the frequency of the PWM cycle to the one closest to frequency in Hz that the
+//   chip can make, from about 24Hz to 1526Hz
+// the percentages of the devices stay the same, so their pulses change length
+// returns 0 on success and -1 on failure
+int setPWMFrequency(double frequency);
+
 // returns the percentage the device is on as a value from 0 - 1
 // specify the device by providing a value to the address variable
 //   which has values from 0 - n where n is the number of supported PWM
@@ -19,5 +56,24 @@ double getDutyPercent(uint8_t address);
 //   where n is the number of PWM devices supported for the address
 void setDutyPercent(uint8_t address, double percent);
 
+// sets the percentages of the count devices starting at first in a single bus write, so
+//   they all change at the same time
+// percents holds a value from 0 - 1 for each device
+// only the devices whose 12 bit register values actually change are written
+// returns 0 on success and -1 on failure
+int setDutyPercents(uint8_t first, uint8_t count, const double *percents);
+
+// like setDutyPercents(), but with the number of counts out of 4096 each device is on for
+//   in every PWM cycle, which is what the chip takes directly
+// counts of 4096 and above keep a device on the whole time
+// returns 0 on success and -1 on failure
+int setDutyCounts(uint8_t first, uint8_t count, const uint16_t *counts);
+
+// reads back every channel from the chip and rewrites the ones that do not hold what
+//   was last written, for example after a brownout reset the chip
+// this goes over the bus for all channels, so keep it out of the control loop
+// returns the number of channels rewritten, or -1 on failure
+int verifyPWMController();
+
 
 #endif
@@ -22,6 +22,15 @@ int i2c_read(uint16_t address, uint8_t reg, uint8_t *data, uint8_t count);
 // returns -1 on failure and 0 on success
 int i2c_write(uint16_t address, const uint8_t *data, uint8_t count);
 
+// sends every following transaction to the simulated bus (see i2csim.h) when simulated
+//   is 1, or back to the real bus when it is 0
+void i2cUseSimulation(int simulated);
+
+// holds the bus so no transaction can run until i2cUnlockBus() is called
+// the simulation uses this to change its devices between transactions
+void i2cLockBus();
+void i2cUnlockBus();
+
 // closes out the i2c file
 // I honestly can't anticipate a valid use for this since it's not like having the
 //   file open is that big a strain, but someone else may have better use, and its
@@ -0,0 +1,140 @@
+// a simulated i2c bus, so the drivers can be run and checked without the hardware
+// once enabled with i2cUseSimulation() (see i2cctl.h), every i2c_read and i2c_write goes
+//   to the simulated device attached at the address instead of the real bus, and
+//   addresses without a device fail like a device that does not acknowledge
+//
+// by Mark Hill
+
+#ifndef _i2csim
+#define _i2csim
+
+#include<stdint.h>
+
+// the most devices that can be attached at once
+#define I2C_SIM_MAX_DEVICES 8
+
+// a device on the simulated bus
+// write gets the bytes of a write transaction, which normally start with a register
+// read gets the register that was selected and fills data with count bytes from there
+// both return 0 on success and -1 to fail the transaction
+struct I2CSimDevice {
+    uint16_t address;
+    int (*write)(struct I2CSimDevice *device, const uint8_t *data, uint8_t count);
+    int (*read)(struct I2CSimDevice *device, uint8_t reg, uint8_t *data, uint8_t count);
+    // whatever the model of the device needs
+    void *state;
+};
+
+// attaches device to the simulated bus, replacing any device at the same address
+// the device must stay valid until it is detached
+// returns 0 on success and -1 if the bus is full
+int i2cSimAttach(struct I2CSimDevice *device);
+
+// detaches every device from the simulated bus
+void i2cSimDetachAll();
+
+// perform a transaction on the simulated bus, called by i2c_read and i2c_write
+// return 0 on success and -1 on failure
+int i2cSimRead(uint16_t address, uint8_t reg, uint8_t *data, uint8_t count);
+int i2cSimWrite(uint16_t address, const uint8_t *data, uint8_t count);
+
+
+////////////////////////
+//   PCA9685 model    //
+////////////////////////
+
+// the PWM chip used for the motors
+// models the register file with auto increment, the sleep bit gating prescale writes,
+//   and the 12 bit on and off counters of every channel
+struct PCA9685Model {
+    uint8_t registers[256];
+    // the number of write transactions the chip has received
+    uint32_t writes;
+    // the number of prescale writes ignored because the oscillator was running
+    uint32_t blockedPrescaleWrites;
+};
+
+// resets the model to the power on state of the chip and sets up device to attach it
+//   at address
+void initPCA9685Model(struct PCA9685Model *model, struct I2CSimDevice *device, uint16_t address);
+
+// returns the PWM frequency in Hz the chip runs at with its current prescale
+double pca9685Frequency(const struct PCA9685Model *model);
+
+// returns the width in microseconds of the pulse the chip puts out on channel
+double pca9685PulseWidth(const struct PCA9685Model *model, uint8_t channel);
+
+
+////////////////////////
+//   LSM6DS33 model   //
+////////////////////////
+
+// the accelerometer and gyroscope
+// models the register file with auto increment and the big endian output order, and
+//   turns the motion into output counts with the full scale of the control registers
+//   whenever the outputs are read, unless that sensor is powered down
+struct LSM6DS33Model {
+    uint8_t registers[128];
+    // in g and degrees per second, in the axes of the chip
+    double acceleration[3];
+    double rotation[3];
+};
+
+// resets the model to the power on state of the chip and sets up device to attach it
+//   at address
+void initLSM6DS33Model(struct LSM6DS33Model *model, struct I2CSimDevice *device, uint16_t address);
+
+// sets the acceleration in g and the rotation in degrees per second the chip measures,
+//   both in the axes of the chip
+// must be called with the bus held (see i2cLockBus)
+void lsm6ds33SetMotion(struct LSM6DS33Model *model, const double *acceleration, \
+        const double *rotation);
+
+
+////////////////////////
+//   MAG3110 model    //
+////////////////////////
+
+// the magnetometer
+// models the register file with auto increment, and only takes new measurements while
+//   the chip is active
+struct MAG3110Model {
+    uint8_t registers[32];
+    // in microteslas, in the axes of the chip
+    double field[3];
+};
+
+// resets the model to the power on state of the chip and sets up device to attach it
+//   at address
+void initMAG3110Model(struct MAG3110Model *model, struct I2CSimDevice *device, uint16_t address);
+
+// sets the field in microteslas the chip measures, in the axes of the chip
+// must be called with the bus held (see i2cLockBus)
+void mag3110SetField(struct MAG3110Model *model, const double *field);
+
+
+////////////////////////
+//    BMP180 model    //
+////////////////////////
+
+// the barometer
+// the chip leaves the compensation to the reader, so the model holds the calibration
+//   values from the example in the datasheet, and each conversion started through the
+//   control register puts out the raw value that compensates back to the pressure set
+struct BMP180Model {
+    uint8_t registers[256];
+    // the pressure in pascals
+    double pressure;
+    // the raw temperature every temperature conversion puts out
+    int32_t uncompensatedTemperature;
+};
+
+// resets the model to the power on state of the chip at sea level pressure and sets up
+//   device to attach it at address
+void initBMP180Model(struct BMP180Model *model, struct I2CSimDevice *device, uint16_t address);
+
+// sets the pressure in pascals the next conversion measures
+// must be called with the bus held (see i2cLockBus)
+void bmp180SetPressure(struct BMP180Model *model, double pressure);
+
+#endif
@@ -0,0 +1,75 @@
+// cascaded biquad filter bank for rejecting motor vibration from the gyroscope
+// a low pass section is followed by a number of notch sections, and all three axes are
+//   filtered together in one FilterSample per sample (see StreamFilters.h)
+//
+// the notch centres can be moved at any time from any thread, for example to follow the
+//   motor speed, without ever blocking the thread doing the filtering
+//
+// by Mark Hill
+
+#ifndef _GyroFilterBank
+#define _GyroFilterBank
+
+#include<stdint.h>
+#include<pthread.h>
+
+#include<atomic>
+
+#include<StreamFilters.h>
+
+#define GYRO_FILTER_MAX_NOTCHES 4
+
+// designs a notch section removing the centre frequency in Hz for the sample rate in Hz
+// higher q values give narrower notches
+struct BiquadCoefficients notchBiquad(double sampleRate, double center, double q);
+
+// every coefficient of the bank, precomputed whenever the notches move
+struct GyroFilterCoefficients {
+	int notchCount;
+	struct BiquadCoefficients lowPass;
+	struct BiquadCoefficients notches[GYRO_FILTER_MAX_NOTCHES];
+};
+
+struct GyroFilterBank {
+	double sampleRate;
+	double notchQ;
+
+	// the coefficients in use, guarded by a sequence number that is odd while they are
+	//   being rewritten
+	// the filtering thread copies them when the sequence changes, retrying if it
+	//   catches a rewrite in progress
+	struct GyroFilterCoefficients shared;
+	std::atomic<uint32_t> sequence;
+	// serializes threads moving the notches
+	pthread_mutex_t updateLock;
+
+	// only touched by the filtering thread
+	struct GyroFilterCoefficients coefficients;
+	uint32_t coefficientSequence;
+	// transposed direct form II state, the low pass first and then each notch
+	FilterSample z1[GYRO_FILTER_MAX_NOTCHES + 1];
+	FilterSample z2[GYRO_FILTER_MAX_NOTCHES + 1];
+};
+
+// sets up a bank filtering samples at sampleRate Hz with a low pass at lowPassCutoff Hz and
+//   notchCount (0 - GYRO_FILTER_MAX_NOTCHES) notches of the given q
+// the notches start out at half the nyquist frequency until moved
+// returns 0 on success and -1 if notchCount is out of range
+int initGyroFilterBank(struct GyroFilterBank *bank, double sampleRate, double lowPassCutoff, \
+		int notchCount, double notchQ);
+
+// moves the notches to the count centre frequencies in Hz
+// centres are clamped to the range the bank can filter, and notches beyond count keep
+//   their current centre
+// may be called from any thread
+void setGyroNotchFrequencies(struct GyroFilterBank *bank, const double *centers, int count);
+
+// sets the state of every section as if value had been filtered forever
+// only call from the filtering thread
+void settleGyroFilterBank(struct GyroFilterBank *bank, FilterSample value);
+
+// filters count samples in place
+// only one thread may filter with a given bank
+void gyroFilterBankProcess(struct GyroFilterBank *bank, FilterSample *samples, int count);
+
+#endif
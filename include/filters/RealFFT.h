@@ -0,0 +1,36 @@
+// fixed size radix-2 fast fourier transform of real valued data
+// the twiddle factors and bit reversal order are computed once when the transform is set
+//   up, after which transforms never allocate memory
+//
+// by Mark Hill
+
+#ifndef _RealFFT
+#define _RealFFT
+
+#include<stdint.h>
+
+#include<complex>
+
+// the largest supported transform size
+#define REAL_FFT_MAX_SIZE 1024
+
+struct RealFFT {
+	int size;
+	// e^(-2 pi i k / size) for k from 0 to size / 2 - 1
+	std::complex<double> twiddles[REAL_FFT_MAX_SIZE / 2];
+	// the bit reversed position of each index of the half size complex transform
+	uint16_t reversed[REAL_FFT_MAX_SIZE / 2];
+	// scratch space for the half size complex transform
+	std::complex<double> work[REAL_FFT_MAX_SIZE / 2];
+};
+
+// sets up a transform of size real values, which must be a power of two between 4 and
+//   REAL_FFT_MAX_SIZE
+// returns 0 on success and -1 if size is not supported
+int initRealFFT(struct RealFFT *fft, int size);
+
+// transforms size real values from input into the size / 2 + 1 non negative frequency
+//   bins of spectrum, bin k being k * sampleRate / size Hz
+void realFFT(struct RealFFT *fft, const double *input, std::complex<double> *spectrum);
+
+#endif
@@ -0,0 +1,113 @@
+// streaming filter stages for three axis sensor data
+// every stage keeps its state between calls and processes whole batches of samples in
+//   place, so a sensor can be read at its full data rate while the consumer only sees
+//   a filtered and decimated stream, all in a constant amount of memory
+//
+// samples are stored as 4 wide arrays holding x, y, z and an unused lane so that Eigen
+//   can process all three axes at once with vector instructions where the processor
+//   has them
+//
+// by Mark Hill
+
+#ifndef _StreamFilters
+#define _StreamFilters
+
+#include<stdint.h>
+
+#include<Eigen/Dense>
+
+using namespace Eigen;
+
+typedef Array4d FilterSample;
+
+// converts a vector into a filter sample and back
+inline FilterSample filterSample(const Vector3d &v) {
+	return FilterSample(v(0), v(1), v(2), 0);
+}
+
+inline Vector3d filterVector(const FilterSample &s) {
+	return Vector3d(s(0), s(1), s(2));
+}
+
+
+////////////////////////
+//    running mean    //
+////////////////////////
+
+// the mean of every sample added since the last reset
+struct RunningMean {
+	FilterSample sum = FilterSample::Zero();
+	uint64_t count = 0;
+};
+
+void resetRunningMean(struct RunningMean *mean);
+
+// adds count samples to the mean
+void addToRunningMean(struct RunningMean *mean, const FilterSample *samples, int count);
+
+// returns the mean of the samples so far, or zero if there are none
+FilterSample runningMean(const struct RunningMean *mean);
+
+
+////////////////////////
+//       biquad       //
+////////////////////////
+
+// the sections are run as a cascade by the gyroscope filter bank (see GyroFilterBank.h)
+// coefficients of a second order section, normalized so a0 = 1
+// y[n] = b0 x[n] + b1 x[n-1] + b2 x[n-2] - a1 y[n-1] - a2 y[n-2]
+struct BiquadCoefficients {
+	double b0, b1, b2, a1, a2;
+};
+
+// designs a low pass section with the cutoff frequency in Hz for the sample rate in Hz
+// a q of 0.7071 gives a butterworth response
+struct BiquadCoefficients lowPassBiquad(double sampleRate, double cutoff, double q);
+
+
+////////////////////////
+//   CIC decimator    //
+////////////////////////
+
+#define CIC_MAX_ORDER 4
+// inputs are clamped to +-this, which is well past the range of any of the sensors
+#define CIC_INPUT_LIMIT 32768.0
+
+// the fixed point registers of the decimator, which wrap around instead of overflowing
+typedef Array<uint64_t, 4, 1> CICRegister;
+
+// cascaded integrator comb decimator, which is the same as order moving averages of
+//   length rate but only costs a few additions per sample
+// the output is scaled to unity gain
+// the integrators keep growing with the input for as long as it runs, so they are fixed
+//   point integers that wrap around, and since the combs subtract in the same wrapping
+//   arithmetic the output comes out exact as long as it fits in the register, which
+//   the fraction bits are chosen to guarantee for inputs within CIC_INPUT_LIMIT
+struct CICDecimator {
+	int order;
+	int rate;
+	// the number of inputs since the last output
+	int phase;
+	CICRegister integrators[CIC_MAX_ORDER];
+	CICRegister combs[CIC_MAX_ORDER];
+	// converts an input to fixed point
+	double scale;
+	// converts an output from fixed point back with unity gain
+	double gain;
+};
+
+// sets up a decimator of the given order (1 - CIC_MAX_ORDER) that outputs one sample for
+//   every rate inputs
+// returns 0 on success and -1 if order or rate are out of range, including a rate so
+//   high that the gain leaves too few fraction bits for the inputs
+int initCICDecimator(struct CICDecimator *cic, int order, int rate);
+
+// decimates count samples in place, writing the outputs to the front of samples
+// returns the number of outputs written
+int cicDecimate(struct CICDecimator *cic, FilterSample *samples, int count);
+
+// feeds the decimator a constant value until its output has settled on that value, which
+//   avoids the startup ramp of a decimator with empty state
+void settleCICDecimator(struct CICDecimator *cic, FilterSample value);
+
+#endif
@@ -0,0 +1,94 @@
+// finds the dominant vibration frequencies in the gyroscope data so that the gyroscope
+//   filter notches can be placed on them
+// the spectral analysis runs on its own low priority thread, taking the newest window of
+//   samples from a SampleRing each frame, and publishes the peaks it finds without locking
+//   so the control path only ever pays for a small copy
+//
+// by Mark Hill
+
+#ifndef _VibrationAnalyzer
+#define _VibrationAnalyzer
+
+#include<stdint.h>
+#include<pthread.h>
+
+#include<atomic>
+#include<complex>
+
+#include<RealFFT.h>
+#include<SampleRing.h>
+
+// the number of samples in each analysis window
+#define VIBRATION_WINDOW_SIZE 256
+// the most peaks reported per frame
+#define VIBRATION_MAX_PEAKS 4
+
+struct VibrationPeaks {
+	// the monotonic time in seconds of the newest sample in the analyzed window
+	double time;
+	// the number of peaks found
+	int count;
+	// frequencies in Hz, strongest first
+	double frequencies[VIBRATION_MAX_PEAKS];
+	// the summed amplitude over all three axes of each peak, in the sample units
+	double magnitudes[VIBRATION_MAX_PEAKS];
+};
+
+struct VibrationAnalyzer {
+	// where the samples come from
+	struct SampleRing *ring;
+	// peaks below this frequency in Hz are ignored, being the motion of the vehicle
+	//   rather than vibration
+	double minimumFrequency;
+	// peaks weaker than this fraction of the strongest peak are ignored
+	double relativeThreshold;
+	// the time between frames in microseconds
+	uint32_t interval;
+
+	// the most recently published peaks, guarded by a sequence number that is odd while
+	//   they are being written
+	struct VibrationPeaks shared;
+	std::atomic<uint32_t> sequence;
+
+	// working buffers, reused for every frame
+	struct RealFFT fft;
+	double window[VIBRATION_WINDOW_SIZE];
+	struct SensorSample samples[VIBRATION_WINDOW_SIZE];
+	double input[VIBRATION_WINDOW_SIZE];
+	std::complex<double> spectrum[VIBRATION_WINDOW_SIZE / 2 + 1];
+	double amplitudes[VIBRATION_WINDOW_SIZE / 2 + 1];
+
+	pthread_t thread;
+	volatile int running;
+	// set by the thread as it exits
+	volatile int finished;
+};
+
+// sets up the analyzer to read from ring, running a frame every interval microseconds
+//   once started
+// returns 0 on success
+int initVibrationAnalyzer(struct VibrationAnalyzer *analyzer, struct SampleRing *ring, \
+		uint32_t interval);
+
+// analyzes the newest window of samples and publishes the peaks
+// this is what the analyzer thread runs every frame, and it can also be called directly
+//   when no thread is wanted
+// returns 0 on success and -1 if the ring does not hold a full window yet
+int analyzeVibration(struct VibrationAnalyzer *analyzer);
+
+// starts the low priority analyzer thread
+// returns 0 on success and -1 on failure
+int startVibrationAnalyzer(struct VibrationAnalyzer *analyzer);
+
+// stops the analyzer thread and waits for it to exit
+void stopVibrationAnalyzer(struct VibrationAnalyzer *analyzer);
+
+// copies the newest peaks into peaks if they were published after the ones identified by
+//   *sequence, then updates *sequence
+// start with a *sequence of 0
+// returns 0 if new peaks were copied and -1 otherwise
+// may be called from any thread, and never blocks
+int newVibrationPeaks(struct VibrationAnalyzer *analyzer, struct VibrationPeaks *peaks, \
+		uint32_t *sequence);
+
+#endif
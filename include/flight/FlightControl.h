@@ -0,0 +1,129 @@
+// the control laws that keep the vehicle level and moving the way the FlightManager asks
+// an outer velocity loop turns the difference between the wanted and the estimated
+//   horizontal velocity into a tilt, an attitude loop turns the difference between the
+//   measured and the wanted direction of gravity into rotation rates, and an inner loop
+//   holds those rates with a PID on the gyroscope, since the gyroscope is far faster and
+//   less noisy than the fused gravity vector
+// another PID holds the climb rate with the total thrust
+//
+// everything the loops need lives in a FlightControl struct that is set up once, so a
+//   control step never allocates, locks or prints and takes the same time every cycle
+//
+// by Mark Hill
+
+#ifndef _FlightControl
+#define _FlightControl
+
+#include<stdint.h>
+
+#include<Eigen/Dense>
+
+#include<SampleRing.h>
+
+using namespace Eigen;
+
+// the most gyroscope samples averaged into one rate measurement
+// the gyroscope runs faster than the loop, so a few new samples are expected each cycle
+#define FLIGHT_GYRO_BATCH 8
+
+struct PIDController {
+	double kp, ki, kd;
+	// the integral term is kept within +- this value of output
+	double integralLimit;
+	// the output is kept within +- this value
+	double outputLimit;
+
+	// the integral term, already multiplied by ki
+	double integral;
+	// the measurement of the last update, for the derivative
+	double previousMeasurement;
+	// 0 until the first update has set previousMeasurement
+	int primed;
+};
+
+struct FlightControl {
+	// the loop rate in Hz
+	double rate;
+
+	// the inner loop, one controller per body axis, from rotation rate error to the
+	//   angular motion vector (see MotorController.h)
+	struct PIDController ratePID[3];
+	// the outer loop gain from attitude error in radians to rotation rate
+	double attitudeGain;
+	// the rotation rates the outer loop and the yaw command may ask for
+	double maximumRate;
+	double maximumYawRate;
+	// the outer loop, one controller each for the body x and y axes, from the horizontal
+	//   velocity error in m/s to the tilt in radians
+	struct PIDController velocityPID[2];
+	// the horizontal speed in m/s asked for by a full horizontal velocity command
+	double maximumSpeed;
+	// the most tilt in radians the velocity loop may ask for on either axis
+	double maximumTilt;
+	// set when the horizontal velocity is measured, otherwise the horizontal velocity
+	//   command sets the tilt directly, as a fraction of maximumTilt
+	int velocityHold;
+
+	// holds the climb rate in m/s with the total thrust, on top of the hover thrust
+	struct PIDController climbPID;
+	// the climb rate in m/s asked for by a full vertical velocity command
+	double maximumClimbRate;
+	// the thrust from 0 to 1 that roughly holds the vehicle in the air
+	double hoverThrust;
+
+	// the unit gravity vector seen while level, which the wanted attitude is tilted from
+	Vector3d levelGravity;
+	// the gyroscope reading at rest, removed from every sample
+	Vector3d drift;
+
+	// the index in the gyroscope ring of the next sample to read
+	uint64_t gyroIndex;
+	struct SensorSample gyroBatch[FLIGHT_GYRO_BATCH];
+	// the newest rotation rate measurement, with the drift removed
+	Vector3d rotation;
+
+	// the outputs of the last step
+	// the velocity in m/s and the tilt in radians along the body x and y axes, z unused
+	Vector3d velocityTarget;
+	Vector3d tiltTarget;
+	Vector3d rateTarget;
+	Vector3d angularCommand;
+	double thrust;
+};
+
+// sets up the controller gains for a loop running at rate Hz and resets its state
+void initFlightControl(struct FlightControl *control, double rate);
+
+// clears the integrators and the measurements, and sets the level gravity vector and the
+//   gyroscope drift, ready for a new flight
+void resetFlightControl(struct FlightControl *control, const Vector3d &levelGravity, \
+		const Vector3d &drift);
+
+// clears the integral terms of every loop, keeping the rest of the state
+// meant for when the vehicle is on the ground, where the loops cannot do what they ask
+//   and the integrals would only wind up
+void clearIntegrators(struct FlightControl *control);
+
+// runs one PID update with the time step dt in seconds and returns the output
+double pidUpdate(struct PIDController *pid, double setpoint, double measurement, double dt);
+
+// averages the gyroscope samples pushed to ring since the last call into
+//   control->rotation, skipping ahead to the newest samples if the loop fell behind
+// ring should hold the filtered samples (see filteredGyroSamples), since the rate loop
+//   would otherwise chase the motor vibration
+// returns the number of samples used, and leaves control->rotation unchanged if there
+//   were none
+int readRotation(struct FlightControl *control, struct SampleRing *ring);
+
+// runs the velocity, attitude, rate and climb loops once with the time step dt in seconds
+// gravity is the fused gravity vector, horizontalVelocity the velocity along the body x
+//   and y axes in m/s and climbRate the vertical velocity in m/s (see Orientation.h)
+// velocity is the velocity command with components from -1 to 1 (positive x forward,
+//   positive y left and positive z climbing) and yaw the yaw rate command from -1 to 1
+// the results are placed in control->angularCommand, kept to a magnitude below 1 as
+//   setAngularMotionVector() wants, and control->thrust, from 0 to 1
+void flightControlStep(struct FlightControl *control, const Vector3d &gravity, \
+		const Vector3d &horizontalVelocity, double climbRate, const Vector3d &velocity, \
+		double yaw, double dt);
+
+#endif
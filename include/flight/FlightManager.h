@@ -11,11 +11,13 @@ using namespace Eigen;
 
 // this function initializes the flight manager and calibrates the sensors so
 //   that they are ready to recieve orientation data when action is requested
-// it then creates a background thread to wait and monitor changes
+// it then creates a background thread to wait and monitor changes, which runs the control
+//   loops (see FlightControl.h) at a fixed rate
 // returns 0 on success, and 1 on failure
 int startFlightManager();
 
 // this function is called to signal to the motor controller that the system is ready for takeoff
+// the vehicle must be sitting level, since the attitude it has now is taken as level
 // it accepts 2 arguments:
 //   - a double representing the rate of the takeoff on a scale of 0 - 1 with 1 being the fastest
 //   - a function pointer to a completion handler function which accepts a double as its argument
@@ -24,29 +26,36 @@ void takeOff(double takeOffTime, void (*takeOffCompletionHandler)(double));
 
 // this function is called to signal to the motor controller that the system has requested to
 //   land
-// it accepts 2 arguments:
-//   - a double representing the rate of landing speed on a scale from 0 - 1 with 1 being the fastest
+// it accepts 1 argument:
 //   - a function pointer to a completion handler function which accepts a double as its argument
 //      where the double represents the amount of time in seconds the landing took
 void land(void (*landedCompletionHandler)(double));
 
 // this function is called to update the linear velocity vector of the system to the supplied
 //   Vec3double argument
-// the vector should have components with values from 0 - 1 with 1 being approximately max speed
+// the vector should have components with values from -1 - 1 with 1 being approximately max speed
+// the x and y components set the velocity along the vehicle's front and left, which it
+//   holds by tilting, and the z component sets the climb rate
+// the velocity can only be held once the drag of the vehicle has been measured (see
+//   setHorizontalDragRate in Orientation.h), and until then the x and y components set
+//   the tilt instead, and the completion handler only waits for the climb rate
 // it accepts 2 arguments
 //   - a Vec3double vector representing the desired linear velocity 
 //   - a function pointer to a completition handler that will be called once the vehicle reached
-//      within 10% of the desired vector components
-void setVelocityVector(Vector3d velocityVector, void (*velocityUpdateCompletionHandler));
+//      within 10% of the desired vector components, with the number of seconds that took
+void setVelocityVector(Vector3d velocityVector, void (*velocityUpdateCompletionHandler)(double));
 
 // this function is called to update the angular velocity vector of the system to the supplied
 //   Vec3double argument
-// the vector should have components with values from 0 - 1 with 1 being approximately max angular speed
+// the vector should have components with values from -1 - 1 with 1 being approximately max angular speed
+// the vehicle holds its attitude, so only the z component (yaw) is used, and tilting is
+//   done through setVelocityVector()
 // it accepts 2 arguments
 //   - a Vec3double vector representing the desired angular velocity 
 //   - a function pointer to a completition handler that will be called once the vehicle reached
-//      within 10% of the desired vector components
-void setAngularVelocityVector(Vector3d angularVelocityVector, void (*angularVelocityUpdateCompletionHandler));
+//      within 10% of the desired vector components, with the number of seconds that took
+void setAngularVelocityVector(Vector3d angularVelocityVector, void (*angularVelocityUpdateCompletionHandler)(double));
+
 
 
 
@@ -0,0 +1,55 @@
+// the signal the ESCs (electronic speed controllers) expect, as pulse widths repeated
+//   every frame
+// everything is given in microseconds of pulse so it does not depend on the frame rate,
+//   and only turned into a duty cycle with the frame rate the PWM chip actually runs at
+//
+// standard PWM sends pulses of up to about 2ms, which limits the frame rate to around
+//   400Hz, while OneShot125 pulses are 8 times shorter and can be sent as fast as the
+//   PWM chip can count, so a new thrust reaches the motors much sooner
+//
+// by Mark Hill
+
+#ifndef _EscProtocol
+#define _EscProtocol
+
+enum EscProtocolType {
+	ESC_PWM,
+	ESC_ONESHOT125,
+};
+
+struct EscProtocol {
+	enum EscProtocolType type;
+	// the number of pulses per second
+	double frameRate;
+
+	// the pulse for an armed motor that does not spin, which is also the arming signal
+	double stopPulse;
+	// the pulses for the lowest thrust that keeps a motor spinning under load and for
+	//   full thrust
+	double idlePulse;
+	double fullPulse;
+	// the low and high endpoints calibrateMotor() teaches the ESCs
+	double calibrationLow;
+	double calibrationHigh;
+};
+
+// standard PWM at the frame rate my ESCs were first set up with, using the endpoints they
+//   were calibrated to
+constexpr struct EscProtocol pwmEscProtocol = {ESC_PWM, 265.37, 226.1, 414.5, 2011.1, 376.8, 2110.2};
+
+// OneShot125 at 1kHz
+constexpr struct EscProtocol oneShot125EscProtocol = {ESC_ONESHOT125, 1000, 120, 131, 245, 125, 250};
+
+// fills protocol with the pulses of the protocol type sent at frameRate Hz
+// returns 0 on success and -1 if the longest pulse of the protocol does not fit in a
+//   frame at that rate
+int escProtocol(enum EscProtocolType type, double frameRate, struct EscProtocol *protocol);
+
+// returns the pulse width in microseconds for a thrust from 0 - 1
+// 0 is the stop pulse, and anything above goes from the idle pulse to the full pulse
+double escPulseWidth(const struct EscProtocol *protocol, double thrust);
+
+// returns the thrust from 0 - 1 that a pulse width in microseconds gives
+double escThrust(const struct EscProtocol *protocol, double pulseWidth);
+
+#endif
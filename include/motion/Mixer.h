@@ -0,0 +1,116 @@
+// turns roll, pitch, yaw and thrust commands into a thrust for every motor
+// the layout of the motors is described by a table of motor positions for each airframe,
+//   and the one the vehicle uses is picked at compile time with AIRFRAME, so the mixing
+//   itself is a single fixed size matrix multiply no matter the motor count
+//
+// adding an airframe only takes a new table and a new AIRFRAME value below
+//
+// by Mark Hill
+
+#ifndef _Mixer
+#define _Mixer
+
+#include<stdint.h>
+
+#include<Eigen/Dense>
+
+using namespace Eigen;
+
+// where a motor sits and which way it spins
+// x and y follow the MotorController axes (x to the front, y to the left) in units of the
+//   distance from the centre to the furthest motor
+// direction is 1 for motors spinning clockwise seen from above, whose drag turns the
+//   vehicle counterclockwise (positive about z), and -1 for counterclockwise motors
+struct MotorGeometry {
+	double x, y;
+	double direction;
+};
+
+// the row of the mixer matrix for a motor, as the thrust change per unit of roll, pitch,
+//   yaw and thrust command
+// positive roll raises the left side, positive pitch lowers the front and positive yaw
+//   turns counterclockwise seen from above
+struct MixerRow {
+	double roll, pitch, yaw, thrust;
+};
+
+constexpr struct MixerRow mixerRow(struct MotorGeometry motor) {
+	return {motor.y, -motor.x, motor.direction, 1};
+}
+
+// motor 0 at the front, then counterclockwise seen from above
+constexpr struct MotorGeometry quadPlusGeometry[] = {
+	{ 1,  0, -1},
+	{ 0,  1,  1},
+	{-1,  0, -1},
+	{ 0, -1,  1},
+};
+
+// motor 0 at the front left, then counterclockwise seen from above
+constexpr struct MotorGeometry quadXGeometry[] = {
+	{ 0.7071,  0.7071, -1},
+	{-0.7071,  0.7071,  1},
+	{-0.7071, -0.7071, -1},
+	{ 0.7071, -0.7071,  1},
+};
+
+// motor 0 at the front left, then counterclockwise seen from above
+constexpr struct MotorGeometry hexXGeometry[] = {
+	{ 0.8660,  0.5, -1},
+	{ 0,       1,    1},
+	{-0.8660,  0.5, -1},
+	{-0.8660, -0.5,  1},
+	{ 0,      -1,   -1},
+	{ 0.8660, -0.5,  1},
+};
+
+// motor 0 just left of the front, then counterclockwise seen from above
+constexpr struct MotorGeometry octoXGeometry[] = {
+	{ 0.9239,  0.3827, -1},
+	{ 0.3827,  0.9239,  1},
+	{-0.3827,  0.9239, -1},
+	{-0.9239,  0.3827,  1},
+	{-0.9239, -0.3827, -1},
+	{-0.3827, -0.9239,  1},
+	{ 0.3827, -0.9239, -1},
+	{ 0.9239, -0.3827,  1},
+};
+
+#define AIRFRAME_QUAD_PLUS 0
+#define AIRFRAME_QUAD_X 1
+#define AIRFRAME_HEX_X 2
+#define AIRFRAME_OCTO_X 3
+
+// the plus layout is how my drone is wired
+#ifndef AIRFRAME
+#define AIRFRAME AIRFRAME_QUAD_PLUS
+#endif
+
+#if AIRFRAME == AIRFRAME_QUAD_PLUS
+#define AIRFRAME_GEOMETRY quadPlusGeometry
+#elif AIRFRAME == AIRFRAME_QUAD_X
+#define AIRFRAME_GEOMETRY quadXGeometry
+#elif AIRFRAME == AIRFRAME_HEX_X
+#define AIRFRAME_GEOMETRY hexXGeometry
+#elif AIRFRAME == AIRFRAME_OCTO_X
+#define AIRFRAME_GEOMETRY octoXGeometry
+#else
+#error "unknown AIRFRAME"
+#endif
+
+// the number of motors on the airframe in use
+constexpr int motorCount = sizeof(AIRFRAME_GEOMETRY) / sizeof(AIRFRAME_GEOMETRY[0]);
+
+typedef Matrix<double, motorCount, 1> MotorThrusts;
+
+// the roll, pitch, yaw and thrust command, in that order
+// thrust is from 0 to 1, and the others move each motor by at most their value
+typedef Vector4d MixerCommand;
+
+// mixes the command into a thrust from 0 to 1 for every motor of the airframe
+// when the command asks for more than the motors can give, the thrust is moved to make
+//   room for the attitude, and if that is not enough the roll, pitch and yaw are scaled
+//   down together, keeping the direction of the correction
+MotorThrusts mixMotors(const MixerCommand &command);
+
+#endif
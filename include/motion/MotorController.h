@@ -11,6 +11,10 @@
 
 #include<Eigen/Dense>
 
+#include<EscProtocol.h>
+#include<ThrustCurve.h>
+#include<Task.h>
+
 using namespace Eigen;
 
 // Note: for the following vector functions, the vectors should follow
@@ -24,15 +28,15 @@ Vector3d getLinearMotionVector();
 
 // sets the target linear motion vector to the supplied argument
 // the MotorController implementation handles properly setting the thrust values
+// the motors pick up the new target on the next PWM cycle (see startMotorOutput)
 // the passed in vector should have a total magnitude less than 1 and greater than 0
 void setLinearMotionVector(Vector3d targetLinearMotion);
 
 
 
-// Important: only Z axis angular motion is supported in my implementation
-//   the X and Y components are ignored and have no effect
-// Instead, it is recommended that the linear velocity be set with a low z value to achieve
-//   rotation in the x and y axises for the drone implementation
+// the x and y components of the angular vector roll and pitch the vehicle, and are added
+//   to the tilt the linear x and y components ask for
+// the motors are mixed for the airframe selected in Mixer.h
 
 // returns the current target angular motion vector of the vehicle
 Vector3d getAngularMotionVector();
@@ -45,19 +49,91 @@ void setAngularMotionVector(Vector3d targetAngularMotion);
 
 
 
+// starts the thread that writes the motion targets to the motors once every PWM cycle
+// setting a motion vector starts it, so this only needs calling to have the thread
+//   running before the first target
+// returns 0 on success and -1 on failure
+int startMotorOutput();
+
+// stops the motor output thread, leaving the motors at their last thrust
+void stopMotorOutput();
+
+
+
 // the following functions are for testing purposes and internal control
 // it is recommended that the motors be controlled from the vector functions
 //   instead
 // implementation can be found in MotorControllerLowLevel.c
 
+// where the ESCs (electronic speed controllers) are in the arming sequence
+// the ESCs only accept thrust after seeing a low arming signal for a short while
+enum MotorArmingState {
+	MOTORS_DISARMED,
+	MOTORS_ARMING,
+	MOTORS_ARMED,
+};
+
+// sends the arming signal to every motor at once and returns without waiting
+// if ready is not NULL, it is called with context on another thread once the motors are
+//   armed, or right away if they already are
+// the call still comes if the motors are disarmed and armed again before then, but not if
+//   they are left disarmed
+// does nothing but the callback if the motors are arming or armed already
+// returns 0 on success and -1 on failure
+int armMotors(void (*ready)(void *), void *context);
+
+// returns the arming state of the motors, never blocks
+enum MotorArmingState motorArmingState();
+
+// removes the signal from every motor, which disarms the ESCs
+void disarmMotors();
+
+// switches the signal the ESCs get to the protocol type at frameRate Hz
+// disarms the motors first, since the ESCs must not see the frame rate change
+// the ESCs have to be set up for the new protocol, and calibrated for it with
+//   calibrateMotor() if they need that
+// returns 0 on success and -1 on failure
+int setEscProtocol(enum EscProtocolType type, double frameRate);
+
+// sets how the motor turns pulses into thrust (see ThrustCurve.h), which is linear until
+//   the motors have been measured
+// disarms the motors first, since the pulse for a thrust changes
+// returns 0 on success and -1 on failure
+int setMotorCalibration(uint8_t motorNumber, struct MotorCalibration calibration);
+
 // returns the thrust percentage of the addressed motor as a value between 0 - 1 where 1 is maximum thrust
 double getMotorThrustPercentage(uint8_t motorNumber);
 
 // sets the thrust percentage for the addressed motor to the value passed to thrustPercentage where
 //   thrustPercentage is a value between 0 - 1 with 1 being maximum thrust
+// like setMotorThrustPercentages(), the thrust is dropped while the motors are not armed
 void setMotorThrustPercentage(uint8_t motorNumber, double thrustPercentage);
 
-// calibrates the motor to the values defined in MotorController.cpp (_maxThrust and _minThrust)
+// sets the thrust percentages of count motors starting at firstMotor at the same time, as
+//   done by setMotorThrustPercentage() for each
+// thrust is only accepted once the motors are armed, so until then this starts arming
+//   (see armMotors) and drops the thrust
+// returns 0 if the thrust was written and -1 otherwise
+int setMotorThrustPercentages(uint8_t firstMotor, uint8_t count, const double *thrustPercentages);
+
+// returns the approximate rotation frequency in Hz of a motor at the given thrust percentage
+// the motors are the main source of vibration, so this tells the sensor filters where to look
+double motorRotationFrequency(double thrustPercentage);
+
+// calibrates the motor to the endpoints of the ESC protocol in use (see EscProtocol.h)
+// asks on standard output to power the ESCs off and on, and waits for enter in between
 void calibrateMotor(uint8_t motorNumber);
 
+// like calibrateMotor(), but as a task on loop (see Task.h), which keeps serving its other
+//   sources while the calibration waits for enter or for the ESCs
+// calls done with context on the loop's thread once the motor is calibrated
+Task calibrateMotorTask(struct EventLoop *loop, uint8_t motorNumber, \
+		void (*done)(void *), void *context);
+
+// configures the PWM chip the motors are on (see PWMController.h) as a task on loop,
+//   waiting between retries and for the chip's oscillator to settle without blocking it
+// calls done with 0 on success or -1 on failure and context on the loop's thread, right
+//   away if the chip was already configured
+Task configureMotorOutputs(struct EventLoop *loop, void (*done)(int, void *), void *context);
+
 #endif
@@ -0,0 +1,53 @@
+// turns the thrust wanted from a motor straight into the PWM counts the chip needs for it
+// a motor's thrust goes roughly with the square of the pulse above idle, and differs a
+//   bit from motor to motor, so each motor gets a table of counts for evenly spaced
+//   thrusts, built once from its calibration, which is then interpolated
+// the lookup is the same few operations for every thrust, with no branches and no
+//   powers or divisions, so every motor can be done at once in the motor output path
+//
+// by Mark Hill
+
+#ifndef _ThrustCurve
+#define _ThrustCurve
+
+#include<stdint.h>
+
+#include<EscProtocol.h>
+
+// the number of points in each table, spaced evenly over thrusts from 0 - 1
+#define THRUST_CURVE_POINTS 65
+
+// how one motor turns pulses into thrust
+struct MotorCalibration {
+	// the thrust at the full pulse, for motors a bit weaker or stronger than the rest
+	double scale;
+	// the thrust goes with the part of the pulse above idle to this power
+	double exponent;
+};
+
+struct ThrustCurve {
+	// the counts for each point
+	float counts[THRUST_CURVE_POINTS];
+	// the counts of the stop pulse, used for no thrust at all
+	float stopCounts;
+
+	// kept to turn counts back into a thrust
+	struct EscProtocol protocol;
+	struct MotorCalibration calibration;
+	double countsPerMicrosecond;
+};
+
+// builds the table of a motor with the given calibration for the protocol sent at
+//   frequency Hz, which should be the frequency the PWM chip really runs at
+void buildThrustCurve(struct ThrustCurve *curve, const struct EscProtocol *protocol, \
+		double frequency, struct MotorCalibration calibration);
+
+// looks up the counts for count thrusts from 0 - 1, one per curve
+// thrusts at or below 0 get the stop pulse, which keeps an armed motor still
+void thrustCounts(const struct ThrustCurve *curves, const double *thrusts, uint16_t *counts, \
+		int count);
+
+// returns the thrust that a motor's counts give, the inverse of the lookup
+double countsThrust(const struct ThrustCurve *curve, double counts);
+
+#endif
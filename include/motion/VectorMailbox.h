@@ -0,0 +1,44 @@
+// holds the newest of a stream of vectors for a consumer that only cares about the
+//   latest one, like the motor output task picking up motion targets
+// any number of threads can post without ever blocking, and the reader always gets a
+//   whole vector, never a mix of two posts
+// posts are kept in a small ring of slots, each carrying the number of the post it holds,
+//   so a reader copying a slot can tell whether a newer post overwrote it meanwhile
+//
+// by Mark Hill
+
+#ifndef _VectorMailbox
+#define _VectorMailbox
+
+#include<stdint.h>
+
+#include<atomic>
+
+#include<Eigen/Dense>
+
+using namespace Eigen;
+
+// the number of posts kept, must be a power of two
+#define MAILBOX_SLOTS 8
+
+struct VectorMailbox {
+	Vector3d values[MAILBOX_SLOTS];
+	// twice the post number plus two for a slot holding a post, odd while it is being
+	//   written and 0 before its first post
+	std::atomic<uint64_t> stamps[MAILBOX_SLOTS] = {};
+	// the number of post numbers handed out
+	std::atomic<uint64_t> tickets = {0};
+	// one more than the number of the newest finished post, 0 while empty
+	std::atomic<uint64_t> latest = {0};
+};
+
+// makes value the newest vector in the mailbox
+// may be called from any thread, and never blocks
+void postVector(struct VectorMailbox *mailbox, const Vector3d &value);
+
+// copies the newest vector into value and its post number plus one into sequence, which
+//   changes whenever a newer vector is posted
+// returns 0 on success and -1 if nothing has been posted yet
+int latestVector(struct VectorMailbox *mailbox, Vector3d *value, uint64_t *sequence);
+
+#endif
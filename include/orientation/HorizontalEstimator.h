@@ -0,0 +1,51 @@
+// estimates the velocity along the body x and y axes, so the vehicle can hold a
+//   horizontal velocity without a position sensor
+// the motors only push along the body z axis, so the part of the accelerometer reading
+//   across it is the air drag alone, which grows with the velocity through the air, and
+//   dividing it by the drag per unit of velocity measures the velocity
+// the acceleration with gravity removed is integrated at its full rate, and the noisier
+//   drag measurement slowly pulls the result back, the same way the barometer corrects
+//   the VerticalEstimator
+// the drag per unit of velocity belongs to the vehicle and has to be measured, for
+//   example by a coast down, and until it is the estimator gives no velocity at all
+//
+// by Mark Hill
+
+#ifndef _HorizontalEstimator
+#define _HorizontalEstimator
+
+#include<Eigen/Dense>
+
+using namespace Eigen;
+
+struct HorizontalEstimator {
+	// the drag deceleration in m/s^2 for every m/s of velocity, 0 while unmeasured
+	double dragRate = 0;
+	// the correction gain, derived from the time constant
+	double velocityGain = 0;
+	// the accelerometer reading in m/s^2 along the body x and y axes at rest, which would
+	//   otherwise read as drag from a constant velocity
+	Vector3d bias = Vector3d(0, 0, 0);
+
+	// the velocity in m/s along the body x and y axes, the z component is always 0
+	Vector3d velocity = Vector3d(0, 0, 0);
+
+	// the time in seconds of the last acceleration sample, 0 if there has been none
+	double predictTime = 0;
+};
+
+// sets up the estimator for a vehicle with the given drag rate, 0 if it is unmeasured,
+//   and the time constant in seconds that the drag measurement corrects over, smaller
+//   values trusting it more
+// bias is the accelerometer reading in m/s^2 at rest, only its x and y are used
+// the estimate starts at rest
+void initHorizontalEstimator(struct HorizontalEstimator *estimator, double dragRate, \
+		double timeConstant, const Vector3d &bias);
+
+// integrates one sample in the body axes, with acceleration the acceleration in m/s^2
+//   with gravity removed and specificForce the whole accelerometer reading in m/s^2
+// time is the monotonic time in seconds the sample was taken
+void horizontalPredict(struct HorizontalEstimator *estimator, const Vector3d &acceleration, \
+		const Vector3d &specificForce, double time);
+
+#endif
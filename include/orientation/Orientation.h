@@ -5,9 +5,13 @@
 #define _Orientation
 
 #include<stdint.h>
+#include<pthread.h>
 
 #include<Eigen/Dense>
 
+#include<VerticalEstimator.h>
+#include<HorizontalEstimator.h>
+
 using namespace Eigen;
 
 struct Orientation {
@@ -23,9 +27,136 @@ struct Orientation {
 	double heading;
 
 	// this gives the vehicle's height in meters from sea level
+	// the barometer is fused with the accelerometer, so this is updated at the
+	//   accelerometer rate
 	double altitude;
+
+	// the rate of climb in m/s, negative when descending
+	double verticalVelocity;
+
+	// the velocity in m/s along the body x and y axes, with a z component of 0
+	// it is measured from the air drag, so it is the velocity through the air, and it
+	//   stays 0 until the drag of the vehicle is known (see setHorizontalDragRate)
+	Vector3d horizontalVelocity;
+};
+
+// holds everything one sensor fusion instance needs, so more than one can exist at a time
+// the live sensors feed a single internal instance, but offline tools (see Replay.h) can
+//   create as many as they like and push recorded samples through the same fusion code
+// a default constructed filter is uncalibrated and ready for calibrateOrientationFilter()
+struct OrientationFilter {
+	// calibration values
+
+	// the expected no motion value of the vector representing the force of gravity
+	Vector3d initGravity = Vector3d(0, 0, 0);
+	// the magnitude of the static gravity vector
+	double initGravityLength = 0;
+	// the average angular error, which is subtracted from any samples
+	Vector3d angularDrift = Vector3d(0, 0, 0);
+	// the inclination of the magnetic field in degrees below the
+	//   horizontal line
+	double inclinationAngle = 0;
+	// the magnitude of the magnetic field
+	double magneticFieldMagnitude = 0;
+
+	// working data
+
+	struct Orientation currentOrientation = {
+		.acceleration = Vector3d(0, 0, 0),
+		.gravity = Vector3d(0, 0, 0),
+		.heading = 0,
+		.altitude = 0,
+		.verticalVelocity = 0,
+		.horizontalVelocity = Vector3d(0, 0, 0),
+	};
+	struct Orientation previousOrientation = {
+		.acceleration = Vector3d(0, 0, 0),
+		.gravity = Vector3d(0, 0, 0),
+		.heading = 0,
+		.altitude = 0,
+		.verticalVelocity = 0,
+		.horizontalVelocity = Vector3d(0, 0, 0),
+	};
+	// the time in seconds of the last accelerometer and gyroscope sample
+	// this is needed because the rotation angle must be found by integrating the gyroscope
+	double angUpdateTime = 0;
+	// fuses the vertical acceleration with the barometer for the altitude
+	struct VerticalEstimator vertical;
+	// fuses the horizontal acceleration with the drag for the horizontal velocity
+	struct HorizontalEstimator horizontal;
+
+	// protects everything above when the filter is shared between threads
+	pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
 };
 
+// sets the calibration values of the filter from the averaged at rest sensor vectors
+//   and resets its orientation to the at rest state
+// gravity is the mean accelerometer vector, drift the mean gyroscope vector and field
+//   the mean magnetometer vector
+void calibrateOrientationFilter(struct OrientationFilter *filter, Vector3d gravity, \
+		Vector3d drift, Vector3d field);
+
+// feeds one accelerometer and gyroscope sample into the filter
+// time is the monotonic time in seconds the sample was taken, which is used to integrate
+//   the gyroscope between calls
+void updateFilterAcceleration(struct OrientationFilter *filter, Vector3d rawAcceleration, \
+		Vector3d rotation, double time);
+
+// feeds one magnetometer sample into the filter
+void updateFilterHeading(struct OrientationFilter *filter, Vector3d magField);
+
+// feeds one barometer altitude sample into the filter
+// the altitude is corrected the next time an accelerometer sample comes in
+void updateFilterAltitude(struct OrientationFilter *filter, double altitude);
+
+// returns a copy of the filter's current orientation
+struct Orientation filterOrientation(struct OrientationFilter *filter);
+
+// starts writing every sample the live filter consumes to the file at path so that the
+//   flight can later be run through replaySensorLog() (see Replay.h)
+// returns 0 on success and -1 on failure
+int startSensorLog(const char *path);
+
+// stops recording and closes the log started with startSensorLog()
+void stopSensorLog();
+
+// sets the drag deceleration of the vehicle in m/s^2 for every m/s of velocity, as
+//   measured by a coast down, which the horizontal velocity is measured with
+// until it is set the horizontal velocity stays 0, since it cannot be measured, and 0
+//   or less unsets it again
+void setHorizontalDragRate(double dragRate);
+
+// returns the drag rate set with setHorizontalDragRate(), 0 while there is none
+double horizontalDragRate();
+
+// returns the ring holding every raw gyroscope read taken for the orientation updates
+// only available while orientation updates are running (see getOrientation)
+struct SampleRing *gyroSamples();
+
+// returns the ring holding the same reads after the low pass and vibration notches,
+//   which is what anything steering the vehicle should use
+// only available while orientation updates are running (see getOrientation)
+struct SampleRing *filteredGyroSamples();
+
+// returns the gyroscope reading at rest found by calibrateSensors(), which has to be
+//   removed from the samples in gyroSamples() and filteredGyroSamples() before they are used
+Vector3d gyroscopeDrift();
+
+// moves the gyroscope vibration notches to the given motor rotation frequency in Hz and
+//   its first harmonic
+// meant to be called by the motor controller whenever the thrust changes
+// ignored while the vibration analysis has recently measured where the vibration is
+void setMotorNoiseFrequency(double frequency);
+
+// places the orientation the drone had at time into orientation, interpolating in between
+//   fusion updates, so readings from slow sensors can be matched to the right orientation
+// time is in seconds on the clock in Clock.h
+// only the last couple of seconds are kept (see OrientationHistory.h)
+// returns 0 on success
+//         1 if time is in the future, in which case the newest orientation is returned
+//         -1 if time is too old or there is no orientation yet
+int getOrientationAt(double time, struct Orientation *orientation);
+
 // prints out all the members of the passed in orientation struct
 void printOrientation(struct Orientation orientation);
 
@@ -0,0 +1,54 @@
+// keeps the most recent orientations along with the time they were computed, so the
+//   orientation at an earlier moment can be looked up
+// this is useful for slow sensors whose readings describe the past by the time they
+//   arrive, like the barometer or a camera frame
+//
+// there may only be one thread adding records, but any number of threads can look up
+//   orientations at the same time without locking
+//
+// by Mark Hill
+
+#ifndef _OrientationHistory
+#define _OrientationHistory
+
+#include<stdint.h>
+
+#include<atomic>
+
+#include<Orientation.h>
+
+// the number of orientations kept, must be a power of two
+// at the 400Hz acceleration rate this covers a bit over 2.5 seconds
+#define ORIENTATION_HISTORY_SIZE 1024
+
+struct OrientationRecord {
+	// monotonic time in seconds
+	double time;
+	struct Orientation orientation;
+};
+
+struct OrientationHistory {
+	struct OrientationRecord records[ORIENTATION_HISTORY_SIZE] = {};
+	// one more than the index of the record held by each slot, 0 while a slot is
+	//   being written
+	// readers compare this before and after copying a record to detect overwrites
+	std::atomic<uint64_t> stamps[ORIENTATION_HISTORY_SIZE] = {};
+	// the total number of records ever added
+	std::atomic<uint64_t> count = {0};
+};
+
+// adds an orientation computed at time, which must not be older than the newest record
+// only one thread may call this for a given history
+void addOrientationRecord(struct OrientationHistory *history, double time, \
+		struct Orientation orientation);
+
+// places the orientation at time into orientation
+// times in between records are interpolated, spherically for the gravity vector
+// returns 0 on success
+//         1 if time is newer than the newest record, in which case the newest
+//           orientation is returned
+//         -1 if the history is empty or time is older than the oldest record
+int orientationAt(struct OrientationHistory *history, double time, \
+		struct Orientation *orientation);
+
+#endif
@@ -0,0 +1,51 @@
+// runs recorded sensor logs through the orientation sensor fusion as fast as the
+//   processor allows, with no real time sleeps in between samples
+// each log gets its own OrientationFilter, so many logs can be replayed at once
+//
+// logs are recorded with startSensorLog() (see Orientation.h) and are plain text with
+//   one sample per line, the first character giving the sample type
+//   c gx gy gz dx dy dz fx fy fz      calibration: mean gravity, gyro drift, magnetic field
+//   a t ax ay az rx ry rz             accelerometer and gyroscope sample taken at time t
+//   h t mx my mz                      magnetometer sample
+//   b t altitude                      barometer altitude
+// times are monotonic seconds, the rest use the units of the SensorManager functions
+// the calibration line must come before any other sample
+//
+// by Mark Hill
+
+#ifndef _Replay
+#define _Replay
+
+#include<stdint.h>
+
+#include<Orientation.h>
+
+// describes the outcome of replaying a single log
+struct ReplayResult {
+	// 0 if the log was replayed, -1 if it could not be opened or was malformed
+	int failed;
+	// the number of samples fed to the filter
+	uint64_t samples;
+	// the amount of flight time the log covers in seconds
+	double duration;
+	// the amount of real time the replay took in seconds
+	double elapsed;
+	// the orientation after the last sample
+	struct Orientation orientation;
+};
+
+// replays the log at logPath through a fresh OrientationFilter
+// if outputPath is not NULL, the orientation after every accelerometer sample is written to
+//   it, one line per sample as 't ax ay az gx gy gz heading altitude climb'
+// returns 0 on success and -1 on failure
+int replaySensorLog(const char *logPath, const char *outputPath, struct ReplayResult *result);
+
+// replays count logs, spreading them over threads worker threads
+// a threads value of 0 uses one thread per online processor
+// outputPaths may be NULL, otherwise it is used as in replaySensorLog() for each log
+// results must have room for count entries
+// returns the number of logs that failed
+int replaySensorLogs(const char *const *logPaths, const char *const *outputPaths, \
+		int count, int threads, struct ReplayResult *results);
+
+#endif
@@ -0,0 +1,48 @@
+// estimates the altitude and climb rate by fusing the vertical acceleration with the
+//   barometer
+// the accelerometer is integrated at its full rate, and the slower, noisier barometer
+//   slowly pulls the result back so the integration does not drift away
+// this is a third order complementary filter, which also learns the bias of the vertical
+//   acceleration, so a constant accelerometer error does not turn into a climb rate
+//
+// by Mark Hill
+
+#ifndef _VerticalEstimator
+#define _VerticalEstimator
+
+// standard gravity in m/s^2, for converting accelerations in g's
+#define STANDARD_GRAVITY 9.80665
+
+struct VerticalEstimator {
+	// the correction gains, derived from the time constant
+	double altitudeGain = 0;
+	double velocityGain = 0;
+	double biasGain = 0;
+
+	// altitude in meters, climb rate in m/s and vertical acceleration bias in m/s^2
+	double altitude = 0;
+	double velocity = 0;
+	double bias = 0;
+
+	// the difference between the last barometer altitude and the estimate, which is
+	//   fed back a bit at a time on every acceleration sample
+	double altitudeError = 0;
+	// the time in seconds of the last acceleration sample, 0 if there has been none
+	double predictTime = 0;
+	// 0 until the first barometer altitude has set the starting altitude
+	int initialized = 0;
+};
+
+// sets up the estimator with the time constant in seconds that the barometer corrects
+//   over, smaller values trusting the barometer more
+// the estimate starts at the first barometer altitude
+void initVerticalEstimator(struct VerticalEstimator *estimator, double timeConstant);
+
+// integrates one vertical acceleration sample in m/s^2, positive up, with gravity removed
+// time is the monotonic time in seconds the sample was taken
+void verticalPredict(struct VerticalEstimator *estimator, double acceleration, double time);
+
+// corrects the estimate with one barometer altitude in meters
+void verticalCorrect(struct VerticalEstimator *estimator, double altitude);
+
+#endif
@@ -0,0 +1,64 @@
+// the one clock every thread reads the time from and sleeps on
+// normally this is just CLOCK_MONOTONIC, but it can be switched to a virtual clock for
+//   simulation (see Simulator.h), where time only moves forward once every thread taking
+//   part is asleep, and then jumps straight to the earliest wake up
+// the virtual clock wakes one thread at a time in a fixed order, so a simulation runs the
+//   same way every time
+// that way the whole flight stack runs as fast as the processor allows, and computing
+//   takes no time at all as far as the code being simulated can tell
+//
+// a thread takes part in the virtual clock until it exits once it has been started with
+//   createClockThread(), has switched to the virtual clock, or has first slept
+// while taking part, a thread must not block on anything but the clock for long, since
+//   the time stands still while it is awake, so joining a thread that is sleeping on the
+//   clock never returns
+//
+// by Mark Hill
+
+#ifndef _Clock
+#define _Clock
+
+#include<pthread.h>
+
+// returns the current time in seconds
+double monotonicTime();
+
+// sleeps until the time in seconds, returning right away if it has passed
+void sleepUntil(double time);
+
+// sleeps for a number of seconds
+void sleepFor(double seconds);
+
+// switches to the virtual clock, starting at time seconds, with the calling thread
+//   taking part
+// must be called before any thread has slept or read the time
+void useVirtualClock(double time);
+
+// starts a thread the same way as pthread_create, and returns what it does
+// on the virtual clock the thread takes part from the moment it is created, so the time
+//   cannot move on while it is getting started, and first runs in its turn once the
+//   calling thread sleeps
+int createClockThread(pthread_t *thread, const pthread_attr_t *attributes, \
+		void *(*routine)(void *), void *argument);
+
+// returns 1 while the virtual clock is in use and 0 otherwise
+int virtualClockEnabled();
+
+// a mutex that can be held across sleeping on the clock
+// on the virtual clock a thread blocked on a plain mutex counts as awake, so the time
+//   cannot move on to wake the thread holding it, while one waiting on this counts as
+//   asleep until the mutex is handed to it, in the order the threads would wake
+// on the real clock it is just a pthread mutex
+struct ClockMutex {
+	pthread_mutex_t mutex;
+	// 1 while a thread holds it on the virtual clock
+	int held;
+};
+
+#define CLOCK_MUTEX_INITIALIZER {PTHREAD_MUTEX_INITIALIZER, 0}
+
+void lockClockMutex(struct ClockMutex *mutex);
+
+void unlockClockMutex(struct ClockMutex *mutex);
+
+#endif
@@ -0,0 +1,126 @@
+// a reactor that lets one thread wait on everything it serves at once: periodic timers,
+//   one off alarms, events signalled by other threads, edges on GPIO lines, like the
+//   data ready pins of the sensors, and any other file becoming readable
+// on the real clock every source is a file in one epoll set, a timerfd, an eventfd or a
+//   GPIO line request, so the thread sleeps in the kernel until something is due and
+//   wakes exactly once for it, and stopping the loop is just one more eventfd
+// on the virtual clock (see Clock.h) the timers sleep on the clock instead, since the
+//   kernel knows nothing of the virtual time, and the files are checked whenever the
+//   loop wakes up
+//
+// the sources are added before the loop runs or from its own handlers, never from other
+//   threads, and nothing is allocated once the loop is running
+//
+// by Mark Hill
+
+#ifndef _EventLoop
+#define _EventLoop
+
+#include<pthread.h>
+
+#include<atomic>
+
+#include<LoopTiming.h>
+
+// the most sources one loop can have
+#define EVENT_LOOP_MAX_SOURCES 16
+// how long in seconds the loop sleeps on the virtual clock at most before checking its
+//   files, when no timer is due sooner
+#define EVENT_LOOP_VIRTUAL_POLL 0.01
+
+// the edges a GPIO source wakes up on
+#define EVENT_GPIO_RISING 1
+#define EVENT_GPIO_FALLING 2
+
+enum EventSourceKind {
+	EVENT_SOURCE_NONE,
+	EVENT_SOURCE_TIMER,
+	EVENT_SOURCE_EVENT,
+	EVENT_SOURCE_GPIO,
+	// a file the loop does not own, like standard input
+	EVENT_SOURCE_FILE,
+};
+
+// called on the loop's thread with the argument the source was added with and the time
+//   in seconds (see Clock.h) it is for: the deadline of a timer, the time an edge was
+//   seen on a GPIO line, or the time an event was picked up
+// returns 0 to keep the source and -1 to remove it
+typedef int (*EventHandler)(void *argument, double time);
+
+struct EventSource {
+	// an EventSourceKind, EVENT_SOURCE_NONE while the slot is free
+	int kind;
+	// the timerfd, eventfd, GPIO line or file, or -1 for a timer on the virtual clock
+	int file;
+	EventHandler handler;
+	void *argument;
+	// the seconds between the deadlines of a timer, 0 for an alarm, and the next one
+	double period;
+	double deadline;
+	// measures how well a timer keeps its rate, or NULL
+	struct LoopTiming *timing;
+	struct LoopClock clock;
+};
+
+struct EventLoop {
+	// the epoll set, and the eventfd stopEventLoop() wakes it with
+	int poll = -1;
+	int wake = -1;
+	// set by stopEventLoop(), even before the loop has started running
+	std::atomic<int> stopped = {0};
+	// set by runEventLoop() as it returns
+	std::atomic<int> finished = {0};
+	struct EventSource sources[EVENT_LOOP_MAX_SOURCES] = {};
+};
+
+// creates the epoll set and the wake up event of loop, which can be run once
+// returns 0 on success and -1 on failure
+int initEventLoop(struct EventLoop *loop);
+
+// removes every source and closes the files of loop, which must not be running
+void closeEventLoop(struct EventLoop *loop);
+
+// adds a timer calling handler every period seconds, starting a period from now
+// missed deadlines are skipped rather than run late one after the other
+// timing, if not NULL, is registered under name and records every call (see LoopTiming.h)
+// returns the source's index on success and -1 on failure
+int addLoopTimer(struct EventLoop *loop, double period, EventHandler handler, \
+		void *argument, struct LoopTiming *timing, const char *name);
+
+// adds an alarm calling handler once at time in seconds (see Clock.h), or as soon as the
+//   loop runs if it has passed, after which it is removed whatever handler returns
+// returns the source's index on success and -1 on failure
+int addLoopAlarm(struct EventLoop *loop, double time, EventHandler handler, void *argument);
+
+// adds file, which the caller keeps open until the source is removed, calling handler
+//   whenever it can be read
+// returns the source's index on success and -1 on failure
+int addLoopFile(struct EventLoop *loop, int file, EventHandler handler, void *argument);
+
+// adds an event calling handler once signalLoopEvent() has been called on it, however
+//   many times that was since the last call
+// returns the source's index on success and -1 on failure
+int addLoopEvent(struct EventLoop *loop, EventHandler handler, void *argument);
+
+// wakes the event source of loop at index, from any thread or a signal handler
+void signalLoopEvent(struct EventLoop *loop, int index);
+
+// adds the line of the GPIO chip at the path, like /dev/gpiochip0, as an input calling
+//   handler on each of the edges, a mix of EVENT_GPIO_RISING and EVENT_GPIO_FALLING
+// returns the source's index on success and -1 on failure
+int addLoopGpio(struct EventLoop *loop, const char *chip, int line, int edges, \
+		EventHandler handler, void *argument);
+
+// runs the handlers of loop as their sources become due until stopEventLoop() is called
+// returns 0 once stopped and -1 if waiting failed
+int runEventLoop(struct EventLoop *loop);
+
+// makes runEventLoop() return, from any thread including the loop's own
+void stopEventLoop(struct EventLoop *loop);
+
+// stops loop, which runs on thread, and waits for the thread to exit
+// on the virtual clock the loop only wakes up while the calling thread sleeps, so this
+//   sleeps on the clock until the loop has finished rather than just joining
+void stopEventLoopThread(struct EventLoop *loop, pthread_t thread);
+
+#endif
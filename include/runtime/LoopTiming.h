@@ -0,0 +1,84 @@
+// measures how well each periodic task keeps its rate
+// every cycle records how late the task woke up, how long it ran and the time since its
+//   last cycle into fixed bucket histograms, so the tails can be read out while flying
+//   without ever taking a lock or allocating on the task's thread
+// the buckets grow with the value, eight to every doubling from a microsecond up, so a
+//   percentile is good to within an eighth of its value wherever it falls
+//
+// every task keeps a LoopTiming, which registers itself on first use so that
+//   printLoopTimings() can show them all, and each thread running the task keeps its own
+//   LoopClock, so one LoopTiming can be shared by several threads of the same kind
+//
+// by Mark Hill
+
+#ifndef _LoopTiming
+#define _LoopTiming
+
+#include<stdint.h>
+
+#include<atomic>
+
+// the bucket layout, see the top of the file
+#define TIMING_SUB_BUCKETS 8
+#define TIMING_OCTAVES 24
+#define TIMING_BUCKETS (1 + TIMING_OCTAVES * TIMING_SUB_BUCKETS)
+// the most tasks that can be registered
+#define LOOP_TIMING_MAX_TASKS 16
+
+// a histogram of durations, which any number of threads can add to at once
+struct TimingHistogram {
+	std::atomic<uint64_t> buckets[TIMING_BUCKETS] = {};
+	std::atomic<uint64_t> count = {0};
+	// in nanoseconds
+	std::atomic<uint64_t> maximum = {0};
+};
+
+struct LoopTiming {
+	const char *name = NULL;
+	// how late the task woke up, how long each cycle ran and the time between the starts
+	//   of consecutive cycles
+	struct TimingHistogram lateness;
+	struct TimingHistogram execution;
+	struct TimingHistogram period;
+	// cycles that ran longer than the period or woke up more than a period late
+	std::atomic<uint64_t> overruns = {0};
+	std::atomic<int> registered = {0};
+};
+
+// the part of the timing belonging to one thread running a task
+struct LoopClock {
+	// the period the thread is meant to run at in seconds
+	double period;
+	// the start of the current and the last cycle, 0 before the first
+	double start;
+	double previous;
+	double lateness;
+};
+
+// sets up clock for a thread running timing's task every period seconds, and registers
+//   timing under name if it is not already
+void initLoopClock(struct LoopClock *clock, struct LoopTiming *timing, const char *name, \
+		double period);
+
+// records the start of a cycle, where expected is the time in seconds (see Clock.h) the
+//   thread meant to wake up at
+void loopStart(struct LoopTiming *timing, struct LoopClock *clock, double expected);
+
+// records the end of the cycle started by the last loopStart()
+void loopEnd(struct LoopTiming *timing, struct LoopClock *clock);
+
+// returns the value in seconds that fraction of the recorded values are at or below,
+//   rounded up to the end of its bucket, or 0 if nothing has been recorded
+double timingPercentile(const struct TimingHistogram *histogram, double fraction);
+
+// returns the number of registered tasks
+int loopTimingCount();
+
+// returns the registered task at index, from 0 up to loopTimingCount()
+struct LoopTiming *loopTimingAt(int index);
+
+// prints the p50, p99, p99.9 and maximum lateness, execution time and period of every
+//   registered task, along with its overruns
+void printLoopTimings();
+
+#endif
@@ -0,0 +1,54 @@
+// puts the time critical threads on the real time scheduler so the sensor reads, the
+//   control loop and the motor writes are not held up by logging or anything else
+//   running on the board
+// once enableRealTime() has been called, each thread calls makeRealTimeThread() with
+//   its task as it starts, which gives it a SCHED_FIFO priority, pins it to a core other
+//   than core 0, where most interrupts and system work end up, and prefaults its stack
+// without the privileges for any of this, the threads fall back to a better nice value
+//   or simply keep running as they are, and printRealTimeReport() tells what was granted
+//
+// by Mark Hill
+
+#ifndef _RealTime
+#define _RealTime
+
+// the kinds of time critical threads, highest priority first
+enum RealTimeTask {
+	// the sensor reading threads in Orientation.cpp
+	REAL_TIME_ACQUISITION,
+	// the motor output thread in the MotorController
+	REAL_TIME_OUTPUT,
+	// the flight control loop in the FlightManager
+	REAL_TIME_CONTROL,
+	// the orientation listener threads
+	REAL_TIME_FUSION,
+	REAL_TIME_TASK_COUNT,
+};
+
+// switches the process to the real time profile
+// locks all current and future memory so no page fault can stall a thread, and faults
+//   in heapBytes of heap up front that stay with the process when freed, so later
+//   allocations do not fault either
+// must be called before the threads are started, usually first thing in main()
+// returns 0 if everything was granted and -1 if the process fell back on anything
+int enableRealTime(unsigned long heapBytes);
+
+// returns 1 if enableRealTime() has been called and 0 otherwise
+int realTimeEnabled();
+
+// gives the calling thread the scheduling, core and prefaulted stack of task
+// does nothing unless enableRealTime() has been called, so threads can always call it
+// returns 0 if everything was granted and -1 if the thread fell back on anything
+int makeRealTimeThread(enum RealTimeTask task);
+
+// puts the calling thread below every other thread, for work like logging that must
+//   never hold up the time critical threads
+// the thread gets a nice value of 10, and once enableRealTime() has been called is kept
+//   on core 0 with the rest of the system
+// returns 0 on success and -1 on failure
+int makeBackgroundThread();
+
+// prints the memory locking and the scheduling each task ended up with
+void printRealTimeReport();
+
+#endif
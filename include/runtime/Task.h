@@ -0,0 +1,149 @@
+// coroutine tasks for device sequences that have to wait on the hardware between steps,
+//   like starting a conversion, waiting for it to finish and reading the result
+// a task is written as straight line code, but every co_await on a sleep hands the
+//   thread back to the event loop (see EventLoop.h) the task runs on until the wait is
+//   over, so any number of sequences can interleave on one thread without holding up
+//   each other or the loop's timers
+// a task runs as soon as it is called, up to its first wait, and frees itself once it
+//   finishes, so nothing has to keep hold of it, and it hands its results back through
+//   what its arguments point to, usually a completion handler
+// the frames come from a fixed pool, so starting a task never allocates, and a task that
+//   cannot get a frame never starts, which its started member tells
+//
+// by Mark Hill
+
+#ifndef _Task
+#define _Task
+
+#include<stddef.h>
+
+#include<coroutine>
+#include<exception>
+
+#include<EventLoop.h>
+#include<Clock.h>
+
+// the most bytes a task's frame can take, and the most tasks that can be running at once
+#define TASK_FRAME_SIZE 1024
+#define TASK_FRAMES 32
+
+// returns a frame of size bytes from the pool, or NULL if it is too large or every
+//   frame is taken
+void *allocateTaskFrame(size_t size);
+
+// returns frame to the pool
+void freeTaskFrame(void *frame);
+
+// resumes the task whose coroutine handle has the address task
+// the event handler of every wait, so it removes its source
+int resumeTask(void *task, double time);
+
+struct Task {
+	struct promise_type {
+		static void *operator new(size_t size) noexcept {
+			return allocateTaskFrame(size);
+		}
+		static void operator delete(void *frame) {
+			freeTaskFrame(frame);
+		}
+		static Task get_return_object_on_allocation_failure() {
+			return Task{0};
+		}
+		Task get_return_object() {
+			return Task{1};
+		}
+		std::suspend_never initial_suspend() noexcept {
+			return {};
+		}
+		std::suspend_never final_suspend() noexcept {
+			return {};
+		}
+		void return_void() {
+		}
+		void unhandled_exception() {
+			std::terminate();
+		}
+	};
+
+	// 1 if the task got a frame and has run up to its first wait, or to its end
+	int started;
+};
+
+// waits on an event loop until a time in seconds (see Clock.h)
+struct TaskSleep {
+	struct EventLoop *loop;
+	double time;
+
+	bool await_ready() {
+		return monotonicTime() >= time;
+	}
+	// when the loop has no room for the alarm, the task sleeps right here instead
+	bool await_suspend(std::coroutine_handle<> task) {
+		if (addLoopAlarm(loop, time, &resumeTask, task.address()) >= 0)
+			return true;
+		sleepUntil(time);
+		return false;
+	}
+	void await_resume() {
+	}
+};
+
+// waits on loop until time in seconds
+inline struct TaskSleep taskSleepUntil(struct EventLoop *loop, double time) {
+	return TaskSleep{loop, time};
+}
+
+// waits on loop for a number of seconds
+inline struct TaskSleep taskSleepFor(struct EventLoop *loop, double seconds) {
+	return TaskSleep{loop, monotonicTime() + seconds};
+}
+
+// waits on an event loop until a file can be read
+struct TaskReadable {
+	struct EventLoop *loop;
+	int file;
+
+	bool await_ready() {
+		return false;
+	}
+	// when the loop has no room for the file, the task carries on and reads it blocking
+	bool await_suspend(std::coroutine_handle<> task) {
+		return addLoopFile(loop, file, &resumeTask, task.address()) >= 0;
+	}
+	void await_resume() {
+	}
+};
+
+// waits on loop until file, which stays open, can be read
+inline struct TaskReadable taskReadable(struct EventLoop *loop, int file) {
+	return TaskReadable{loop, file};
+}
+
+// runs a bus transaction, a function taking nothing and returning 0 on success and -1
+//   on failure, and gives back what it returned
+// the bus drivers finish a transaction within the call, in a fraction of a millisecond,
+//   so the task carries on right away, but the sequences wait on their transactions
+//   like on anything else, so a driver that queues them can hand the thread back to
+//   the loop without the sequences changing
+template<typename Transaction>
+struct TaskTransaction {
+	Transaction transaction;
+	int result;
+
+	bool await_ready() {
+		result = transaction();
+		return true;
+	}
+	void await_suspend(std::coroutine_handle<> task) {
+	}
+	int await_resume() {
+		return result;
+	}
+};
+
+template<typename Transaction>
+inline struct TaskTransaction<Transaction> busTransaction(Transaction transaction) {
+	return TaskTransaction<Transaction>{transaction, 0};
+}
+
+#endif
@@ -0,0 +1,52 @@
+// a fixed size ring of timestamped sensor vectors, written by the thread acquiring the
+//   sensor and read by any number of consumers that each keep their own position
+// readers never take a lock and never slow the writer down, but a reader that falls more
+//   than SAMPLE_RING_SIZE samples behind loses the samples that were overwritten
+//
+// by Mark Hill
+
+#ifndef _SampleRing
+#define _SampleRing
+
+#include<stdint.h>
+
+#include<atomic>
+
+#include<Eigen/Dense>
+
+using namespace Eigen;
+
+// the number of samples kept, must be a power of two
+#define SAMPLE_RING_SIZE 2048
+
+struct SensorSample {
+	// monotonic time in seconds
+	double time;
+	Vector3d value;
+};
+
+struct SampleRing {
+	struct SensorSample samples[SAMPLE_RING_SIZE] = {};
+	// one more than the index of the sample held by each slot, 0 while a slot is
+	//   being written
+	std::atomic<uint64_t> stamps[SAMPLE_RING_SIZE] = {};
+	// the total number of samples ever pushed
+	std::atomic<uint64_t> count = {0};
+};
+
+// adds a sample to the ring
+// only one thread may push to a given ring
+void pushSample(struct SampleRing *ring, double time, const Vector3d &value);
+
+// returns the total number of samples ever pushed, which is one more than the index of
+//   the newest sample
+uint64_t sampleCount(struct SampleRing *ring);
+
+// copies the samples with indices first through first + count - 1 into samples
+// returns the number of samples copied, which is less than count if the ring does not
+//   hold all of them (yet, or any longer)
+// the copy stops at the first missing sample, so the copied samples are always the
+//   consecutive ones starting at first
+int readSamples(struct SampleRing *ring, uint64_t first, struct SensorSample *samples, int count);
+
+#endif
@@ -11,6 +11,7 @@
 #include<stdint.h>
 
 #include<Eigen/Dense>
+#include<Task.h>
 
 using namespace Eigen;
 
@@ -22,7 +23,7 @@ Vector3d accelerationVector();
 // in a similar manner to the accelerationVector() function, this
 //   collects sensors data and returns a vector, but of the angular
 //   rotation rate of the gyroscope instead of the linear acceleration
-// measured in units of degrees per second
+// measured in units of radians per second
 Vector3d rotationVector();
 
 // this collects data from the magnetometer and returns a vector containing
@@ -39,6 +40,14 @@ Vector3d magneticField();
 // measured in units of meters
 double barometerAltitude();
 
+// reads the altitude like barometerAltitude(), but as a task on loop (see Task.h) that
+//   hands the thread back to the loop while the temperature and pressure conversions
+//   run, instead of sleeping through the 30 milliseconds they take
+// calls done with the altitude in meters, or NAN if the read failed, and context on the
+//   loop's thread once it is finished
+Task readBarometerAltitude(struct EventLoop *loop, \
+		void (*done)(double altitude, void *context), void *context);
+
 // sets up all the sensors by writing their configuration registers and other setup as needed
 int initializeSensors();
 
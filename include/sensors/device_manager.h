@@ -93,15 +93,15 @@ struct dr_dev {
 
 	enum dr_dev_type type;
 	enum dr_dev_flags flags;
-	uint8_t *name[NAME_LEN];
-	uint8_t *hw_name[NAME_LEN]
-	
+	char name[NAME_LEN];
+	char hw_name[NAME_LEN];
+
 	enum dr_bus_type bus_type;
 	unsigned int bus_num;
 	uint16_t address;
 	int8_t active;
 
-	pthread_mutext_t lock;
+	pthread_mutex_t lock;
 };
 
 /**
@@ -113,17 +113,38 @@ struct dr_dev {
 int8_t name_dr_dev(struct dr_dev *dev, const char *name);
 
 /**
- * registers *dev with the device manager
+ * registers *dev with the device manager, calling dev_init() first
+ * the device table is read-mostly (see rcu_set.h), so looking devices up never waits
+ * 	on registration
  * @dev				the device to be registered
  *
  * @return			0 if successful
+ * 					1 if dev_init() failed or the table could not be changed
+ * 					2 if dev or one of its required functions is NULL
+ * 					3 if dev is already registered
  */
 int8_t register_device(struct dr_dev *dev);
 
 /**
  * unregisters *dev with the device manager and sends dev_close()
+ * once this returns no lookup can still find dev
  * @dev				the devices to be unregistered
  */
 void unregister_device(struct dr_dev *dev);
 
+/**
+ * finds the first active registered device that reads all of the types
+ * wait-free, so it can be used from the control loops
+ * @type			the dr_dev_type values wanted, bitwise ORed
+ *
+ * @return			the device, which stays valid until it is unregistered
+ * 					NULL if no active device reads all of them
+ */
+struct dr_dev *find_device(enum dr_dev_type type);
+
+/**
+ * @return			the number of registered devices
+ */
+uint64_t device_count(void);
+
 #endif
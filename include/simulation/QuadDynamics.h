@@ -0,0 +1,73 @@
+// a rigid body model of the vehicle for the simulator (see Simulator.h)
+// every motor of the airframe in Mixer.h pushes along the body z axis at its position and
+//   twists the body with its drag, and follows its command with a short lag like a real
+//   propeller spinning up
+// the vehicle rests on flat ground at height 0, which holds it still and level
+//
+// the world axes are x to the north, y to the west and z up, and the body axes follow the
+//   MotorController (x to the front, y to the left and z to the top), so a level vehicle
+//   facing north has its body axes on the world axes
+//
+// by Mark Hill
+
+#ifndef _QuadDynamics
+#define _QuadDynamics
+
+#include<Eigen/Dense>
+
+#include<Mixer.h>
+
+using namespace Eigen;
+
+struct QuadParameters {
+	// in kg
+	double mass;
+	// the moments of inertia about the body axes in kg m^2
+	Vector3d inertia;
+	// the distance from the centre to the furthest motor in meters
+	double armLength;
+	// the thrust of one motor at full command in newtons
+	double maximumThrust;
+	// the drag torque a motor puts on the body per newton of thrust, in meters
+	double dragTorqueRatio;
+	// the time constant in seconds of a motor following its command
+	double motorTimeConstant;
+	// the air drag in newtons per m/s and in newton meters per rad/s
+	double linearDrag;
+	double angularDrag;
+	// the most deceleration in m/s^2 the landing gear puts on the vehicle coming down on
+	//   it, since nothing stops instantly and no accelerometer could measure it if it did
+	double gearDeceleration;
+};
+
+struct QuadState {
+	// in meters and m/s in the world axes
+	Vector3d position;
+	Vector3d velocity;
+	// the acceleration over the last step in m/s^2 in the world axes
+	Vector3d acceleration;
+	// turns the body axes into the world axes
+	Quaterniond attitude;
+	// in rad/s in the body axes
+	Vector3d angularVelocity;
+	// the thrust of every motor in newtons
+	double motorThrusts[motorCount];
+};
+
+// fills parameters with a vehicle of about a kilogram that hovers at a bit over half
+//   thrust
+void defaultQuadParameters(struct QuadParameters *parameters);
+
+// puts the vehicle at rest and level on the ground at the origin, facing north
+void initQuadState(struct QuadState *state);
+
+// moves state on by dt seconds with every motor given a command from 0 - 1 of its
+//   maximum thrust
+void stepQuadDynamics(const struct QuadParameters *parameters, struct QuadState *state, \
+		const double *commands, double dt);
+
+// returns what an accelerometer at the centre of the vehicle reads, in g's in the body
+//   axes, which is gravity pointing up at rest
+Vector3d specificForce(const struct QuadState *state);
+
+#endif
@@ -0,0 +1,38 @@
+// runs the whole flight stack closed loop against a simulated vehicle, much faster than
+//   real time
+// the PWM chip, the accelerometer and gyroscope, the magnetometer and the barometer are
+//   replaced by the models in i2csim.h on the simulated i2c bus, so the drivers and
+//   everything above them, from the SensorManager through the Orientation and the
+//   FlightManager to the MotorController, run unchanged
+// time is switched to the virtual clock (see Clock.h), and a simulator thread steps the
+//   vehicle (see QuadDynamics.h) at a fixed rate on it, reading the pulse every motor
+//   gets from the PWM chip, turning it into a command the way the ESCs do, and writing
+//   the motion that results back into the sensors
+//
+// the simulated ESCs speak standard PWM (see EscProtocol.h), arm after seeing a pulse
+//   below idle for a while, and give thrust going with the square of the pulse above
+//   idle, and motor n is on PWM channel n
+//
+// by Mark Hill
+
+#ifndef _Simulator
+#define _Simulator
+
+#include<QuadDynamics.h>
+
+// the rate in Hz the vehicle is stepped at
+#define SIMULATOR_STEP_RATE 1000
+
+// switches to the virtual clock and the simulated i2c bus and starts stepping a vehicle
+//   with the given parameters, or the default ones if vehicle is NULL
+// must be called before anything else reads the time or touches the i2c bus
+// returns 0 on success and -1 on failure
+int startSimulator(const struct QuadParameters *vehicle);
+
+// stops stepping the vehicle, leaving the virtual clock and the simulated bus in use
+void stopSimulator();
+
+// returns the state of the vehicle as of the last step
+struct QuadState simulatorState();
+
+#endif
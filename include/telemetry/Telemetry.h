@@ -0,0 +1,58 @@
+// streams the orientation, the motor outputs and the loop timings to a ground station
+//   over UDP while flying (see TelemetryProtocol.h for the messages, and
+//   tools/telemetryReceive.cpp for a receiver)
+// the time critical threads publish without ever blocking, allocating or making a system
+//   call: every message type has a rate limit, and a message that gets past it is
+//   encoded straight into a free buffer of a preallocated pool and marked ready
+// a background sender thread collects the ready buffers every TELEMETRY_SEND_INTERVAL
+//   seconds and hands them all to the kernel with one sendmmsg() on a non blocking
+//   socket, so a slow or missing ground station costs messages, never flight time
+// when the pool has no free buffer the message is dropped, and the per type sequence
+//   numbers show the receiver where
+//
+// by Mark Hill
+
+#ifndef _Telemetry
+#define _Telemetry
+
+#include<TelemetryProtocol.h>
+
+// the number of buffers in the pool, the most messages that can wait to be sent
+#define TELEMETRY_POOL_SIZE 64
+// how often in seconds the sender thread sends what has been published
+#define TELEMETRY_SEND_INTERVAL 0.02
+// the port the receiver listens on unless told otherwise
+#define TELEMETRY_DEFAULT_PORT 14560
+
+// the default rates in Hz of the message types
+#define TELEMETRY_ORIENTATION_RATE 50
+#define TELEMETRY_MOTORS_RATE 50
+#define TELEMETRY_LOOP_STATS_RATE 1
+
+// starts sending to port on host, a name or an address, and starts the sender thread
+// on the virtual clock (see Clock.h) this must be called after switching to it
+// returns 0 on success and -1 on failure
+int startTelemetry(const char *host, int port);
+
+// sends everything published so far, stops the sender thread and closes the socket
+void stopTelemetry();
+
+// returns 1 while telemetry is being sent and 0 otherwise
+int telemetrySending();
+
+// sets the most messages of type that are sent per second, 0 to send none
+void setTelemetryRate(enum TelemetryType type, double rate);
+
+// publishes an orientation or a motors message of count values at time in seconds,
+//   keeping only the first TELEMETRY_MAX_VALUES values (see TelemetryProtocol.h for what
+//   the values are)
+// does nothing unless telemetry is being sent, and drops the message if it comes sooner
+//   than the rate of type allows
+// the loop stats are published by the sender thread itself
+void publishTelemetry(enum TelemetryType type, double time, const double *values, int count);
+
+// prints the messages sent, rate limited and dropped of every type, and the datagrams
+//   sent per system call
+void printTelemetryReport();
+
+#endif
@@ -0,0 +1,85 @@
+// the wire format of the telemetry stream (see Telemetry.h)
+// every UDP datagram holds one message, a TELEMETRY_HEADER_SIZE byte header followed by
+//   its payload, with every number little endian
+//
+// the header is
+//   magic      u16   TELEMETRY_MAGIC
+//   version    u8    TELEMETRY_VERSION
+//   type       u8    a TelemetryType
+//   length     u16   the bytes of payload that follow
+//   sequence   u32   counts the messages of the type, so a gap means some were lost
+//   time       u64   microseconds on the flight clock (see Clock.h)
+//
+// and the payloads are
+//   orientation   f32 x 9   gravity x y z, acceleration x y z in g's, heading in
+//                           degrees, altitude in meters, climb rate in m/s
+//   motors        u8 count, then f32 x count thrusts from 0 to 1
+//   loop stats    u8 count, then for each task
+//                   char x TELEMETRY_NAME_SIZE   the name, padded with zeros
+//                   f32 x 4                      lateness p99, execution p50, p99 and
+//                                                maximum, in microseconds
+//                   u32                          overruns
+//
+// by Mark Hill
+
+#ifndef _TelemetryProtocol
+#define _TelemetryProtocol
+
+#include<stdint.h>
+
+#define TELEMETRY_MAGIC 0x4d54
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_HEADER_SIZE 18
+// the longest name a task is sent with
+#define TELEMETRY_NAME_SIZE 16
+// the most values and tasks one message holds
+#define TELEMETRY_MAX_VALUES 9
+#define TELEMETRY_MAX_TASKS 16
+// the largest message, a loop stats message with every task
+#define TELEMETRY_PACKET_SIZE \
+	(TELEMETRY_HEADER_SIZE + 1 + TELEMETRY_MAX_TASKS * (TELEMETRY_NAME_SIZE + 4 * 4 + 4))
+
+enum TelemetryType {
+	TELEMETRY_ORIENTATION,
+	TELEMETRY_MOTORS,
+	TELEMETRY_LOOP_STATS,
+	TELEMETRY_TYPES,
+};
+
+// the timing of one task in a loop stats message
+struct TelemetryTaskStats {
+	char name[TELEMETRY_NAME_SIZE + 1];
+	float latenessP99;
+	float executionP50;
+	float executionP99;
+	float executionMaximum;
+	uint32_t overruns;
+};
+
+// any message, decoded
+struct TelemetryMessage {
+	int type;
+	uint32_t sequence;
+	// in seconds
+	double time;
+	// the values of an orientation or a motors message
+	int count;
+	float values[TELEMETRY_MAX_VALUES];
+	// the tasks of a loop stats message
+	int tasks;
+	struct TelemetryTaskStats stats[TELEMETRY_MAX_TASKS];
+};
+
+// encodes message into output, which has room for capacity bytes
+// returns the size of the datagram, or -1 if the message is malformed or does not fit
+int encodeTelemetryMessage(const struct TelemetryMessage *message, uint8_t *output, \
+		int capacity);
+
+// decodes the datagram input of size bytes into message
+// returns 0 on success and -1 if it is not a telemetry message of this version
+int decodeTelemetryMessage(const uint8_t *input, int size, struct TelemetryMessage *message);
+
+// returns the name of a TelemetryType
+const char *telemetryTypeName(int type);
+
+#endif
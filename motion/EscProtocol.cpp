@@ -0,0 +1,50 @@
+// implementation for the EscProtocol header
+//
+// by Mark Hill
+
+#include<stdio.h>
+
+#include<EscProtocol.h>
+
+// the ESCs need a gap between pulses to tell where one ends, so the frame must be this
+//   much longer than the longest pulse
+static const double _frameMargin = 1.1;
+
+int escProtocol(enum EscProtocolType type, double frameRate, struct EscProtocol *protocol) {
+	switch (type) {
+	case ESC_PWM:
+		*protocol = pwmEscProtocol;
+		break;
+	case ESC_ONESHOT125:
+		*protocol = oneShot125EscProtocol;
+		break;
+	default:
+		printf("unknown ESC protocol %d\n", type);
+		return -1;
+	}
+
+	if (frameRate <= 0 || protocol->calibrationHigh * _frameMargin > 1000000 / frameRate) {
+		printf("a %.1fHz frame is too short for the ESC protocol\n", frameRate);
+		return -1;
+	}
+
+	protocol->frameRate = frameRate;
+	return 0;
+}
+
+double escPulseWidth(const struct EscProtocol *protocol, double thrust) {
+	if (thrust <= 0.00001)
+		return protocol->stopPulse;
+	// this protects against a value too large being passed in
+	if (thrust >= 1)
+		return protocol->fullPulse;
+
+	return protocol->idlePulse + thrust * (protocol->fullPulse - protocol->idlePulse);
+}
+
+double escThrust(const struct EscProtocol *protocol, double pulseWidth) {
+	double thrust = (pulseWidth - protocol->idlePulse) / (protocol->fullPulse - protocol->idlePulse);
+	thrust = thrust < 0 ? 0 : thrust;
+	thrust = thrust > 1 ? 1 : thrust;
+	return thrust;
+}
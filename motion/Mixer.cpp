@@ -0,0 +1,47 @@
+// implementation for the Mixer header
+//
+// by Mark Hill
+
+#include<stdint.h>
+
+#include<Mixer.h>
+#include<Eigen/Dense>
+
+using namespace Eigen;
+
+typedef Matrix<double, motorCount, 4> MixerMatrix;
+
+// builds the mixer matrix from the geometry of the airframe in use
+static MixerMatrix mixerMatrix() {
+	MixerMatrix matrix;
+	for (int i = 0; i < motorCount; i++) {
+		struct MixerRow row = mixerRow(AIRFRAME_GEOMETRY[i]);
+		matrix.row(i) << row.roll, row.pitch, row.yaw, row.thrust;
+	}
+	return matrix;
+}
+
+static const MixerMatrix _mixer = mixerMatrix();
+
+MotorThrusts mixMotors(const MixerCommand &command) {
+	// the thrust column is all ones, so the attitude part can be mixed on its own and
+	//   the thrust added once it is known how much room there is
+	MotorThrusts attitude = _mixer.leftCols<3>() * command.head<3>();
+	double lowest = attitude.minCoeff();
+	double highest = attitude.maxCoeff();
+
+	// an attitude spread the motors can not cover at all is scaled down to fit
+	double spread = highest - lowest;
+	if (spread > 1) {
+		attitude /= spread;
+		lowest /= spread;
+		highest /= spread;
+	}
+
+	// then the thrust is moved as little as possible to keep every motor in range
+	double thrust = command(3);
+	thrust = thrust > 1 - highest ? 1 - highest : thrust;
+	thrust = thrust < -lowest ? -lowest : thrust;
+
+	return attitude.array() + thrust;
+}
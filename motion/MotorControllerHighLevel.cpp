@@ -1,57 +1,71 @@
 // implementation for the high level, vector based MotorController functions
 // abstacts away the motor count and exact position of the motors
 //
+// the target vectors are posted to mailboxes, and a single output thread mixes the newest
+//   targets and writes the motors once per PWM cycle, so callers never touch the bus
+//
 // by Mark Hill
 #include<stdio.h>
 #include<math.h>
 #include<stdint.h>
+#include<pthread.h>
+
+#include<atomic>
 
 #include<MotorController.h>
+#include<Mixer.h>
+#include<VectorMailbox.h>
+#include<Orientation.h>
+#include<RealTime.h>
+#include<LoopTiming.h>
+#include<Clock.h>
+#include<Blackbox.h>
+#include<Telemetry.h>
 #include<Eigen/Dense>
+extern "C" {
+	#include<PWMController.h>
+}
 
 using namespace Eigen;
 
-// when setting the current motion vector, this array contains the thrust value for each motor located
-//   at the index equal to the motor number
-static double _motorThrustValues[] = {0, 0, 0, 0};
-static const uint8_t _motorCount = 4;
+static_assert(motorCount <= BLACKBOX_RECORD_VALUES, "every motor should fit in one blackbox record");
+static_assert(motorCount <= TELEMETRY_MAX_VALUES, "every motor should fit in one telemetry message");
 
 // stores the target vectors
-static Vector3d _targetLinearVector(0, 0, 0);
-static Vector3d _targetAngularVector(0, 0, 0);
-
-// these arrays contain the motor number(s) for each corresponding motion axis
-static const uint8_t _linearPosXMotors[] = {2};
-static const uint8_t _linearPosXMotorCount = 1;
-static const uint8_t _linearNegXMotors[] = {0};
-static const uint8_t _linearNegXMotorCount = 1;
-static const uint8_t _linearPosYMotors[] = {3};
-static const uint8_t _linearPosYMotorCount = 1;
-static const uint8_t _linearNegYMotors[] = {1};
-static const uint8_t _linearNegYMotorCount = 1;
-static const uint8_t _linearPosZMotors[] = {0, 1, 2, 3};
-static const uint8_t _linearPosZMotorCount = 4;
-// no negative linear Z because the motors are not able to be reversed with my ESCs (electronic speed controllers)
-
-static const uint8_t _angularPosZMotors[] = {1, 3};
-static const uint8_t _angularPosZMotorCount = 2;
-static const uint8_t _angularNegZMotors[] = {0, 2};
-static const uint8_t _angularNegZMotorCount = 2;
+static struct VectorMailbox _targetLinearVector;
+static struct VectorMailbox _targetAngularVector;
+
+// the thread writing the motors and whether it should keep running
+static pthread_t _outputThread;
+static std::atomic<int> _outputRunning(0);
+// serializes starting and stopping the output thread
+static pthread_mutex_t _outputLock = PTHREAD_MUTEX_INITIALIZER;
+// how well the output thread keeps to the PWM cycle
+static struct LoopTiming _outputTiming;
 
 // implemented below
 // sets the motor thrust values based on the target vectors
-static void updateMotion();
+// returns 0 on success and -1 if the motors did not take the thrust
+static int updateMotion(const Vector3d &linear, const Vector3d &angular);
+
 
 
+// returns the newest vector in the mailbox, or zero if there is none
+static Vector3d latestTarget(struct VectorMailbox *mailbox) {
+	Vector3d value(0, 0, 0);
+	uint64_t sequence;
+	latestVector(mailbox, &value, &sequence);
+	return value;
+}
 
 // returns the current linear motion vector
 Vector3d getLinearMotionVector() {
-	return _targetLinearVector;
+	return latestTarget(&_targetLinearVector);
 }
 
 // returns the current angular motion vector
 Vector3d getAngularMotionVector() {
-	return _targetAngularVector;
+	return latestTarget(&_targetAngularVector);
 }
 
 // sets the target linear motion vector
@@ -65,9 +79,8 @@ void setLinearMotionVector(Vector3d targetLinearMotion) {
 		return;
 	}
 
-	_targetLinearVector = targetLinearMotion;
-
-	updateMotion();
+	postVector(&_targetLinearVector, targetLinearMotion);
+	startMotorOutput();
 }
 
 // sets the target angular motion vector
@@ -77,114 +90,109 @@ void setAngularMotionVector(Vector3d targetAngularMotion) {
 		return;
 	}
 
-	_targetAngularVector = targetAngularMotion;
-
-	updateMotion();
+	postVector(&_targetAngularVector, targetAngularMotion);
+	startMotorOutput();
 }
 
 
-
-
-// updates the motion of the vehicle based on the linear and angular motion vectors
-//   stored (look up for the variables)
-static void updateMotion() {
-
-	// zero out the thrust values at the beginning so that thrusts by axis can be added
-	for (int i = 0; i < _motorCount; i++) {
-		_motorThrustValues[i] = 0;
-	}
-
-	// since x^2 + y^2 + z^2 <= 1 (as verified by the magnitude check), adding squared values
-	//   rather than plain values will never give a thrust per motor of greater than 1
-	double xSquare = pow(_targetLinearVector(0), 2);
-	double ySquare = pow(_targetLinearVector(1), 2);
-	double zSquare = pow(_targetLinearVector(2), 2);
-
-
-	// linear section
-
-	// set the x values
-	const uint8_t *xMotors = _targetLinearVector(0) < 0 ? _linearNegXMotors : _linearPosXMotors;
-	uint8_t xMotorCount = _targetLinearVector(0) < 0 ? _linearNegXMotorCount : _linearPosXMotorCount;
-	for (int i = 0; i < xMotorCount; i++) {
-		_motorThrustValues[xMotors[i]] += xSquare;
+// wakes up once every PWM cycle, and whenever a target changed since the last cycle,
+//   mixes the newest targets and writes the motors
+// the PWM chip only picks up new values at the end of a cycle, so writing more often
+//   would only waste bus time
+// sleeps until an absolute deadline so the period does not drift with the time spent
+//   writing
+static void *motorOutput(void *input) {
+	makeRealTimeThread(REAL_TIME_OUTPUT);
+
+	double period = 1 / pwmFrequency();
+	uint64_t linearSequence = 0, angularSequence = 0;
+	int pending = 0;
+
+	struct LoopClock clock;
+	initLoopClock(&clock, &_outputTiming, "motor output", period);
+
+	double deadline = monotonicTime();
+
+	while (_outputRunning.load(std::memory_order_acquire)) {
+		loopStart(&_outputTiming, &clock, deadline);
+		Vector3d linear(0, 0, 0), angular(0, 0, 0);
+		uint64_t newLinearSequence = 0, newAngularSequence = 0;
+		latestVector(&_targetLinearVector, &linear, &newLinearSequence);
+		latestVector(&_targetAngularVector, &angular, &newAngularSequence);
+		// targets that could not be written, because the motors were still arming, are
+		//   retried every cycle
+		if (newLinearSequence != linearSequence || newAngularSequence != angularSequence || \
+				pending) {
+			linearSequence = newLinearSequence;
+			angularSequence = newAngularSequence;
+			pending = updateMotion(linear, angular) != 0;
+		}
+		loopEnd(&_outputTiming, &clock);
+
+		// skips the cycles that were missed instead of rushing to catch up
+		deadline += period;
+		double now = monotonicTime();
+		if (deadline < now)
+			deadline = now;
+		sleepUntil(deadline);
 	}
 
-	// set the y values
-	const uint8_t *yMotors = _targetLinearVector(1) < 0 ? _linearNegYMotors : _linearPosYMotors;
-	uint8_t yMotorCount = _targetLinearVector(1) < 0 ? _linearNegYMotorCount : _linearPosYMotorCount;
-	for (int i = 0; i < yMotorCount; i++) {
-		_motorThrustValues[yMotors[i]] += ySquare;
-	}
+	return NULL;
+}
 
-	// set the z values
-	const uint8_t *zMotors = _linearPosZMotors;
-	uint8_t zMotorCount = _linearPosZMotorCount;
-	for (int i = 0; i < zMotorCount; i++) {
-		_motorThrustValues[zMotors[i]] += zSquare;
-		printf("%d %f\n", zMotors[i], zSquare);
+int startMotorOutput() {
+	if (_outputRunning.load(std::memory_order_acquire))
+		return 0;
+
+	// the motors arm while the first targets come in
+	armMotors(NULL, NULL);
+
+	int failure = 0;
+	pthread_mutex_lock(&_outputLock);
+	if (!_outputRunning.load(std::memory_order_relaxed)) {
+		_outputRunning.store(1, std::memory_order_release);
+		failure = createClockThread(&_outputThread, NULL, &motorOutput, NULL);
+		if (failure) {
+			printf("failed to create motor output thread\n");
+			_outputRunning.store(0, std::memory_order_release);
+		}
 	}
+	pthread_mutex_unlock(&_outputLock);
 
+	return failure ? -1 : 0;
+}
 
-	// angular section
-
-	double zSquareAngular = pow(_targetAngularVector(2), 2);
-
-	// set the z axis spin
-	// this is done by maintaining total additive thrust, but reducing the thrust for the
-	//   pair of motors generating balancing spin and increasing thrust for motors with
-	//   resultant spin in the desired direction
-	const uint8_t *desiredSpinMotors = _targetAngularVector(2) < 0 ? _angularNegZMotors : _angularPosZMotors;
-	uint8_t desiredMotorCount = _targetAngularVector(2) < 0 ? _angularNegZMotorCount : _angularPosZMotorCount;
-	const uint8_t *undesiredSpinMotors = _targetAngularVector(2) < 0 ? _angularPosZMotors : _angularNegZMotors;
-	uint8_t undesiredMotorCount = _targetAngularVector(2) < 0 ? _angularPosZMotorCount : _angularNegZMotorCount;
-
-	// since the angular setting is performed after the linear setting, the maximum increase and decrease
-	//   must be determined to protect against a value >1 being set
-	double maxIncrease = 1;
-	double maxDecrease = undesiredSpinMotors[0];
-
-	for (int i = 0; i < desiredMotorCount; i++) {
-		double possibleIncrease = 1 - _motorThrustValues[desiredSpinMotors[i]];
-		maxIncrease = maxIncrease > possibleIncrease ? possibleIncrease : maxIncrease;
-	}
-
-	for (int i = 1; i < undesiredMotorCount; i++) {
-		double possibleDecrease = _motorThrustValues[undesiredSpinMotors[i]];
-		maxDecrease = maxDecrease > possibleDecrease ? possibleDecrease : maxDecrease;
+void stopMotorOutput() {
+	pthread_mutex_lock(&_outputLock);
+	if (_outputRunning.load(std::memory_order_relaxed)) {
+		_outputRunning.store(0, std::memory_order_release);
+		pthread_join(_outputThread, NULL);
 	}
+	pthread_mutex_unlock(&_outputLock);
+}
 
-	// with the max decrease and increase determined, now correct the motor values
-	for (int i = 0; i < desiredMotorCount; i++) {
-		_motorThrustValues[desiredSpinMotors[i]] += maxIncrease * zSquareAngular;
-	}
 
-	for (int i = 0; i < undesiredMotorCount; i++) {
-		_motorThrustValues[undesiredSpinMotors[i]] -= maxDecrease * zSquareAngular;
-	}
-	printf("%f %f\n", maxDecrease, maxIncrease);
 
 
-	// thrust section
+// updates the motion of the vehicle based on the linear and angular motion vectors
+// moving along x or y is done by tilting the vehicle towards that direction, so those
+//   components turn into pitch and roll on top of any angular x and y
+// no negative linear Z because the motors are not able to be reversed with my ESCs
+//   (electronic speed controllers)
+static int updateMotion(const Vector3d &linear, const Vector3d &angular) {
+	MixerCommand command(angular(0) - linear(1), angular(1) + linear(0), \
+			angular(2), linear(2));
+	MotorThrusts thrusts = mixMotors(command);
 
-	// now actually set the thrust values
 	// bounds verification is done at the low level implementation
-	for (int i = 0; i < _motorCount; i++) {
-		// take the square root of this value since it is a sum of squares
-		double thrust = pow(_motorThrustValues[i], 0.5);
-		thrust = thrust > 1 ? 1 : thrust;
-		thrust = thrust < 0 ? 0 : thrust;
-		printf("thrust %d %.9f\n", i, thrust);
-
-		setMotorThrustPercentage(i, thrust);
-	}
+	// all motors are written together so they change at the same instant
+	if (setMotorThrustPercentages(0, motorCount, thrusts.data()))
+		return -1;
+	double time = monotonicTime();
+	blackboxRecord(BLACKBOX_MOTOR_OUTPUT, time, thrusts.data(), motorCount);
+	publishTelemetry(TELEMETRY_MOTORS, time, thrusts.data(), motorCount);
+
+	// lets the gyroscope filter follow the motor vibration
+	setMotorNoiseFrequency(motorRotationFrequency(thrusts.mean()));
+	return 0;
 }
-
-
-
-
-
-
-
-
-
@@ -2,115 +2,353 @@
 // this handles the raw power and arming of the motors
 
 #include<stdio.h>
+#include<stdlib.h>
+#include<stdint.h>
 #include<unistd.h>
+#include<math.h>
+#include<pthread.h>
+
+#include<atomic>
 
 #include <MotorController.h>
+#include <Mixer.h>
+#include <EscProtocol.h>
+#include <ThrustCurve.h>
+#include <Clock.h>
+#include <EventLoop.h>
+#include <Task.h>
 extern "C" {
 	#include <PWMController.h>
 }
 
-// the arming, minimum, and maximum thrust values
-// the arming value is a PWM percentage that tells the ESC there is a proper PWM signal source attached
-// there are based on the ESC and will most likely vary with different devices
-static const double _armingThrust = 0.0600;
-static const double _minimumThrust = 0.1000 + 0.0100;
-static const double _maximumThrust = 0.5337;
-static const double _thrustRange = (/*_maximumThrust*/0.6337 - /*_minimumThrust*/0.1100);
+// the signal the ESCs get, which holds the arming, minimum, and maximum thrust pulses
+// the arming pulse tells the ESC there is a proper PWM signal source attached
+// these are based on the ESC and will most likely vary with different devices
+// only changed by setEscProtocol() while the motors are disarmed
+static struct EscProtocol _protocol = pwmEscProtocol;
+
+// how each motor turns pulses into thrust, with the index being the motor number
+// PLACEHOLDERS: no motor has been measured yet, so every one keeps the linear mapping
+//   from thrust percentage to pulse the motor layer always had, rather than guessing at
+//   a curve; replace them with measured calibrations, or set them with
+//   setMotorCalibration(), like the simulator does for its ESCs
+static struct MotorCalibration _motorCalibrations[] = {
+	{1, 1}, {1, 1}, {1, 1}, {1, 1}, {1, 1}, {1, 1}, {1, 1}, {1, 1},
+};
+static_assert(sizeof(_motorCalibrations) / sizeof(_motorCalibrations[0]) >= motorCount, \
+		"a motor has no calibration");
+
+// the counts for each thrust of each motor, rebuilt whenever the protocol changes
+static struct ThrustCurve _thrustCurves[motorCount];
+
+// the approximate rotation frequency of the motors in Hz when idling and at full thrust
+// thrust goes with the square of the rotation speed, so speed goes with the square root
+//   of the thrust in between
+static const double _idleRotationFrequency = 30;
+static const double _maximumRotationFrequency = 160;
 
-// array containing the status of each ESC's status as 'armed' (value of 1, meaning ready to 
-//   spin) or 'unarmed' (value of 0, not ready to spin)
+// how long in nanoseconds the ESCs need to see the arming signal before they are ready
 // ESC = electronic speed controller
-uint8_t _armingStatus[] = {0, 0, 0, 0};
+static const int64_t _armingTime = 50000000;
 
-// the hardware addresses of the PWM slot the motors are connected to
+// where the ESCs are in the arming sequence, see MotorArmingState
+static std::atomic<int> _armingState(MOTORS_DISARMED);
+// the time in nanoseconds (see Clock.h) at which arming completes
+// INT64_MAX while disarmed, and set before the arming state is, so whoever sees the
+//   motors arming also sees when they will be armed
+// moving it off INT64_MAX is how a thread claims the arming, so only one sends the signal
+static std::atomic<int64_t> _armedTime(INT64_MAX);
+
+// the hardware addresses of the PWM slot the motors are connected to, with the index being
+//   the motor number of the airframe in Mixer.h
+// the slots must stay in order so that all the motors can be set with one PWM write
 // PWM = pulse width modulation
-static const uint8_t _motor1Address = 0;
-static const uint8_t _motor2Address = 1;
-static const uint8_t _motor3Address = 2;
-static const uint8_t _motor4Address = 3;
-// holds the array for motor addresses used to lookup true PWM address for each motor number
-static uint8_t motorAddressLookupTable[4];
+static uint8_t motorAddressLookupTable[] = {0, 1, 2, 3, 4, 5, 6, 7};
+static_assert(sizeof(motorAddressLookupTable) >= motorCount, "a motor has no PWM slot");
 
 // returns an array containing the motor addresses based with the index number being the motor number
 static uint8_t *motorAddresses() {
-	motorAddressLookupTable[0] = _motor1Address;
-	motorAddressLookupTable[1] = _motor2Address;
-	motorAddressLookupTable[2] = _motor3Address;
-	motorAddressLookupTable[3] = _motor4Address;
 	return motorAddressLookupTable;
 }
 
 // NOTE: There is a special case for 0 since the minimum thrust value actually is slightly above the
 //   true minimum to ensure it has no problems rotating under load
 
-// in order to use the motor, the ESC must first be armed by setting a low PWM signal
-static void armMotor(uint8_t motorNumber) {
-	if (_armingStatus[motorNumber] == 0) {
-		setDutyPercent(motorAddresses()[motorNumber], _armingThrust);
-		usleep(50000);
-		_armingStatus[motorNumber] = 1;
+// converts a pulse width in microseconds into the PWM percentage at the current frame rate
+static double pulseDuty(double pulseWidth) {
+	return pulseWidth * pwmFrequency() / 1000000;
+}
+
+// builds the thrust curves of the motors for the protocol in use
+static int buildThrustCurves() {
+	for (int i = 0; i < motorCount; i++) {
+		buildThrustCurve(&_thrustCurves[i], &_protocol, pwmFrequency(), _motorCalibrations[i]);
+	}
+	return 0;
+}
+
+// the curves are ready before anything can set a thrust
+static int _thrustCurvesBuilt = buildThrustCurves();
+
+// returns the current monotonic time in nanoseconds (see Clock.h)
+static int64_t currentNanoseconds() {
+	return (int64_t)(monotonicTime() * 1000000000.0);
+}
+
+// what the thread waiting on an arming deadline needs to report it
+struct ArmingWaiter {
+	void (*ready)(void *);
+	void *context;
+};
+
+// sleeps until the arming deadline, then reports the motors as ready
+// the deadline moves if the motors are disarmed and armed again meanwhile, so this keeps
+//   sleeping until they are armed, or until they are left disarmed
+// runs on its own detached thread, so nobody else has to wait
+static void *waitForArming(void *input) {
+	struct ArmingWaiter waiter = *(struct ArmingWaiter *)(input);
+	free(input);
+
+	int64_t woken = 0;
+	while (motorArmingState() != MOTORS_ARMED) {
+		int64_t deadline = _armedTime.load(std::memory_order_acquire);
+		if (deadline == INT64_MAX) {
+			printf("the motors were disarmed before they armed\n");
+			return NULL;
+		}
+		// a deadline that passed without the motors arming belongs to a signal still being
+		//   sent, which moves it once sent
+		if (deadline <= woken)
+			deadline = woken + _armingTime;
+		sleepUntil(deadline / 1000000000.0);
+		woken = deadline;
+	}
+
+	waiter.ready(waiter.context);
+	return NULL;
+}
+
+// in order to use the motors, the ESCs must first be armed by setting a low PWM signal
+// all the motors get the signal in one write and then share one settle period
+int armMotors(void (*ready)(void *), void *context) {
+	int64_t unset = INT64_MAX;
+	if (_armedTime.compare_exchange_strong(unset, currentNanoseconds() + _armingTime)) {
+		uint16_t arming[motorCount];
+		for (int i = 0; i < motorCount; i++) {
+			arming[i] = (uint16_t)(_thrustCurves[i].stopCounts + 0.5);
+		}
+		if (setDutyCounts(motorAddresses()[0], motorCount, arming)) {
+			printf("failed to send the arming signal to the motors\n");
+			_armedTime.store(INT64_MAX, std::memory_order_release);
+			return -1;
+		}
+		// the settle period starts once the ESCs have the signal
+		_armedTime.store(currentNanoseconds() + _armingTime, std::memory_order_release);
+		_armingState.store(MOTORS_ARMING, std::memory_order_release);
+	}
+
+	if (ready == NULL)
+		return 0;
+	if (motorArmingState() == MOTORS_ARMED) {
+		ready(context);
+		return 0;
+	}
+
+	struct ArmingWaiter *waiter = (struct ArmingWaiter *)malloc(sizeof(struct ArmingWaiter));
+	waiter->ready = ready;
+	waiter->context = context;
+	pthread_t thread;
+	pthread_attr_t attributes;
+	pthread_attr_init(&attributes);
+	pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+	int failure = createClockThread(&thread, &attributes, &waitForArming, waiter);
+	pthread_attr_destroy(&attributes);
+	if (failure) {
+		printf("failed to create arming thread\n");
+		free(waiter);
+		return -1;
+	}
+
+	return 0;
+}
+
+// moves from arming to armed once the settle period is over, which is all the state
+//   machine needs, so it never has to run on a thread of its own
+enum MotorArmingState motorArmingState() {
+	int state = _armingState.load(std::memory_order_acquire);
+	if (state == MOTORS_ARMING && \
+			currentNanoseconds() >= _armedTime.load(std::memory_order_acquire)) {
+		_armingState.compare_exchange_strong(state, MOTORS_ARMED);
+		state = _armingState.load(std::memory_order_acquire);
 	}
+
+	return (enum MotorArmingState)state;
+}
+
+// removing the signal disarms the ESCs
+void disarmMotors() {
+	double off[motorCount] = {};
+	// the deadline goes last, since that lets the motors be armed again
+	_armingState.store(MOTORS_DISARMED, std::memory_order_release);
+	_armedTime.store(INT64_MAX, std::memory_order_release);
+	setDutyPercents(motorAddresses()[0], motorCount, off);
 }
 
 // returns the thurst percentage
 double getMotorThrustPercentage(uint8_t motorNumber) {
 	double pwmThrustPercentage = getDutyPercent(motorAddresses()[motorNumber]);
 
-	double motorThrustPercentage = (pwmThrustPercentage - _minimumThrust) / (_thrustRange);
-	
-	if (motorThrustPercentage < 0) {
-		motorThrustPercentage = 0;
+	return countsThrust(&_thrustCurves[motorNumber], pwmThrustPercentage * 4096);
+}
+
+int setMotorCalibration(uint8_t motorNumber, struct MotorCalibration calibration) {
+	if (motorNumber >= motorCount || calibration.scale <= 0 || calibration.exponent <= 0) {
+		printf("invalid calibration for motor %d\n", motorNumber);
+		return -1;
 	}
 
-	return motorThrustPercentage;
+	// the counts for a thrust change, so the motor must not be spinning on the old ones
+	disarmMotors();
+	_motorCalibrations[motorNumber] = calibration;
+	buildThrustCurve(&_thrustCurves[motorNumber], &_protocol, pwmFrequency(), calibration);
+	return 0;
 }
 
+int setEscProtocol(enum EscProtocolType type, double frameRate) {
+	struct EscProtocol protocol;
+	if (escProtocol(type, frameRate, &protocol))
+		return -1;
+
+	// the pulses change length with the frame rate, so the ESCs must not be listening
+	disarmMotors();
+	if (setPWMFrequency(frameRate))
+		return -1;
+
+	// the chip can only make some frame rates, the pulses are worked out from the real one
+	protocol.frameRate = pwmFrequency();
+	_protocol = protocol;
+	buildThrustCurves();
+	return 0;
+}
 
 // sets the thrust percentage
 void setMotorThrustPercentage(uint8_t motorNumber, double thrustPercentage) {
-	// first the ESC must be armed
-	// the armMotor function takes care of checking if the ESC has been armed already
-	armMotor(motorNumber);
+	setMotorThrustPercentages(motorNumber, 1, &thrustPercentage);
+}
 
-	double pwmPercentage = thrustPercentage * _thrustRange + _minimumThrust;
+// sets the thrust percentages of count motors in one PWM write
+int setMotorThrustPercentages(uint8_t firstMotor, uint8_t count, const double *thrustPercentages) {
+	if (firstMotor + count > motorCount) {
+		printf("motors %d - %d do not exist\n", firstMotor, firstMotor + count - 1);
+		return -1;
+	}
 
-	if (thrustPercentage <= 0.00001) {
-		
-		pwmPercentage = _armingThrust;
+	// first the ESCs must be armed, and until they are the arming signal has to stay
+	// starts arming if nobody has yet, without waiting for it
+	if (motorArmingState() != MOTORS_ARMED) {
+		armMotors(NULL, NULL);
+		return -1;
 	}
 
-	// this protects against a value too large being passed in
-	if (thrustPercentage >= 1) {
-		pwmPercentage = _maximumThrust;
+	uint16_t counts[motorCount];
+	thrustCounts(&_thrustCurves[firstMotor], thrustPercentages, counts, count);
+
+	return setDutyCounts(motorAddresses()[firstMotor], count, counts);
+}
+
+// estimates the rotation frequency from the thrust
+double motorRotationFrequency(double thrustPercentage) {
+	thrustPercentage = thrustPercentage < 0 ? 0 : thrustPercentage;
+	thrustPercentage = thrustPercentage > 1 ? 1 : thrustPercentage;
+	return _idleRotationFrequency + \
+		(_maximumRotationFrequency - _idleRotationFrequency) * sqrt(thrustPercentage);
+}
+
+// how long in seconds to wait before retrying a PWM configuration write that failed,
+//   giving the bus a moment to recover
+static const double _configurationRetryDelay = 0.001;
+
+// the same steps initializePWMController() takes, but the retries and the oscillator
+//   wait hand the loop back instead of blocking it
+Task configureMotorOutputs(struct EventLoop *loop, void (*done)(int, void *), void *context) {
+	int steps = pwmConfigurationSteps();
+	int success = 0;
+	for (int step = 0; step < steps; step++) {
+		int failure = co_await busTransaction([step] {
+			return writePWMConfiguration(step);
+		});
+		for (int i = 0; i < PWM_CONFIGURATION_RETRIES && failure != 0; i++) {
+			printf("retrying %s register write in PWMController\n", \
+					pwmConfigurationStepName(step));
+			co_await taskSleepFor(loop, _configurationRetryDelay);
+			failure = co_await busTransaction([step] {
+				return writePWMConfiguration(step);
+			});
+		}
+		success |= failure;
 	}
 
-	setDutyPercent(motorAddresses()[motorNumber], pwmPercentage);
+	if (steps > 0) {
+		co_await taskSleepFor(loop, PWM_OSCILLATOR_SETTLE_TIME);
+		finishPWMConfiguration(success);
+	}
+	done(success, context);
+}
+
+// reads the rest of a line from standard input once it can be read, so the next wait
+//   does not find it
+static void skipLine() {
+	int c;
+	while ((c = getchar()) != '\n' && c != EOF);
 }
 
-// calibrates the motors
 // goes one at a time so that error tones can be easily differentiated
-void calibrateMotor(uint8_t motorNumber) {
+Task calibrateMotorTask(struct EventLoop *loop, uint8_t motorNumber, \
+		void (*done)(void *), void *context) {
 	// the maxThrottle should be a little higher than max thrust so that the maximum motor
 	//   speed is not reached before 100%
-	double maxThrottle = _maximumThrust + 0.0263;
-	double minThrottle = 0.1000;
+	double maxThrottle = pulseDuty(_protocol.calibrationHigh);
+	double minThrottle = pulseDuty(_protocol.calibrationLow);
 	
 	printf("disconnect the ESCs (electronic speed controller) from power, then press enter to continue\n");
-	getchar();
+	fflush(stdout);
+	co_await taskReadable(loop, STDIN_FILENO);
+	skipLine();
 	
 	printf("calibrating motor %d\n", motorNumber);
 	printf("setting maximum throttle to %.2f%%\n", 100*maxThrottle);
 	setDutyPercent(motorAddresses()[motorNumber], maxThrottle);
 
-	usleep(500000);
+	co_await taskSleepFor(loop, 0.5);
 	
 	printf("\nreconnect the ESCs to power\nthen, within 1-2 seconds of the beeps, press enter to continue\n");
-	getchar();
+	fflush(stdout);
+	co_await taskReadable(loop, STDIN_FILENO);
+	skipLine();
 
 	printf("setting minimum throttle to %.2f%%\n", 100*minThrottle);
 	setDutyPercent(motorAddresses()[motorNumber], minThrottle);
 	
-	usleep(1000000);
+	co_await taskSleepFor(loop, 1);
+	done(context);
+}
+
+// stops the loop the calibration ran on
+static void calibrationDone(void *context) {
+	stopEventLoop((struct EventLoop *)(context));
+}
+
+// runs the calibration task on a loop of its own until it is done
+void calibrateMotor(uint8_t motorNumber) {
+	struct EventLoop loop;
+	if (initEventLoop(&loop) || \
+			!calibrateMotorTask(&loop, motorNumber, &calibrationDone, &loop).started) {
+		printf("failed to start calibrating motor %d\n", motorNumber);
+		closeEventLoop(&loop);
+		return;
+	}
+	runEventLoop(&loop);
+	closeEventLoop(&loop);
 }
 
 
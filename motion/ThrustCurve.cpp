@@ -0,0 +1,60 @@
+// implementation for the ThrustCurve header
+//
+// by Mark Hill
+
+#include<stdint.h>
+#include<math.h>
+
+#include<ThrustCurve.h>
+#include<EscProtocol.h>
+
+// thrusts this close to 0 count as no thrust, as in escPulseWidth()
+static const double _stopThreshold = 0.00001;
+
+void buildThrustCurve(struct ThrustCurve *curve, const struct EscProtocol *protocol, \
+		double frequency, struct MotorCalibration calibration) {
+	curve->protocol = *protocol;
+	curve->calibration = calibration;
+	curve->countsPerMicrosecond = frequency * 4096 / 1000000;
+
+	for (int i = 0; i < THRUST_CURVE_POINTS; i++) {
+		double thrust = i / (double)(THRUST_CURVE_POINTS - 1);
+		// the part of the range from idle to full that gives the thrust, which a weak
+		//   motor may not reach
+		double command = pow(thrust / calibration.scale, 1 / calibration.exponent);
+		command = command > 1 ? 1 : command;
+		double pulse = protocol->idlePulse + command * (protocol->fullPulse - protocol->idlePulse);
+		curve->counts[i] = (float)(pulse * curve->countsPerMicrosecond);
+	}
+	curve->stopCounts = (float)(protocol->stopPulse * curve->countsPerMicrosecond);
+}
+
+void thrustCounts(const struct ThrustCurve *curves, const double *thrusts, uint16_t *counts, \
+		int count) {
+	const int last = THRUST_CURVE_POINTS - 1;
+
+	// the comparisons below are all selects, which compile to min, max and blend
+	//   instructions rather than jumps
+	for (int i = 0; i < count; i++) {
+		double thrust = thrusts[i];
+		thrust = thrust < 0 ? 0 : thrust;
+		thrust = thrust > 1 ? 1 : thrust;
+
+		double position = thrust * last;
+		int index = (int)position;
+		index = index > last - 1 ? last - 1 : index;
+		double fraction = position - index;
+
+		const float *table = curves[i].counts;
+		double value = table[index] + fraction * (table[index + 1] - table[index]);
+		double stop = curves[i].stopCounts;
+		value = thrusts[i] > _stopThreshold ? value : stop;
+
+		counts[i] = (uint16_t)(value + 0.5);
+	}
+}
+
+double countsThrust(const struct ThrustCurve *curve, double counts) {
+	double command = escThrust(&curve->protocol, counts / curve->countsPerMicrosecond);
+	return curve->calibration.scale * pow(command, curve->calibration.exponent);
+}
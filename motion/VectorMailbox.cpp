@@ -0,0 +1,55 @@
+// implementation for the VectorMailbox header
+//
+// by Mark Hill
+
+#include<stdint.h>
+
+#include<atomic>
+
+#include<VectorMailbox.h>
+
+void postVector(struct VectorMailbox *mailbox, const Vector3d &value) {
+	uint64_t ticket;
+	uint64_t slot;
+
+	// claims the slot of a fresh ticket, skipping any slot another poster is still
+	//   writing to, which only happens when MAILBOX_SLOTS posts land during one write
+	while (1) {
+		ticket = mailbox->tickets.fetch_add(1, std::memory_order_relaxed);
+		slot = ticket & (MAILBOX_SLOTS - 1);
+		uint64_t stamp = mailbox->stamps[slot].load(std::memory_order_relaxed);
+		if (!(stamp & 1) && mailbox->stamps[slot].compare_exchange_strong(stamp, \
+				2 * ticket + 1, std::memory_order_relaxed))
+			break;
+	}
+	std::atomic_thread_fence(std::memory_order_release);
+
+	mailbox->values[slot] = value;
+
+	mailbox->stamps[slot].store(2 * ticket + 2, std::memory_order_release);
+
+	// a slower poster with an older ticket must not hide this post
+	uint64_t latest = mailbox->latest.load(std::memory_order_relaxed);
+	while (latest < ticket + 1 && !mailbox->latest.compare_exchange_weak(latest, ticket + 1, \
+			std::memory_order_release, std::memory_order_relaxed));
+}
+
+int latestVector(struct VectorMailbox *mailbox, Vector3d *value, uint64_t *sequence) {
+	while (1) {
+		uint64_t latest = mailbox->latest.load(std::memory_order_acquire);
+		if (latest == 0)
+			return -1;
+
+		uint64_t slot = (latest - 1) & (MAILBOX_SLOTS - 1);
+		if (mailbox->stamps[slot].load(std::memory_order_acquire) != 2 * latest)
+			continue;
+		Vector3d copy = mailbox->values[slot];
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (mailbox->stamps[slot].load(std::memory_order_relaxed) != 2 * latest)
+			continue;
+
+		*value = copy;
+		*sequence = latest;
+		return 0;
+	}
+}
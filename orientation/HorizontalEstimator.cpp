@@ -0,0 +1,35 @@
+// implementation for the HorizontalEstimator header
+//
+// by Mark Hill
+
+#include<Eigen/Dense>
+
+#include<HorizontalEstimator.h>
+
+using namespace Eigen;
+
+// gaps between acceleration samples longer than this in seconds are not integrated, since
+//   the acceleration in between is unknown
+static const double _maximumStep = 0.5;
+
+void initHorizontalEstimator(struct HorizontalEstimator *estimator, double dragRate, \
+		double timeConstant, const Vector3d &bias) {
+	*estimator = HorizontalEstimator();
+	estimator->dragRate = dragRate;
+	estimator->velocityGain = 1 / timeConstant;
+	estimator->bias = Vector3d(bias(0), bias(1), 0);
+}
+
+void horizontalPredict(struct HorizontalEstimator *estimator, const Vector3d &acceleration, \
+		const Vector3d &specificForce, double time) {
+	double dt = time - estimator->predictTime;
+	estimator->predictTime = time;
+	if (dt <= 0 || dt > _maximumStep || estimator->dragRate <= 0)
+		return;
+
+	// the drag pushes against the velocity
+	Vector3d drag = specificForce - estimator->bias;
+	Vector3d measured(-drag(0) / estimator->dragRate, -drag(1) / estimator->dragRate, 0);
+	estimator->velocity += (measured - estimator->velocity) * estimator->velocityGain * dt;
+	estimator->velocity += Vector3d(acceleration(0), acceleration(1), 0) * dt;
+}
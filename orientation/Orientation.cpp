@@ -9,39 +9,32 @@
 #include<unistd.h>
 #include<time.h>
 #include<pthread.h>
+#include<stdarg.h>
+
+#include<atomic>
 
 #include<SensorManager.h>
 #include<Orientation.h>
+#include<OrientationHistory.h>
+#include<StreamFilters.h>
+#include<GyroFilterBank.h>
+#include<VibrationAnalyzer.h>
+#include<SampleRing.h>
 #include<Eigen/Dense>
 #include<geometry.h>
+#include<RealTime.h>
+#include<Blackbox.h>
+#include<Telemetry.h>
+#include<LoopTiming.h>
+#include<Clock.h>
+#include<EventLoop.h>
+extern "C" {
+	#include<rcu_set.h>
+}
 
 using namespace Eigen;
 using namespace std;
 
-////////////////////////
-// calibration values //
-////////////////////////
-
-// the expected no motion value of the vector representing the force of gravity
-static Vector3d _init_gravity;
-// the magnitude of the static gravity vector
-static double _init_gravity_length = 0;
-
-// the average angular error, which is subtracted from any samples
-static Vector3d _angular_drift;
-
-// the inclination of the magnetic field in degrees below the
-//   horizontal line
-static double _inclinationAngle = 0;
-// the magnitude of the magnetic field
-// it makes more sense to use only the mag. and inclination instead of
-//   a vector here since the magnitude and inclination are constant
-//   unlike the rest of the components
-static double _magneticFieldMagnitude = 0;
-
-////////////////////////
-
-
 ////////////////////////
 //      constants     //
 ////////////////////////
@@ -49,26 +42,51 @@ static double _magneticFieldMagnitude = 0;
 // this defines the "numVectors" value to be used during calibration
 static const uint16_t _init_samples = 500;
 
-// this defines the "numVectors" value to be used during update computation
-// hopefully reduces noise
+// this defines the number of sensor reads per update, which are decimated down to one
+//   vector to reduce noise
+// the accelerometer and gyroscope reads are spread evenly over the update, so they take
+//   a new output of the chip each time (see readMotion)
 static const uint16_t _update_samples = 2;
+// the order of the CIC decimators used during updates
+static const int _decimationOrder = 2;
+// the number of sensor reads processed at a time while averaging
+static const int _batchSize = 16;
 
-// this variable is a flag indicating whether updates should
-//   be run or that the system should be put to sleep
-// 0 means stop, positive values mean go
-static int volatile shouldUpdate = 0;
 // these following values indicate the frequency with which
 //   to run their corresponding functions
 // values are in Hz
 static const uint16_t accelerationUpdateFrequency = 400;
+// the accelerometer and gyroscope are read at _update_samples times the update rate,
+//   which their output data rate of 833 Hz keeps up with (see initializeSensors)
+static const double motionReadFrequency = accelerationUpdateFrequency * _update_samples;
 static const uint16_t headingUpdateFrequency = 30;
 static const uint16_t altitudeUpdateFrequency = 30;
 
+// values used by the gyroscope vibration filter
+// it runs on every gyroscope read, so at the evenly spaced read rate
+static const double _gyroFilterRate = motionReadFrequency;
+static const double _gyroLowPassCutoff = 100;
+// notches for the motor rotation frequency and its first harmonic
+static const int _gyroNotchCount = 2;
+static const double _gyroNotchQ = 3;
+// the time between vibration analyses in microseconds
+static const uint32_t _vibrationInterval = 50000;
+// how long in seconds the notches stay where the vibration analysis put them before
+//   following the motor speed estimate again
+static const double _vibrationPeakLifetime = 1;
+
 // values used in exponentially weighted moving average filter
 static const double smoothing = 0.8;
 
 // values used in sensor fusion
-static const double gyroTrust = 0.9;
+// the time in seconds over which the accelerometer corrects the integrated gyroscope
+// the accelerometer only reads gravity while the vehicle is not accelerating, so this
+//   has to be longer than the vehicle keeps speeding up or slowing down
+static const double gravityTimeConstant = 1;
+// the time in seconds over which the barometer corrects the integrated acceleration
+static const double verticalTimeConstant = 2;
+// the time in seconds over which the drag corrects the integrated acceleration
+static const double horizontalTimeConstant = 0.2;
 
 /////////////////////////
 
@@ -77,27 +95,54 @@ static const double gyroTrust = 0.9;
 //    working data    //
 ////////////////////////
 
-// this struct contains the angular position of the device
-// it is computed through a combination of the magnetometer
-//   position and the integrated angle of the gyroscope
-static struct Orientation _currentOrientation = {
-	.acceleration = Vector3d(0, 0, 0),
-	.gravity = Vector3d(0, 0, 0), 
-	.heading = 0,
-	.altitude = 0,
-};
-static struct Orientation _previousOrientation = {
-	.acceleration = Vector3d(0, 0, 0),
-	.gravity = Vector3d(0, 0, 0), 
-	.heading = 0,
-	.altitude = 0,
-};
-
-
-// this is the mutex lock for use when reading from or writing to
-//   the Orientation structures
-static pthread_mutex_t _orientationMutex;
-static int _mutex_created = 0;
+// the fusion instance fed by the live sensors
+// its currentOrientation is what gets passed to the getOrientation listeners
+static struct OrientationFilter _filter;
+
+// the recent orientations of _filter, for getOrientationAt
+// only the acceleration thread adds to it
+static struct OrientationHistory _history;
+
+// decimate the raw sensor reads down to the update rate
+// each is only used by the thread that updates from its sensor
+static struct CICDecimator _accelerationDecimator;
+static struct CICDecimator _rotationDecimator;
+static struct CICDecimator _magneticFieldDecimator;
+
+// the accelerometer and gyroscope reads of the update being collected, with the times
+//   they were taken, and the number there are so far
+// only used by the thread that reads them
+static FilterSample _accelerationReads[_update_samples];
+static FilterSample _rotationReads[_update_samples];
+static double _motionReadTimes[_update_samples];
+static int _motionReads = 0;
+
+// removes motor vibration from the gyroscope reads before they are decimated
+// only used by the acceleration thread, though any thread can move its notches
+static struct GyroFilterBank _gyroFilter;
+
+// every raw gyroscope read of the acceleration thread, for anything that wants to look
+//   at the unfiltered data, like the vibration analyzer
+static struct SampleRing _gyroSamples;
+// the same reads once _gyroFilter has removed the vibration, for the flight control
+static struct SampleRing _filteredGyroSamples;
+// finds the vibration frequencies in _gyroSamples for the notches of _gyroFilter
+static struct VibrationAnalyzer _vibrationAnalyzer;
+static int _vibrationAnalyzerCreated = 0;
+// identifies the last vibration peaks applied to the notches
+static uint32_t _vibrationSequence = 0;
+// the time of the last vibration peaks applied to the notches
+static std::atomic<double> _vibrationPeakTime(0);
+
+// how well the sensor threads and the listeners keep their rates (see LoopTiming.h)
+static struct LoopTiming _accelerationTiming;
+static struct LoopTiming _headingTiming;
+static struct LoopTiming _altitudeTiming;
+static struct LoopTiming _listenerTiming;
+
+// the file every sample fed to _filter is written to, if a log was requested
+// protected by _filter.lock
+static FILE *_sensorLog = NULL;
 
 ////////////////////////
 
@@ -106,177 +151,187 @@ static int _mutex_created = 0;
 //     functions      //
 ////////////////////////
 
+static void readMotion();
 static void getAcceleration();
 static double getAltitude();
+static void recordAltitude(double altitude);
 static double degreesFromNorth();
+static double currentTime();
 
 
 
-// taken from i2cctl, gets the mutex lock to make
-//   the _currentOrienation object accessible
-static void getLock() {
-	if (!_mutex_created) {
-		pthread_mutex_init(&_orientationMutex, NULL);
-		_mutex_created = 1;
-	}
-	pthread_mutex_lock(&_orientationMutex);
+// gets the mutex lock to make the filter's orientation accessible
+static void getLock(struct OrientationFilter *filter) {
+	pthread_mutex_lock(&filter->lock);
 }
 
-// taken from i2cctl, frees the mutex lock
-static void releaseLock() {
-	if (_mutex_created) {
-		pthread_mutex_unlock(&_orientationMutex);
-	}
+// frees the mutex lock
+static void releaseLock(struct OrientationFilter *filter) {
+	pthread_mutex_unlock(&filter->lock);
 }
 
 // helper functions
 
-// creates 'numVectors' vectors using the function passed in and returns a vector with
+// reads 'numVectors' vectors using the function passed in and returns a vector with
 //   components that are averages of the 'numVectors' vectors
+// the vectors are streamed through a running mean a batch at a time, so this uses the
+//   same small amount of memory no matter how many vectors are averaged
 static Vector3d averageVector(Vector3d (*creation)(), uint16_t numVectors) {
-	// stores the vectors created by the creationFunction
-	Vector3d vectorArray[numVectors];
+	struct RunningMean mean;
+	FilterSample batch[_batchSize];
 
-	// loop through 'numVectors' times, create a vector, and add it to the array
-	for (int i = 0; i < numVectors; i++) {
-		vectorArray[i] = creation();
+	for (int read = 0; read < numVectors;) {
+		int count = numVectors - read < _batchSize ? numVectors - read : _batchSize;
+		for (int i = 0; i < count; i++) {
+			batch[i] = filterSample(creation());
+		}
+		addToRunningMean(&mean, batch, count);
+		read += count;
 	}
 
-	// the vector in which to store the average components
-	Vector3d average = Vector3d(0, 0, 0);
+	return filterVector(runningMean(&mean));
+}
 
-	// store the sums of the components in average
-	for (int i = 0; i < numVectors; i++) {
-		for (int j = 0; j < 3; j++) {
-			average[j] += vectorArray[i][j];
+// runs the '_update_samples' vectors in batch through the decimator, which then outputs
+//   the single newest filtered vector
+// unlike averaging each group on its own, the decimator remembers earlier groups, so
+//   noise above the update rate is properly filtered out instead of aliased
+// if bank is not NULL, the vectors go through it before being decimated, and if
+//   filteredRing is not NULL, the vectors that came out of it are pushed there with the
+//   times they were read at
+// batch is filtered in place
+static Vector3d decimateBatch(FilterSample *batch, const double *times, \
+		struct CICDecimator *decimator, struct GyroFilterBank *bank, \
+		struct SampleRing *filteredRing) {
+	if (bank != NULL)
+		gyroFilterBankProcess(bank, batch, _update_samples);
+	if (filteredRing != NULL) {
+		for (int i = 0; i < _update_samples; i++) {
+			pushSample(filteredRing, times[i], filterVector(batch[i]));
 		}
 	}
+	cicDecimate(decimator, batch, _update_samples);
 
-	// divide the totals by the count
-	average /= numVectors;
-
-	return average;
+	return filterVector(batch[0]);
 }
 
+// reads '_update_samples' vectors back to back using the function passed in and
+//   decimates them (see decimateBatch)
+static Vector3d decimatedVector(Vector3d (*creation)(), struct CICDecimator *decimator) {
+	FilterSample batch[_update_samples];
 
-// internal functions for setting defaults
-
+	for (int i = 0; i < _update_samples; i++) {
+		batch[i] = filterSample(creation());
+	}
 
-// gets the average vector of the accelerometer
-//   for use as a baseline acceleration at rest
-// gives component values in g's
-static void calibrateAccelerometer() {
-	// gets the mutex lock for writing
-	getLock();
-	_init_gravity = averageVector(&accelerationVector, _init_samples);
-	_init_gravity_length = _init_gravity.norm();
-	_currentOrientation.gravity = _init_gravity;
-	printVector(_init_gravity, "initial gravity");
-	// done writing
-	releaseLock();
+	return decimateBatch(batch, NULL, decimator, NULL, NULL);
 }
 
-// gets the expected angular drift (offset error)
-static void calibrateGyroscope() {
-	getLock();
-	_angular_drift = averageVector(&rotationVector, _init_samples);
-	printVector(_angular_drift, "angular drift");
-	releaseLock();
+// sets up the decimator as if the sensor had read value forever
+static void startDecimator(struct CICDecimator *decimator, Vector3d value) {
+	initCICDecimator(decimator, _decimationOrder, _update_samples);
+	settleCICDecimator(decimator, filterSample(value));
 }
 
-// gets the inclination of the magnetic field
-//   and returns a decimal value in degrees
-// DEPENDS: calibrateAccelerometer
-static void calibrateMagnetometer() {
-	// retrieve the magnetic field average vector and its angle from horizontal
-	Vector3d meanField = averageVector(&magneticField, _init_samples);
+// returns the current monotonic time in seconds, which is virtual while simulating
+//   (see Clock.h)
+static double currentTime() {
+	return monotonicTime();
+}
 
-	// gets the mutex lock for writing
-	getLock();
+// returns the difference between the second argument and the time in seconds
+//   stored in the first argument, then stores the second argument in the first
+// returns 0 when the stored time is still unset, meaning there is nothing to compare to
+static double timeSince(double *prev, double time) {
+	double deltaTime = time - *prev;
 
-	// gets the inclination
-	_inclinationAngle = angle_between(meanField, _init_gravity) - 90;
-	printf("inclination is %f degrees below horizontal\n", _inclinationAngle);
+	// which means that this is the first time this function has been called,
+	//   so there was really no comparison value in the first place
+	// have to include floating point tolerance when dealing with small
+	// values
+	if (*prev <= 0.00001) {
+		*prev = time;
+		return 0;
+	}
 
-	// done writing
-	releaseLock();
+	*prev = time;
+	return deltaTime;
 }
 
-// calibrates using the above internal functions
-void calibrateSensors() {
-	calibrateAccelerometer();
-	calibrateGyroscope();
-	calibrateMagnetometer();
+// returns the difference in the current time in seconds as compared to
+//   the argument, which should be a pointer to a double containing the current
+//   time in seconds
+double deltaTime(double *prev) {
+	return timeSince(prev, currentTime());
+}
 
-	// populates the current orientation object
-	getAcceleration();
-	degreesFromNorth();
-	getAltitude();
+// moves deadline on by period and sleeps until it, so the update rate does not drift
+//   with the time each update takes
+// skips the updates that were missed instead of rushing to catch up
+static void waitForNextUpdate(double *deadline, double period) {
+	*deadline += period;
+	double now = currentTime();
+	if (*deadline < now)
+		*deadline = now;
+	sleepUntil(*deadline);
 }
 
 
+// fusion functions
+// these only do math on the values passed in, so they work the same no matter
+//   whether the samples come from the sensors or from a log file
 
-// functions for updating values
+void calibrateOrientationFilter(struct OrientationFilter *filter, Vector3d gravity, \
+		Vector3d drift, Vector3d field) {
+	getLock(filter);
 
-// returns the horizonal plane angle the device is relative to
-//   a ray pointing towards magnetic North
-static double degreesFromNorth() {
-	Vector3d magField = averageVector(&magneticField, _update_samples);
+	// the accelerometer at rest is the baseline acceleration, given in g's
+	filter->initGravity = gravity;
+	filter->initGravityLength = gravity.norm();
+	filter->currentOrientation.gravity = gravity;
 
-	// this is actually not the correct way to get north
-	getLock();
-	_previousOrientation.heading = _currentOrientation.heading;
-	_currentOrientation.heading = smoothing * angleXY(magField) + \
-				      (1 - smoothing) * _previousOrientation.heading;
-	releaseLock();
+	// the expected angular drift (offset error)
+	filter->angularDrift = drift;
 
-	return _currentOrientation.heading;
-}
+	// the inclination of the magnetic field in degrees below horizontal
+	filter->inclinationAngle = angle_between(field, gravity) - 90;
 
-// returns the difference in the current time in seconds as compared to
-//   the argument, which should be a pointer to a double containing the current
-//   time in seconds
-// for use only with the getAngularPosition function
-double deltaTime(double *prev) {
-	struct timespec currentTime;
-	int failed = clock_gettime(CLOCK_MONOTONIC, &currentTime);
-	if (failed) {
-		printf("getting clock time failed \n");
-		return 0;
-	}
-
-	double nanoSecondTime = currentTime.tv_sec + \
-				(double)(currentTime.tv_nsec)/1000000000.0;
-	double deltaTime = nanoSecondTime - *prev;
-
-	// which means that this is the first time this function has been called,
-	//   so there was really no comparison value in the first place
-	// have to include floating point tolerance when dealing with small
-	// values
-	if (*prev <= 0.00001) {
-		*prev = nanoSecondTime;
-		return 0;
-	}
+	filter->angUpdateTime = 0;
+	initVerticalEstimator(&filter->vertical, verticalTimeConstant);
+	filter->currentOrientation.verticalVelocity = 0;
+	// the drag rate belongs to the vehicle, so it is kept, and the vehicle sits level while
+	//   calibrating, so across the accelerometer is its bias
+	Vector3d bias = filter->initGravityLength > 0 ? \
+			Vector3d(gravity * STANDARD_GRAVITY / filter->initGravityLength) : Vector3d(0, 0, 0);
+	initHorizontalEstimator(&filter->horizontal, filter->horizontal.dragRate, \
+			horizontalTimeConstant, bias);
+	filter->currentOrientation.horizontalVelocity = Vector3d(0, 0, 0);
 
-	*prev = nanoSecondTime;
-	return deltaTime;
+	releaseLock(filter);
 }
 
-// this variable stores the time the angularPosition was last updated in nanoseconds
-// this is done because the rotation angle must be found using a vector
-double angUpdateTime = 0;
+// sets the heading as the horizonal plane angle the device is relative to
+//   a ray pointing towards magnetic North
+void updateFilterHeading(struct OrientationFilter *filter, Vector3d magField) {
+	// this is actually not the correct way to get north
+	getLock(filter);
+	filter->previousOrientation.heading = filter->currentOrientation.heading;
+	filter->currentOrientation.heading = smoothing * angleXY(magField) + \
+				      (1 - smoothing) * filter->previousOrientation.heading;
+	releaseLock(filter);
+}
 
-// uses the gyroscope to obtain the current angular position
-static Vector3d angPosGyro() {
-	Vector3d rotation = averageVector(&rotationVector, \
-						   _update_samples) - _angular_drift;
+// uses the gyroscope to obtain the current angular position dt seconds after the last
+static Vector3d angPosGyro(struct OrientationFilter *filter, Vector3d rotation, double dt) {
+	rotation -= filter->angularDrift;
 
-	getLock();
-	double dt = deltaTime(&angUpdateTime);
-	Vector3d gravity = _currentOrientation.gravity;
-	releaseLock();
+	getLock(filter);
+	Vector3d gravity = filter->currentOrientation.gravity;
+	releaseLock(filter);
 
-	rotation *= dt;
+	// the gravity vector is fixed in the world, so seen from the body it turns the
+	//   opposite way to the body's rotation
+	rotation *= -dt;
 	AngleAxisd roll = AngleAxisd(rotation(0), Vector3d::UnitX());
 	AngleAxisd pitch = AngleAxisd(rotation(1), Vector3d::UnitY());
 	AngleAxisd yaw = AngleAxisd(rotation(2), Vector3d::UnitZ());
@@ -289,146 +344,350 @@ static Vector3d angPosGyro() {
 // gets the current angular position relative to a ray pointing towards the ground
 // uses sensor fusion of the accelerometer and gyro to compute the angular position
 // expects a vector containing the accelerometer vector as the input
-void getAngularPosition(Vector3d accel) {
+static void getAngularPosition(struct OrientationFilter *filter, Vector3d accel, \
+		Vector3d rotation, double time) {
 	// uses the gyro and accelerometer obtained position values in combination
-	Vector3d accelPos = _init_gravity_length * accel / accel.norm();
-	Vector3d gyroPos = angPosGyro();
+	Vector3d accelPos = filter->initGravityLength * accel / accel.norm();
+	getLock(filter);
+	double dt = timeSince(&filter->angUpdateTime, time);
+	releaseLock(filter);
+	Vector3d gyroPos = angPosGyro(filter, rotation, dt);
+	// weighs the samples the same over time whatever their rate
+	double gyroTrust = gravityTimeConstant / (gravityTimeConstant + dt);
 	double xPos = gyroPos(0) * gyroTrust + accelPos(0) * (1 - gyroTrust);
 	double yPos = gyroPos(1) * gyroTrust + accelPos(1) * (1 - gyroTrust);
 	double zPos = gyroPos(2) * gyroTrust + accelPos(2) * (1 - gyroTrust);
 
 	double mag = Vector3d(xPos, yPos, zPos).norm();
-	double magCoeff = _init_gravity_length / mag;
+	double magCoeff = filter->initGravityLength / mag;
 
 	Vector3d angPos = magCoeff * Vector3d(xPos, yPos, zPos);
 
 	// updates the angular position
-	getLock();
-	_previousOrientation.gravity = _currentOrientation.gravity;
-	_currentOrientation.gravity = smoothing * angPos + (1 - smoothing) * _previousOrientation.gravity;
-	releaseLock();
+	getLock(filter);
+	filter->previousOrientation.gravity = filter->currentOrientation.gravity;
+	filter->currentOrientation.gravity = smoothing * angPos + \
+				(1 - smoothing) * filter->previousOrientation.gravity;
+	releaseLock(filter);
 }
 
-// returns the acceleration vector adjusted for the position of ground
-void getAcceleration() {
-
-	// retrieve the acceleration value from the sensors
-	Vector3d rawAcceleration = averageVector(&accelerationVector, _update_samples);
+// sets the acceleration vector adjusted for the position of ground
+void updateFilterAcceleration(struct OrientationFilter *filter, Vector3d rawAcceleration, \
+		Vector3d rotation, double time) {
 	// compute the angular position to obtain the gravity vector used later
-	getAngularPosition(rawAcceleration);
-	
+	getAngularPosition(filter, rawAcceleration, rotation, time);
+
 	// creates a vector pointing in the direction of gravity with the magnitude measuring
 	//   in the system's stationary state
 	// needs the mutex lock
 
-	Vector3d acc = rawAcceleration - _currentOrientation.gravity;
+	Vector3d acc = rawAcceleration - filter->currentOrientation.gravity;
 
-	getLock();
+	getLock(filter);
 	// updates the internal orientation struct
-	_previousOrientation.acceleration = _currentOrientation.acceleration;
-	_currentOrientation.acceleration = smoothing * acc + (1 - smoothing) * _previousOrientation.acceleration;
-	releaseLock();
-}
+	filter->previousOrientation.acceleration = filter->currentOrientation.acceleration;
+	filter->currentOrientation.acceleration = smoothing * acc + \
+				(1 - smoothing) * filter->previousOrientation.acceleration;
+
+	// the part of the acceleration along gravity is the vertical acceleration, and since
+	//   the accelerometer reads gravity as pointing up, positive means climbing
+	// uses the unsmoothed acceleration, the estimator does its own filtering
+	Vector3d gravity = filter->currentOrientation.gravity;
+	double gravityLength = gravity.norm();
+	if (gravityLength > 0 && filter->initGravityLength > 0) {
+		double vertical = acc.dot(gravity) / (gravityLength * filter->initGravityLength);
+		verticalPredict(&filter->vertical, vertical * STANDARD_GRAVITY, time);
+		if (filter->vertical.initialized) {
+			filter->previousOrientation.altitude = filter->currentOrientation.altitude;
+			filter->currentOrientation.altitude = filter->vertical.altitude;
+			filter->currentOrientation.verticalVelocity = filter->vertical.velocity;
+		}
 
-// yes, I know this seems redunant, but it allow for easier modification
-static double getAltitude() {
-	double altitude = barometerAltitude();
+		// the horizontal velocity takes the same samples in m/s^2
+		double scale = STANDARD_GRAVITY / filter->initGravityLength;
+		horizontalPredict(&filter->horizontal, acc * scale, rawAcceleration * scale, time);
+		filter->currentOrientation.horizontalVelocity = filter->horizontal.velocity;
+	}
+	releaseLock(filter);
+}
 
-	// updates the internal orientation struct
-	getLock();
-	_previousOrientation.altitude = _currentOrientation.altitude;
-	_currentOrientation.altitude = smoothing * altitude + \
-				(1 - smoothing) * _previousOrientation.altitude;
-	releaseLock();
+// corrects the vertical estimator, which the accelerometer updates then carry into
+//   the orientation
+// the first reading sets the altitude directly, since there is nothing to correct yet
+void updateFilterAltitude(struct OrientationFilter *filter, double altitude) {
+	getLock(filter);
+	int initialized = filter->vertical.initialized;
+	verticalCorrect(&filter->vertical, altitude);
+	if (!initialized) {
+		filter->previousOrientation.altitude = filter->currentOrientation.altitude;
+		filter->currentOrientation.altitude = altitude;
+	}
+	releaseLock(filter);
+}
 
-	return altitude;
+struct Orientation filterOrientation(struct OrientationFilter *filter) {
+	getLock(filter);
+	struct Orientation orientation = filter->currentOrientation;
+	releaseLock(filter);
+	return orientation;
 }
 
 
-// this function is executed infinitely while shouldUpdate
-//   is a positive value
-// setting shouldUpdate to 0 causes this function to put its
-//   thread into a sleep state, waking up every few seconds to
-//   check the shouldUpdate flag
-// updates the acceleration and gravity member of the struct input
-static void *updateAcceleration(void *input) {
-	// this is the pointer the orientation struct which
-	//   this function will record updates to
-	struct Orientation *orientation = (struct Orientation *)(input);
-	// stores the time the function should sleep between
-	//   updates in microseconds
-	uint32_t period = 1000000 / accelerationUpdateFrequency;
-	double lastUpdateTime = 0;
+// sensor log functions
+// the log is plain text, one sample per line, see Replay.h for the format
 
-	while (1) {
-		while (!shouldUpdate) {
-			// sleeps for 1.5 seconds
-			usleep(1500000);
-		}
+int startSensorLog(const char *path) {
+	FILE *log = fopen(path, "w");
+	if (log == NULL) {
+		printf("failed to open sensor log %s\n", path);
+		return -1;
+	}
 
-		uint32_t sleepTime = period - deltaTime(&lastUpdateTime) * 1000000;
-		if (sleepTime > 0)
-			usleep(sleepTime);
-		
-		getAcceleration();
+	getLock(&_filter);
+	if (_sensorLog != NULL)
+		fclose(_sensorLog);
+	_sensorLog = log;
+	releaseLock(&_filter);
+
+	return 0;
+}
+
+void stopSensorLog() {
+	getLock(&_filter);
+	if (_sensorLog != NULL)
+		fclose(_sensorLog);
+	_sensorLog = NULL;
+	releaseLock(&_filter);
+}
+
+// writes a line to the sensor log if one is open
+static void logSample(const char *format, ...) {
+	getLock(&_filter);
+	if (_sensorLog != NULL) {
+		va_list args;
+		va_start(args, format);
+		vfprintf(_sensorLog, format, args);
+		va_end(args);
 	}
-	return NULL;
+	releaseLock(&_filter);
 }
 
 
-// this function is executed infinitely while shouldUpdate
-//   is a positive value
-// setting shouldUpdate to 0 causes this function to put its
-//   thread into a sleep state, waking up every few seconds to
-//   check the shouldUpdate flag
-// updates the heading member of the struct input
-static void *updateHeading(void *input) {
-	// stores the time the function should sleep between
-	//   updates in microseconds
-	uint32_t period = 1000000 / accelerationUpdateFrequency;
-	double lastUpdateTime = 0;
+// live sensor functions
+// these read the sensors and feed the samples to the live filter
 
-	while (1) {
-		while (!shouldUpdate) {
-			// sleeps for 1.5 seconds
-			usleep(1500000);
-		}
+// calibrates the live filter using the average of the at rest sensor vectors
+void calibrateSensors() {
+	Vector3d gravity = averageVector(&accelerationVector, _init_samples);
+	printVector(gravity, "initial gravity");
+	Vector3d drift = averageVector(&rotationVector, _init_samples);
+	printVector(drift, "angular drift");
+	Vector3d field = averageVector(&magneticField, _init_samples);
+
+	calibrateOrientationFilter(&_filter, gravity, drift, field);
+	startDecimator(&_accelerationDecimator, gravity);
+	startDecimator(&_rotationDecimator, drift);
+	startDecimator(&_magneticFieldDecimator, field);
+	if (_gyroFilter.sampleRate == 0) {
+		initGyroFilterBank(&_gyroFilter, _gyroFilterRate, _gyroLowPassCutoff, \
+				_gyroNotchCount, _gyroNotchQ);
+	}
+	settleGyroFilterBank(&_gyroFilter, filterSample(drift));
+	printf("inclination is %f degrees below horizontal\n", _filter.inclinationAngle);
+	logSample("c %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g\n", \
+			gravity(0), gravity(1), gravity(2), drift(0), drift(1), drift(2), \
+			field(0), field(1), field(2));
 
-		uint32_t sleepTime = period - deltaTime(&lastUpdateTime) * 1000000;
-		if (sleepTime > 0)
-			usleep(sleepTime);
-		
-		degreesFromNorth();
+	// populates the current orientation object
+	_motionReads = 0;
+	for (int i = 0; i < _update_samples; i++) {
+		readMotion();
 	}
-	return NULL;
+	degreesFromNorth();
+	getAltitude();
 }
 
+// updates the heading from the magnetometer
+static double degreesFromNorth() {
+	Vector3d magField = decimatedVector(&magneticField, &_magneticFieldDecimator);
+	double time = currentTime();
+	logSample("h %.9f %.9g %.9g %.9g\n", time, magField(0), magField(1), magField(2));
+	blackboxRecord(BLACKBOX_MAGNETIC_FIELD, time, magField.data(), 3);
 
+	updateFilterHeading(&_filter, magField);
 
-// this function is executed infinitely while shouldUpdate
-//   is a positive value
-// setting shouldUpdate to 0 causes this function to put its
-//   thread into a sleep state, waking up every few seconds to
-//   check the shouldUpdate flag
-// updates the altitude member of the struct input
-static void *updateAltitude(void *input) {
-	// stores the time the function should sleep between
-	//   updates in microseconds
-	uint32_t period = 1000000 / accelerationUpdateFrequency;
-	double lastUpdateTime = 0;
+	return filterOrientation(&_filter).heading;
+}
 
-	while (1) {
-		while (!shouldUpdate) {
-			// sleeps for 1.5 seconds
-			usleep(1500000);
-		}
+// reads the accelerometer and gyroscope once, and updates the acceleration and gravity
+//   from the reads once there are '_update_samples' of them
+static void readMotion() {
+	Vector3d acceleration = accelerationVector();
+	Vector3d rotation = rotationVector();
+	double time = currentTime();
+	pushSample(&_gyroSamples, time, rotation);
+
+	_accelerationReads[_motionReads] = filterSample(acceleration);
+	_rotationReads[_motionReads] = filterSample(rotation);
+	_motionReadTimes[_motionReads] = time;
+	if (++_motionReads == _update_samples) {
+		_motionReads = 0;
+		getAcceleration();
+	}
+}
+
+// updates the acceleration and gravity from the accelerometer and gyroscope reads
+static void getAcceleration() {
+	Vector3d rawAcceleration = decimateBatch(_accelerationReads, _motionReadTimes, \
+			&_accelerationDecimator, NULL, NULL);
+	Vector3d rotation = decimateBatch(_rotationReads, _motionReadTimes, \
+			&_rotationDecimator, &_gyroFilter, &_filteredGyroSamples);
+	double time = currentTime();
+	logSample("a %.9f %.9g %.9g %.9g %.9g %.9g %.9g\n", time, \
+			rawAcceleration(0), rawAcceleration(1), rawAcceleration(2), \
+			rotation(0), rotation(1), rotation(2));
+
+	blackboxRecord(BLACKBOX_ACCELERATION, time, rawAcceleration.data(), 3);
+	blackboxRecord(BLACKBOX_ROTATION, time, rotation.data(), 3);
+
+	updateFilterAcceleration(&_filter, rawAcceleration, rotation, time);
+	struct Orientation orientation = filterOrientation(&_filter);
+	addOrientationRecord(&_history, time, orientation);
+	double fused[6] = {orientation.gravity(0), orientation.gravity(1), orientation.gravity(2), \
+			orientation.heading, orientation.altitude, orientation.verticalVelocity};
+	blackboxRecord(BLACKBOX_ORIENTATION, time, fused, 6);
+	double sent[TELEMETRY_MAX_VALUES] = {orientation.gravity(0), orientation.gravity(1), \
+			orientation.gravity(2), orientation.acceleration(0), orientation.acceleration(1), \
+			orientation.acceleration(2), orientation.heading, orientation.altitude, \
+			orientation.verticalVelocity};
+	publishTelemetry(TELEMETRY_ORIENTATION, time, sent, TELEMETRY_MAX_VALUES);
+
+	// moves the notches onto the vibration peaks whenever the analyzer finds new ones
+	struct VibrationPeaks peaks;
+	if (newVibrationPeaks(&_vibrationAnalyzer, &peaks, &_vibrationSequence) == 0 && \
+			peaks.count > 0) {
+		setGyroNotchFrequencies(&_gyroFilter, peaks.frequencies, \
+				peaks.count < _gyroNotchCount ? peaks.count : _gyroNotchCount);
+		_vibrationPeakTime = peaks.time;
+	}
+}
 
-		uint32_t sleepTime = period - deltaTime(&lastUpdateTime) * 1000000;
-		if (sleepTime > 0)
-			usleep(sleepTime);
-		
-		getAltitude();
+void setHorizontalDragRate(double dragRate) {
+	getLock(&_filter);
+	_filter.horizontal.dragRate = dragRate > 0 ? dragRate : 0;
+	if (dragRate <= 0) {
+		_filter.horizontal.velocity = Vector3d(0, 0, 0);
+		_filter.currentOrientation.horizontalVelocity = Vector3d(0, 0, 0);
 	}
+	releaseLock(&_filter);
+}
+
+double horizontalDragRate() {
+	getLock(&_filter);
+	double dragRate = _filter.horizontal.dragRate;
+	releaseLock(&_filter);
+	return dragRate;
+}
+
+struct SampleRing *gyroSamples() {
+	return &_gyroSamples;
+}
+
+struct SampleRing *filteredGyroSamples() {
+	return &_filteredGyroSamples;
+}
+
+Vector3d gyroscopeDrift() {
+	getLock(&_filter);
+	Vector3d drift = _filter.angularDrift;
+	releaseLock(&_filter);
+
+	return drift;
+}
+
+void setMotorNoiseFrequency(double frequency) {
+	// the filter is set up during calibration
+	if (_gyroFilter.sampleRate == 0)
+		return;
+	// measured vibration beats an estimate
+	if (currentTime() - _vibrationPeakTime < _vibrationPeakLifetime)
+		return;
+
+	double centers[_gyroNotchCount] = {frequency, 2 * frequency};
+	setGyroNotchFrequencies(&_gyroFilter, centers, _gyroNotchCount);
+}
+
+int getOrientationAt(double time, struct Orientation *orientation) {
+	return orientationAt(&_history, time, orientation);
+}
+
+// updates the altitude from the barometer
+static double getAltitude() {
+	double altitude = barometerAltitude();
+	recordAltitude(altitude);
+
+	return altitude;
+}
+
+// logs and records a new altitude from the barometer and feeds it to the filter
+static void recordAltitude(double altitude) {
+	double time = currentTime();
+	logSample("b %.9f %.9g\n", time, altitude);
+	blackboxRecord(BLACKBOX_ALTITUDE, time, &altitude, 1);
+
+	updateFilterAltitude(&_filter, altitude);
+}
+
+
+
+// the sensor reads run as timers on one event loop (see EventLoop.h), the barometer's
+//   read being a task (see Task.h) that hands the loop back to the other sensors while
+//   its conversions take their tens of milliseconds
+// the loop only runs while there are listeners, so nothing wakes up in between
+
+// the loop every sensor read runs on
+static struct EventLoop _sensorLoop;
+// 1 while a barometer read is running on the sensor loop, so the timer does not start
+//   another, and the loop is not stopped before it has finished
+static std::atomic<int> _barometerReading(0);
+// set while the sensor loop is being stopped, so no new barometer read is started
+static std::atomic<int> _sensorsStopping(0);
+
+// reads the accelerometer and gyroscope on every timer deadline, which updates the
+//   acceleration and gravity every '_update_samples' reads
+static int updateAcceleration(void *input, double time) {
+	readMotion();
+	return 0;
+}
+
+// updates the heading on every timer deadline
+static int updateHeading(void *input, double time) {
+	degreesFromNorth();
+	return 0;
+}
+
+// takes the altitude the barometer read, or NAN if it failed
+static void altitudeRead(double altitude, void *context) {
+	if (!isnan(altitude))
+		recordAltitude(altitude);
+	_barometerReading = 0;
+}
+
+// starts reading the altitude on every timer deadline, unless a read is still running
+static int updateAltitude(void *input, double time) {
+	if (_barometerReading || _sensorsStopping)
+		return 0;
+
+	_barometerReading = 1;
+	if (!readBarometerAltitude(&_sensorLoop, &altitudeRead, NULL).started)
+		_barometerReading = 0;
+	return 0;
+}
+
+// runs the event loop input points to as a sensor thread until it is stopped
+static void *runSensorLoop(void *input) {
+	makeRealTimeThread(REAL_TIME_ACQUISITION);
+	runEventLoop((struct EventLoop *)(input));
 	return NULL;
 }
 
@@ -445,35 +704,65 @@ struct Observer {
 };
 
 
-// stores the thread pointers
-// only one thread per Orientation struct member is used, which
-//   allows for multiple listener functions without wasting resources
-static pthread_t _accelerationThread = 0;
-static pthread_t _altitudeThread = 0;
-static pthread_t _headingThread = 0;
-// stores the current number of listeners as an integer
-static uint16_t _numListeners = 0;
+// the sensor loop and the thread running it
+// only one of each is used, which allows for multiple listener functions without
+//   wasting resources
+static pthread_t _sensorThread = 0;
+// the Observer of every listener, from the call to getOrientation() until its thread
+//   exits, read without locking whenever the listeners are counted (see rcu_set.h)
+static struct rcu_set *_listeners = rcu_set_init();
 // stores the max allowed number of listeners
 static const uint16_t _maxListeners = 10;
+// serializes adding and removing listeners with starting and stopping the sensors, so
+//   the limit holds and the last listener leaving cannot stop the sensors under one
+//   that is starting
+// a clock mutex (see Clock.h), since the thread holding it may sleep on the clock for
+//   seconds while it starts or stops the sensors
+static struct ClockMutex _listenersLock = CLOCK_MUTEX_INITIALIZER;
+// 1 once the sensors have been started for the current listeners, even if only partly,
+//   so the last listener leaving knows to stop them
+// protected by _listenersLock
+static int _sensorsStarted = 0;
+
+static void lockListeners() {
+	lockClockMutex(&_listenersLock);
+}
+
+static void unlockListeners() {
+	unlockClockMutex(&_listenersLock);
+}
 
 // creates the threads for the orientation struct member
 //   update functions
 // if the threads already exist, simply returns 0 and acts
 //   like it did something
+// must be called with the listeners locked
 // returns 0 on success and -1 on failure
 int createStructMemberUpdateThreads() {
+	_sensorsStarted = 1;
 	int failure = initializeSensors();
 	calibrateSensors();
 
-	if (_accelerationThread == 0) {
-		failure |= pthread_create(&_accelerationThread, NULL, &updateAcceleration, NULL);
-	}
-	if (_altitudeThread == 0) {
-		failure |= pthread_create(&_altitudeThread, NULL, &updateAltitude, NULL);
+	if (_sensorThread == 0) {
+		_sensorsStopping = 0;
+		if (initEventLoop(&_sensorLoop) || \
+				addLoopTimer(&_sensorLoop, 1.0 / motionReadFrequency, \
+					&updateAcceleration, NULL, &_accelerationTiming, "acceleration") < 0 || \
+				addLoopTimer(&_sensorLoop, 1.0 / headingUpdateFrequency, \
+					&updateHeading, NULL, &_headingTiming, "heading") < 0 || \
+				addLoopTimer(&_sensorLoop, 1.0 / altitudeUpdateFrequency, \
+					&updateAltitude, NULL, &_altitudeTiming, "altitude") < 0 || \
+				createClockThread(&_sensorThread, NULL, &runSensorLoop, &_sensorLoop)) {
+			closeEventLoop(&_sensorLoop);
+			_sensorThread = 0;
+			failure = -1;
+		}
 	}
-	if (_headingThread == 0) {
-		failure |= pthread_create(&_headingThread, NULL, &updateHeading, NULL);
+	if (!_vibrationAnalyzerCreated) {
+		failure |= initVibrationAnalyzer(&_vibrationAnalyzer, &_gyroSamples, _vibrationInterval);
+		_vibrationAnalyzerCreated = 1;
 	}
+	failure |= startVibrationAnalyzer(&_vibrationAnalyzer);
 
 	if (failure) {
 		printf("failed to create struct member update threads\n");
@@ -483,51 +772,42 @@ int createStructMemberUpdateThreads() {
 	return 0;
 }
 
-// gracefully exits (hopefully) or kills the orientation
-//   struct member update threads
+// stops the orientation struct member update loops and waits for
+//   their threads to exit
 // if the threads are already dead, or if there are other
 // active listeners, simply returns 0 and acts like it did something
+// must be called with the listeners locked
 // returns 0 on success and -1 on failure
 int killStructMemberUpdateThreads() {
-	if (_numListeners > 0) {
+	if (rcu_set_count(_listeners) > 0 || !_sensorsStarted) {
 		return 0;
 	}
+	_sensorsStarted = 0;
 	printf("last listener exited\nterminated orientation update threads\n");
-	int returnValue = 0;
-	if (_accelerationThread != 0) {
-		int failure = pthread_cancel(_accelerationThread);
-		if (!failure) {
-			_accelerationThread = 0;
-		}
-		else {
-			printf("failed to cancel acceleration thread\n");
-			returnValue = -1;
-		}
-	}
-	if (_altitudeThread != 0) {
-		int failure = pthread_cancel(_altitudeThread);
-		if (!failure) {
-			_altitudeThread = 0;
-		}
-		else {
-			printf("failed to cancel altitude thread\n");
-			returnValue = -1;
-		}
-	}
-	if (_headingThread != 0) {
-		int failure = pthread_cancel(_headingThread);
-		if (!failure) {
-			_headingThread = 0;
-		}
-		else {
-			printf("failed to cancel heading thread\n");
-			returnValue = -1;
-		}
+	// lets a running barometer read finish, since its task only ends on the loop, then
+	//   wakes the loop up right away, so the thread is gone before the sensors are
+	if (_sensorThread != 0) {
+		_sensorsStopping = 1;
+		while (_barometerReading)
+			sleepFor(0.001);
+		stopEventLoopThread(&_sensorLoop, _sensorThread);
+		closeEventLoop(&_sensorLoop);
+		_sensorThread = 0;
 	}
+	stopVibrationAnalyzer(&_vibrationAnalyzer);
 	
 	deinitializeSensors();
 
-	return returnValue;
+	return 0;
+}
+
+// takes the listener out of the table and frees it, then stops the sensors if it was
+//   the last one
+// must be called with the listeners locked
+static void removeListener(struct Observer *observer) {
+	rcu_set_remove(_listeners, observer);
+	free(observer);
+	killStructMemberUpdateThreads();
 }
 
 // handles calling the completion handler of the getOrientation
@@ -539,48 +819,51 @@ int killStructMemberUpdateThreads() {
 // the argument must be an OrienationUpdateInformation struct
 //   containing the information to be used on this thread
 void *updateOrientation(void *input) {
-	struct Observer threadInfo = *((struct Observer *)(input));
-	free(input);
-	// increment the number of listeners
-	_numListeners++;
+	struct Observer *observer = (struct Observer *)(input);
+	struct Observer threadInfo = *observer;
 
 	// creates the threads if they haven't been created
+	lockListeners();
 	int failure = createStructMemberUpdateThreads();
 	if (failure) {
 		printf("update listener terminated due thread spawn error\n");
-		_numListeners--;
-		killStructMemberUpdateThreads();
+		removeListener(observer);
+		unlockListeners();
 		pthread_exit(NULL);
 	}
+	unlockListeners();
+
+	makeRealTimeThread(REAL_TIME_FUSION);
 
 	// waits the desired interval, then passes the current
 	//   orientation struct to the completion handler
 	// if the completion handler requests termination,
 	//   terminates on the next loop
-	uint32_t waitTimeMicroseconds = 1000000/threadInfo.frequency;
-	double lastUpdateTime = 0;
-	deltaTime(&lastUpdateTime);
 	int completion = 0;
+	// all the listeners share one timing, each with its own period
+	struct LoopClock clock;
+	initLoopClock(&clock, &_listenerTiming, "orientation listeners", \
+			1.0 / threadInfo.frequency);
+	double deadline = currentTime();
 
 	while (1) {
-		getLock();
-		completion = threadInfo.completionHandler(_currentOrientation);
-		releaseLock();
+		loopStart(&_listenerTiming, &clock, deadline);
+		completion = threadInfo.completionHandler(filterOrientation(&_filter));
+		loopEnd(&_listenerTiming, &clock);
 
 		if (completion < 0) {
 			printf("exit requested\nending listener thread\n");
-			_numListeners--;
-			killStructMemberUpdateThreads();
+			lockListeners();
+			removeListener(observer);
+			unlockListeners();
 			pthread_exit(NULL);
 		}
 		else if (completion > 0) {
 			threadInfo.frequency = completion;
-			waitTimeMicroseconds = 1000000/completion;
+			clock.period = 1.0 / completion;
 		}
 
-		uint32_t sleepTimeMicro = waitTimeMicroseconds - (deltaTime(&lastUpdateTime) * 1000000);
-		if (sleepTimeMicro > 0)
-			usleep(sleepTimeMicro);
+		waitForNextUpdate(&deadline, clock.period);
 	}
 
 	return NULL;
@@ -590,25 +873,42 @@ void *updateOrientation(void *input) {
 //   struct into the passed in completion handler function
 // returns 0 on success and -1 on failure
 int getOrientation(int (*completion)(struct Orientation), uint16_t updateRate) {
-	// if listener count is exceed, return failure code
-	if (_numListeners >= _maxListeners) {
-		printf("call to getOrientation exited due to listener count exceeding maximum allowed count\n");
-		return -1;
-	}
 	// set the update information struct
 	struct Observer *threadInfo = \
 			(struct Observer *)(malloc(sizeof(struct Observer)));
+	if (threadInfo == NULL) {
+		printf("failed to allocate orientation listener\n");
+		return -1;
+	}
 	threadInfo->frequency = updateRate;
 	threadInfo->completionHandler = completion;
-	// set the shouldUpdate flag
-	shouldUpdate = 1;
+
+	// the listener is counted from here on, so the limit holds however many threads
+	//   call this at once
+	lockListeners();
+	if (rcu_set_count(_listeners) >= _maxListeners) {
+		unlockListeners();
+		free(threadInfo);
+		printf("call to getOrientation exited due to listener count exceeding maximum allowed count\n");
+		return -1;
+	}
+	if (rcu_set_add(_listeners, threadInfo)) {
+		unlockListeners();
+		free(threadInfo);
+		printf("failed to add orientation listener to the listener table\n");
+		return -1;
+	}
+	unlockListeners();
 
 	// spin up thread for orientation updates
 	pthread_t orienatationThread;
-	int failure = pthread_create(&orienatationThread, NULL, \
+	int failure = createClockThread(&orienatationThread, NULL, \
 				     &updateOrientation, threadInfo);
 	if (failure) {
 		printf("failed to create orientation thread\n");
+		lockListeners();
+		removeListener(threadInfo);
+		unlockListeners();
 		return -1;
 	}
 
@@ -630,6 +930,7 @@ void printOrientation(struct Orientation o) {
 	printVector(o.gravity, g);
 	printf("%sdegrees from North%s\n %f\n", HEADING_COLOR, NORMAL_COLOR, o.heading);
 	printf("%saltitude%s\n %f\n", ALTITUDE_COLOR, NORMAL_COLOR, o.altitude);
+	printf("%svertical velocity%s\n %f\n", ALTITUDE_COLOR, NORMAL_COLOR, o.verticalVelocity);
 }
 
 
@@ -0,0 +1,145 @@
+// implementation for the OrientationHistory header
+//
+// each slot works like a tiny seqlock: the writer clears the slot's stamp, writes the
+//   record, and then sets the stamp to the record's index
+// a reader that sees the same stamp before and after copying knows the copy is whole
+//
+// by Mark Hill
+
+#include<stdint.h>
+#include<math.h>
+
+#include<atomic>
+
+#include<OrientationHistory.h>
+#include<Orientation.h>
+#include<Eigen/Dense>
+#include<Eigen/Geometry>
+
+using namespace Eigen;
+
+// how many times a lookup restarts after the writer overwrote a record it was using
+static const int _maxAttempts = 8;
+
+void addOrientationRecord(struct OrientationHistory *history, double time, \
+		struct Orientation orientation) {
+	uint64_t index = history->count.load(std::memory_order_relaxed);
+	uint64_t slot = index & (ORIENTATION_HISTORY_SIZE - 1);
+
+	history->stamps[slot].store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	history->records[slot].time = time;
+	history->records[slot].orientation = orientation;
+
+	history->stamps[slot].store(index + 1, std::memory_order_release);
+	history->count.store(index + 1, std::memory_order_release);
+}
+
+// copies the record with the given index into record
+// returns 0 on success and -1 if the record has been overwritten or is being written
+static int readRecord(struct OrientationHistory *history, uint64_t index, \
+		struct OrientationRecord *record) {
+	uint64_t slot = index & (ORIENTATION_HISTORY_SIZE - 1);
+
+	if (history->stamps[slot].load(std::memory_order_acquire) != index + 1)
+		return -1;
+	*record = history->records[slot];
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (history->stamps[slot].load(std::memory_order_relaxed) != index + 1)
+		return -1;
+
+	return 0;
+}
+
+// interpolates between two orientations, fraction being 0 at a and 1 at b
+static struct Orientation interpolate(const struct Orientation &a, const struct Orientation &b, \
+		double fraction) {
+	struct Orientation result;
+	result.acceleration = a.acceleration + fraction * (b.acceleration - a.acceleration);
+	result.altitude = a.altitude + fraction * (b.altitude - a.altitude);
+	result.verticalVelocity = a.verticalVelocity + \
+			fraction * (b.verticalVelocity - a.verticalVelocity);
+	result.horizontalVelocity = a.horizontalVelocity + \
+			fraction * (b.horizontalVelocity - a.horizontalVelocity);
+
+	// rotates the direction of gravity along the arc between the two vectors while
+	//   scaling its length linearly
+	double aLength = a.gravity.norm();
+	double bLength = b.gravity.norm();
+	if (aLength > 0 && bLength > 0) {
+		Quaterniond arc = Quaterniond::FromTwoVectors(a.gravity, b.gravity);
+		Quaterniond partial = Quaterniond::Identity().slerp(fraction, arc);
+		result.gravity = (partial * (a.gravity / aLength)) * \
+				(aLength + fraction * (bLength - aLength));
+	}
+	else {
+		result.gravity = a.gravity + fraction * (b.gravity - a.gravity);
+	}
+
+	// the heading takes the short way around the circle
+	double headingChange = fmod(b.heading - a.heading, 360);
+	if (headingChange > 180)
+		headingChange -= 360;
+	else if (headingChange < -180)
+		headingChange += 360;
+	result.heading = a.heading + fraction * headingChange;
+
+	return result;
+}
+
+int orientationAt(struct OrientationHistory *history, double time, \
+		struct Orientation *orientation) {
+	for (int attempt = 0; attempt < _maxAttempts; attempt++) {
+		uint64_t count = history->count.load(std::memory_order_acquire);
+		if (count == 0)
+			return -1;
+
+		uint64_t newest = count - 1;
+		uint64_t oldest = count > ORIENTATION_HISTORY_SIZE ? count - ORIENTATION_HISTORY_SIZE : 0;
+		struct OrientationRecord low, high;
+
+		if (readRecord(history, newest, &high))
+			continue;
+		if (time >= high.time) {
+			*orientation = high.orientation;
+			return time > high.time ? 1 : 0;
+		}
+
+		if (readRecord(history, oldest, &low))
+			continue;
+		if (time < low.time)
+			return -1;
+
+		// binary search for the pair of records surrounding time
+		// low.time <= time < high.time holds the whole way through
+		uint64_t lowIndex = oldest, highIndex = newest;
+		int overwritten = 0;
+		while (highIndex - lowIndex > 1) {
+			uint64_t middleIndex = lowIndex + (highIndex - lowIndex) / 2;
+			struct OrientationRecord middle;
+			if (readRecord(history, middleIndex, &middle)) {
+				overwritten = 1;
+				break;
+			}
+
+			if (middle.time <= time) {
+				lowIndex = middleIndex;
+				low = middle;
+			}
+			else {
+				highIndex = middleIndex;
+				high = middle;
+			}
+		}
+		if (overwritten)
+			continue;
+
+		double span = high.time - low.time;
+		double fraction = span > 0 ? (time - low.time) / span : 0;
+		*orientation = interpolate(low.orientation, high.orientation, fraction);
+		return 0;
+	}
+
+	return -1;
+}
@@ -0,0 +1,189 @@
+// implementation for the Replay header
+//
+// by Mark Hill
+
+#include<stdint.h>
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<unistd.h>
+#include<time.h>
+#include<pthread.h>
+
+#include<atomic>
+
+#include<Orientation.h>
+#include<Replay.h>
+#include<Eigen/Dense>
+
+using namespace Eigen;
+
+// the most values any log line holds (the calibration line)
+static const int _maxLineValues = 9;
+
+// returns the current monotonic time in seconds, used to time the replay itself
+static double wallTime() {
+	struct timespec currentTime;
+	clock_gettime(CLOCK_MONOTONIC, &currentTime);
+	return currentTime.tv_sec + (double)(currentTime.tv_nsec)/1000000000.0;
+}
+
+// reads up to max numbers following the type character of a log line into values
+// returns the number of values read
+static int parseLine(const char *line, double *values, int max) {
+	const char *position = line + 1;
+	int count = 0;
+	while (count < max) {
+		char *end;
+		double value = strtod(position, &end);
+		if (end == position)
+			break;
+		values[count++] = value;
+		position = end;
+	}
+	return count;
+}
+
+int replaySensorLog(const char *logPath, const char *outputPath, struct ReplayResult *result) {
+	*result = ReplayResult();
+	result->failed = -1;
+	double startTime = wallTime();
+
+	FILE *log = fopen(logPath, "r");
+	if (log == NULL) {
+		printf("failed to open sensor log %s\n", logPath);
+		return -1;
+	}
+	FILE *output = NULL;
+	if (outputPath != NULL && (output = fopen(outputPath, "w")) == NULL) {
+		printf("failed to open replay output %s\n", outputPath);
+		fclose(log);
+		return -1;
+	}
+
+	struct OrientationFilter *filter = new OrientationFilter();
+	int calibrated = 0;
+	double firstTime = -1, lastTime = 0;
+	uint64_t lineNumber = 0;
+	char line[512];
+
+	while (fgets(line, sizeof(line), log) != NULL) {
+		lineNumber++;
+		double v[_maxLineValues];
+		int count = parseLine(line, v, _maxLineValues);
+
+		if (line[0] == '\n' || line[0] == '#') {
+			continue;
+		}
+		else if (line[0] == 'c' && count == 9) {
+			calibrateOrientationFilter(filter, Vector3d(v[0], v[1], v[2]), \
+					Vector3d(v[3], v[4], v[5]), Vector3d(v[6], v[7], v[8]));
+			calibrated = 1;
+			continue;
+		}
+		else if (!calibrated) {
+			printf("%s:%llu: sample before calibration\n", logPath, \
+					(long long unsigned int)lineNumber);
+			break;
+		}
+		else if (line[0] == 'a' && count == 7) {
+			updateFilterAcceleration(filter, Vector3d(v[1], v[2], v[3]), \
+					Vector3d(v[4], v[5], v[6]), v[0]);
+			if (output != NULL) {
+				struct Orientation o = filterOrientation(filter);
+				fprintf(output, "%.9f %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g\n", \
+						v[0], o.acceleration(0), o.acceleration(1), o.acceleration(2), \
+						o.gravity(0), o.gravity(1), o.gravity(2), o.heading, o.altitude, \
+						o.verticalVelocity);
+			}
+		}
+		else if (line[0] == 'h' && count == 4) {
+			updateFilterHeading(filter, Vector3d(v[1], v[2], v[3]));
+		}
+		else if (line[0] == 'b' && count == 2) {
+			updateFilterAltitude(filter, v[1]);
+		}
+		else {
+			printf("%s:%llu: malformed line\n", logPath, (long long unsigned int)lineNumber);
+			break;
+		}
+
+		if (firstTime < 0)
+			firstTime = v[0];
+		lastTime = v[0];
+		result->samples++;
+	}
+
+	if (feof(log) && calibrated)
+		result->failed = 0;
+	result->duration = firstTime < 0 ? 0 : lastTime - firstTime;
+	result->orientation = filterOrientation(filter);
+	result->elapsed = wallTime() - startTime;
+
+	delete filter;
+	if (output != NULL)
+		fclose(output);
+	fclose(log);
+
+	return result->failed;
+}
+
+
+// shared between the worker threads of replaySensorLogs
+// each worker takes the next unclaimed log until none are left
+struct ReplayJob {
+	const char *const *logPaths;
+	const char *const *outputPaths;
+	int count;
+	struct ReplayResult *results;
+	std::atomic<int> next;
+};
+
+static void *replayWorker(void *input) {
+	struct ReplayJob *job = (struct ReplayJob *)(input);
+
+	int index;
+	while ((index = job->next.fetch_add(1)) < job->count) {
+		const char *outputPath = job->outputPaths ? job->outputPaths[index] : NULL;
+		replaySensorLog(job->logPaths[index], outputPath, &job->results[index]);
+	}
+
+	return NULL;
+}
+
+int replaySensorLogs(const char *const *logPaths, const char *const *outputPaths, \
+		int count, int threads, struct ReplayResult *results) {
+	if (threads <= 0)
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (threads > count)
+		threads = count;
+	if (threads < 1)
+		threads = 1;
+
+	struct ReplayJob job;
+	job.logPaths = logPaths;
+	job.outputPaths = outputPaths;
+	job.count = count;
+	job.results = results;
+	job.next = 0;
+
+	// the calling thread does its share of the work too
+	pthread_t workers[threads - 1];
+	int started = 0;
+	for (; started < threads - 1; started++) {
+		if (pthread_create(&workers[started], NULL, &replayWorker, &job)) {
+			printf("failed to create replay thread, continuing with %d\n", started + 1);
+			break;
+		}
+	}
+	replayWorker(&job);
+	for (int i = 0; i < started; i++) {
+		pthread_join(workers[i], NULL);
+	}
+
+	int failures = 0;
+	for (int i = 0; i < count; i++) {
+		failures += results[i].failed ? 1 : 0;
+	}
+	return failures;
+}
@@ -0,0 +1,44 @@
+// implementation for the VerticalEstimator header
+//
+// by Mark Hill
+
+#include<VerticalEstimator.h>
+
+// gaps between acceleration samples longer than this in seconds are not integrated, since
+//   the acceleration in between is unknown
+static const double _maximumStep = 0.5;
+
+void initVerticalEstimator(struct VerticalEstimator *estimator, double timeConstant) {
+	*estimator = VerticalEstimator();
+
+	// places all three poles of the error dynamics at -1 / timeConstant
+	estimator->altitudeGain = 3 / timeConstant;
+	estimator->velocityGain = 3 / (timeConstant * timeConstant);
+	estimator->biasGain = 1 / (timeConstant * timeConstant * timeConstant);
+}
+
+void verticalPredict(struct VerticalEstimator *estimator, double acceleration, double time) {
+	double dt = time - estimator->predictTime;
+	estimator->predictTime = time;
+	if (!estimator->initialized || dt <= 0 || dt > _maximumStep)
+		return;
+
+	// feeds the barometer error back into every state
+	double error = estimator->altitudeError;
+	estimator->bias -= error * estimator->biasGain * dt;
+	estimator->velocity += error * estimator->velocityGain * dt;
+	estimator->altitude += error * estimator->altitudeGain * dt;
+
+	double a = acceleration - estimator->bias;
+	estimator->altitude += estimator->velocity * dt + 0.5 * a * dt * dt;
+	estimator->velocity += a * dt;
+}
+
+void verticalCorrect(struct VerticalEstimator *estimator, double altitude) {
+	if (!estimator->initialized) {
+		estimator->altitude = altitude;
+		estimator->initialized = 1;
+	}
+
+	estimator->altitudeError = altitude - estimator->altitude;
+}
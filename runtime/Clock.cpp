@@ -0,0 +1,348 @@
+// implementation for the Clock header
+//
+// by Mark Hill
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdint.h>
+#include<math.h>
+#include<time.h>
+#include<errno.h>
+#include<pthread.h>
+
+#include<atomic>
+
+#include<Clock.h>
+
+// the most threads that can take part in the virtual clock at once
+#define VIRTUAL_CLOCK_MAX_THREADS 64
+
+static std::atomic<int> _virtual(0);
+static std::atomic<double> _virtualTime(0);
+
+// everything below is protected by _clockLock
+static pthread_mutex_t _clockLock = PTHREAD_MUTEX_INITIALIZER;
+// the time each slot's thread sleeps until, or -1 while it is awake
+static double _wakeTimes[VIRTUAL_CLOCK_MAX_THREADS];
+// signalled when it is the slot's thread's turn to wake up, so only that thread wakes
+static pthread_cond_t _slotWakes[VIRTUAL_CLOCK_MAX_THREADS];
+static int _slotUsed[VIRTUAL_CLOCK_MAX_THREADS];
+static int _participants = 0;
+static int _sleeping = 0;
+// the slot of the thread woken up but not yet running, or -1 if there is none
+static int _waking = -1;
+// the mutex each slot's thread is waiting for, or NULL if it is not waiting for one
+static struct ClockMutex *_mutexWaits[VIRTUAL_CLOCK_MAX_THREADS];
+
+// holds one more than the slot of each taking part thread, and removes it on exit
+static pthread_key_t _slotKey;
+static pthread_once_t _slotKeyOnce = PTHREAD_ONCE_INIT;
+
+double monotonicTime() {
+	if (_virtual.load(std::memory_order_acquire))
+		return _virtualTime.load(std::memory_order_acquire);
+
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec / 1000000000.0;
+}
+
+// once every taking part thread sleeps, wakes the one with the earliest wake up, moving
+//   the virtual time on to it
+// the threads are woken one at a time, and those due at the same time in the order of
+//   their slots, so the threads always run in the same order and a simulation gives the
+//   same result every time it is run
+// must be called with _clockLock held
+static void advanceIfIdle() {
+	if (_participants == 0 || _sleeping < _participants || _waking >= 0)
+		return;
+
+	int next = -1;
+	for (int slot = 0; slot < VIRTUAL_CLOCK_MAX_THREADS; slot++) {
+		if (_slotUsed[slot] && _wakeTimes[slot] >= 0 && _mutexWaits[slot] == NULL && \
+				(next < 0 || _wakeTimes[slot] < _wakeTimes[next]))
+			next = slot;
+	}
+	if (next < 0)
+		return;
+
+	if (_wakeTimes[next] > _virtualTime.load(std::memory_order_relaxed))
+		_virtualTime.store(_wakeTimes[next], std::memory_order_release);
+	_waking = next;
+	pthread_cond_signal(&_slotWakes[next]);
+}
+
+// the destructor of _slotKey, which takes an exiting thread out of the virtual clock
+static void leaveVirtualClock(void *value) {
+	int slot = (int)((intptr_t)(value)) - 1;
+
+	pthread_mutex_lock(&_clockLock);
+	_slotUsed[slot] = 0;
+	_participants--;
+	advanceIfIdle();
+	pthread_mutex_unlock(&_clockLock);
+}
+
+static void createSlotKey() {
+	pthread_key_create(&_slotKey, &leaveVirtualClock);
+	for (int slot = 0; slot < VIRTUAL_CLOCK_MAX_THREADS; slot++) {
+		pthread_cond_init(&_slotWakes[slot], NULL);
+	}
+}
+
+// takes a free slot for a thread that is awake, or returns -1 if they are all taken
+// must be called with _clockLock held
+static int takeSlot() {
+	for (int slot = 0; slot < VIRTUAL_CLOCK_MAX_THREADS; slot++) {
+		if (!_slotUsed[slot]) {
+			_slotUsed[slot] = 1;
+			_wakeTimes[slot] = -1;
+			_mutexWaits[slot] = NULL;
+			_participants++;
+			return slot;
+		}
+	}
+	return -1;
+}
+
+// returns the calling thread's slot, taking one if it has none yet, or -1 if they are
+//   all taken
+// must be called with _clockLock held
+static int joinVirtualClock() {
+	pthread_once(&_slotKeyOnce, &createSlotKey);
+	void *value = pthread_getspecific(_slotKey);
+	if (value != NULL)
+		return (int)((intptr_t)(value)) - 1;
+
+	int slot = takeSlot();
+	if (slot >= 0)
+		pthread_setspecific(_slotKey, (void *)((intptr_t)(slot + 1)));
+	return slot;
+}
+
+// undoes the sleep of a thread cancelled while waiting for the virtual time
+static void cancelSleep(void *input) {
+	int slot = *(int *)(input);
+	_wakeTimes[slot] = -1;
+	_sleeping--;
+	if (_waking == slot)
+		_waking = -1;
+	pthread_mutex_unlock(&_clockLock);
+}
+
+static void virtualSleepUntil(double time) {
+	pthread_mutex_lock(&_clockLock);
+	int slot = joinVirtualClock();
+	if (slot < 0) {
+		pthread_mutex_unlock(&_clockLock);
+		printf("too many threads on the virtual clock\n");
+		return;
+	}
+
+	if (time > _virtualTime.load(std::memory_order_relaxed)) {
+		_wakeTimes[slot] = time;
+		_sleeping++;
+		advanceIfIdle();
+
+		pthread_cleanup_push(&cancelSleep, &slot);
+		while (_waking != slot) {
+			pthread_cond_wait(&_slotWakes[slot], &_clockLock);
+		}
+		pthread_cleanup_pop(0);
+
+		_waking = -1;
+		_wakeTimes[slot] = -1;
+		_sleeping--;
+	}
+	pthread_mutex_unlock(&_clockLock);
+}
+
+void sleepUntil(double time) {
+	if (_virtual.load(std::memory_order_acquire)) {
+		virtualSleepUntil(time);
+		return;
+	}
+
+	struct timespec deadline;
+	deadline.tv_sec = (time_t)(time);
+	deadline.tv_nsec = (long)((time - deadline.tv_sec) * 1000000000.0);
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR);
+}
+
+void sleepFor(double seconds) {
+	sleepUntil(monotonicTime() + seconds);
+}
+
+void useVirtualClock(double time) {
+	_virtualTime.store(time, std::memory_order_relaxed);
+	_virtual.store(1, std::memory_order_release);
+
+	pthread_mutex_lock(&_clockLock);
+	if (joinVirtualClock() < 0)
+		printf("too many threads on the virtual clock\n");
+	pthread_mutex_unlock(&_clockLock);
+}
+
+// what a thread started by createClockThread() needs before it runs its routine
+struct ClockThreadStart {
+	void *(*routine)(void *);
+	void *argument;
+	// the slot taken for the thread, or -1 if it has none
+	int slot;
+};
+
+static void *startClockThread(void *input) {
+	struct ClockThreadStart start = *(struct ClockThreadStart *)(input);
+	free(input);
+
+	if (start.slot >= 0) {
+		pthread_setspecific(_slotKey, (void *)((intptr_t)(start.slot + 1)));
+
+		// waits for its turn like a sleeping thread, so it does not run alongside the
+		//   thread that created it
+		pthread_mutex_lock(&_clockLock);
+		while (_waking != start.slot) {
+			pthread_cond_wait(&_slotWakes[start.slot], &_clockLock);
+		}
+		_waking = -1;
+		_wakeTimes[start.slot] = -1;
+		_sleeping--;
+		pthread_mutex_unlock(&_clockLock);
+	}
+	return start.routine(start.argument);
+}
+
+int createClockThread(pthread_t *thread, const pthread_attr_t *attributes, \
+		void *(*routine)(void *), void *argument) {
+	if (!_virtual.load(std::memory_order_acquire))
+		return pthread_create(thread, attributes, routine, argument);
+
+	struct ClockThreadStart *start = \
+			(struct ClockThreadStart *)(malloc(sizeof(struct ClockThreadStart)));
+	if (start == NULL)
+		return -1;
+	start->routine = routine;
+	start->argument = argument;
+
+	// the slot is taken here rather than by the new thread, so the time cannot move on
+	//   before the thread gets going, and the thread starts out asleep until now, so it
+	//   first runs in its turn once its creator sleeps
+	pthread_once(&_slotKeyOnce, &createSlotKey);
+	pthread_mutex_lock(&_clockLock);
+	start->slot = takeSlot();
+	if (start->slot >= 0) {
+		_wakeTimes[start->slot] = _virtualTime.load(std::memory_order_relaxed);
+		_sleeping++;
+	}
+	pthread_mutex_unlock(&_clockLock);
+	if (start->slot < 0)
+		printf("too many threads on the virtual clock\n");
+
+	int failure = pthread_create(thread, attributes, &startClockThread, start);
+	if (failure) {
+		if (start->slot >= 0) {
+			pthread_mutex_lock(&_clockLock);
+			_slotUsed[start->slot] = 0;
+			_wakeTimes[start->slot] = -1;
+			_sleeping--;
+			_participants--;
+			advanceIfIdle();
+			pthread_mutex_unlock(&_clockLock);
+		}
+		free(start);
+	}
+
+	return failure;
+}
+
+int virtualClockEnabled() {
+	return _virtual.load(std::memory_order_acquire);
+}
+
+// passes a virtual clock mutex on to the waiting thread with the lowest slot, the same
+//   order threads due at once wake in, which then wakes up holding it in its turn at the
+//   current time, or frees it if nothing is waiting
+// must be called with _clockLock held
+static void releaseClockMutex(struct ClockMutex *mutex) {
+	for (int slot = 0; slot < VIRTUAL_CLOCK_MAX_THREADS; slot++) {
+		if (_slotUsed[slot] && _mutexWaits[slot] == mutex) {
+			_mutexWaits[slot] = NULL;
+			_wakeTimes[slot] = _virtualTime.load(std::memory_order_relaxed);
+			advanceIfIdle();
+			return;
+		}
+	}
+	mutex->held = 0;
+}
+
+// a thread waiting for a virtual clock mutex, for undoing the wait if it is cancelled
+struct MutexWait {
+	int slot;
+	struct ClockMutex *mutex;
+};
+
+// undoes the wait of a thread cancelled while waiting for a mutex, passing the mutex on
+//   if it had already been handed to the thread
+static void cancelMutexWait(void *input) {
+	struct MutexWait *wait = (struct MutexWait *)(input);
+	if (_mutexWaits[wait->slot] == NULL)
+		releaseClockMutex(wait->mutex);
+	_mutexWaits[wait->slot] = NULL;
+	cancelSleep(&wait->slot);
+}
+
+void lockClockMutex(struct ClockMutex *mutex) {
+	if (!_virtual.load(std::memory_order_acquire)) {
+		pthread_mutex_lock(&mutex->mutex);
+		return;
+	}
+
+	pthread_mutex_lock(&_clockLock);
+	struct MutexWait wait;
+	wait.slot = joinVirtualClock();
+	wait.mutex = mutex;
+	if (wait.slot < 0) {
+		pthread_mutex_unlock(&_clockLock);
+		printf("too many threads on the virtual clock\n");
+		return;
+	}
+
+	if (!mutex->held) {
+		mutex->held = 1;
+		pthread_mutex_unlock(&_clockLock);
+		return;
+	}
+
+	// sleeps without a wake up time until releaseClockMutex() hands the mutex over, so
+	//   the time can move on for the thread holding it
+	_mutexWaits[wait.slot] = mutex;
+	_wakeTimes[wait.slot] = 0;
+	_sleeping++;
+	advanceIfIdle();
+
+	pthread_cleanup_push(&cancelMutexWait, &wait);
+	while (_waking != wait.slot) {
+		pthread_cond_wait(&_slotWakes[wait.slot], &_clockLock);
+	}
+	pthread_cleanup_pop(0);
+
+	_waking = -1;
+	_wakeTimes[wait.slot] = -1;
+	_sleeping--;
+	pthread_mutex_unlock(&_clockLock);
+}
+
+void unlockClockMutex(struct ClockMutex *mutex) {
+	if (!_virtual.load(std::memory_order_acquire)) {
+		pthread_mutex_unlock(&mutex->mutex);
+		return;
+	}
+
+	pthread_mutex_lock(&_clockLock);
+	releaseClockMutex(mutex);
+	pthread_mutex_unlock(&_clockLock);
+}
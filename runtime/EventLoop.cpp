@@ -0,0 +1,360 @@
+// implementation for the EventLoop header
+//
+// by Mark Hill
+
+#include<stdio.h>
+#include<stdint.h>
+#include<string.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<time.h>
+#include<pthread.h>
+#include<sys/epoll.h>
+#include<sys/timerfd.h>
+#include<sys/eventfd.h>
+#include<sys/ioctl.h>
+#include<linux/gpio.h>
+
+#include<atomic>
+
+#include<EventLoop.h>
+#include<Clock.h>
+
+// the epoll data of the wake up event, past every source index
+#define WAKE_INDEX EVENT_LOOP_MAX_SOURCES
+// the most GPIO edges taken in one read
+#define GPIO_EVENT_BATCH 16
+
+// turns a time in seconds into a timespec
+static struct timespec timespecFromSeconds(double time) {
+	struct timespec result;
+	result.tv_sec = (time_t)(time);
+	result.tv_nsec = (long)((time - result.tv_sec) * 1000000000.0);
+	if (result.tv_nsec >= 1000000000) {
+		result.tv_sec++;
+		result.tv_nsec -= 1000000000;
+	}
+	return result;
+}
+
+int initEventLoop(struct EventLoop *loop) {
+	for (int i = 0; i < EVENT_LOOP_MAX_SOURCES; i++) {
+		loop->sources[i].kind = EVENT_SOURCE_NONE;
+		loop->sources[i].file = -1;
+	}
+	loop->stopped.store(0, std::memory_order_relaxed);
+	loop->finished.store(0, std::memory_order_relaxed);
+
+	loop->poll = epoll_create1(EPOLL_CLOEXEC);
+	if (loop->poll < 0) {
+		printf("failed to create event loop (%s)\n", strerror(errno));
+		return -1;
+	}
+	loop->wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	struct epoll_event event;
+	event.events = EPOLLIN;
+	event.data.u32 = WAKE_INDEX;
+	if (loop->wake < 0 || epoll_ctl(loop->poll, EPOLL_CTL_ADD, loop->wake, &event)) {
+		printf("failed to create event loop wake up (%s)\n", strerror(errno));
+		closeEventLoop(loop);
+		return -1;
+	}
+	return 0;
+}
+
+// frees the source, closing its file unless it belongs to someone else
+static void removeSource(struct EventLoop *loop, int index) {
+	struct EventSource *source = &loop->sources[index];
+	if (source->file >= 0) {
+		epoll_ctl(loop->poll, EPOLL_CTL_DEL, source->file, NULL);
+		if (source->kind != EVENT_SOURCE_FILE)
+			close(source->file);
+	}
+	source->file = -1;
+	source->kind = EVENT_SOURCE_NONE;
+}
+
+void closeEventLoop(struct EventLoop *loop) {
+	for (int i = 0; i < EVENT_LOOP_MAX_SOURCES; i++) {
+		if (loop->sources[i].kind != EVENT_SOURCE_NONE)
+			removeSource(loop, i);
+	}
+	if (loop->wake >= 0)
+		close(loop->wake);
+	if (loop->poll >= 0)
+		close(loop->poll);
+	loop->wake = -1;
+	loop->poll = -1;
+}
+
+// takes a free source for kind with file, adding the file to the epoll set if there is
+//   one, and returns its index, or -1 on failure, in which case file is closed
+static int addSource(struct EventLoop *loop, int kind, int file, EventHandler handler, \
+		void *argument) {
+	int index = 0;
+	while (index < EVENT_LOOP_MAX_SOURCES && loop->sources[index].kind != EVENT_SOURCE_NONE)
+		index++;
+	if (index == EVENT_LOOP_MAX_SOURCES) {
+		printf("too many event loop sources\n");
+		if (file >= 0 && kind != EVENT_SOURCE_FILE)
+			close(file);
+		return -1;
+	}
+
+	if (file >= 0) {
+		struct epoll_event event;
+		event.events = EPOLLIN;
+		event.data.u32 = index;
+		if (epoll_ctl(loop->poll, EPOLL_CTL_ADD, file, &event)) {
+			printf("failed to add event loop source (%s)\n", strerror(errno));
+			if (kind != EVENT_SOURCE_FILE)
+				close(file);
+			return -1;
+		}
+	}
+
+	struct EventSource *source = &loop->sources[index];
+	source->kind = kind;
+	source->file = file;
+	source->handler = handler;
+	source->argument = argument;
+	source->period = 0;
+	source->deadline = 0;
+	source->timing = NULL;
+	return index;
+}
+
+// adds a timer with its first deadline at time in seconds repeating every period, or
+//   just once if period is 0
+// returns the source's index on success and -1 on failure
+static int addTimerSource(struct EventLoop *loop, double time, double period, \
+		EventHandler handler, void *argument) {
+	int file = -1;
+	// the virtual clock has no timerfd, runEventLoop() sleeps on it instead
+	if (!virtualClockEnabled()) {
+		file = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		struct itimerspec setting;
+		// a zero time would disarm the timer instead of firing it right away
+		setting.it_value = timespecFromSeconds(time > 0 ? time : 1e-9);
+		setting.it_interval = timespecFromSeconds(period);
+		if (file < 0 || timerfd_settime(file, TFD_TIMER_ABSTIME, &setting, NULL)) {
+			printf("failed to create event loop timer (%s)\n", strerror(errno));
+			if (file >= 0)
+				close(file);
+			return -1;
+		}
+	}
+
+	int index = addSource(loop, EVENT_SOURCE_TIMER, file, handler, argument);
+	if (index < 0)
+		return -1;
+	loop->sources[index].period = period;
+	loop->sources[index].deadline = time;
+	return index;
+}
+
+int addLoopTimer(struct EventLoop *loop, double period, EventHandler handler, \
+		void *argument, struct LoopTiming *timing, const char *name) {
+	int index = addTimerSource(loop, monotonicTime() + period, period, handler, argument);
+	if (index < 0)
+		return -1;
+	struct EventSource *source = &loop->sources[index];
+	source->timing = timing;
+	if (timing != NULL)
+		initLoopClock(&source->clock, timing, name, period);
+	return index;
+}
+
+int addLoopAlarm(struct EventLoop *loop, double time, EventHandler handler, void *argument) {
+	return addTimerSource(loop, time, 0, handler, argument);
+}
+
+int addLoopFile(struct EventLoop *loop, int file, EventHandler handler, void *argument) {
+	return addSource(loop, EVENT_SOURCE_FILE, file, handler, argument);
+}
+
+int addLoopEvent(struct EventLoop *loop, EventHandler handler, void *argument) {
+	int file = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (file < 0) {
+		printf("failed to create event loop event (%s)\n", strerror(errno));
+		return -1;
+	}
+	return addSource(loop, EVENT_SOURCE_EVENT, file, handler, argument);
+}
+
+void signalLoopEvent(struct EventLoop *loop, int index) {
+	if (index < 0 || index >= EVENT_LOOP_MAX_SOURCES)
+		return;
+	uint64_t one = 1;
+	// only fails otherwise once the count is about to overflow, when the event is
+	//   pending anyway
+	while (write(loop->sources[index].file, &one, sizeof(one)) < 0 && errno == EINTR);
+}
+
+int addLoopGpio(struct EventLoop *loop, const char *chip, int line, int edges, \
+		EventHandler handler, void *argument) {
+	int chipFile = open(chip, O_RDONLY | O_CLOEXEC);
+	if (chipFile < 0) {
+		printf("failed to open %s (%s)\n", chip, strerror(errno));
+		return -1;
+	}
+
+	struct gpio_v2_line_request request;
+	memset(&request, 0, sizeof(request));
+	request.offsets[0] = line;
+	request.num_lines = 1;
+	strncpy(request.consumer, "drone", sizeof(request.consumer) - 1);
+	request.config.flags = GPIO_V2_LINE_FLAG_INPUT;
+	if (edges & EVENT_GPIO_RISING)
+		request.config.flags |= GPIO_V2_LINE_FLAG_EDGE_RISING;
+	if (edges & EVENT_GPIO_FALLING)
+		request.config.flags |= GPIO_V2_LINE_FLAG_EDGE_FALLING;
+	int failed = ioctl(chipFile, GPIO_V2_GET_LINE_IOCTL, &request);
+	close(chipFile);
+	if (failed) {
+		printf("failed to request line %d of %s (%s)\n", line, chip, strerror(errno));
+		return -1;
+	}
+
+	fcntl(request.fd, F_SETFL, fcntl(request.fd, F_GETFL) | O_NONBLOCK);
+	return addSource(loop, EVENT_SOURCE_GPIO, request.fd, handler, argument);
+}
+
+// calls the handler of a timer whose deadline has come, for the latest deadline that
+//   has passed, and moves the deadline on past now, or removes an alarm
+static void runTimer(struct EventLoop *loop, int index, double now) {
+	struct EventSource *source = &loop->sources[index];
+	if (source->period <= 0) {
+		source->handler(source->argument, source->deadline);
+		removeSource(loop, index);
+		return;
+	}
+
+	double expected = source->deadline;
+	while (expected + source->period <= now) {
+		expected += source->period;
+	}
+	source->deadline = expected + source->period;
+
+	if (source->timing != NULL)
+		loopStart(source->timing, &source->clock, expected);
+	int result = source->handler(source->argument, expected);
+	if (source->timing != NULL)
+		loopEnd(source->timing, &source->clock);
+	if (result < 0)
+		removeSource(loop, index);
+}
+
+// handles whatever made the file of the source at index readable
+static void dispatchSource(struct EventLoop *loop, int index) {
+	// the wake up event only has to wake the loop, which it has
+	if (index == WAKE_INDEX) {
+		uint64_t count;
+		while (read(loop->wake, &count, sizeof(count)) > 0);
+		return;
+	}
+
+	struct EventSource *source = &loop->sources[index];
+	int result = 0;
+	if (source->kind == EVENT_SOURCE_TIMER) {
+		uint64_t expirations;
+		if (read(source->file, &expirations, sizeof(expirations)) != sizeof(expirations))
+			return;
+		runTimer(loop, index, monotonicTime());
+		return;
+	}
+	else if (source->kind == EVENT_SOURCE_EVENT) {
+		uint64_t count;
+		if (read(source->file, &count, sizeof(count)) != sizeof(count))
+			return;
+		result = source->handler(source->argument, monotonicTime());
+	}
+	// the handler reads the file itself
+	else if (source->kind == EVENT_SOURCE_FILE) {
+		result = source->handler(source->argument, monotonicTime());
+	}
+	else if (source->kind == EVENT_SOURCE_GPIO) {
+		struct gpio_v2_line_event events[GPIO_EVENT_BATCH];
+		ssize_t size = read(source->file, events, sizeof(events));
+		int count = size > 0 ? size / sizeof(events[0]) : 0;
+		for (int i = 0; i < count && result == 0; i++) {
+			// stamped on CLOCK_MONOTONIC, which is the real clock's time
+			double time = virtualClockEnabled() ? monotonicTime() : \
+					events[i].timestamp_ns / 1000000000.0;
+			result = source->handler(source->argument, time);
+		}
+	}
+	if (result < 0)
+		removeSource(loop, index);
+}
+
+// runs the loop on the virtual clock, sleeping on it until the next deadline
+static void runVirtualLoop(struct EventLoop *loop) {
+	struct epoll_event ready[EVENT_LOOP_MAX_SOURCES + 1];
+	while (!loop->stopped.load(std::memory_order_acquire)) {
+		// wakes up every so often even without a timer due, to check the files and
+		//   whether the loop has been stopped
+		double now = monotonicTime();
+		double next = now + EVENT_LOOP_VIRTUAL_POLL;
+		for (int i = 0; i < EVENT_LOOP_MAX_SOURCES; i++) {
+			struct EventSource *source = &loop->sources[i];
+			if (source->kind == EVENT_SOURCE_TIMER && source->deadline < next)
+				next = source->deadline;
+		}
+		sleepUntil(next);
+
+		int count = epoll_wait(loop->poll, ready, EVENT_LOOP_MAX_SOURCES + 1, 0);
+		for (int i = 0; i < count; i++) {
+			dispatchSource(loop, ready[i].data.u32);
+		}
+		now = monotonicTime();
+		for (int i = 0; i < EVENT_LOOP_MAX_SOURCES && \
+				!loop->stopped.load(std::memory_order_relaxed); i++) {
+			if (loop->sources[i].kind == EVENT_SOURCE_TIMER && loop->sources[i].deadline <= now)
+				runTimer(loop, i, now);
+		}
+	}
+}
+
+int runEventLoop(struct EventLoop *loop) {
+	int failure = 0;
+	if (virtualClockEnabled()) {
+		runVirtualLoop(loop);
+	}
+	else {
+		struct epoll_event ready[EVENT_LOOP_MAX_SOURCES + 1];
+		while (!loop->stopped.load(std::memory_order_acquire)) {
+			int count = epoll_wait(loop->poll, ready, EVENT_LOOP_MAX_SOURCES + 1, -1);
+			if (count < 0) {
+				if (errno == EINTR)
+					continue;
+				printf("failed to wait for events (%s)\n", strerror(errno));
+				failure = -1;
+				break;
+			}
+			for (int i = 0; i < count && !loop->stopped.load(std::memory_order_relaxed); i++) {
+				dispatchSource(loop, ready[i].data.u32);
+			}
+		}
+	}
+
+	loop->finished.store(1, std::memory_order_release);
+	return failure;
+}
+
+void stopEventLoop(struct EventLoop *loop) {
+	loop->stopped.store(1, std::memory_order_release);
+	uint64_t one = 1;
+	while (write(loop->wake, &one, sizeof(one)) < 0 && errno == EINTR);
+}
+
+void stopEventLoopThread(struct EventLoop *loop, pthread_t thread) {
+	stopEventLoop(loop);
+	if (virtualClockEnabled()) {
+		while (!loop->finished.load(std::memory_order_acquire)) {
+			sleepFor(EVENT_LOOP_VIRTUAL_POLL);
+		}
+	}
+	pthread_join(thread, NULL);
+}
@@ -0,0 +1,165 @@
+// implementation for the LoopTiming header
+//
+// by Mark Hill
+
+#include<stdio.h>
+#include<stdint.h>
+#include<pthread.h>
+
+#include<atomic>
+
+#include<LoopTiming.h>
+#include<Clock.h>
+
+// the registered tasks, only ever added to
+static struct LoopTiming *_timings[LOOP_TIMING_MAX_TASKS];
+static std::atomic<int> _timingCount(0);
+static pthread_mutex_t _registerLock = PTHREAD_MUTEX_INITIALIZER;
+
+// the values below this many nanoseconds all go in the first bucket
+static const int _firstOctave = 10;
+
+static void registerLoopTiming(struct LoopTiming *timing, const char *name) {
+	if (timing->registered.load(std::memory_order_acquire))
+		return;
+
+	pthread_mutex_lock(&_registerLock);
+	if (!timing->registered.load(std::memory_order_relaxed)) {
+		int count = _timingCount.load(std::memory_order_relaxed);
+		timing->name = name;
+		if (count < LOOP_TIMING_MAX_TASKS) {
+			_timings[count] = timing;
+			_timingCount.store(count + 1, std::memory_order_release);
+		}
+		else {
+			printf("too many loop timings, %s will not be reported\n", name);
+		}
+		timing->registered.store(1, std::memory_order_release);
+	}
+	pthread_mutex_unlock(&_registerLock);
+}
+
+void initLoopClock(struct LoopClock *clock, struct LoopTiming *timing, const char *name, \
+		double period) {
+	registerLoopTiming(timing, name);
+
+	clock->period = period;
+	clock->start = 0;
+	clock->previous = 0;
+	clock->lateness = 0;
+}
+
+// returns the bucket holding a value of nanoseconds
+static int timingBucket(uint64_t nanoseconds) {
+	if (nanoseconds < ((uint64_t)(1) << _firstOctave))
+		return 0;
+
+	int octave = 63 - __builtin_clzll(nanoseconds);
+	int sub = (int)(nanoseconds >> (octave - 3)) & (TIMING_SUB_BUCKETS - 1);
+	int bucket = 1 + (octave - _firstOctave) * TIMING_SUB_BUCKETS + sub;
+
+	return bucket < TIMING_BUCKETS ? bucket : TIMING_BUCKETS - 1;
+}
+
+// returns the largest value in nanoseconds that goes in bucket
+static uint64_t bucketEnd(int bucket) {
+	if (bucket == 0)
+		return ((uint64_t)(1) << _firstOctave) - 1;
+
+	int octave = (bucket - 1) / TIMING_SUB_BUCKETS + _firstOctave;
+	int sub = (bucket - 1) % TIMING_SUB_BUCKETS;
+	return ((uint64_t)(TIMING_SUB_BUCKETS + sub + 1) << (octave - 3)) - 1;
+}
+
+static void recordTiming(struct TimingHistogram *histogram, double seconds) {
+	uint64_t nanoseconds = seconds > 0 ? (uint64_t)(seconds * 1000000000.0) : 0;
+
+	histogram->buckets[timingBucket(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+	histogram->count.fetch_add(1, std::memory_order_relaxed);
+
+	uint64_t maximum = histogram->maximum.load(std::memory_order_relaxed);
+	while (nanoseconds > maximum && \
+			!histogram->maximum.compare_exchange_weak(maximum, nanoseconds, \
+				std::memory_order_relaxed)) {
+	}
+}
+
+void loopStart(struct LoopTiming *timing, struct LoopClock *clock, double expected) {
+	double now = monotonicTime();
+
+	clock->previous = clock->start;
+	clock->start = now;
+	clock->lateness = now - expected;
+
+	recordTiming(&timing->lateness, clock->lateness);
+	if (clock->previous > 0)
+		recordTiming(&timing->period, now - clock->previous);
+}
+
+void loopEnd(struct LoopTiming *timing, struct LoopClock *clock) {
+	double execution = monotonicTime() - clock->start;
+	recordTiming(&timing->execution, execution);
+
+	if (execution > clock->period || clock->lateness > clock->period)
+		timing->overruns.fetch_add(1, std::memory_order_relaxed);
+}
+
+double timingPercentile(const struct TimingHistogram *histogram, double fraction) {
+	uint64_t count = histogram->count.load(std::memory_order_relaxed);
+	if (count == 0)
+		return 0;
+
+	// the rank of the value wanted, counting from 1
+	uint64_t rank = (uint64_t)(fraction * count + 0.999999);
+	rank = rank < 1 ? 1 : rank;
+
+	uint64_t seen = 0;
+	for (int bucket = 0; bucket < TIMING_BUCKETS; bucket++) {
+		seen += histogram->buckets[bucket].load(std::memory_order_relaxed);
+		if (seen >= rank) {
+			// the maximum is exact, so never report past it
+			uint64_t end = bucketEnd(bucket);
+			uint64_t maximum = histogram->maximum.load(std::memory_order_relaxed);
+			return (end < maximum ? end : maximum) / 1000000000.0;
+		}
+	}
+
+	return histogram->maximum.load(std::memory_order_relaxed) / 1000000000.0;
+}
+
+static void printHistogram(const char *label, const struct TimingHistogram *histogram) {
+	printf("  %-10s %10llu %10.1f %10.1f %10.1f %10.1f\n", label, \
+			(unsigned long long)histogram->count.load(std::memory_order_relaxed), \
+			timingPercentile(histogram, 0.5) * 1e6, timingPercentile(histogram, 0.99) * 1e6, \
+			timingPercentile(histogram, 0.999) * 1e6, \
+			histogram->maximum.load(std::memory_order_relaxed) / 1000.0);
+}
+
+int loopTimingCount() {
+	return _timingCount.load(std::memory_order_acquire);
+}
+
+struct LoopTiming *loopTimingAt(int index) {
+	if (index < 0 || index >= loopTimingCount())
+		return NULL;
+	return _timings[index];
+}
+
+void printLoopTimings() {
+	int count = _timingCount.load(std::memory_order_acquire);
+	if (count == 0) {
+		printf("no loop timings recorded\n");
+		return;
+	}
+
+	for (int i = 0; i < count; i++) {
+		struct LoopTiming *timing = _timings[i];
+		printf("%s: %llu overruns\n", timing->name, \
+				(unsigned long long)timing->overruns.load(std::memory_order_relaxed));
+		printf("  %-10s %10s %10s %10s %10s %10s\n", "(us)", "count", "p50", "p99", \
+				"p99.9", "max");
+		printHistogram("lateness", &timing->lateness);
+		printHistogram("execution", &timing->execution);
+		printHistogram("period", &timing->period);
+	}
+}
@@ -0,0 +1,219 @@
+// implementation for the RealTime header
+//
+// by Mark Hill
+
+#include<stdio.h>
+#include<stdint.h>
+#include<stdlib.h>
+#include<string.h>
+#include<errno.h>
+#include<unistd.h>
+#include<sched.h>
+#include<malloc.h>
+#include<pthread.h>
+#include<sys/mman.h>
+#include<sys/resource.h>
+#include<sys/syscall.h>
+
+#include<atomic>
+
+#include<RealTime.h>
+
+// the SCHED_FIFO priority of each task, kept below 99 so the kernel's own real time
+//   threads still win
+// the sensors come first since a late read skews every integration, and the motor
+//   output is next since the ESCs expect a steady frame
+static const int _priorities[REAL_TIME_TASK_COUNT] = {80, 75, 70, 50};
+// the core each task prefers, out of the cores other than core 0, which is left to the
+//   rest of the system
+// the control loop shares a core with the output thread it feeds
+static const int _cores[REAL_TIME_TASK_COUNT] = {0, 1, 1, 2};
+// the nice value used when the real time scheduler is not allowed
+static const int _fallbackNice = -10;
+// the nice value of background threads
+static const int _backgroundNice = 10;
+// the stack faulted in by every real time thread
+#define PREFAULT_STACK_SIZE (64 * 1024)
+
+static const char *_taskNames[REAL_TIME_TASK_COUNT] = {
+	"acquisition",
+	"output",
+	"control",
+	"fusion",
+};
+
+// what a task was granted, for the report
+struct TaskReport {
+	int threads;
+	int policy;
+	int priority;
+	int nice;
+	// the core the task is pinned to, or -1 if it is not
+	int core;
+};
+
+static std::atomic<int> _enabled(0);
+static int _memoryLocked = 0;
+static unsigned long _heapPrefaulted = 0;
+static struct TaskReport _reports[REAL_TIME_TASK_COUNT];
+static pthread_mutex_t _reportLock = PTHREAD_MUTEX_INITIALIZER;
+
+int enableRealTime(unsigned long heapBytes) {
+	int failure = 0;
+
+	if (mlockall(MCL_CURRENT | MCL_FUTURE)) {
+		printf("could not lock memory (%s), page faults may stall the real time threads\n", \
+				strerror(errno));
+		failure = -1;
+	}
+	else {
+		_memoryLocked = 1;
+	}
+
+	// keeps freed memory in the heap instead of giving it back, and large allocations out
+	//   of mmap, so the prefaulted pages are the ones reused
+	mallopt(M_TRIM_THRESHOLD, -1);
+	mallopt(M_MMAP_MAX, 0);
+	if (heapBytes > 0) {
+		char *heap = (char *)(malloc(heapBytes));
+		if (heap == NULL) {
+			printf("could not prefault %lu bytes of heap\n", heapBytes);
+			failure = -1;
+		}
+		else {
+			long page = sysconf(_SC_PAGESIZE);
+			for (unsigned long i = 0; i < heapBytes; i += page) {
+				((volatile char *)(heap))[i] = 0;
+			}
+			free(heap);
+			_heapPrefaulted = heapBytes;
+		}
+	}
+
+	_enabled.store(1, std::memory_order_release);
+	return failure;
+}
+
+int realTimeEnabled() {
+	return _enabled.load(std::memory_order_acquire);
+}
+
+// touches the next PREFAULT_STACK_SIZE bytes of the stack so they are mapped, and
+//   locked if memory is locked, before the thread needs them
+static void prefaultStack() {
+	volatile char stack[PREFAULT_STACK_SIZE];
+	long page = sysconf(_SC_PAGESIZE);
+	for (int i = 0; i < PREFAULT_STACK_SIZE; i += page) {
+		stack[i] = 0;
+	}
+	// keeps the compiler from dropping the array, whose bytes are never read back
+	asm volatile("" :: "r"(stack) : "memory");
+}
+
+// pins the calling thread to the core task prefers
+// returns the core, or -1 if there is only one core or pinning failed
+static int pinThread(enum RealTimeTask task) {
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cores <= 1)
+		return -1;
+
+	int core = 1 + _cores[task] % (cores - 1);
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(core, &set);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+		return -1;
+
+	return core;
+}
+
+int makeRealTimeThread(enum RealTimeTask task) {
+	if (!realTimeEnabled() || task < 0 || task >= REAL_TIME_TASK_COUNT)
+		return 0;
+
+	int failure = 0;
+	struct TaskReport report = {};
+
+	struct sched_param parameters = {};
+	parameters.sched_priority = _priorities[task];
+	if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &parameters) == 0) {
+		report.policy = SCHED_FIFO;
+		report.priority = _priorities[task];
+	}
+	else {
+		failure = -1;
+		report.policy = SCHED_OTHER;
+		pid_t thread = syscall(SYS_gettid);
+		// raising the nice value takes the same privileges as SCHED_FIFO, so this
+		//   mostly fails where SCHED_FIFO did
+		if (setpriority(PRIO_PROCESS, thread, _fallbackNice) == 0) {
+			report.nice = _fallbackNice;
+		}
+		else {
+			report.nice = getpriority(PRIO_PROCESS, thread);
+			printf("could not raise the %s thread's priority, it stays at nice %d\n", \
+					_taskNames[task], report.nice);
+		}
+	}
+
+	report.core = pinThread(task);
+	if (report.core < 0 && sysconf(_SC_NPROCESSORS_ONLN) > 1)
+		failure = -1;
+
+	prefaultStack();
+
+	pthread_mutex_lock(&_reportLock);
+	report.threads = _reports[task].threads + 1;
+	_reports[task] = report;
+	pthread_mutex_unlock(&_reportLock);
+
+	return failure;
+}
+
+int makeBackgroundThread() {
+	int failure = 0;
+
+	if (setpriority(PRIO_PROCESS, syscall(SYS_gettid), _backgroundNice))
+		failure = -1;
+
+	if (realTimeEnabled() && sysconf(_SC_NPROCESSORS_ONLN) > 1) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(0, &set);
+		if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+			failure = -1;
+	}
+
+	return failure;
+}
+
+void printRealTimeReport() {
+	if (!realTimeEnabled()) {
+		printf("real time profile not enabled\n");
+		return;
+	}
+
+	printf("memory %s, %lu bytes of heap prefaulted\n", \
+			_memoryLocked ? "locked" : "not locked", _heapPrefaulted);
+
+	pthread_mutex_lock(&_reportLock);
+	for (int task = 0; task < REAL_TIME_TASK_COUNT; task++) {
+		struct TaskReport *report = &_reports[task];
+		printf("%-12s", _taskNames[task]);
+		if (report->threads == 0) {
+			printf("not started\n");
+			continue;
+		}
+
+		printf("%d thread%s, ", report->threads, report->threads == 1 ? "" : "s");
+		if (report->policy == SCHED_FIFO)
+			printf("SCHED_FIFO priority %d", report->priority);
+		else
+			printf("SCHED_OTHER nice %d", report->nice);
+		if (report->core >= 0)
+			printf(", core %d\n", report->core);
+		else
+			printf(", not pinned\n");
+	}
+	pthread_mutex_unlock(&_reportLock);
+}
@@ -0,0 +1,40 @@
+// implementation for the Task header
+//
+// by Mark Hill
+
+#include<stdint.h>
+
+#include<atomic>
+
+#include<Task.h>
+
+static_assert(TASK_FRAMES <= 32, "every frame needs a bit of _usedFrames");
+
+alignas(64) static unsigned char _frames[TASK_FRAMES][TASK_FRAME_SIZE];
+// a bit for every frame, set while a task has it
+static std::atomic<uint32_t> _usedFrames(0);
+
+void *allocateTaskFrame(size_t size) {
+	if (size > TASK_FRAME_SIZE)
+		return NULL;
+
+	const uint32_t full = TASK_FRAMES == 32 ? 0xffffffff : (1u << TASK_FRAMES) - 1;
+	uint32_t used = _usedFrames.load(std::memory_order_relaxed);
+	while (used != full) {
+		int frame = __builtin_ctz(~used);
+		if (_usedFrames.compare_exchange_weak(used, used | 1u << frame, \
+				std::memory_order_acquire))
+			return _frames[frame];
+	}
+	return NULL;
+}
+
+void freeTaskFrame(void *frame) {
+	int index = ((unsigned char *)(frame) - &_frames[0][0]) / TASK_FRAME_SIZE;
+	_usedFrames.fetch_and(~(1u << index), std::memory_order_release);
+}
+
+int resumeTask(void *task, double time) {
+	std::coroutine_handle<>::from_address(task).resume();
+	return -1;
+}
@@ -0,0 +1,46 @@
+// implementation for the SampleRing header
+//
+// works the same way as the OrientationHistory: each slot carries the index of the
+//   sample it holds, which readers check before and after copying
+//
+// by Mark Hill
+
+#include<stdint.h>
+
+#include<atomic>
+
+#include<SampleRing.h>
+
+void pushSample(struct SampleRing *ring, double time, const Vector3d &value) {
+	uint64_t index = ring->count.load(std::memory_order_relaxed);
+	uint64_t slot = index & (SAMPLE_RING_SIZE - 1);
+
+	ring->stamps[slot].store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	ring->samples[slot].time = time;
+	ring->samples[slot].value = value;
+
+	ring->stamps[slot].store(index + 1, std::memory_order_release);
+	ring->count.store(index + 1, std::memory_order_release);
+}
+
+uint64_t sampleCount(struct SampleRing *ring) {
+	return ring->count.load(std::memory_order_acquire);
+}
+
+int readSamples(struct SampleRing *ring, uint64_t first, struct SensorSample *samples, int count) {
+	for (int i = 0; i < count; i++) {
+		uint64_t index = first + i;
+		uint64_t slot = index & (SAMPLE_RING_SIZE - 1);
+
+		if (ring->stamps[slot].load(std::memory_order_acquire) != index + 1)
+			return i;
+		samples[i] = ring->samples[slot];
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (ring->stamps[slot].load(std::memory_order_relaxed) != index + 1)
+			return i;
+	}
+
+	return count;
+}
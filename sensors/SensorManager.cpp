@@ -22,6 +22,7 @@
 
 #include<Eigen/Dense>
 #include<SensorManager.h>
+#include<Clock.h>
 extern "C" {
 	#include<i2cctl.h>
 }
@@ -66,7 +67,10 @@ int initializeSensors() {
 		return -1;
 	}
 
-	uint8_t data[] = {0x10, 0x6b, 0x64, 0x06, 0x80, 0x00, 0x00, 0x00, 0x80, 0x38, 0x38};
+	// both run at 833 Hz, so the orientation updates reading them at 800 Hz get a new
+	//   output every read (see Orientation.cpp), the accelerometer at +- 4g with a 50 Hz
+	//   anti aliasing filter and the gyroscope at +- 500 degrees per second
+	uint8_t data[] = {0x10, 0x7b, 0x74, 0x06, 0x80, 0x00, 0x00, 0x00, 0x80, 0x38, 0x38};
 	// perform the actual write and check for errors
 	int failure = i2c_write(accelAddress, data, 11);
 	if (failure) {
@@ -124,7 +128,7 @@ int initializeSensors() {
 	getBarometerParameters();
 
 	// let power stabilize with a wait
-	usleep(50);
+	sleepFor(0.00005);
 	_sensorsAvailable = 1;
 
 	return 0;
@@ -264,18 +268,15 @@ Vector3d accelerationVector() {
 //   the sensors are on the same chip, and I don't care if you know
 Vector3d rotationVector() {
 	// scale is given as the +- dps range for the gyroscope
-	// with a +- 2000 dps scale and a 16 bit output integer, the raw value should be
-	//   divided by 2^(bits - log2(range)) which comes out to be 2^(15 - ceil(log2(500)))
-	//   which equals 2^4 = 16
+	// at the +- 500 dps scale the datasheet gives 17.5 millidegrees per second per count,
+	//   and everything using the rotation works in radians, so the raw value is divided
+	//   by the counts per radian per second, 1 / (0.0175 * pi / 180)
 	//
-	// why 15? well remember, the raw 16 bit register output has to be converted to a signed value
-	//   two's complement effectively uses a bit to encode sign, so we lost a bit for the total amount
+	// this used to be 64, which nobody could explain, and which gave the orientation
+	//   filter rotations about 50 times too large once the simulation checked it
 	// for the sake of efficiency, this value is hardcoded, but it is important to know how it was
 	//   determined for future adaptation
-	//
-	// looking back, I have no idea how this divisor became 32 when the math says 16
-	// dont ask me
-	int divisor = 64;
+	double divisor = 3274.04;
 
 	// create an even more user-friendly rotation vector
 	Vector3d r = threeAxisVector(gyroAddress, 0x22, divisor);
@@ -339,20 +340,56 @@ void getBarometerParameters() {
 }
 
 
-// helper function to get the barometer uncompensatedtemperature
-uint32_t uncompensatedTemperature() {
-	uint8_t temperatureConfig[] = {0xf4, 0x2e};
-	int success = i2c_write(barometerAddress, temperatureConfig, 2);
+// the barometer's conversion commands, with the pressure at the highest sample rate, and
+//   the time in seconds the datasheet gives each to finish
+static const uint8_t barometerSampleRate = 3;
+static const uint8_t temperatureCommand = 0x2e;
+static const uint8_t pressureCommand = 0x34 | (barometerSampleRate << 6);
+static const double temperatureConversionTime = 0.0045;
+static const double pressureConversionTime = 0.0255;
 
-	// datasheet suggests waiting 4.5 seconds for the value to be obtained
-	usleep(4500);
+// starts the barometer converting a temperature or pressure
+// returns -1 on failure and 0 on success
+static int startBarometerConversion(uint8_t command) {
+	uint8_t config[] = {0xf4, command};
+	return i2c_write(barometerAddress, config, 2);
+}
 
+// reads the barometer's finished temperature conversion into temperature
+// returns -1 on failure and 0 on success
+static int readTemperatureConversion(uint32_t *temperature) {
 	uint8_t dataRegisters[] = {0xf6, 0xf7};
 	uint8_t data[2];
 
-	success |= i2c_read(barometerAddress, dataRegisters[0], data, 1);
+	int success = i2c_read(barometerAddress, dataRegisters[0], data, 1);
 	success |= i2c_read(barometerAddress, dataRegisters[1], &data[1], 1);
-	uint32_t temperature = ((uint16_t)data[0] << 8) + (uint16_t)data[1];
+	*temperature = ((uint16_t)data[0] << 8) + (uint16_t)data[1];
+	return success;
+}
+
+// reads the barometer's finished pressure conversion into pressure
+// returns -1 on failure and 0 on success
+static int readPressureConversion(uint32_t *pressure) {
+	uint8_t dataRegisters[] = {0xf6, 0xf7, 0xf8};
+	uint8_t data[3];
+
+	int success = i2c_read(barometerAddress, dataRegisters[0], data, 1);
+	success |= i2c_read(barometerAddress, dataRegisters[1], &data[1], 1);
+	success |= i2c_read(barometerAddress, dataRegisters[2], &data[2], 1);
+	*pressure = (((uint32_t)data[0] << 16) + ((uint32_t)data[1] << 8) + (uint32_t)data[2]) >> \
+			(8 - barometerSampleRate);
+	return success;
+}
+
+// helper function to get the barometer uncompensatedtemperature
+uint32_t uncompensatedTemperature() {
+	int success = startBarometerConversion(temperatureCommand);
+
+	// datasheet suggests waiting 4.5 milliseconds for the value to be obtained
+	sleepFor(temperatureConversionTime);
+
+	uint32_t temperature;
+	success |= readTemperatureConversion(&temperature);
 
 	if (success != 0) {
 		printf("barometer temperature read failed");
@@ -363,21 +400,13 @@ uint32_t uncompensatedTemperature() {
 
 // helper function to get the barometer uncompensated pressure
 uint32_t uncompensatedPressure() {
-	uint8_t sampleRate = 3;
-
-	uint8_t pressureConfig[] = {0xf4, 0xf4};
-	int success = i2c_write(barometerAddress, pressureConfig, 2);
+	int success = startBarometerConversion(pressureCommand);
 
 	// datasheet suggests a 25.5ms waiting period for a sample rate of 3
-	usleep(25500);
+	sleepFor(pressureConversionTime);
 
-	uint8_t dataRegisters[] = {0xf6, 0xf7, 0xf8};
-	uint8_t data[3];
-
-	success |= i2c_read(barometerAddress, dataRegisters[0], data, 1);
-	success |= i2c_read(barometerAddress, dataRegisters[1], &data[1], 1);
-	success |= i2c_read(barometerAddress, dataRegisters[2], &data[2], 1);
-	uint32_t pressure = (((uint32_t)data[0] << 16) + ((uint32_t)data[1] << 8) + (uint32_t)data[2]) >> (8 - sampleRate);
+	uint32_t pressure;
+	success |= readPressureConversion(&pressure);
 
 	if (success != 0) {
 		printf("barometer pressure read failed");
@@ -387,15 +416,9 @@ uint32_t uncompensatedPressure() {
 	return pressure;
 }
 
-// gets the altitude relative to the take-off height
-double barometerAltitude() {
-	// initialize the sensors before using data
-	initializeSensors();
-
-	uint8_t sampleRate = 3;
-
-	uint32_t uncompPressure = uncompensatedPressure();
-	uint32_t uncompTemperature = uncompensatedTemperature();
+// turns the uncompensated temperature and pressure into the altitude in meters
+static double compensatedAltitude(uint32_t uncompTemperature, uint32_t uncompPressure) {
+	uint8_t sampleRate = barometerSampleRate;
 
 	// the following calculations are taken from the datasheet
 	int32_t X1 = (uncompTemperature - baroVals[5]) * baroVals[4] / 32768;
@@ -438,6 +461,48 @@ double barometerAltitude() {
 	return altitude;
 }
 
+// gets the altitude relative to the take-off height
+double barometerAltitude() {
+	// initialize the sensors before using data
+	initializeSensors();
+
+	uint32_t uncompTemperature = uncompensatedTemperature();
+	uint32_t uncompPressure = uncompensatedPressure();
+
+	return compensatedAltitude(uncompTemperature, uncompPressure);
+}
+
+Task readBarometerAltitude(struct EventLoop *loop, \
+		void (*done)(double altitude, void *context), void *context) {
+	initializeSensors();
+
+	uint32_t temperature = 0;
+	uint32_t pressure = 0;
+	int success = co_await busTransaction([] {
+		return startBarometerConversion(temperatureCommand);
+	});
+	co_await taskSleepFor(loop, temperatureConversionTime);
+	success |= co_await busTransaction([&] {
+		return readTemperatureConversion(&temperature);
+	});
+
+	success |= co_await busTransaction([] {
+		return startBarometerConversion(pressureCommand);
+	});
+	co_await taskSleepFor(loop, pressureConversionTime);
+	success |= co_await busTransaction([&] {
+		return readPressureConversion(&pressure);
+	});
+
+	if (success != 0) {
+		printf("barometer read failed\n");
+		done(NAN, context);
+	}
+	else {
+		done(compensatedAltitude(temperature, pressure), context);
+	}
+}
+
 
 
 
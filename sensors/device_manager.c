@@ -7,17 +7,87 @@
 #include<stdint.h>
 #include<string.h>
 
+#include<pthread.h>
+
 #include<device_manager.h>
-#include<dynamic_set.h>
+#include<rcu_set.h>
 #include<string_additions.h>
 
 
+/* every registered device, created the first time it is needed */
+static struct rcu_set *__devices = NULL;
+static pthread_once_t __devices_once = PTHREAD_ONCE_INIT;
+/* serializes registering and unregistering, so a device's dev_init() and dev_close()
+ * 	only ever run for the call that changes the table; lookups never take it */
+static pthread_mutex_t __registration_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void __init_devices(void) {
+	__devices = rcu_set_init();
+}
+
+static struct rcu_set *__device_table(void) {
+	pthread_once(&__devices_once, &__init_devices);
+	return __devices;
+}
+
+
 /* success if non-null string was copied */
 int8_t name_dr_dev(struct dr_dev *dev, const char *name) {
 	return (strlcpy(dev->name, name, NAME_LEN - 1)) ? 0 : 1;
 }
 
 int8_t register_device(struct dr_dev *dev) {
-	
+	if (dev == NULL || dev->dev_init == NULL || dev->dev_close == NULL || dev->ping == NULL)
+		return 2;
+
+	pthread_mutex_lock(&__registration_lock);
+	if (rcu_set_contains(__device_table(), dev)) {
+		pthread_mutex_unlock(&__registration_lock);
+		return 3;
+	}
+
+	if (dev->dev_init(dev)) {
+		pthread_mutex_unlock(&__registration_lock);
+		return 1;
+	}
+	dev->active = 1;
+
+	/* nobody else can have added dev meanwhile, so this only fails on allocation */
+	int8_t failure = rcu_set_add(__device_table(), dev);
+	if (failure) {
+		dev->active = 0;
+		dev->dev_close(dev);
+	}
+	pthread_mutex_unlock(&__registration_lock);
+	return failure ? 1 : 0;
+}
+
+void unregister_device(struct dr_dev *dev) {
+	pthread_mutex_lock(&__registration_lock);
+	if (rcu_set_remove(__device_table(), dev) == 0) {
+		dev->active = 0;
+		dev->dev_close(dev);
+	}
+	pthread_mutex_unlock(&__registration_lock);
+}
+
+struct dr_dev *find_device(enum dr_dev_type type) {
+	struct rcu_set *table = __device_table();
+	struct rcu_set_reader reader;
+	struct dr_dev *found = NULL;
+
+	rcu_set_read_begin(table, &reader);
+	for (uint64_t i = 0; i < reader.count && found == NULL; i++) {
+		struct dr_dev *dev = reader.items[i];
+		if (dev->active == 1 && (dev->type & type) == type)
+			found = dev;
+	}
+	rcu_set_read_end(table, &reader);
+
+	return found;
+}
+
+uint64_t device_count(void) {
+	return rcu_set_count(__device_table());
 }
 
@@ -0,0 +1,114 @@
+// implementation for the QuadDynamics header
+//
+// by Mark Hill
+
+#include<math.h>
+
+#include<Eigen/Dense>
+
+#include<QuadDynamics.h>
+#include<Mixer.h>
+
+using namespace Eigen;
+
+// standard gravity in m/s^2
+static const double _gravity = 9.80665;
+
+void defaultQuadParameters(struct QuadParameters *parameters) {
+	parameters->mass = 1.2;
+	parameters->inertia = Vector3d(0.012, 0.012, 0.022);
+	parameters->armLength = 0.225;
+	// hovers at 0.535 of full thrust on four motors
+	parameters->maximumThrust = 5.5;
+	parameters->dragTorqueRatio = 0.016;
+	parameters->motorTimeConstant = 0.03;
+	parameters->linearDrag = 0.3;
+	parameters->angularDrag = 0.002;
+	// stops the 0.5 m/s landing descent in about 5 mm
+	parameters->gearDeceleration = 20;
+}
+
+void initQuadState(struct QuadState *state) {
+	state->position = Vector3d(0, 0, 0);
+	state->velocity = Vector3d(0, 0, 0);
+	state->acceleration = Vector3d(0, 0, 0);
+	state->attitude = Quaterniond::Identity();
+	state->angularVelocity = Vector3d(0, 0, 0);
+	for (int i = 0; i < motorCount; i++) {
+		state->motorThrusts[i] = 0;
+	}
+}
+
+// keeps the vehicle on the ground, where it stands level facing the way it was
+// the landing gear gives way until it has stopped the vehicle, and then it stands still
+//   where it stopped, below which is the ground until it takes off again
+static void groundContact(const struct QuadParameters *parameters, struct QuadState *state, \
+		double previousHeight, double dt) {
+	if (state->position(2) > 0 || state->velocity(2) > 0)
+		return;
+
+	Vector3d front = state->attitude * Vector3d::UnitX();
+	state->attitude = Quaterniond(AngleAxisd(atan2(front(1), front(0)), Vector3d::UnitZ()));
+	state->angularVelocity = Vector3d(0, 0, 0);
+
+	double stop = parameters->gearDeceleration * dt;
+	if (state->velocity(2) < -stop) {
+		state->velocity = Vector3d(0, 0, state->velocity(2) + stop);
+		state->position(2) = previousHeight + state->velocity(2) * dt;
+	}
+	else {
+		state->velocity = Vector3d(0, 0, 0);
+		state->position(2) = previousHeight < 0 ? previousHeight : 0;
+	}
+}
+
+// the motors are integrated exactly, and the body with semi-implicit Euler steps, which
+//   are stable for the small steps the simulator takes
+void stepQuadDynamics(const struct QuadParameters *parameters, struct QuadState *state, \
+		const double *commands, double dt) {
+	double lag = 1 - exp(-dt / parameters->motorTimeConstant);
+	double totalThrust = 0;
+	Vector3d torque(0, 0, 0);
+
+	for (int i = 0; i < motorCount; i++) {
+		double command = commands[i] < 0 ? 0 : (commands[i] > 1 ? 1 : commands[i]);
+		state->motorThrusts[i] += (command * parameters->maximumThrust - \
+				state->motorThrusts[i]) * lag;
+
+		double thrust = state->motorThrusts[i];
+		const struct MotorGeometry &motor = AIRFRAME_GEOMETRY[i];
+		totalThrust += thrust;
+		torque += Vector3d(motor.y * parameters->armLength * thrust, \
+				-motor.x * parameters->armLength * thrust, \
+				motor.direction * parameters->dragTorqueRatio * thrust);
+	}
+	torque -= parameters->angularDrag * state->angularVelocity;
+
+	Vector3d force = state->attitude * Vector3d(0, 0, totalThrust) - \
+			parameters->linearDrag * state->velocity + \
+			Vector3d(0, 0, -parameters->mass * _gravity);
+	Vector3d previousVelocity = state->velocity;
+	double previousHeight = state->position(2);
+	state->velocity += force / parameters->mass * dt;
+	state->position += state->velocity * dt;
+
+	// Euler's equations, with the gyroscopic term from the spinning body
+	const Vector3d &inertia = parameters->inertia;
+	Vector3d &rate = state->angularVelocity;
+	Vector3d momentum = inertia.cwiseProduct(rate);
+	rate += (torque - rate.cross(momentum)).cwiseQuotient(inertia) * dt;
+
+	double angle = rate.norm() * dt;
+	if (angle > 0) {
+		state->attitude = state->attitude * Quaterniond(AngleAxisd(angle, rate.normalized()));
+		state->attitude.normalize();
+	}
+
+	groundContact(parameters, state, previousHeight, dt);
+	state->acceleration = (state->velocity - previousVelocity) / dt;
+}
+
+Vector3d specificForce(const struct QuadState *state) {
+	Vector3d force = state->acceleration + Vector3d(0, 0, _gravity);
+	return state->attitude.conjugate() * force / _gravity;
+}
@@ -0,0 +1,215 @@
+// implementation for the Simulator header
+//
+// by Mark Hill
+
+#include<stdio.h>
+#include<stdint.h>
+#include<math.h>
+#include<pthread.h>
+
+#include<atomic>
+
+#include<Eigen/Dense>
+
+#include<Simulator.h>
+#include<QuadDynamics.h>
+#include<Mixer.h>
+#include<MotorController.h>
+#include<EscProtocol.h>
+#include<Clock.h>
+extern "C" {
+	#include<i2cctl.h>
+	#include<i2csim.h>
+}
+
+using namespace Eigen;
+
+// the addresses the SensorManager and the PWMController use
+static const uint16_t _pwmAddress = 0x40;
+static const uint16_t _imuAddress = 0x6b;
+static const uint16_t _magnetometerAddress = 0x0e;
+static const uint16_t _barometerAddress = 0x77;
+
+// the virtual clock starts here rather than at 0, which the loop timings take as unset
+static const double _startTime = 1;
+
+// how long in seconds an ESC has to see a pulse below idle before it drives its motor
+static const double _escArmingTime = 0.04;
+
+// the earth's field in microteslas, pointing north and 60 degrees down
+static const Vector3d _magneticField(25, 0, -43.3);
+// the accelerometer reading in g's at rest and level, other than gravity, as a real one
+//   has, in the axes of the vehicle
+static const Vector3d _accelerometerBias(0.02, -0.015, 0);
+// the height of the ground above sea level in meters
+static const double _groundAltitude = 0;
+
+// one simulated ESC
+struct SimulatedEsc {
+	// the time it started seeing a pulse below idle, or -1 while it is not
+	double lowSince;
+	int armed;
+};
+
+static struct PCA9685Model _pwm;
+static struct LSM6DS33Model _imu;
+static struct MAG3110Model _magnetometer;
+static struct BMP180Model _barometer;
+static struct I2CSimDevice _devices[4];
+
+static struct SimulatedEsc _escs[motorCount];
+static struct QuadParameters _vehicle;
+
+// the vehicle, protected by _stateLock
+static struct QuadState _state;
+static pthread_mutex_t _stateLock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_t _simulatorThread;
+static std::atomic<int> _running(0);
+// set by the simulator thread once it has seen it should stop
+static std::atomic<int> _finished(0);
+
+
+// returns the command from 0 - 1 an ESC gives its motor for a pulse in microseconds
+static double escCommand(struct SimulatedEsc *esc, double pulse, double now) {
+	const struct EscProtocol *protocol = &pwmEscProtocol;
+
+	// losing the signal disarms the ESC
+	if (pulse <= 0) {
+		esc->lowSince = -1;
+		esc->armed = 0;
+		return 0;
+	}
+	if (!esc->armed) {
+		if (pulse >= protocol->idlePulse)
+			esc->lowSince = -1;
+		else if (esc->lowSince < 0)
+			esc->lowSince = now;
+		else if (now - esc->lowSince >= _escArmingTime)
+			esc->armed = 1;
+		return 0;
+	}
+
+	double command = escThrust(protocol, pulse);
+	return command * command;
+}
+
+// writes what the sensors measure of the vehicle into their models
+// the bus must be held
+static void measureVehicle(const struct QuadState *state) {
+	// the accelerometer and gyroscope sit on the body axes at the centre
+	Vector3d acceleration = specificForce(state) + _accelerometerBias;
+	Vector3d rotation = state->angularVelocity * 180 / M_PI;
+	lsm6ds33SetMotion(&_imu, acceleration.data(), rotation.data());
+
+	// the magnetometer is mounted upside down, see magneticField()
+	Vector3d field = state->attitude.conjugate() * _magneticField;
+	field(2) = -field(2);
+	mag3110SetField(&_magnetometer, field.data());
+
+	// the international barometric formula the SensorManager inverts
+	double altitude = _groundAltitude + state->position(2);
+	bmp180SetPressure(&_barometer, 101325 * pow(1 - altitude / 44330, 5.255));
+}
+
+// steps the vehicle once every period on the virtual clock until stopped
+static void *simulatorLoop(void *input) {
+	double period = 1.0 / SIMULATOR_STEP_RATE;
+	double deadline = monotonicTime();
+
+	while (_running.load(std::memory_order_acquire)) {
+		deadline += period;
+		sleepUntil(deadline);
+
+		// nothing can touch the devices while the vehicle moves
+		i2cLockBus();
+		double commands[motorCount];
+		for (int i = 0; i < motorCount; i++) {
+			commands[i] = escCommand(&_escs[i], pca9685PulseWidth(&_pwm, i), deadline);
+		}
+
+		pthread_mutex_lock(&_stateLock);
+		stepQuadDynamics(&_vehicle, &_state, commands, period);
+		struct QuadState state = _state;
+		pthread_mutex_unlock(&_stateLock);
+
+		measureVehicle(&state);
+		i2cUnlockBus();
+	}
+
+	_finished.store(1, std::memory_order_release);
+	return NULL;
+}
+
+int startSimulator(const struct QuadParameters *vehicle) {
+	if (_running.load(std::memory_order_acquire))
+		return 0;
+
+	if (vehicle != NULL)
+		_vehicle = *vehicle;
+	else
+		defaultQuadParameters(&_vehicle);
+	initQuadState(&_state);
+	for (int i = 0; i < motorCount; i++) {
+		_escs[i].lowSince = -1;
+		_escs[i].armed = 0;
+	}
+
+	useVirtualClock(_startTime);
+
+	initPCA9685Model(&_pwm, &_devices[0], _pwmAddress);
+	initLSM6DS33Model(&_imu, &_devices[1], _imuAddress);
+	initMAG3110Model(&_magnetometer, &_devices[2], _magnetometerAddress);
+	initBMP180Model(&_barometer, &_devices[3], _barometerAddress);
+	int failure = 0;
+	for (int i = 0; i < 4; i++) {
+		failure |= i2cSimAttach(&_devices[i]);
+	}
+	if (failure) {
+		printf("failed to attach the simulated devices\n");
+		return -1;
+	}
+	i2cUseSimulation(1);
+
+	// the simulated ESCs give thrust going with the square of the pulse above idle, so
+	//   the motor layer is told so, like it would be for measured motors
+	for (int i = 0; i < motorCount; i++) {
+		setMotorCalibration(i, MotorCalibration{1, 2});
+	}
+
+	// the sensors read the vehicle at rest before the first step
+	i2cLockBus();
+	measureVehicle(&_state);
+	i2cUnlockBus();
+
+	_finished.store(0, std::memory_order_relaxed);
+	_running.store(1, std::memory_order_release);
+	if (createClockThread(&_simulatorThread, NULL, &simulatorLoop, NULL)) {
+		printf("failed to create simulator thread\n");
+		_running.store(0, std::memory_order_release);
+		return -1;
+	}
+
+	return 0;
+}
+
+void stopSimulator() {
+	if (!_running.load(std::memory_order_acquire))
+		return;
+
+	_running.store(0, std::memory_order_release);
+	// the simulator thread only wakes up when the virtual time moves, which it cannot
+	//   while this thread is blocked joining it, so this sleeps on the clock until the
+	//   thread is on its way out
+	while (!_finished.load(std::memory_order_acquire)) {
+		sleepFor(1.0 / SIMULATOR_STEP_RATE);
+	}
+	pthread_join(_simulatorThread, NULL);
+}
+
+struct QuadState simulatorState() {
+	pthread_mutex_lock(&_stateLock);
+	struct QuadState state = _state;
+	pthread_mutex_unlock(&_stateLock);
+	return state;
+}
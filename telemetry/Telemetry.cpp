@@ -0,0 +1,387 @@
+// implementation for the Telemetry header
+//
+// every buffer of the pool goes from free to filling when a publisher claims it, to
+//   ready once the message is in it and back to free when the sender thread has sent it,
+//   so a buffer only ever has one thread touching it and the state is all they share
+//
+// by Mark Hill
+
+#include<stdio.h>
+#include<stdint.h>
+#include<string.h>
+#include<errno.h>
+#include<unistd.h>
+#include<pthread.h>
+#include<netdb.h>
+#include<sys/socket.h>
+#include<sys/uio.h>
+#include<netinet/in.h>
+
+#include<atomic>
+
+#include<Telemetry.h>
+#include<Clock.h>
+#include<RealTime.h>
+#include<LoopTiming.h>
+
+enum BufferState {
+	BUFFER_FREE,
+	BUFFER_FILLING,
+	BUFFER_READY,
+};
+
+struct TelemetryBuffer {
+	std::atomic<int> state;
+	int type;
+	int size;
+	// the order the buffers were published in, so they are sent in it
+	uint64_t order;
+	uint8_t data[TELEMETRY_PACKET_SIZE];
+};
+
+// what each message type keeps
+struct TelemetryStream {
+	// 1 while the type is sent at all, and the seconds between messages
+	std::atomic<int> enabled;
+	std::atomic<double> interval;
+	// the earliest time the next message is let through
+	std::atomic<double> nextTime;
+	std::atomic<uint32_t> sequence;
+
+	// the statistics for the report
+	std::atomic<uint64_t> sent;
+	std::atomic<uint64_t> limited;
+	std::atomic<uint64_t> dropped;
+	std::atomic<uint64_t> failed;
+};
+
+static struct TelemetryBuffer _pool[TELEMETRY_POOL_SIZE];
+// where the next publisher starts looking for a free buffer, which spreads the
+//   publishers over the pool
+static std::atomic<uint32_t> _nextBuffer(0);
+static std::atomic<uint64_t> _nextOrder(0);
+static struct TelemetryStream _streams[TELEMETRY_TYPES];
+static const double _defaultRates[TELEMETRY_TYPES] = {
+	TELEMETRY_ORIENTATION_RATE,
+	TELEMETRY_MOTORS_RATE,
+	TELEMETRY_LOOP_STATS_RATE,
+};
+static std::atomic<int> _ratesSet(0);
+
+static std::atomic<int> _sending(0);
+static std::atomic<int> _senderRunning(0);
+// set by the sender thread once it has sent everything
+static std::atomic<int> _senderFinished(0);
+static pthread_t _senderThread;
+static int _socket = -1;
+
+// only touched by the sender thread, the ready buffers of one send and the messages
+//   sendmmsg() takes for them
+static struct TelemetryBuffer *_batch[TELEMETRY_POOL_SIZE];
+static struct iovec _vectors[TELEMETRY_POOL_SIZE];
+static struct mmsghdr _messages[TELEMETRY_POOL_SIZE];
+static std::atomic<uint64_t> _sendCalls(0);
+
+
+void setTelemetryRate(enum TelemetryType type, double rate) {
+	if (type < 0 || type >= TELEMETRY_TYPES)
+		return;
+	struct TelemetryStream *stream = &_streams[type];
+	stream->interval.store(rate > 0 ? 1 / rate : 0, std::memory_order_relaxed);
+	stream->enabled.store(rate > 0, std::memory_order_release);
+	_ratesSet.store(1, std::memory_order_release);
+}
+
+// returns 1 if a message of type at time is within its rate limit, and makes the next
+//   one wait its turn
+static int admitMessage(struct TelemetryStream *stream, double time) {
+	if (!stream->enabled.load(std::memory_order_acquire))
+		return 0;
+
+	double interval = stream->interval.load(std::memory_order_relaxed);
+	double next = stream->nextTime.load(std::memory_order_relaxed);
+	if (time < next) {
+		stream->limited.fetch_add(1, std::memory_order_relaxed);
+		return 0;
+	}
+	// keep to the rate's cadence unless a whole interval has been missed, so a faster
+	//   source is not slowed down to less than the rate by its own jitter
+	double following = next + interval > time ? next + interval : time + interval;
+	// another thread publishing the same type got there first
+	if (!stream->nextTime.compare_exchange_strong(next, following, \
+			std::memory_order_relaxed)) {
+		stream->limited.fetch_add(1, std::memory_order_relaxed);
+		return 0;
+	}
+	return 1;
+}
+
+// gives the calling thread a free buffer, or returns NULL if they are all taken
+static struct TelemetryBuffer *claimBuffer() {
+	uint32_t start = _nextBuffer.fetch_add(1, std::memory_order_relaxed);
+	for (int i = 0; i < TELEMETRY_POOL_SIZE; i++) {
+		struct TelemetryBuffer *buffer = &_pool[(start + i) % TELEMETRY_POOL_SIZE];
+		int expected = BUFFER_FREE;
+		if (buffer->state.compare_exchange_strong(expected, BUFFER_FILLING, \
+				std::memory_order_acquire))
+			return buffer;
+	}
+	return NULL;
+}
+
+// rate limits message and, if it gets through, encodes it into a buffer for the sender
+static void publishMessage(struct TelemetryMessage *message) {
+	struct TelemetryStream *stream = &_streams[message->type];
+	if (!admitMessage(stream, message->time))
+		return;
+
+	// taken even when there is no buffer, so the receiver sees the gap
+	message->sequence = stream->sequence.fetch_add(1, std::memory_order_relaxed);
+	struct TelemetryBuffer *buffer = claimBuffer();
+	if (buffer == NULL) {
+		stream->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	int size = encodeTelemetryMessage(message, buffer->data, sizeof(buffer->data));
+	if (size < 0) {
+		stream->dropped.fetch_add(1, std::memory_order_relaxed);
+		buffer->state.store(BUFFER_FREE, std::memory_order_release);
+		return;
+	}
+	buffer->type = message->type;
+	buffer->size = size;
+	buffer->order = _nextOrder.fetch_add(1, std::memory_order_relaxed);
+	buffer->state.store(BUFFER_READY, std::memory_order_release);
+}
+
+void publishTelemetry(enum TelemetryType type, double time, const double *values, int count) {
+	if (!_sending.load(std::memory_order_relaxed))
+		return;
+	if (type != TELEMETRY_ORIENTATION && type != TELEMETRY_MOTORS)
+		return;
+
+	struct TelemetryMessage message;
+	message.type = type;
+	message.time = time;
+	message.tasks = 0;
+	if (count > TELEMETRY_MAX_VALUES)
+		count = TELEMETRY_MAX_VALUES;
+	// an orientation message always has all of its values
+	message.count = type == TELEMETRY_ORIENTATION ? TELEMETRY_MAX_VALUES : count;
+	for (int i = 0; i < message.count; i++) {
+		message.values[i] = i < count ? (float)(values[i]) : 0;
+	}
+	publishMessage(&message);
+}
+
+// publishes the timing of every registered task (see LoopTiming.h)
+static void publishLoopStats(double time) {
+	struct TelemetryMessage message;
+	message.type = TELEMETRY_LOOP_STATS;
+	message.time = time;
+	message.count = 0;
+	message.tasks = 0;
+	int count = loopTimingCount();
+	for (int i = 0; i < count && message.tasks < TELEMETRY_MAX_TASKS; i++) {
+		struct LoopTiming *timing = loopTimingAt(i);
+		struct TelemetryTaskStats *stats = &message.stats[message.tasks++];
+		strncpy(stats->name, timing->name != NULL ? timing->name : "", TELEMETRY_NAME_SIZE);
+		stats->name[TELEMETRY_NAME_SIZE] = '\0';
+		stats->latenessP99 = timingPercentile(&timing->lateness, 0.99) * 1e6;
+		stats->executionP50 = timingPercentile(&timing->execution, 0.5) * 1e6;
+		stats->executionP99 = timingPercentile(&timing->execution, 0.99) * 1e6;
+		stats->executionMaximum = \
+				timing->execution.maximum.load(std::memory_order_relaxed) / 1e3;
+		stats->overruns = (uint32_t)(timing->overruns.load(std::memory_order_relaxed));
+	}
+	publishMessage(&message);
+}
+
+int telemetrySending() {
+	return _sending.load(std::memory_order_acquire);
+}
+
+
+// sender functions
+
+// sends every ready buffer in the order they were published and frees them
+static void sendReady() {
+	int count = 0;
+	for (int i = 0; i < TELEMETRY_POOL_SIZE; i++) {
+		if (_pool[i].state.load(std::memory_order_acquire) != BUFFER_READY)
+			continue;
+		// insertion sort, the pool is small and mostly in order already
+		int position = count++;
+		for (; position > 0 && _batch[position - 1]->order > _pool[i].order; position--) {
+			_batch[position] = _batch[position - 1];
+		}
+		_batch[position] = &_pool[i];
+	}
+	if (count == 0)
+		return;
+
+	for (int i = 0; i < count; i++) {
+		_vectors[i].iov_base = _batch[i]->data;
+		_vectors[i].iov_len = _batch[i]->size;
+		memset(&_messages[i], 0, sizeof(_messages[i]));
+		_messages[i].msg_hdr.msg_iov = &_vectors[i];
+		_messages[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	int first = 0;
+	int retried = 0;
+	while (first < count) {
+		int sent = sendmmsg(_socket, _messages + first, count - first, MSG_DONTWAIT);
+		_sendCalls.fetch_add(1, std::memory_order_relaxed);
+		if (sent > 0) {
+			for (int i = first; i < first + sent; i++) {
+				_streams[_batch[i]->type].sent.fetch_add(1, std::memory_order_relaxed);
+			}
+			first += sent;
+			continue;
+		}
+		// a refused earlier datagram is reported on the next send, which is then not made
+		if (sent < 0 && (errno == EINTR || (errno == ECONNREFUSED && !retried))) {
+			retried = errno == ECONNREFUSED;
+			continue;
+		}
+		// the socket buffer is full or the network is down, so the rest are lost
+		for (int i = first; i < count; i++) {
+			_streams[_batch[i]->type].failed.fetch_add(1, std::memory_order_relaxed);
+		}
+		break;
+	}
+
+	for (int i = 0; i < count; i++) {
+		_batch[i]->state.store(BUFFER_FREE, std::memory_order_release);
+	}
+}
+
+// sends what has been published every TELEMETRY_SEND_INTERVAL seconds until stopped
+static void *telemetrySender(void *input) {
+	makeBackgroundThread();
+
+	while (_senderRunning.load(std::memory_order_acquire)) {
+		sleepFor(TELEMETRY_SEND_INTERVAL);
+		publishLoopStats(monotonicTime());
+		sendReady();
+	}
+
+	sendReady();
+	_senderFinished.store(1, std::memory_order_release);
+	return NULL;
+}
+
+// creates a non blocking UDP socket connected to port on host
+// returns the socket, or -1 on failure
+static int openSocket(const char *host, int port) {
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	char service[16];
+	snprintf(service, sizeof(service), "%d", port);
+
+	struct addrinfo *addresses;
+	int error = getaddrinfo(host, service, &hints, &addresses);
+	if (error) {
+		printf("failed to find telemetry host %s (%s)\n", host, gai_strerror(error));
+		return -1;
+	}
+
+	int socketFile = -1;
+	for (struct addrinfo *address = addresses; address != NULL; address = address->ai_next) {
+		socketFile = socket(address->ai_family, \
+				address->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, address->ai_protocol);
+		if (socketFile < 0)
+			continue;
+		if (connect(socketFile, address->ai_addr, address->ai_addrlen) == 0)
+			break;
+		close(socketFile);
+		socketFile = -1;
+	}
+	if (socketFile < 0)
+		printf("failed to open telemetry socket to %s:%d (%s)\n", host, port, strerror(errno));
+	freeaddrinfo(addresses);
+	return socketFile;
+}
+
+int startTelemetry(const char *host, int port) {
+	if (_senderRunning.load(std::memory_order_acquire))
+		return 0;
+
+	_socket = openSocket(host, port);
+	if (_socket < 0)
+		return -1;
+
+	if (!_ratesSet.load(std::memory_order_acquire)) {
+		for (int type = 0; type < TELEMETRY_TYPES; type++) {
+			setTelemetryRate((enum TelemetryType)(type), _defaultRates[type]);
+		}
+	}
+	for (int type = 0; type < TELEMETRY_TYPES; type++) {
+		struct TelemetryStream *stream = &_streams[type];
+		stream->nextTime.store(0, std::memory_order_relaxed);
+		stream->sequence.store(0, std::memory_order_relaxed);
+		stream->sent.store(0, std::memory_order_relaxed);
+		stream->limited.store(0, std::memory_order_relaxed);
+		stream->dropped.store(0, std::memory_order_relaxed);
+		stream->failed.store(0, std::memory_order_relaxed);
+	}
+	for (int i = 0; i < TELEMETRY_POOL_SIZE; i++) {
+		_pool[i].state.store(BUFFER_FREE, std::memory_order_relaxed);
+	}
+	_sendCalls.store(0, std::memory_order_relaxed);
+
+	_senderFinished.store(0, std::memory_order_relaxed);
+	_senderRunning.store(1, std::memory_order_release);
+	if (createClockThread(&_senderThread, NULL, &telemetrySender, NULL)) {
+		printf("failed to create telemetry sender thread\n");
+		_senderRunning.store(0, std::memory_order_release);
+		close(_socket);
+		_socket = -1;
+		return -1;
+	}
+	_sending.store(1, std::memory_order_release);
+
+	return 0;
+}
+
+void stopTelemetry() {
+	if (!_senderRunning.load(std::memory_order_acquire))
+		return;
+
+	_sending.store(0, std::memory_order_release);
+	_senderRunning.store(0, std::memory_order_release);
+	// on the virtual clock the sender only wakes up while this thread sleeps, see
+	//   stopSimulator()
+	while (!_senderFinished.load(std::memory_order_acquire)) {
+		sleepFor(TELEMETRY_SEND_INTERVAL);
+	}
+	pthread_join(_senderThread, NULL);
+
+	close(_socket);
+	_socket = -1;
+}
+
+void printTelemetryReport() {
+	uint64_t datagrams = 0;
+	for (int type = 0; type < TELEMETRY_TYPES; type++) {
+		datagrams += _streams[type].sent.load(std::memory_order_relaxed);
+	}
+	uint64_t calls = _sendCalls.load(std::memory_order_relaxed);
+
+	printf("telemetry %s, %llu datagrams in %llu sends, %.1f per send\n", \
+			telemetrySending() ? "sending" : "stopped", (unsigned long long)(datagrams), \
+			(unsigned long long)(calls), calls > 0 ? (double)(datagrams) / calls : 0);
+	for (int type = 0; type < TELEMETRY_TYPES; type++) {
+		struct TelemetryStream *stream = &_streams[type];
+		printf("  %-14s%8llu sent, %llu rate limited, %llu dropped, %llu failed\n", \
+				telemetryTypeName(type), \
+				(unsigned long long)(stream->sent.load(std::memory_order_relaxed)), \
+				(unsigned long long)(stream->limited.load(std::memory_order_relaxed)), \
+				(unsigned long long)(stream->dropped.load(std::memory_order_relaxed)), \
+				(unsigned long long)(stream->failed.load(std::memory_order_relaxed)));
+	}
+}
@@ -0,0 +1,188 @@
+// implementation for the TelemetryProtocol header
+//
+// by Mark Hill
+
+#include<stdint.h>
+#include<string.h>
+#include<math.h>
+
+#include<TelemetryProtocol.h>
+
+// the bytes every task takes in a loop stats message
+#define TASK_SIZE (TELEMETRY_NAME_SIZE + 4 * 4 + 4)
+
+static void putShort(uint8_t *output, uint16_t value) {
+	output[0] = (uint8_t)(value);
+	output[1] = (uint8_t)(value >> 8);
+}
+
+static void putLong(uint8_t *output, uint32_t value) {
+	for (int i = 0; i < 4; i++)
+		output[i] = (uint8_t)(value >> (8 * i));
+}
+
+static void putQuad(uint8_t *output, uint64_t value) {
+	for (int i = 0; i < 8; i++)
+		output[i] = (uint8_t)(value >> (8 * i));
+}
+
+static void putFloat(uint8_t *output, float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	putLong(output, bits);
+}
+
+static uint16_t getShort(const uint8_t *input) {
+	return (uint16_t)(input[0] | input[1] << 8);
+}
+
+static uint32_t getLong(const uint8_t *input) {
+	uint32_t value = 0;
+	for (int i = 0; i < 4; i++)
+		value |= (uint32_t)(input[i]) << (8 * i);
+	return value;
+}
+
+static uint64_t getQuad(const uint8_t *input) {
+	uint64_t value = 0;
+	for (int i = 0; i < 8; i++)
+		value |= (uint64_t)(input[i]) << (8 * i);
+	return value;
+}
+
+static float getFloat(const uint8_t *input) {
+	uint32_t bits = getLong(input);
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+// returns the bytes of payload message takes, or -1 if it is malformed
+static int payloadSize(const struct TelemetryMessage *message) {
+	switch (message->type) {
+	case TELEMETRY_ORIENTATION:
+		return TELEMETRY_MAX_VALUES * 4;
+	case TELEMETRY_MOTORS:
+		if (message->count < 0 || message->count > TELEMETRY_MAX_VALUES)
+			return -1;
+		return 1 + message->count * 4;
+	case TELEMETRY_LOOP_STATS:
+		if (message->tasks < 0 || message->tasks > TELEMETRY_MAX_TASKS)
+			return -1;
+		return 1 + message->tasks * TASK_SIZE;
+	default:
+		return -1;
+	}
+}
+
+int encodeTelemetryMessage(const struct TelemetryMessage *message, uint8_t *output, \
+		int capacity) {
+	int length = payloadSize(message);
+	if (length < 0 || TELEMETRY_HEADER_SIZE + length > capacity)
+		return -1;
+
+	putShort(output, TELEMETRY_MAGIC);
+	output[2] = TELEMETRY_VERSION;
+	output[3] = (uint8_t)(message->type);
+	putShort(output + 4, (uint16_t)(length));
+	putLong(output + 6, message->sequence);
+	putQuad(output + 10, message->time > 0 ? (uint64_t)(llround(message->time * 1e6)) : 0);
+
+	uint8_t *payload = output + TELEMETRY_HEADER_SIZE;
+	if (message->type == TELEMETRY_ORIENTATION) {
+		for (int i = 0; i < TELEMETRY_MAX_VALUES; i++)
+			putFloat(payload + 4 * i, message->values[i]);
+	}
+	else if (message->type == TELEMETRY_MOTORS) {
+		payload[0] = (uint8_t)(message->count);
+		for (int i = 0; i < message->count; i++)
+			putFloat(payload + 1 + 4 * i, message->values[i]);
+	}
+	else {
+		payload[0] = (uint8_t)(message->tasks);
+		for (int i = 0; i < message->tasks; i++) {
+			const struct TelemetryTaskStats *stats = &message->stats[i];
+			uint8_t *task = payload + 1 + i * TASK_SIZE;
+			strncpy((char *)(task), stats->name, TELEMETRY_NAME_SIZE);
+			putFloat(task + TELEMETRY_NAME_SIZE, stats->latenessP99);
+			putFloat(task + TELEMETRY_NAME_SIZE + 4, stats->executionP50);
+			putFloat(task + TELEMETRY_NAME_SIZE + 8, stats->executionP99);
+			putFloat(task + TELEMETRY_NAME_SIZE + 12, stats->executionMaximum);
+			putLong(task + TELEMETRY_NAME_SIZE + 16, stats->overruns);
+		}
+	}
+
+	return TELEMETRY_HEADER_SIZE + length;
+}
+
+int decodeTelemetryMessage(const uint8_t *input, int size, struct TelemetryMessage *message) {
+	if (size < TELEMETRY_HEADER_SIZE || getShort(input) != TELEMETRY_MAGIC || \
+			input[2] != TELEMETRY_VERSION)
+		return -1;
+	int length = getShort(input + 4);
+	if (TELEMETRY_HEADER_SIZE + length > size)
+		return -1;
+
+	message->type = input[3];
+	message->sequence = getLong(input + 6);
+	message->time = getQuad(input + 10) / 1e6;
+	message->count = 0;
+	message->tasks = 0;
+
+	const uint8_t *payload = input + TELEMETRY_HEADER_SIZE;
+	if (message->type == TELEMETRY_ORIENTATION) {
+		message->count = TELEMETRY_MAX_VALUES;
+	}
+	else if (message->type == TELEMETRY_MOTORS) {
+		if (length < 1)
+			return -1;
+		message->count = payload[0];
+	}
+	else if (message->type == TELEMETRY_LOOP_STATS) {
+		if (length < 1)
+			return -1;
+		message->tasks = payload[0];
+	}
+	else {
+		return -1;
+	}
+	if (payloadSize(message) != length)
+		return -1;
+
+	if (message->type == TELEMETRY_ORIENTATION) {
+		for (int i = 0; i < TELEMETRY_MAX_VALUES; i++)
+			message->values[i] = getFloat(payload + 4 * i);
+	}
+	else if (message->type == TELEMETRY_MOTORS) {
+		for (int i = 0; i < message->count; i++)
+			message->values[i] = getFloat(payload + 1 + 4 * i);
+	}
+	else {
+		for (int i = 0; i < message->tasks; i++) {
+			struct TelemetryTaskStats *stats = &message->stats[i];
+			const uint8_t *task = payload + 1 + i * TASK_SIZE;
+			memcpy(stats->name, task, TELEMETRY_NAME_SIZE);
+			stats->name[TELEMETRY_NAME_SIZE] = '\0';
+			stats->latenessP99 = getFloat(task + TELEMETRY_NAME_SIZE);
+			stats->executionP50 = getFloat(task + TELEMETRY_NAME_SIZE + 4);
+			stats->executionP99 = getFloat(task + TELEMETRY_NAME_SIZE + 8);
+			stats->executionMaximum = getFloat(task + TELEMETRY_NAME_SIZE + 12);
+			stats->overruns = getLong(task + TELEMETRY_NAME_SIZE + 16);
+		}
+	}
+
+	return 0;
+}
+
+const char *telemetryTypeName(int type) {
+	switch (type) {
+	case TELEMETRY_ORIENTATION:
+		return "orientation";
+	case TELEMETRY_MOTORS:
+		return "motors";
+	case TELEMETRY_LOOP_STATS:
+		return "loop stats";
+	default:
+		return "unknown";
+	}
+}
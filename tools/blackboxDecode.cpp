@@ -0,0 +1,72 @@
+// decodes a blackbox file (see Blackbox.h) on every core into one array per field
+// usage: blackboxDecode [-j threads] [-o directory] file
+//   -j   the number of threads, defaults to one per processor
+//   -o   writes the arrays and summary.csv into directory (see BlackboxColumns.h)
+//
+// by Mark Hill
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<time.h>
+
+#include<BlackboxColumns.h>
+
+// returns the monotonic time in seconds
+static double wallTime() {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec / 1000000000.0;
+}
+
+int main(int argc, char *argv[]) {
+	int threads = 0;
+	const char *directory = NULL;
+	int argument = 1;
+	for (; argument < argc && argv[argument][0] == '-'; argument++) {
+		if (strcmp(argv[argument], "-j") == 0 && argument + 1 < argc) {
+			threads = atoi(argv[++argument]);
+		}
+		else if (strcmp(argv[argument], "-o") == 0 && argument + 1 < argc) {
+			directory = argv[++argument];
+		}
+		else {
+			break;
+		}
+	}
+	if (argument != argc - 1) {
+		printf("usage: %s [-j threads] [-o directory] file\n", argv[0]);
+		return 1;
+	}
+
+	struct BlackboxColumns columns;
+	double start = wallTime();
+	if (decodeBlackboxColumns(argv[argument], threads, &columns))
+		return 1;
+	double elapsed = wallTime() - start;
+
+	unsigned long long records = 0;
+	for (int type = 0; type < BLACKBOX_RECORD_TYPES; type++) {
+		struct BlackboxTable *table = &columns.tables[type];
+		if (table->rows == 0)
+			continue;
+		printf("%-16s%10llu rows, %d values\n", blackboxTypeName(type), \
+				(unsigned long long)(table->rows), table->width);
+		records += table->rows;
+	}
+	double megabytes = columns.blocks * (double)(BLACKBOX_BLOCK_SIZE) / (1024 * 1024);
+	printf("decoded %llu records from %llu blocks (%llu bad) in %.3fs, %.0f records and " \
+			"%.1f MB per second\n", records, (unsigned long long)(columns.blocks), \
+			(unsigned long long)(columns.badBlocks), elapsed, \
+			elapsed > 0 ? records / elapsed : 0, elapsed > 0 ? megabytes / elapsed : 0);
+
+	int failure = 0;
+	if (directory != NULL) {
+		failure = writeBlackboxColumns(&columns, directory);
+		if (!failure)
+			printf("wrote the columns to %s\n", directory);
+	}
+
+	freeBlackboxColumns(&columns);
+	return failure || columns.badBlocks ? 1 : 0;
+}
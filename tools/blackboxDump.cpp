@@ -0,0 +1,95 @@
+// decodes a blackbox file (see Blackbox.h) into text, one record per line
+// usage: blackboxDump [-b first] [-n blocks] file
+//   -b   the block to start at, defaults to the first
+//   -n   the number of blocks to decode, defaults to all of them
+// every line holds the type, the source, the sequence number, the time in seconds and
+//   the values of a record, and a summary goes to stderr at the end
+//
+// by Mark Hill
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<stdint.h>
+
+#include<Blackbox.h>
+#include<BlackboxEncoding.h>
+
+// the short names of the record types
+static const char *_typeNames[BLACKBOX_RECORD_TYPES] = {
+	"pad",
+	"acc",
+	"rot",
+	"mag",
+	"alt",
+	"ori",
+	"set",
+	"ctl",
+	"mot",
+};
+
+int main(int argc, char *argv[]) {
+	long first = 0, blocks = -1;
+	int argument = 1;
+	for (; argument < argc && argv[argument][0] == '-'; argument++) {
+		if (strcmp(argv[argument], "-b") == 0 && argument + 1 < argc) {
+			first = atol(argv[++argument]);
+		}
+		else if (strcmp(argv[argument], "-n") == 0 && argument + 1 < argc) {
+			blocks = atol(argv[++argument]);
+		}
+		else {
+			break;
+		}
+	}
+	if (argument != argc - 1) {
+		printf("usage: %s [-b first] [-n blocks] file\n", argv[0]);
+		return 1;
+	}
+
+	FILE *file = fopen(argv[argument], "rb");
+	if (file == NULL) {
+		printf("failed to open %s\n", argv[argument]);
+		return 1;
+	}
+	// every block is a keyframe, so decoding can start at any of them
+	if (fseek(file, first * BLACKBOX_BLOCK_SIZE, SEEK_SET)) {
+		printf("failed to seek to block %ld\n", first);
+		fclose(file);
+		return 1;
+	}
+
+	static char block[BLACKBOX_BLOCK_SIZE];
+	static struct BlackboxBlockReader reader;
+	unsigned long decoded = 0, records = 0, bad = 0;
+	while ((blocks < 0 || (long)(decoded) < blocks) && \
+			fread(block, BLACKBOX_BLOCK_SIZE, 1, file) == 1) {
+		decoded++;
+		if (openBlackboxBlock(&reader, block)) {
+			fprintf(stderr, "block %ld is not a blackbox block\n", first + decoded - 1);
+			bad++;
+			continue;
+		}
+
+		struct BlackboxRecord record;
+		int result;
+		while ((result = nextBlackboxRecord(&reader, &record)) > 0) {
+			printf("%s %u %u %.6f", _typeNames[record.type], record.source, record.sequence, \
+					record.time);
+			for (int i = 0; i < record.count; i++) {
+				printf(" %.9g", record.values[i]);
+			}
+			printf("\n");
+			records++;
+		}
+		if (result < 0) {
+			fprintf(stderr, "block %ld is broken after %u bytes\n", first + decoded - 1, \
+					reader.position);
+			bad++;
+		}
+	}
+	fclose(file);
+
+	fprintf(stderr, "decoded %lu records from %lu blocks, %lu bad\n", records, decoded, bad);
+	return bad ? 1 : 0;
+}
@@ -0,0 +1,81 @@
+// replays recorded sensor logs through the orientation sensor fusion
+// usage: replay [-j threads] [-o] log...
+//   -j   the number of worker threads, defaults to one per processor
+//   -o   writes the orientation after every sample next to each log as <log>.orientation
+//
+// by Mark Hill
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<time.h>
+
+#include<Replay.h>
+
+int main(int argc, char *argv[]) {
+	int threads = 0;
+	int writeOutput = 0;
+	int first = 1;
+	for (; first < argc && argv[first][0] == '-'; first++) {
+		if (strcmp(argv[first], "-j") == 0 && first + 1 < argc) {
+			threads = atoi(argv[++first]);
+		}
+		else if (strcmp(argv[first], "-o") == 0) {
+			writeOutput = 1;
+		}
+		else {
+			break;
+		}
+	}
+
+	int count = argc - first;
+	if (count <= 0) {
+		printf("usage: %s [-j threads] [-o] log...\n", argv[0]);
+		return 1;
+	}
+
+	const char **logPaths = (const char **)(&argv[first]);
+	char **outputPaths = NULL;
+	if (writeOutput) {
+		outputPaths = (char **)(calloc(count, sizeof(char *)));
+		for (int i = 0; i < count; i++) {
+			outputPaths[i] = (char *)(malloc(strlen(logPaths[i]) + 13));
+			sprintf(outputPaths[i], "%s.orientation", logPaths[i]);
+		}
+	}
+	struct ReplayResult *results = \
+			(struct ReplayResult *)(calloc(count, sizeof(struct ReplayResult)));
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	int failures = replaySensorLogs(logPaths, (const char *const *)(outputPaths), \
+			count, threads, results);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1000000000.0;
+
+	uint64_t samples = 0;
+	double flightTime = 0;
+	for (int i = 0; i < count; i++) {
+		struct ReplayResult *r = &results[i];
+		if (r->failed) {
+			printf("%s: failed\n", logPaths[i]);
+			continue;
+		}
+		printf("%s: %llu samples, %.1fs of flight in %.3fs, heading %f, altitude %f\n", \
+				logPaths[i], (long long unsigned int)r->samples, r->duration, r->elapsed, \
+				r->orientation.heading, r->orientation.altitude);
+		samples += r->samples;
+		flightTime += r->duration;
+	}
+	printf("replayed %d logs (%d failed), %.1fs of flight in %.3fs, %.0f samples per second\n", \
+			count, failures, flightTime, elapsed, elapsed > 0 ? samples / elapsed : 0);
+
+	if (outputPaths != NULL) {
+		for (int i = 0; i < count; i++) {
+			free(outputPaths[i]);
+		}
+		free(outputPaths);
+	}
+	free(results);
+	return failures ? 1 : 0;
+}
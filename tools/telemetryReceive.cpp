@@ -0,0 +1,187 @@
+// receives the telemetry of a flight (see Telemetry.h) and prints it, one message per line
+// usage: telemetryReceive [-p port] [-n messages] [-t seconds] [-q]
+//   -p   the port to listen on, defaults to TELEMETRY_DEFAULT_PORT
+//   -n   stops after this many messages
+//   -t   stops after this many seconds
+//   -q   only prints the summary
+// the summary at the end counts the messages of every type and the ones lost on the way,
+//   found from the gaps in their sequence numbers
+//
+// by Mark Hill
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdint.h>
+#include<string.h>
+#include<errno.h>
+#include<time.h>
+#include<unistd.h>
+#include<sys/socket.h>
+#include<netinet/in.h>
+
+#include<Telemetry.h>
+#include<TelemetryProtocol.h>
+
+// the most datagrams taken out of the socket in one go
+#define RECEIVE_BATCH 32
+
+// what was received of each type
+struct TypeSummary {
+	uint64_t received;
+	uint64_t lost;
+	uint64_t reordered;
+	uint32_t nextSequence;
+};
+
+// returns the monotonic time in seconds
+static double wallTime() {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec / 1000000000.0;
+}
+
+static void printMessage(const struct TelemetryMessage *message) {
+	printf("%s %u %.6f", telemetryTypeName(message->type), message->sequence, message->time);
+	for (int i = 0; i < message->count; i++) {
+		printf(" %.4g", message->values[i]);
+	}
+	for (int i = 0; i < message->tasks; i++) {
+		const struct TelemetryTaskStats *stats = &message->stats[i];
+		printf("%s %s late p99 %.0fus run p50 %.0fus p99 %.0fus max %.0fus overruns %u", \
+				i > 0 ? "," : "", stats->name, stats->latenessP99, stats->executionP50, \
+				stats->executionP99, stats->executionMaximum, stats->overruns);
+	}
+	printf("\n");
+}
+
+// counts message in summary, with the gap since the last one of its type as lost
+static void countMessage(struct TypeSummary *summary, const struct TelemetryMessage *message) {
+	if (summary->received > 0 && message->sequence < summary->nextSequence) {
+		summary->reordered++;
+		if (summary->lost > 0)
+			summary->lost--;
+	}
+	else {
+		summary->lost += message->sequence - (summary->received > 0 ? summary->nextSequence : 0);
+		summary->nextSequence = message->sequence + 1;
+	}
+	summary->received++;
+}
+
+int main(int argc, char *argv[]) {
+	int port = TELEMETRY_DEFAULT_PORT;
+	uint64_t limit = 0;
+	double duration = 0;
+	int quiet = 0;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+			port = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+			limit = strtoull(argv[++i], NULL, 10);
+		}
+		else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+			duration = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-q") == 0) {
+			quiet = 1;
+		}
+		else {
+			printf("usage: %s [-p port] [-n messages] [-t seconds] [-q]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	int socketFile = socket(AF_INET6, SOCK_DGRAM, 0);
+	int dualStack = socketFile >= 0;
+	if (!dualStack)
+		socketFile = socket(AF_INET, SOCK_DGRAM, 0);
+	if (socketFile < 0) {
+		printf("failed to create socket (%s)\n", strerror(errno));
+		return 1;
+	}
+	int result;
+	if (dualStack) {
+		// takes IPv4 senders as well
+		int off = 0;
+		setsockopt(socketFile, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+		struct sockaddr_in6 address;
+		memset(&address, 0, sizeof(address));
+		address.sin6_family = AF_INET6;
+		address.sin6_addr = in6addr_any;
+		address.sin6_port = htons(port);
+		result = bind(socketFile, (struct sockaddr *)(&address), sizeof(address));
+	}
+	else {
+		struct sockaddr_in address;
+		memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_ANY);
+		address.sin_port = htons(port);
+		result = bind(socketFile, (struct sockaddr *)(&address), sizeof(address));
+	}
+	if (result) {
+		printf("failed to listen on port %d (%s)\n", port, strerror(errno));
+		close(socketFile);
+		return 1;
+	}
+	// wakes up now and then to check the time limit
+	struct timeval timeout = {0, 200000};
+	setsockopt(socketFile, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	static uint8_t buffers[RECEIVE_BATCH][TELEMETRY_PACKET_SIZE];
+	struct iovec vectors[RECEIVE_BATCH];
+	struct mmsghdr messages[RECEIVE_BATCH];
+	struct TypeSummary summaries[TELEMETRY_TYPES];
+	memset(summaries, 0, sizeof(summaries));
+	uint64_t received = 0;
+	uint64_t invalid = 0;
+	uint64_t calls = 0;
+	double start = wallTime();
+
+	while ((limit == 0 || received < limit) && \
+			(duration <= 0 || wallTime() - start < duration)) {
+		for (int i = 0; i < RECEIVE_BATCH; i++) {
+			vectors[i].iov_base = buffers[i];
+			vectors[i].iov_len = sizeof(buffers[i]);
+			memset(&messages[i], 0, sizeof(messages[i]));
+			messages[i].msg_hdr.msg_iov = &vectors[i];
+			messages[i].msg_hdr.msg_iovlen = 1;
+		}
+		// waits for the first datagram and takes whatever else has arrived with it
+		int count = recvmmsg(socketFile, messages, RECEIVE_BATCH, MSG_WAITFORONE, NULL);
+		if (count < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+				continue;
+			printf("failed to receive (%s)\n", strerror(errno));
+			break;
+		}
+		calls++;
+
+		for (int i = 0; i < count && (limit == 0 || received < limit); i++) {
+			struct TelemetryMessage message;
+			if (decodeTelemetryMessage(buffers[i], messages[i].msg_len, &message)) {
+				invalid++;
+				continue;
+			}
+			received++;
+			countMessage(&summaries[message.type], &message);
+			if (!quiet)
+				printMessage(&message);
+		}
+		fflush(stdout);
+	}
+	close(socketFile);
+
+	double elapsed = wallTime() - start;
+	printf("received %llu messages in %llu receives over %.1fs, %llu invalid\n", \
+			(unsigned long long)(received), (unsigned long long)(calls), elapsed, \
+			(unsigned long long)(invalid));
+	for (int type = 0; type < TELEMETRY_TYPES; type++) {
+		struct TypeSummary *summary = &summaries[type];
+		printf("  %-14s%8llu received, %llu lost, %llu out of order\n", \
+				telemetryTypeName(type), (unsigned long long)(summary->received), \
+				(unsigned long long)(summary->lost), (unsigned long long)(summary->reordered));
+	}
+	return 0;
+}